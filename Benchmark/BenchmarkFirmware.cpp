@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     BenchmarkFirmware.cpp
+/// Author:   David Stalter
+///
+/// Details:  Firmware that boots the car sketch on a simulated Mega and
+///           measures its hot paths for BenchmarkRunner.  It takes the place
+///           of the Arduino core's main(): the core is set up the same way
+///           and the sketch's setup() builds the car, but then the benchmarks
+///           run instead of loop(), and the CPU goes to sleep with interrupts
+///           off so the simulation ends.
+///
+///           The interrupt handlers are called with interrupts off, the way
+///           their vectors run them, so those counts are exact.  Everything
+///           else runs with interrupts on like it does in the car, so the
+///           maximums include whatever interrupts landed in the middle.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <Arduino.h>                  // for init() and the core
+#include <avr/sleep.h>                // for ending the simulation
+#include "SoapBoxDerbyCar.hpp"        // for the car class
+#include "Benchmarks.hpp"             // for the benchmark IDs and markers
+
+// Sketch entry point (SoapBoxDerbyCar.ino)
+void setup();
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  SoapBoxDerbyCarBenchmark
+///
+/// Details:  Makes the measured calls into the car.  It is a friend of
+///           SoapBoxDerbyCar so private methods can be measured directly.
+////////////////////////////////////////////////////////////////////////////////
+class SoapBoxDerbyCarBenchmark
+{
+public:
+  static void RunBenchmarks();
+
+private:
+  // The barriers keep the compiler from moving any of the measured code
+  // across the marker writes
+  static inline __attribute__((always_inline)) void StartMeasurement(Benchmarks::Id id)
+  {
+    asm volatile("" ::: "memory");
+    GPIOR0 = static_cast<uint8_t>(id);
+    asm volatile("" ::: "memory");
+  }
+
+  static inline __attribute__((always_inline)) void StopMeasurement()
+  {
+    asm volatile("" ::: "memory");
+    GPIOR0 = Benchmarks::STOP_MARKER;
+    asm volatile("" ::: "memory");
+  }
+
+  static const uint8_t        BENCHMARK_REPEATS       = 20;
+  static const uint16_t       RUN_PASS_REPEATS        = 1000;
+  static const unsigned long  BENCHMARK_INTERVAL_MS   = 3;      // Longer than HALL_MIN_EDGE_INTERVAL_US
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunBenchmarks
+///
+/// Details:  Measures each benchmark BENCHMARK_REPEATS times.  Calls are
+///           spaced out so the Hall edges are not thrown away as glitches
+///           and the serial ports have time to drain.  The Run() passes are
+///           measured back to back at the end, the way loop() makes them.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarBenchmark::RunBenchmarks()
+{
+  SoapBoxDerbyCar * pCar = SoapBoxDerbyCar::GetSingletonInstance();
+
+  for (uint8_t i = 0U; i < BENCHMARK_REPEATS; i++)
+  {
+    StartMeasurement(Benchmarks::MARKER_OVERHEAD);
+    StopMeasurement();
+
+    delay(BENCHMARK_INTERVAL_MS);
+    noInterrupts();
+    StartMeasurement(Benchmarks::LEFT_HALL_ISR);
+    SoapBoxDerbyCar::LeftHallSensorInterruptHandler();
+    StopMeasurement();
+    interrupts();
+
+    delay(BENCHMARK_INTERVAL_MS);
+    noInterrupts();
+    unsigned long edgeTimeUs = SoapBoxDerbyCar::GetTimeStampUs();
+    StartMeasurement(Benchmarks::INCREMENT_LEFT_HALL);
+    pCar->IncrementLeftHallSensorCount(edgeTimeUs);
+    StopMeasurement();
+    interrupts();
+
+    delay(BENCHMARK_INTERVAL_MS);
+    StartMeasurement(Benchmarks::UPDATE_SPEED_CONTROLLERS);
+    pCar->UpdateSpeedControllers();
+    StopMeasurement();
+
+    delay(BENCHMARK_INTERVAL_MS);
+    unsigned long entryTimeStampMs = SoapBoxDerbyCar::GetTimeStampMs();
+    StartMeasurement(Benchmarks::LOG_DATA);
+    pCar->LogData(entryTimeStampMs);
+    StopMeasurement();
+
+    delay(BENCHMARK_INTERVAL_MS);
+    StartMeasurement(Benchmarks::SEND_CAR_SERIAL_DATA);
+    pCar->SendCarSerialData();
+    StopMeasurement();
+  }
+
+  for (uint16_t i = 0U; i < RUN_PASS_REPEATS; i++)
+  {
+    StartMeasurement(Benchmarks::RUN_PASS);
+    pCar->Run();
+    StopMeasurement();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Benchmark firmware entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main()
+{
+  // Timers, ADC and PWM, as the core's main() sets them up
+  init();
+
+  setup();
+  GPIOR0 = Benchmarks::BOOTED_MARKER;
+
+  SoapBoxDerbyCarBenchmark::RunBenchmarks();
+  GPIOR0 = Benchmarks::DONE_MARKER;
+
+  // Sleeping with interrupts off is the end of the simulation
+  noInterrupts();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+  return 0;
+}
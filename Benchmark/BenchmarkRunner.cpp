@@ -0,0 +1,442 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     BenchmarkRunner.cpp
+/// Author:   David Stalter
+///
+/// Details:  Runs the benchmark firmware under simavr and reports the cycles
+///           each benchmark took (see Benchmarks.hpp), along with the flash
+///           and SRAM the car sketch image takes.  Given a budget file,
+///           anything over its budget fails the run, so a change that makes
+///           an ISR or the loop slower shows up when it is made.
+///
+///           The runner also stands in for the car's hardware, just enough
+///           for the sketch to boot and run its manual loop: the limit
+///           switches read closed through the steering calibration and open
+///           after it, the autonomous switch is off and the receiver sends
+///           centered sticks with master enable on.
+///
+/// Usage:    SoapBoxDerbyCarBenchmarkRunner [-b file] [-w file] firmware sketch
+///             -b        fail if a result is over its budget in this file
+///             -w        write this run's results to this file as budgets,
+///                       with BUDGET_HEADROOM_PERCENT added
+///             firmware  the benchmark firmware image (.elf)
+///             sketch    the car sketch image as built for the board (.elf)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <stdio.h>                    // for printf/fopen
+#include <stdlib.h>                   // for exit codes
+#include <string.h>                   // for strcmp
+#include <string>                     // for budget names
+#include <vector>                     // for the result table
+#include "sim_avr.h"                  // for the simulated AVR
+#include "sim_elf.h"                  // for loading the images
+#include "sim_cycle_timers.h"         // for the receiver timing
+#include "avr_ioport.h"               // for driving the input pins
+#include "avr_uart.h"                 // for quieting the serial ports
+#include "Benchmarks.hpp"             // for the benchmark IDs and markers
+
+namespace
+{
+  #define BENCHMARK_NAME(id, name)   name,
+
+  const char * const BENCHMARK_NAMES[Benchmarks::NUM_BENCHMARKS] =
+  {
+    "",
+    BENCHMARKS(BENCHMARK_NAME)
+  };
+
+  // A pin as the simulator sees it
+  struct Pin
+  {
+    char    m_Port;
+    uint8_t m_Bit;
+  };
+
+  // Mirrored from SoapBoxDerbyCar.hpp (and DigitalPin.hpp's pin map)
+  const Pin           LEFT_LIMIT_SWITCH_PIN     = { 'B', 4 };   // 10
+  const Pin           RIGHT_LIMIT_SWITCH_PIN    = { 'B', 5 };   // 11
+  const Pin           AUTONOMOUS_SWITCH_PIN     = { 'L', 5 };   // 44
+  const char          CONTROLLER_INPUT_PORT     = 'K';          // CH1-CH6 on PK0-PK5
+  const uint8_t       NUM_CONTROLLER_CHANNELS   = 6;
+
+  // Mirrored from the host RcTransmitter
+  const unsigned long CONTROLLER_PULSES_US[NUM_CONTROLLER_CHANNELS] = { 1490, 1500, 1500, 1500, 1000, 1900 };
+  const unsigned long CONTROLLER_FRAME_PERIOD_US  = 20000;
+  const unsigned long CONTROLLER_CHANNEL_GAP_US   = 500;
+
+  const char * const  MCU_NAME                  = "atmega2560";
+  const uint32_t      MCU_FREQUENCY_HZ          = 16000000;
+  const avr_io_addr_t MARKER_REGISTER_ADDRESS   = 0x3E;         // GPIOR0
+  const unsigned long MAX_SIMULATED_SECONDS     = 120;
+  const unsigned long BUDGET_HEADROOM_PERCENT   = 5;
+
+  // Cycle counts of one benchmark
+  struct Result
+  {
+    std::string m_Name;
+    unsigned long m_Count;
+    avr_cycle_count_t m_Min;
+    avr_cycle_count_t m_Max;
+    avr_cycle_count_t m_Total;
+  };
+
+  // What the simulated hardware and the marker register are doing
+  struct Simulation
+  {
+    avr_t * m_pAvr;
+    uint8_t m_CurrentId;
+    avr_cycle_count_t m_StartCycle;
+    std::vector<avr_cycle_count_t> m_Cycles[Benchmarks::NUM_BENCHMARKS];
+    bool m_bBooted;
+    bool m_bDone;
+    uint8_t m_ControllerChannel;
+    bool m_bControllerPulseHigh;
+    avr_cycle_count_t m_ControllerFrameStartCycle;
+  };
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: SetPin
+  ///
+  /// Details:  Drives an input pin from outside the chip.
+  //////////////////////////////////////////////////////////////////////////////
+  void SetPin(avr_t * pAvr, char port, uint8_t bit, bool bHigh)
+  {
+    avr_raise_irq(avr_io_getirq(pAvr, AVR_IOCTL_IOPORT_GETIRQ(port), bit), bHigh ? 1 : 0);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: MarkerWriteCallback
+  ///
+  /// Details:  Called on every write to the marker register.  Starts, stops
+  ///           and records the measurements, and releases the limit switches
+  ///           once the car has booted.
+  //////////////////////////////////////////////////////////////////////////////
+  void MarkerWriteCallback(avr_t * pAvr, avr_io_addr_t address, uint8_t value, void * pContext)
+  {
+    Simulation & rSimulation = *static_cast<Simulation *>(pContext);
+    pAvr->data[address] = value;
+
+    if (value == Benchmarks::STOP_MARKER)
+    {
+      if (rSimulation.m_CurrentId != Benchmarks::NO_BENCHMARK)
+      {
+        rSimulation.m_Cycles[rSimulation.m_CurrentId].push_back(pAvr->cycle - rSimulation.m_StartCycle);
+        rSimulation.m_CurrentId = Benchmarks::NO_BENCHMARK;
+      }
+    }
+    else if (value == Benchmarks::BOOTED_MARKER)
+    {
+      rSimulation.m_bBooted = true;
+      SetPin(pAvr, LEFT_LIMIT_SWITCH_PIN.m_Port, LEFT_LIMIT_SWITCH_PIN.m_Bit, false);
+      SetPin(pAvr, RIGHT_LIMIT_SWITCH_PIN.m_Port, RIGHT_LIMIT_SWITCH_PIN.m_Bit, false);
+    }
+    else if (value == Benchmarks::DONE_MARKER)
+    {
+      rSimulation.m_bDone = true;
+    }
+    else if ((value > Benchmarks::NO_BENCHMARK) && (value < Benchmarks::NUM_BENCHMARKS))
+    {
+      rSimulation.m_CurrentId = value;
+      rSimulation.m_StartCycle = pAvr->cycle;
+    }
+    else
+    {
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ControllerCallback
+  ///
+  /// Details:  Cycle timer for the receiver.  Like the real one, it pulses
+  ///           its outputs one after the other, once per frame.
+  //////////////////////////////////////////////////////////////////////////////
+  avr_cycle_count_t ControllerCallback(avr_t * pAvr, avr_cycle_count_t when, void * pContext)
+  {
+    Simulation & rSimulation = *static_cast<Simulation *>(pContext);
+    uint8_t channel = rSimulation.m_ControllerChannel;
+
+    if (!rSimulation.m_bControllerPulseHigh)
+    {
+      if (channel == 0U)
+      {
+        rSimulation.m_ControllerFrameStartCycle = when;
+      }
+      SetPin(pAvr, CONTROLLER_INPUT_PORT, channel, true);
+      rSimulation.m_bControllerPulseHigh = true;
+      return when + avr_usec_to_cycles(pAvr, CONTROLLER_PULSES_US[channel]);
+    }
+
+    SetPin(pAvr, CONTROLLER_INPUT_PORT, channel, false);
+    rSimulation.m_bControllerPulseHigh = false;
+    if (++rSimulation.m_ControllerChannel == NUM_CONTROLLER_CHANNELS)
+    {
+      rSimulation.m_ControllerChannel = 0U;
+      return rSimulation.m_ControllerFrameStartCycle + avr_usec_to_cycles(pAvr, CONTROLLER_FRAME_PERIOD_US);
+    }
+    return when + avr_usec_to_cycles(pAvr, CONTROLLER_CHANNEL_GAP_US);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ReadBudgets
+  ///
+  /// Details:  Reads a budget file, one "name value" per line ('#' starts a
+  ///           comment).  Returns false if it could not be read.
+  //////////////////////////////////////////////////////////////////////////////
+  bool ReadBudgets(const char * pFileName, std::vector<std::pair<std::string, unsigned long>> & rBudgets)
+  {
+    FILE * pFile = fopen(pFileName, "r");
+    if (pFile == nullptr)
+    {
+      return false;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), pFile) != nullptr)
+    {
+      char name[64];
+      unsigned long value = 0UL;
+      if ((line[0] != '#') && (sscanf(line, "%63s %lu", name, &value) == 2))
+      {
+        rBudgets.push_back(std::make_pair(std::string(name), value));
+      }
+    }
+
+    fclose(pFile);
+    return true;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: FindBudget
+  ///
+  /// Details:  Looks up a result's budget.  Returns false if it has none.
+  //////////////////////////////////////////////////////////////////////////////
+  bool FindBudget(const std::vector<std::pair<std::string, unsigned long>> & rBudgets, const std::string & rName, unsigned long & rBudget)
+  {
+    for (size_t i = 0; i < rBudgets.size(); i++)
+    {
+      if (rBudgets[i].first == rName)
+      {
+        rBudget = rBudgets[i].second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: Simulate
+  ///
+  /// Details:  Runs the benchmark firmware to the end.  Returns false if it
+  ///           crashed or never finished.
+  //////////////////////////////////////////////////////////////////////////////
+  bool Simulate(const char * pFirmwareFileName, Simulation & rSimulation)
+  {
+    elf_firmware_t firmware = {};
+    if (elf_read_firmware(pFirmwareFileName, &firmware) != 0)
+    {
+      fprintf(stderr, "Could not read %s\n", pFirmwareFileName);
+      return false;
+    }
+    firmware.frequency = MCU_FREQUENCY_HZ;
+
+    avr_t * pAvr = avr_make_mcu_by_name(MCU_NAME);
+    if (pAvr == nullptr)
+    {
+      fprintf(stderr, "simavr does not have the %s\n", MCU_NAME);
+      return false;
+    }
+    avr_init(pAvr);
+    avr_load_firmware(pAvr, &firmware);
+    rSimulation.m_pAvr = pAvr;
+
+    // The sketch's console and car data output would only get in the way
+    for (char uart = '0'; uart <= '3'; uart++)
+    {
+      uint32_t flags = 0U;
+      if (avr_ioctl(pAvr, AVR_IOCTL_UART_GET_FLAGS(uart), &flags) == 0)
+      {
+        flags &= ~AVR_UART_FLAG_STDIO;
+        avr_ioctl(pAvr, AVR_IOCTL_UART_SET_FLAGS(uart), &flags);
+      }
+    }
+
+    // Manual control, and limit switches that let the calibration finish
+    SetPin(pAvr, AUTONOMOUS_SWITCH_PIN.m_Port, AUTONOMOUS_SWITCH_PIN.m_Bit, false);
+    SetPin(pAvr, LEFT_LIMIT_SWITCH_PIN.m_Port, LEFT_LIMIT_SWITCH_PIN.m_Bit, true);
+    SetPin(pAvr, RIGHT_LIMIT_SWITCH_PIN.m_Port, RIGHT_LIMIT_SWITCH_PIN.m_Bit, true);
+    avr_cycle_timer_register_usec(pAvr, CONTROLLER_FRAME_PERIOD_US, ControllerCallback, &rSimulation);
+
+    avr_register_io_write(pAvr, MARKER_REGISTER_ADDRESS, MarkerWriteCallback, &rSimulation);
+
+    avr_cycle_count_t maxCycles = static_cast<avr_cycle_count_t>(MAX_SIMULATED_SECONDS) * MCU_FREQUENCY_HZ;
+    int state = cpu_Running;
+    while (!rSimulation.m_bDone && (state != cpu_Done) && (state != cpu_Crashed) && (pAvr->cycle < maxCycles))
+    {
+      state = avr_run(pAvr);
+    }
+
+    if (!rSimulation.m_bDone)
+    {
+      fprintf(stderr, "Benchmark firmware %s after %.3f s simulated (%s)\n",
+              (state == cpu_Crashed) ? "crashed" : "did not finish",
+              static_cast<double>(pAvr->cycle) / MCU_FREQUENCY_HZ,
+              rSimulation.m_bBooted ? "booted" : "never booted");
+      return false;
+    }
+
+    return true;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Benchmark runner entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  const char * pBudgetFileName = nullptr;
+  const char * pWriteFileName = nullptr;
+  const char * pFileNames[2] = {};
+  int numFileNames = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-b") == 0) && ((i + 1) < argc))
+    {
+      pBudgetFileName = argv[++i];
+    }
+    else if ((strcmp(argv[i], "-w") == 0) && ((i + 1) < argc))
+    {
+      pWriteFileName = argv[++i];
+    }
+    else if (numFileNames < 2)
+    {
+      pFileNames[numFileNames++] = argv[i];
+    }
+    else
+    {
+    }
+  }
+
+  if (numFileNames != 2)
+  {
+    fprintf(stderr, "Usage: %s [-b budgets] [-w budgets] firmware.elf sketch.elf\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<std::pair<std::string, unsigned long>> budgets;
+  if ((pBudgetFileName != nullptr) && !ReadBudgets(pBudgetFileName, budgets))
+  {
+    fprintf(stderr, "Could not read budgets from %s (make budgets writes them)\n", pBudgetFileName);
+    return 1;
+  }
+
+  // The sizes come from the real image, not the benchmark firmware
+  elf_firmware_t sketch = {};
+  if (elf_read_firmware(pFileNames[1], &sketch) != 0)
+  {
+    fprintf(stderr, "Could not read %s\n", pFileNames[1]);
+    return 1;
+  }
+
+  static Simulation simulation = {};
+  if (!Simulate(pFileNames[0], simulation))
+  {
+    return 1;
+  }
+
+  // The marker writes themselves are taken out of every other benchmark
+  std::vector<Result> results;
+  avr_cycle_count_t overhead = 0U;
+  for (uint8_t id = Benchmarks::NO_BENCHMARK + 1U; id < Benchmarks::NUM_BENCHMARKS; id++)
+  {
+    const std::vector<avr_cycle_count_t> & rCycles = simulation.m_Cycles[id];
+    Result result = { BENCHMARK_NAMES[id], static_cast<unsigned long>(rCycles.size()), ~0ULL, 0U, 0U };
+    for (size_t i = 0; i < rCycles.size(); i++)
+    {
+      avr_cycle_count_t cycles = rCycles[i] - ((id == Benchmarks::MARKER_OVERHEAD) ? 0U : overhead);
+      result.m_Min = (cycles < result.m_Min) ? cycles : result.m_Min;
+      result.m_Max = (cycles > result.m_Max) ? cycles : result.m_Max;
+      result.m_Total += cycles;
+    }
+    if (result.m_Count == 0UL)
+    {
+      result.m_Min = 0U;
+    }
+    if (id == Benchmarks::MARKER_OVERHEAD)
+    {
+      overhead = result.m_Min;
+    }
+    results.push_back(result);
+  }
+
+  // Flash is the code and the data initializers, SRAM the static data
+  Result flash = { "FlashBytes", 1UL, sketch.flashsize, sketch.flashsize, sketch.flashsize };
+  Result sram = { "SramBytes", 1UL, sketch.datasize + sketch.bsssize, sketch.datasize + sketch.bsssize, sketch.datasize + sketch.bsssize };
+  results.push_back(flash);
+  results.push_back(sram);
+
+  // Budgets are on the worst case
+  bool bOverBudget = false;
+  printf("%-32s %8s %10s %10s %10s %10s\n", "Benchmark", "Count", "Min", "Avg", "Max", "Budget");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result & rResult = results[i];
+    unsigned long budget = 0UL;
+    bool bHasBudget = FindBudget(budgets, rResult.m_Name, budget);
+    bool bOver = bHasBudget && (rResult.m_Max > budget);
+    bOverBudget = bOverBudget || bOver;
+
+    printf("%-32s %8lu %10llu %10llu %10llu ", rResult.m_Name.c_str(), rResult.m_Count,
+           static_cast<unsigned long long>(rResult.m_Min),
+           static_cast<unsigned long long>((rResult.m_Count != 0UL) ? (rResult.m_Total / rResult.m_Count) : 0U),
+           static_cast<unsigned long long>(rResult.m_Max));
+    if (bHasBudget)
+    {
+      printf("%10lu%s\n", budget, bOver ? "  OVER BUDGET" : "");
+    }
+    else
+    {
+      printf("%10s\n", "-");
+    }
+  }
+
+  if (pWriteFileName != nullptr)
+  {
+    FILE * pFile = fopen(pWriteFileName, "w");
+    if (pFile == nullptr)
+    {
+      perror(pWriteFileName);
+      return 1;
+    }
+    fprintf(pFile, "# Worst case cycles (bytes for the sizes) allowed, written by 'make budgets'\n");
+    fprintf(pFile, "# from a run of this tree with %lu%% headroom.  Lower them by hand as\n", BUDGET_HEADROOM_PERCENT);
+    fprintf(pFile, "# things get faster, raise them only on purpose.\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      if (results[i].m_Name != BENCHMARK_NAMES[Benchmarks::MARKER_OVERHEAD])
+      {
+        unsigned long long budget = results[i].m_Max + ((results[i].m_Max * BUDGET_HEADROOM_PERCENT) + 99U) / 100U;
+        fprintf(pFile, "%-32s %llu\n", results[i].m_Name.c_str(), budget);
+      }
+    }
+    fclose(pFile);
+    printf("Budgets written to %s\n", pWriteFileName);
+  }
+
+  if (bOverBudget)
+  {
+    fprintf(stderr, "Over budget!\n");
+    return 1;
+  }
+  return 0;
+}
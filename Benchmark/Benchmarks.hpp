@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     Benchmarks.hpp
+/// Author:   David Stalter
+///
+/// Details:  The cycle count benchmarks the benchmark firmware runs and the
+///           simavr runner reports.  The firmware brackets each measured call
+///           with writes to GPIOR0, an I/O register nothing else uses: the
+///           benchmark's ID to start and STOP_MARKER to stop.  The runner
+///           watches the register and reads the simulated cycle count at
+///           each write.  Both sides build their tables from this list, so
+///           they always agree.
+///
+///           To add a benchmark, add a line to BENCHMARKS with its ID and
+///           the name it is reported and budgeted under, then measure it in
+///           BenchmarkFirmware.cpp.  The name is also its key in the budget
+///           file, so renaming one drops its budget.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+
+// INCLUDES
+#include <stdint.h>                   // for fixed width integer types
+
+// BENCHMARK(ID, name)
+#define BENCHMARKS(BENCHMARK)                                           \
+  BENCHMARK(MARKER_OVERHEAD,          "MarkerOverhead")                 \
+  BENCHMARK(LEFT_HALL_ISR,            "LeftHallSensorInterruptHandler") \
+  BENCHMARK(INCREMENT_LEFT_HALL,      "IncrementLeftHallSensorCount")   \
+  BENCHMARK(UPDATE_SPEED_CONTROLLERS, "UpdateSpeedControllers")         \
+  BENCHMARK(LOG_DATA,                 "LogData")                        \
+  BENCHMARK(SEND_CAR_SERIAL_DATA,     "SendCarSerialData")              \
+  BENCHMARK(RUN_PASS,                 "RunPass")
+
+#define BENCHMARK_ID(id, name)   id,
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  Benchmarks
+///
+/// Details:  Benchmark IDs and the other values written to the marker
+///           register.
+////////////////////////////////////////////////////////////////////////////////
+class Benchmarks
+{
+public:
+  enum Id
+  {
+    NO_BENCHMARK,
+    BENCHMARKS(BENCHMARK_ID)
+    NUM_BENCHMARKS
+  };
+
+  // The car is constructed and its ISRs attached
+  static const uint8_t  BOOTED_MARKER   = 0xFD;
+
+  // The measurement that was started is over
+  static const uint8_t  STOP_MARKER     = 0xFE;
+
+  // All of the benchmarks have run
+  static const uint8_t  DONE_MARKER     = 0xFF;
+
+  static_assert(NUM_BENCHMARKS < BOOTED_MARKER, "Benchmark IDs overlap the markers!");
+};
+
+#endif // BENCHMARKS_HPP
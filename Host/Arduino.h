@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     Arduino.h
+/// Author:   David Stalter
+///
+/// Details:  Host (Linux) stand in for the Arduino core header.  It provides
+///           the subset of the Arduino API the car sketch uses, backed by the
+///           simulated hardware in HostHal.cpp.  Every call advances a virtual
+///           clock by roughly what it costs on the Mega, so timing logic in the
+///           sketch behaves the same while running far faster than real time.
+///
+///           This file is only on the include path for the host build.  The
+///           AVR build uses the real Arduino core, so none of this is compiled
+///           into the car firmware.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// INCLUDES
+#include <stdint.h>                   // for fixed width types
+#include <stddef.h>                   // for size_t
+#include <stdlib.h>                   // for abs
+#include <string.h>                   // for memcpy/memset
+#include <math.h>                     // for M_PI, tan, etc.
+#include <string>                     // for String storage
+#include "HostAvr.hpp"                // for simulated AVR registers and ISR()
+
+// TYPES
+typedef uint8_t byte;
+typedef bool boolean;
+class __FlashStringHelper;
+
+// MACROS
+#define F(string_literal)     (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PROGMEM
+#define pgm_read_byte(addr)   (*reinterpret_cast<const uint8_t *>(addr))
+#define pgm_read_word(addr)   (*reinterpret_cast<const uint16_t *>(addr))
+#define pgm_read_dword(addr)  (*reinterpret_cast<const uint32_t *>(addr))
+#define memcpy_P              memcpy
+#define min(a, b)             ((a) < (b) ? (a) : (b))
+#define max(a, b)             ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define interrupts()          sei()
+#define noInterrupts()        cli()
+#define digitalPinToInterrupt(p)  ((p) == 2 ? 0 : ((p) == 3 ? 1 : ((p) >= 18 && (p) <= 21 ? 23 - (p) : NOT_AN_INTERRUPT)))
+
+// CONSTANTS
+static const int            LOW               = 0;
+static const int            HIGH              = 1;
+static const uint8_t        INPUT             = 0;
+static const uint8_t        OUTPUT            = 1;
+static const uint8_t        INPUT_PULLUP      = 2;
+static const int            CHANGE            = 1;
+static const int            FALLING           = 2;
+static const int            RISING            = 3;
+static const int            NOT_AN_INTERRUPT  = -1;
+static const int            DEC               = 10;
+static const int            HEX               = 16;
+static const int            BIN               = 2;
+static const uint8_t        A0                = 54;
+static const uint8_t        A8                = 62;
+
+// DIGITAL/ANALOG I/O
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs = 1000000UL);
+
+// TIME
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// INTERRUPTS
+void attachInterrupt(int interruptNumber, void (*pIsr)(), int mode);
+void detachInterrupt(int interruptNumber);
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: String
+///
+/// Details:  Minimal Arduino String replacement for the host build.
+////////////////////////////////////////////////////////////////////////////////
+class String
+{
+public:
+  String(const char * pString = "") : m_String(pString) {}
+  String(const std::string & rString) : m_String(rString) {}
+
+  inline bool operator==(const String & rOther) const { return m_String == rOther.m_String; }
+  inline bool operator==(const char * pOther) const { return m_String == pOther; }
+  inline char operator[](unsigned int index) const { return (index < m_String.length()) ? m_String[index] : 0; }
+  inline unsigned int length() const { return m_String.length(); }
+  inline const char * c_str() const { return m_String.c_str(); }
+
+private:
+  std::string m_String;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: HardwareSerial
+///
+/// Details:  Simulated UART.  Transmitted bytes go through a 64 byte buffer
+///           that drains at the configured baud rate, so a write to a full
+///           buffer blocks (advances the virtual clock) the same way it does
+///           on the Mega.  Received bytes are injected by the host harness.
+////////////////////////////////////////////////////////////////////////////////
+class HardwareSerial
+{
+public:
+  explicit HardwareSerial(int portNumber);
+
+  void begin(unsigned long baudRate);
+  void end() {}
+  void setTimeout(unsigned long timeoutMs) { m_TimeoutMs = timeoutMs; }
+  int available();
+  int peek();
+  int read();
+  int availableForWrite();
+  void flush();
+  String readString();
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t * pData, size_t length);
+  size_t write(const char * pString) { return write(reinterpret_cast<const uint8_t *>(pString), strlen(pString)); }
+
+  size_t print(const __FlashStringHelper * pString) { return write(reinterpret_cast<const char *>(pString)); }
+  size_t print(const String & rString) { return write(rString.c_str()); }
+  size_t print(const char * pString) { return write(pString); }
+  size_t print(char value) { return write(static_cast<uint8_t>(value)); }
+  size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <typename T>
+  size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+  // Host harness access
+  void InjectInput(const char * pData);
+  void InjectInput(const uint8_t * pData, size_t length);
+  std::string & GetOutput() { return m_Output; }
+  void SetEcho(bool bEcho) { m_bEcho = bEcho; }
+
+private:
+  int m_PortNumber;
+  unsigned long m_ByteTimeUs;
+  unsigned long m_TimeoutMs;
+  uint64_t m_TxDrainEndUs;
+  std::string m_Input;
+  std::string m_Output;
+  bool m_bEcho;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,373 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     CarSimulator.cpp
+/// Author:   David Stalter
+///
+/// Details:  Implementation of the soap box derby car physics model.
+///
+/// Note:     Each step integrates the next STEP_US of motion from the current
+///           outputs of the sketch.  Hall sensor edges that fall inside the
+///           step are scheduled at their exact (interpolated) time rather
+///           than at the step boundary, so the edge timing the sketch sees
+///           is not quantized to the step size.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <math.h>                     // for trig functions
+#include "CarSimulator.hpp"           // for class declaration
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetDefaultParameters
+///
+/// Details:  A 600 foot, 5% grade lane with a perfectly aligned car.  The
+///           resistance numbers give a top speed around 25mph.
+////////////////////////////////////////////////////////////////////////////////
+CarSimulator::Parameters CarSimulator::GetDefaultParameters()
+{
+  Parameters parameters;
+  parameters.m_HillLengthFeet               = 600.0;
+  parameters.m_HillGradePercent             = 5.0;
+  parameters.m_LaneWidthFeet                = 10.0;
+  parameters.m_RollingResistance            = 0.015;
+  parameters.m_DragPerFoot                  = 0.0008;
+  parameters.m_BrakeDecelerationG           = 0.5;
+  parameters.m_SteeringRateDegreesPerSec    = 20.0;
+  parameters.m_SteeringTimeConstantSec      = 0.05;
+  parameters.m_SteeringDeadbandPercent      = 4.0;
+  parameters.m_SteeringAlignmentDegrees     = 0.0;
+  parameters.m_InitialHeadingDegrees        = 0.0;
+  parameters.m_LeftWheelScale               = 1.0;
+  parameters.m_RightWheelScale              = 1.0;
+  parameters.m_PotNoiseClicks               = 1;
+  parameters.m_Seed                         = 1U;
+  return parameters;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CarSimulator
+///
+/// Details:  The car starts behind the gate with the steering centered.
+////////////////////////////////////////////////////////////////////////////////
+CarSimulator::CarSimulator(const Parameters & rParameters) :
+  m_Parameters(),
+  m_RandomState(1U),
+  m_SteeringAngleDegrees(0.0),
+  m_SteeringRateDegreesPerSec(0.0),
+  m_bReleased(false),
+  m_bFinished(false),
+  m_bOffCourse(false),
+  m_ElapsedSec(0.0),
+  m_DistanceFeet(0.0),
+  m_LateralOffsetFeet(0.0),
+  m_MaxLateralOffsetFeet(0.0),
+  m_HeadingRadians(0.0),
+  m_SpeedFeetPerSec(0.0),
+  m_LeftWheel(),
+  m_RightWheel()
+{
+  const double MAGNET_PITCH_INCHES = M_PI * WHEEL_DIAMETER_INCHES / NUM_MAGNETS_PER_WHEEL;
+
+  // Both wheels start half way between magnets
+  Wheel wheel = { 0, MAGNET_PITCH_INCHES / 2.0, MAGNET_PITCH_INCHES, false, true };
+  m_LeftWheel = wheel;
+  m_LeftWheel.m_HallPin = LEFT_HALL_SENSOR_PIN;
+  m_RightWheel = wheel;
+  m_RightWheel.m_HallPin = RIGHT_HALL_SENSOR_PIN;
+
+  SetParameters(rParameters);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SetParameters
+///
+/// Details:  Updates the model parameters.  The initial heading only applies
+///           if the car has not been released yet.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::SetParameters(const Parameters & rParameters)
+{
+  m_Parameters = rParameters;
+  m_RandomState = (rParameters.m_Seed != 0U) ? rParameters.m_Seed : 1U;
+  if (!m_bReleased)
+  {
+    m_HeadingRadians = m_Parameters.m_InitialHeadingDegrees / DEGREES_PER_RADIAN;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Attach
+///
+/// Details:  Drives the sensor inputs and starts stepping the model.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::Attach()
+{
+  // Hall sensors are active low, no magnet to start
+  HostHal::SetDigitalInput(LEFT_HALL_SENSOR_PIN, true);
+  HostHal::SetDigitalInput(RIGHT_HALL_SENSOR_PIN, true);
+  HostHal::SetDigitalInput(STEERING_ENCODER_PIN, false);
+  UpdateSensors();
+
+  HostHal::AddPeriodicCallback(STEP_US, StepCallback, this);
+  HostHal::AddPeriodicCallback(ENCODER_PWM_PERIOD_US, EncoderPulseStartCallback, this);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Release
+///
+/// Details:  Drops the starting gate.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::Release()
+{
+  m_bReleased = true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: StepCallback
+///
+/// Details:  Virtual clock hook for the model step.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::StepCallback(void * pContext)
+{
+  static_cast<CarSimulator *>(pContext)->Step();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Step
+///
+/// Details:  Advances the model by one step.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::Step()
+{
+  const double DT_SEC = STEP_US / 1000000.0;
+
+  StepSteering(DT_SEC);
+  StepCar(DT_SEC);
+  UpdateSensors();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: StepSteering
+///
+/// Details:  Steering motor and axle.  The motor follows the speed controller
+///           output (outside its deadband) with a first order lag, and the
+///           axle stops dead at either end of its travel.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::StepSteering(double dtSec)
+{
+  const double NEUTRAL_PULSE_US = 1500.0;
+  const double FULL_SCALE_PULSE_US = 500.0;
+
+  double outputPercent = 100.0 * (HostHal::GetServoPulseUs(STEERING_SPEED_CONTROLLER_PIN) - NEUTRAL_PULSE_US) / FULL_SCALE_PULSE_US;
+  if (fabs(outputPercent) < m_Parameters.m_SteeringDeadbandPercent)
+  {
+    outputPercent = 0.0;
+  }
+
+  double targetRate = (outputPercent / 100.0) * m_Parameters.m_SteeringRateDegreesPerSec;
+  m_SteeringRateDegreesPerSec += (targetRate - m_SteeringRateDegreesPerSec) * (1.0 - exp(-dtSec / m_Parameters.m_SteeringTimeConstantSec));
+  m_SteeringAngleDegrees += m_SteeringRateDegreesPerSec * dtSec;
+
+  if (m_SteeringAngleDegrees >= STEERING_HALF_RANGE_DEGREES)
+  {
+    m_SteeringAngleDegrees = STEERING_HALF_RANGE_DEGREES;
+    m_SteeringRateDegreesPerSec = 0.0;
+  }
+  else if (m_SteeringAngleDegrees <= -STEERING_HALF_RANGE_DEGREES)
+  {
+    m_SteeringAngleDegrees = -STEERING_HALF_RANGE_DEGREES;
+    m_SteeringRateDegreesPerSec = 0.0;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: StepCar
+///
+/// Details:  Rolls the car down the hill and turns the rear wheels.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::StepCar(double dtSec)
+{
+  if (!m_bReleased || m_bFinished || m_bOffCourse)
+  {
+    return;
+  }
+
+  // Gravity along the slope less rolling resistance, drag and the brake
+  double slopeRadians = atan(m_Parameters.m_HillGradePercent / 100.0);
+  double acceleration = GRAVITY_FEET_PER_SEC2 * (sin(slopeRadians) - (m_Parameters.m_RollingResistance * cos(slopeRadians)));
+  acceleration -= m_Parameters.m_DragPerFoot * m_SpeedFeetPerSec * m_SpeedFeetPerSec;
+  if (!HostHal::GetDigitalOutput(BRAKE_MAGNET_RELAY_PIN))
+  {
+    acceleration -= m_Parameters.m_BrakeDecelerationG * GRAVITY_FEET_PER_SEC2;
+  }
+
+  m_SpeedFeetPerSec += acceleration * dtSec;
+  if (m_SpeedFeetPerSec < 0.0)
+  {
+    m_SpeedFeetPerSec = 0.0;
+  }
+
+  // Kinematic bicycle model about the rear axle
+  double distanceFeet = m_SpeedFeetPerSec * dtSec;
+  double axleAngleRadians = (m_SteeringAngleDegrees + m_Parameters.m_SteeringAlignmentDegrees) / DEGREES_PER_RADIAN;
+  double curvaturePerFoot = tan(axleAngleRadians) / (WHEEL_BASE_LENGTH_INCHES / INCHES_PER_FOOT);
+  double previousDistanceFeet = m_DistanceFeet;
+
+  m_HeadingRadians += distanceFeet * curvaturePerFoot;
+  m_DistanceFeet += distanceFeet * cos(m_HeadingRadians);
+  m_LateralOffsetFeet += distanceFeet * sin(m_HeadingRadians);
+  m_MaxLateralOffsetFeet = fmax(m_MaxLateralOffsetFeet, fabs(m_LateralOffsetFeet));
+
+  // The outside wheel covers more ground, turning right the left wheel is outside
+  double halfTrackFeet = (WHEEL_AXLE_LENGTH_INCHES / INCHES_PER_FOOT) / 2.0;
+  uint64_t startTimeUs = HostHal::GetTimeUs();
+  RollWheel(m_LeftWheel, distanceFeet * (1.0 + (curvaturePerFoot * halfTrackFeet)) * INCHES_PER_FOOT, m_Parameters.m_LeftWheelScale, startTimeUs, dtSec);
+  RollWheel(m_RightWheel, distanceFeet * (1.0 - (curvaturePerFoot * halfTrackFeet)) * INCHES_PER_FOOT, m_Parameters.m_RightWheelScale, startTimeUs, dtSec);
+
+  // Interpolate the finish time within the step
+  if (m_DistanceFeet >= m_Parameters.m_HillLengthFeet)
+  {
+    double fraction = (m_Parameters.m_HillLengthFeet - previousDistanceFeet) / (m_DistanceFeet - previousDistanceFeet);
+    m_ElapsedSec += fraction * dtSec;
+    m_bFinished = true;
+  }
+  else
+  {
+    m_ElapsedSec += dtSec;
+  }
+
+  if (fabs(m_LateralOffsetFeet) > (m_Parameters.m_LaneWidthFeet / 2.0))
+  {
+    m_bOffCourse = true;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RollWheel
+///
+/// Details:  Advances a wheel and schedules the Hall sensor edges for every
+///           magnet boundary it passes during the step.  A wheel that is
+///           larger than nominal turns less for the same ground distance.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::RollWheel(Wheel & rWheel, double distanceInches, double scale, uint64_t startTimeUs, double dtSec)
+{
+  const double MAGNET_PITCH_INCHES = M_PI * WHEEL_DIAMETER_INCHES / NUM_MAGNETS_PER_WHEEL;
+
+  double rollInches = distanceInches / scale;
+  if (rollInches <= 0.0)
+  {
+    return;
+  }
+
+  double endInches = rWheel.m_RollInches + rollInches;
+  while (rWheel.m_NextEdgeInches <= endInches)
+  {
+    double fraction = (rWheel.m_NextEdgeInches - rWheel.m_RollInches) / rollInches;
+    uint64_t edgeTimeUs = startTimeUs + static_cast<uint64_t>(fraction * dtSec * 1000000.0);
+    HostHal::ScheduleCallback(edgeTimeUs, (&rWheel == &m_LeftWheel) ? LeftHallEdgeCallback : RightHallEdgeCallback, this);
+
+    // Magnet leading edge to trailing edge, then on to the next magnet
+    rWheel.m_bMagnetPresent = !rWheel.m_bMagnetPresent;
+    rWheel.m_NextEdgeInches += MAGNET_PITCH_INCHES * (rWheel.m_bMagnetPresent ? MAGNET_WIDTH_FRACTION : (1.0 - MAGNET_WIDTH_FRACTION));
+  }
+
+  rWheel.m_RollInches = endInches;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LeftHallEdgeCallback/RightHallEdgeCallback/ToggleHallSensor
+///
+/// Details:  Scheduled Hall sensor edges.  Edges for a wheel always alternate,
+///           so each one just toggles the sensor output.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::LeftHallEdgeCallback(void * pContext)
+{
+  ToggleHallSensor(static_cast<CarSimulator *>(pContext)->m_LeftWheel);
+}
+
+void CarSimulator::RightHallEdgeCallback(void * pContext)
+{
+  ToggleHallSensor(static_cast<CarSimulator *>(pContext)->m_RightWheel);
+}
+
+void CarSimulator::ToggleHallSensor(Wheel & rWheel)
+{
+  rWheel.m_bPinHigh = !rWheel.m_bPinHigh;
+  HostHal::SetDigitalInput(rWheel.m_HallPin, rWheel.m_bPinHigh);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: EncoderPulseStartCallback/EncoderPulseEndCallback
+///
+/// Details:  The magnetic encoder's absolute PWM output.  Each period starts
+///           with a pulse whose width is the position within the turn.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::EncoderPulseStartCallback(void * pContext)
+{
+  const CarSimulator * pSimulator = static_cast<const CarSimulator *>(pContext);
+
+  long units = ENCODER_CENTER_UNITS - lround(pSimulator->m_SteeringAngleDegrees * ENCODER_UNITS_PER_DEGREE);
+  units = ((units % ENCODER_UNITS_PER_TURN) + ENCODER_UNITS_PER_TURN) % ENCODER_UNITS_PER_TURN;
+  unsigned long pulseUs = static_cast<unsigned long>(lround(static_cast<double>(units * ENCODER_PWM_PERIOD_US) / ENCODER_UNITS_PER_TURN));
+  if (pulseUs == 0UL)
+  {
+    pulseUs = 1UL;
+  }
+
+  HostHal::SetDigitalInput(STEERING_ENCODER_PIN, true);
+  HostHal::ScheduleCallback(HostHal::GetTimeUs() + pulseUs, EncoderPulseEndCallback, pContext);
+}
+
+void CarSimulator::EncoderPulseEndCallback(void * pContext)
+{
+  HostHal::SetDigitalInput(STEERING_ENCODER_PIN, false);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateSensors
+///
+/// Details:  Drives the potentiometer and limit switches from the axle angle.
+////////////////////////////////////////////////////////////////////////////////
+void CarSimulator::UpdateSensors()
+{
+  const double POT_CLICKS_PER_DEGREE = POT_RANGE_CLICKS / (2.0 * STEERING_HALF_RANGE_DEGREES);
+  const double LIMIT_SWITCH_TRAVEL_DEGREES = 0.05;
+
+  int potValue = POT_CENTER_VALUE - static_cast<int>(lround(m_SteeringAngleDegrees * POT_CLICKS_PER_DEGREE)) + NextNoise();
+  HostHal::SetAnalogInput(FRONT_AXLE_POT_CHANNEL, potValue);
+
+  HostHal::SetDigitalInput(LEFT_LIMIT_SWITCH_PIN, m_SteeringAngleDegrees <= (LIMIT_SWITCH_TRAVEL_DEGREES - STEERING_HALF_RANGE_DEGREES));
+  HostHal::SetDigitalInput(RIGHT_LIMIT_SWITCH_PIN, m_SteeringAngleDegrees >= (STEERING_HALF_RANGE_DEGREES - LIMIT_SWITCH_TRAVEL_DEGREES));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: NextNoise
+///
+/// Details:  Uniform pot noise in +/- m_PotNoiseClicks (xorshift32, so runs
+///           are repeatable for a given seed).
+////////////////////////////////////////////////////////////////////////////////
+int CarSimulator::NextNoise()
+{
+  if (m_Parameters.m_PotNoiseClicks <= 0)
+  {
+    return 0;
+  }
+
+  m_RandomState ^= m_RandomState << 13;
+  m_RandomState ^= m_RandomState >> 17;
+  m_RandomState ^= m_RandomState << 5;
+  return static_cast<int>(m_RandomState % static_cast<uint32_t>((2 * m_Parameters.m_PotNoiseClicks) + 1)) - m_Parameters.m_PotNoiseClicks;
+}
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     CarSimulator.hpp
+/// Author:   David Stalter
+///
+/// Details:  Deterministic physics model of the soap box derby car for the
+///           host build.  It closes the loop around the sketch: the steering
+///           speed controller output drives a motor on the front axle, the
+///           axle moves the potentiometer, the magnetic encoder and trips the
+///           limit switches at either end, and the car rolls down a hill
+///           turning the rear wheels past the Hall sensor magnets.
+///
+/// Note:     The model is a kinematic bicycle with the whole front axle
+///           pivoting.  Positive steering angle, heading and lateral offset
+///           are all to the right, matching the sign of the steering speed
+///           controller value.  Distances are in inches and feet to match
+///           the sketch.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CARSIMULATOR_HPP
+#define CARSIMULATOR_HPP
+
+// INCLUDES
+#include "HostHal.hpp"                // for simulated hardware control
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: CarSimulator
+///
+/// Details:  Steering, wheel and hill model driven from the virtual clock.
+////////////////////////////////////////////////////////////////////////////////
+class CarSimulator
+{
+public:
+  // Track and car imperfections are all in here so runs can be varied
+  struct Parameters
+  {
+    double    m_HillLengthFeet;
+    double    m_HillGradePercent;
+    double    m_LaneWidthFeet;
+    double    m_RollingResistance;              // Fraction of normal force
+    double    m_DragPerFoot;                    // Deceleration = m_DragPerFoot * v^2
+    double    m_BrakeDecelerationG;
+    double    m_SteeringRateDegreesPerSec;      // Axle rate at full output
+    double    m_SteeringTimeConstantSec;        // Motor/rack lag
+    double    m_SteeringDeadbandPercent;        // Speed controller deadband
+    double    m_SteeringAlignmentDegrees;       // Axle angle error at pot center
+    double    m_InitialHeadingDegrees;
+    double    m_LeftWheelScale;                 // Actual/nominal wheel diameter
+    double    m_RightWheelScale;
+    int       m_PotNoiseClicks;
+    uint32_t  m_Seed;
+  };
+
+  static Parameters GetDefaultParameters();
+
+  explicit CarSimulator(const Parameters & rParameters);
+
+  // Hooks the model into the virtual clock and drives the initial inputs
+  void Attach();
+
+  // Changes the track/car parameters (for per-run variation after boot)
+  void SetParameters(const Parameters & rParameters);
+
+  // Lets the car start rolling (the starting gate drops)
+  void Release();
+
+  // Distance down the hill, lateral offset from the lane center, heading
+  inline double GetDistanceFeet() const { return m_DistanceFeet; }
+  inline double GetLateralOffsetInches() const { return m_LateralOffsetFeet * INCHES_PER_FOOT; }
+  inline double GetMaxLateralOffsetInches() const { return m_MaxLateralOffsetFeet * INCHES_PER_FOOT; }
+  inline double GetHeadingDegrees() const { return m_HeadingRadians * DEGREES_PER_RADIAN; }
+  inline double GetSpeedFeetPerSec() const { return m_SpeedFeetPerSec; }
+  inline double GetSteeringAngleDegrees() const { return m_SteeringAngleDegrees; }
+  inline double GetSteeringPosition() const { return (m_SteeringAngleDegrees + STEERING_HALF_RANGE_DEGREES) / (2.0 * STEERING_HALF_RANGE_DEGREES); }
+
+  // A run ends at the finish line, off the side of the lane, or stopped
+  inline bool IsReleased() const { return m_bReleased; }
+  inline bool IsFinished() const { return m_bFinished; }
+  inline bool IsOffCourse() const { return m_bOffCourse; }
+  inline bool IsStopped() const { return m_bReleased && !m_bFinished && (m_SpeedFeetPerSec <= 0.0) && (m_DistanceFeet > 0.0); }
+  inline bool IsRunOver() const { return m_bFinished || m_bOffCourse || IsStopped(); }
+  inline double GetElapsedSec() const { return m_ElapsedSec; }
+
+  // Mirrored from SoapBoxDerbyCar.hpp and the notes in ReadPotentiometers()
+  static constexpr double     WHEEL_AXLE_LENGTH_INCHES      = 32.0;
+  static constexpr double     WHEEL_BASE_LENGTH_INCHES      = 61.0;
+  static constexpr double     WHEEL_DIAMETER_INCHES         = 12.125;
+  static const int            NUM_MAGNETS_PER_WHEEL         = 12;
+  static constexpr double     STEERING_HALF_RANGE_DEGREES   = 14.6484735 / 2.0;
+  static const int            POT_RANGE_CLICKS              = 60;
+  static const int            POT_CENTER_VALUE              = 340;     // Pot decreases left to right
+  static const int            ENCODER_UNITS_PER_TURN        = 4096;
+  static constexpr double     ENCODER_UNITS_PER_DEGREE      = 3.0 * ENCODER_UNITS_PER_TURN / (2.0 * STEERING_HALF_RANGE_DEGREES);  // Three turns lock to lock
+  static const int            ENCODER_CENTER_UNITS          = 1000;    // Encoder decreases left to right
+  static const unsigned long  ENCODER_PWM_PERIOD_US         = 4098;    // ~244Hz
+
+  static const uint8_t        STEERING_SPEED_CONTROLLER_PIN = 8;
+  static const uint8_t        BRAKE_MAGNET_RELAY_PIN        = 9;
+  static const uint8_t        LEFT_LIMIT_SWITCH_PIN         = 10;
+  static const uint8_t        RIGHT_LIMIT_SWITCH_PIN        = 11;
+  static const uint8_t        LEFT_HALL_SENSOR_PIN          = 18;
+  static const uint8_t        RIGHT_HALL_SENSOR_PIN         = 19;
+  static const uint8_t        STEERING_ENCODER_PIN          = 48;
+  static const uint8_t        FRONT_AXLE_POT_CHANNEL        = 0;
+
+private:
+  // One rear wheel and its Hall sensor
+  struct Wheel
+  {
+    uint8_t m_HallPin;
+    double m_RollInches;                        // Nominal rim distance rolled
+    double m_NextEdgeInches;
+    bool m_bMagnetPresent;                      // After the edges scheduled so far
+    bool m_bPinHigh;                            // Sensor output right now
+  };
+
+  void Step();
+  void StepSteering(double dtSec);
+  void StepCar(double dtSec);
+  void RollWheel(Wheel & rWheel, double distanceInches, double scale, uint64_t startTimeUs, double dtSec);
+  void UpdateSensors();
+  int NextNoise();
+
+  static void StepCallback(void * pContext);
+  static void LeftHallEdgeCallback(void * pContext);
+  static void RightHallEdgeCallback(void * pContext);
+  static void ToggleHallSensor(Wheel & rWheel);
+  static void EncoderPulseStartCallback(void * pContext);
+  static void EncoderPulseEndCallback(void * pContext);
+
+  static const unsigned long  STEP_US                       = 1000;
+  static constexpr double     MAGNET_WIDTH_FRACTION         = 0.25;
+  static constexpr double     GRAVITY_FEET_PER_SEC2         = 32.174;
+  static constexpr double     INCHES_PER_FOOT               = 12.0;
+  static constexpr double     DEGREES_PER_RADIAN            = 57.29577951308232;
+
+  Parameters m_Parameters;
+  uint32_t m_RandomState;
+
+  // Steering
+  double m_SteeringAngleDegrees;
+  double m_SteeringRateDegreesPerSec;
+
+  // Car
+  bool m_bReleased;
+  bool m_bFinished;
+  bool m_bOffCourse;
+  double m_ElapsedSec;
+  double m_DistanceFeet;
+  double m_LateralOffsetFeet;
+  double m_MaxLateralOffsetFeet;
+  double m_HeadingRadians;
+  double m_SpeedFeetPerSec;
+
+  Wheel m_LeftWheel;
+  Wheel m_RightWheel;
+};
+
+#endif // CARSIMULATOR_HPP
@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     DebugLogExpander.cpp
+/// Author:   David Stalter
+///
+/// Details:  Host tool that turns the car's deferred debug log back into
+///           text.  The input is the console output (a capture, a serial
+///           device read with another program, or SoapBoxDerbyCarHost -v).
+///           Debug log frames are replaced by their message, formatted from
+///           the table in DebugLogMessages.hpp and prefixed with the car's
+///           time stamp.  Everything else is passed through unchanged.
+///
+/// Usage:    SoapBoxDerbyCarDebugLogExpander [file]
+///             file      captured console output (default: stdin)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <stdio.h>                    // for printf/fopen
+#include <vector>                     // for the pass through buffer
+#include "DebugLogMessages.hpp"       // for the message table
+#include "TelemetryProtocol.hpp"      // for the frame format
+
+namespace
+{
+  #define DEBUG_LOG_MESSAGE_INFO(id, numArguments, format)   { #id, numArguments, format },
+
+  struct MessageInfo
+  {
+    const char * m_pName;
+    unsigned     m_NumArguments;
+    const char * m_pFormat;
+  };
+
+  const MessageInfo MESSAGES[DebugLogMessages::NUM_MESSAGES] =
+  {
+    DEBUG_LOG_MESSAGES(DEBUG_LOG_MESSAGE_INFO)
+  };
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: PrintMessage
+  ///
+  /// Details:  Prints one debug log frame as text.
+  //////////////////////////////////////////////////////////////////////////////
+  void PrintMessage(const TelemetryDecoder & rDecoder)
+  {
+    int32_t fields[DebugLogMessages::MAX_FIELDS];
+    unsigned numFields = rDecoder.GetFields(fields, DebugLogMessages::MAX_FIELDS);
+    if (numFields < 2U)
+    {
+      printf("[debug log] malformed message\n");
+      return;
+    }
+
+    long args[DebugLogMessages::MAX_ARGUMENTS] = {};
+    unsigned numArguments = numFields - 2U;
+    for (unsigned i = 0U; i < numArguments; i++)
+    {
+      args[i] = fields[i + 2U];
+    }
+
+    printf("[%10.3f] ", static_cast<uint32_t>(fields[0]) / 1000.0);
+
+    unsigned id = static_cast<unsigned>(fields[1]);
+    if ((id >= DebugLogMessages::NUM_MESSAGES) || (MESSAGES[id].m_NumArguments != numArguments))
+    {
+      printf("unknown debug log message %u:", id);
+      for (unsigned i = 0U; i < numArguments; i++)
+      {
+        printf(" %ld", args[i]);
+      }
+      printf("\n");
+      return;
+    }
+
+    printf(MESSAGES[id].m_pFormat, args[0], args[1], args[2], args[3]);
+    printf("\n");
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Debug log expander entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  FILE * pFile = stdin;
+  if (argc > 1)
+  {
+    pFile = fopen(argv[1], "rb");
+    if (pFile == nullptr)
+    {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  // Bytes since the last frame.  A frame is at the end of them when the
+  // decoder finds it, and whatever came before it is console text.
+  TelemetryDecoder decoder;
+  std::vector<uint8_t> pending;
+  unsigned long numOtherFrames = 0UL;
+  int data = 0;
+  while ((data = fgetc(pFile)) != EOF)
+  {
+    pending.push_back(static_cast<uint8_t>(data));
+    if (!decoder.ProcessByte(static_cast<uint8_t>(data)))
+    {
+      // A frame in progress is never longer than this
+      if (pending.size() > (4U * TelemetryProtocol::MAX_FRAME_SIZE_BYTES))
+      {
+        size_t numText = pending.size() - TelemetryProtocol::MAX_FRAME_SIZE_BYTES;
+        fwrite(pending.data(), 1, numText, stdout);
+        pending.erase(pending.begin(), pending.begin() + numText);
+      }
+      continue;
+    }
+
+    size_t numText = pending.size() - decoder.GetFrameSize();
+    fwrite(pending.data(), 1, numText, stdout);
+    if ((numText != 0U) && (pending[numText - 1U] != '\n'))
+    {
+      printf("\n");
+    }
+    pending.clear();
+
+    if (decoder.GetType() == TelemetryProtocol::DEBUG_LOG_FRAME)
+    {
+      PrintMessage(decoder);
+    }
+    else
+    {
+      numOtherFrames++;
+    }
+  }
+  fwrite(pending.data(), 1, pending.size(), stdout);
+
+  if (pFile != stdin)
+  {
+    fclose(pFile);
+  }
+
+  fprintf(stderr, "Debug log frames: %lu, other frames: %lu, missed: %lu, CRC errors: %lu\n",
+          decoder.GetNumFrames() - numOtherFrames, numOtherFrames, decoder.GetNumMissedFrames(), decoder.GetNumCrcErrors());
+  return 0;
+}
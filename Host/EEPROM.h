@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     EEPROM.h
+/// Author:   David Stalter
+///
+/// Details:  Host (Linux) stand in for the Arduino EEPROM library.  The 4kB
+///           image lives in the simulated hardware.  Like the Mega, a write
+///           starts right away and the cell is busy for ~3.3ms afterward;
+///           the next read or write waits for it, and eeprom_is_ready() (from
+///           avr/eeprom.h on the Mega) reports when it is done.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+// INCLUDES
+#include "HostHal.hpp"                // for the EEPROM image
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: EEPROMClass
+///
+/// Details:  Byte access to the simulated EEPROM.
+////////////////////////////////////////////////////////////////////////////////
+class EEPROMClass
+{
+public:
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  inline void update(int address, uint8_t value) { if (read(address) != value) { write(address, value); } }
+  inline uint16_t length() { return EEPROM_LENGTH_BYTES; }
+
+  static const uint16_t EEPROM_LENGTH_BYTES = 4096;
+};
+
+extern EEPROMClass EEPROM;
+
+bool eeprom_is_ready();
+
+#endif // HOST_EEPROM_H
@@ -0,0 +1,202 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     HostAvr.hpp
+/// Author:   David Stalter
+///
+/// Details:  Host (Linux) stand in for the parts of <avr/io.h> and
+///           <avr/interrupt.h> the car sketch touches directly.  The special
+///           function registers are plain variables that the simulated
+///           peripherals in HostHal.cpp read and write, and ISR() defines an
+///           ordinary function the simulator calls when the interrupt fires.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_AVR_HPP
+#define HOST_AVR_HPP
+
+// INCLUDES
+#include <stdint.h>                   // for fixed width types
+
+// MACROS
+#define F_CPU                 16000000UL
+#define _BV(bit)              (1U << (bit))
+#define ISR(vector, ...)      extern "C" void vector(void)
+#define cli()                 HostCli()
+#define sei()                 HostSei()
+
+// Interrupt enable state lives in SREG just like on the AVR
+extern volatile uint8_t SREG;
+void HostCli();
+void HostSei();
+
+// DIGITAL PORTS
+// Each register name is a plain variable that HostHal.cpp reads and writes
+// directly.  A port access costs no simulated time; the harness charges a
+// fixed cost per pass through Run() instead (see RUN_PASS_COST_US).
+#define HOST_DECLARE_PORT(x)  extern volatile uint8_t HostPin##x; extern volatile uint8_t HostDdr##x; extern volatile uint8_t HostPort##x
+HOST_DECLARE_PORT(A);
+HOST_DECLARE_PORT(B);
+HOST_DECLARE_PORT(C);
+HOST_DECLARE_PORT(D);
+HOST_DECLARE_PORT(E);
+HOST_DECLARE_PORT(F);
+HOST_DECLARE_PORT(G);
+HOST_DECLARE_PORT(H);
+HOST_DECLARE_PORT(J);
+HOST_DECLARE_PORT(K);
+HOST_DECLARE_PORT(L);
+#undef HOST_DECLARE_PORT
+#define PINA                  HostPinA
+#define DDRA                  HostDdrA
+#define PORTA                 HostPortA
+#define PINB                  HostPinB
+#define DDRB                  HostDdrB
+#define PORTB                 HostPortB
+#define PINC                  HostPinC
+#define DDRC                  HostDdrC
+#define PORTC                 HostPortC
+#define PIND                  HostPinD
+#define DDRD                  HostDdrD
+#define PORTD                 HostPortD
+#define PINE                  HostPinE
+#define DDRE                  HostDdrE
+#define PORTE                 HostPortE
+#define PINF                  HostPinF
+#define DDRF                  HostDdrF
+#define PORTF                 HostPortF
+#define PING                  HostPinG
+#define DDRG                  HostDdrG
+#define PORTG                 HostPortG
+#define PINH                  HostPinH
+#define DDRH                  HostDdrH
+#define PORTH                 HostPortH
+#define PINJ                  HostPinJ
+#define DDRJ                  HostDdrJ
+#define PORTJ                 HostPortJ
+#define PINK                  HostPinK
+#define DDRK                  HostDdrK
+#define PORTK                 HostPortK
+#define PINL                  HostPinL
+#define DDRL                  HostDdrL
+#define PORTL                 HostPortL
+
+// PIN CHANGE INTERRUPTS
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+static const uint8_t PCIE0 = 0;
+static const uint8_t PCIE1 = 1;
+static const uint8_t PCIE2 = 2;
+static const uint8_t PCIF0 = 0;
+static const uint8_t PCIF1 = 1;
+static const uint8_t PCIF2 = 2;
+
+// TIMER 2
+extern volatile uint8_t TCCR2A;
+extern volatile uint8_t TCCR2B;
+extern volatile uint8_t TCNT2;
+extern volatile uint8_t OCR2A;
+extern volatile uint8_t OCR2B;
+extern volatile uint8_t TIMSK2;
+extern volatile uint8_t TIFR2;
+static const uint8_t WGM20  = 0;
+static const uint8_t WGM21  = 1;
+static const uint8_t WGM22  = 3;
+static const uint8_t CS20   = 0;
+static const uint8_t CS21   = 1;
+static const uint8_t CS22   = 2;
+static const uint8_t OCIE2A = 1;
+static const uint8_t OCIE2B = 2;
+static const uint8_t OCF2A  = 1;
+static const uint8_t OCF2B  = 2;
+
+// TIMER 4 (fast PWM with ICR4 as TOP, output compare C only)
+extern volatile uint8_t TCCR4A;
+extern volatile uint8_t TCCR4B;
+extern volatile uint16_t TCNT4;
+extern volatile uint16_t ICR4;
+extern volatile uint16_t OCR4C;
+extern volatile uint8_t TIMSK4;
+extern volatile uint8_t TIFR4;
+static const uint8_t COM4C1 = 3;
+static const uint8_t COM4C0 = 2;
+static const uint8_t WGM41  = 1;
+static const uint8_t WGM40  = 0;
+static const uint8_t WGM43  = 4;
+static const uint8_t WGM42  = 3;
+static const uint8_t CS40   = 0;
+static const uint8_t CS41   = 1;
+static const uint8_t CS42   = 2;
+static const uint8_t TOIE4  = 0;
+static const uint8_t TOV4   = 0;
+
+// TIMER 5 (normal mode input capture only)
+extern volatile uint8_t TCCR5A;
+extern volatile uint8_t TCCR5B;
+extern volatile uint16_t ICR5;
+extern volatile uint8_t TIMSK5;
+extern volatile uint8_t TIFR5;
+static const uint8_t ICNC5  = 7;
+static const uint8_t ICES5  = 6;
+static const uint8_t CS50   = 0;
+static const uint8_t CS51   = 1;
+static const uint8_t CS52   = 2;
+static const uint8_t ICIE5  = 5;
+static const uint8_t ICF5   = 5;
+
+// ADC
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t DIDR0;
+extern volatile uint8_t DIDR2;
+extern volatile uint16_t ADC;
+static const uint8_t REFS1  = 7;
+static const uint8_t REFS0  = 6;
+static const uint8_t ADLAR  = 5;
+static const uint8_t ADEN   = 7;
+static const uint8_t ADSC   = 6;
+static const uint8_t ADATE  = 5;
+static const uint8_t ADIF   = 4;
+static const uint8_t ADIE   = 3;
+static const uint8_t ADPS2  = 2;
+static const uint8_t ADPS1  = 1;
+static const uint8_t ADPS0  = 0;
+static const uint8_t MUX5   = 3;
+
+// SRAM LAYOUT
+// The host has no AVR memory map, so the sketch's SRAM monitor sees a
+// simulated one.  HostHeapAndStack is the SRAM above the static data, which
+// is only there as a size.  The heap never grows (the sketch's objects really
+// live in host memory) and the stack pointer is parked near the top.  As
+// with the registers, each name is what the AVR headers and avr-libc give
+// the sketch.
+static const unsigned int HOST_SRAM_STATIC_DATA_BYTES     = 6 * 1024;
+static const unsigned int HOST_SRAM_HEAP_AND_STACK_BYTES  = 2 * 1024;
+extern char HostHeapAndStack[HOST_SRAM_HEAP_AND_STACK_BYTES];
+extern char * HostBrkval;
+extern uintptr_t HostStackPointer;
+#define RAMSTART              (reinterpret_cast<uintptr_t>(HostHeapAndStack) - HOST_SRAM_STATIC_DATA_BYTES)
+#define RAMEND                (reinterpret_cast<uintptr_t>(&HostHeapAndStack[HOST_SRAM_HEAP_AND_STACK_BYTES - 1U]))
+#define SP                    HostStackPointer
+#define __heap_start          HostHeapAndStack
+#define __brkval              HostBrkval
+
+// INTERRUPT VECTORS
+// Each vector is a C function the simulator calls.  They are weak in the HAL
+// so the sketch only has to define the ones it uses.
+extern "C"
+{
+void PCINT0_vect(void);
+void PCINT1_vect(void);
+void PCINT2_vect(void);
+void TIMER2_COMPA_vect(void);
+void TIMER2_COMPB_vect(void);
+void TIMER4_OVF_vect(void);
+void TIMER5_CAPT_vect(void);
+void ADC_vect(void);
+}
+
+#endif // HOST_AVR_HPP
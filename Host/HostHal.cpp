@@ -0,0 +1,1163 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     HostHal.cpp
+/// Author:   David Stalter
+///
+/// Details:  Implementation of the simulated Mega for the host build.  This
+///           covers the virtual clock, digital/analog pins, external and pin
+///           change interrupts, Timer 2, Timer 4 PWM on OC4C, Timer 5 input
+///           capture, the ADC, the UARTs and EEPROM.  Only the behavior the
+///           car sketch depends on is modeled.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <stdio.h>                    // for snprintf/fwrite
+#include <vector>                     // for periodic callbacks
+#include "HostHal.hpp"                // for class declaration
+#include "EEPROM.h"                   // for EEPROMClass
+
+// WEAK INTERRUPT VECTORS
+// The sketch overrides whichever of these it actually uses.
+extern "C"
+{
+void PCINT0_vect(void) __attribute__((weak));
+void PCINT1_vect(void) __attribute__((weak));
+void PCINT2_vect(void) __attribute__((weak));
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER2_COMPB_vect(void) __attribute__((weak));
+void TIMER4_OVF_vect(void) __attribute__((weak));
+void TIMER5_CAPT_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+}
+
+// SIMULATED REGISTERS
+volatile uint8_t SREG = 0x80;
+#define HOST_DEFINE_PORT(x)   volatile uint8_t HostPin##x = 0; volatile uint8_t HostDdr##x = 0; volatile uint8_t HostPort##x = 0
+HOST_DEFINE_PORT(A);
+HOST_DEFINE_PORT(B);
+HOST_DEFINE_PORT(C);
+HOST_DEFINE_PORT(D);
+HOST_DEFINE_PORT(E);
+HOST_DEFINE_PORT(F);
+HOST_DEFINE_PORT(G);
+HOST_DEFINE_PORT(H);
+HOST_DEFINE_PORT(J);
+HOST_DEFINE_PORT(K);
+HOST_DEFINE_PORT(L);
+#undef HOST_DEFINE_PORT
+volatile uint8_t PCICR  = 0;
+volatile uint8_t PCIFR  = 0;
+volatile uint8_t PCMSK0 = 0;
+volatile uint8_t PCMSK1 = 0;
+volatile uint8_t PCMSK2 = 0;
+volatile uint8_t TCCR2A = 0;
+volatile uint8_t TCCR2B = 0;
+volatile uint8_t TCNT2  = 0;
+volatile uint8_t OCR2A  = 0;
+volatile uint8_t OCR2B  = 0;
+volatile uint8_t TIMSK2 = 0;
+volatile uint8_t TIFR2  = 0;
+volatile uint8_t TCCR4A = 0;
+volatile uint8_t TCCR4B = 0;
+volatile uint16_t TCNT4 = 0;
+volatile uint16_t ICR4  = 0;
+volatile uint16_t OCR4C = 0;
+volatile uint8_t TIMSK4 = 0;
+volatile uint8_t TIFR4  = 0;
+volatile uint8_t TCCR5A = 0;
+volatile uint8_t TCCR5B = 0;
+volatile uint16_t ICR5  = 0;
+volatile uint8_t TIMSK5 = 0;
+volatile uint8_t TIFR5  = 0;
+volatile uint8_t ADMUX  = 0;
+volatile uint8_t ADCSRA = 0;
+volatile uint8_t ADCSRB = 0;
+volatile uint8_t DIDR0  = 0;
+volatile uint8_t DIDR2  = 0;
+volatile uint16_t ADC   = 0;
+
+// SIMULATED SRAM
+// The stack pointer sits as deep as the main loop with an interrupt on top
+// of it goes
+static const unsigned int HOST_SRAM_STACK_BYTES = 256;
+char HostHeapAndStack[HOST_SRAM_HEAP_AND_STACK_BYTES] = {};
+char * HostBrkval = nullptr;
+uintptr_t HostStackPointer = reinterpret_cast<uintptr_t>(&HostHeapAndStack[HOST_SRAM_HEAP_AND_STACK_BYTES - 1U - HOST_SRAM_STACK_BYTES]);
+
+// GLOBALS
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+EEPROMClass EEPROM;
+
+namespace
+{
+  // Port registers plus the pin change interrupt group the port feeds
+  struct PortRegisters
+  {
+    volatile uint8_t * m_pPin;
+    volatile uint8_t * m_pDdr;
+    volatile uint8_t * m_pPort;
+  };
+
+  enum PortIndex { PA, PB, PC, PD, PE, PF, PG, PH, PJ, PK, PL };
+
+  const PortRegisters PORTS[] =
+  {
+    { &HostPinA, &HostDdrA, &HostPortA }, { &HostPinB, &HostDdrB, &HostPortB }, { &HostPinC, &HostDdrC, &HostPortC },
+    { &HostPinD, &HostDdrD, &HostPortD }, { &HostPinE, &HostDdrE, &HostPortE }, { &HostPinF, &HostDdrF, &HostPortF },
+    { &HostPinG, &HostDdrG, &HostPortG }, { &HostPinH, &HostDdrH, &HostPortH }, { &HostPinJ, &HostDdrJ, &HostPortJ },
+    { &HostPinK, &HostDdrK, &HostPortK }, { &HostPinL, &HostDdrL, &HostPortL }
+  };
+
+  // Arduino Mega pin number to port/bit
+  struct PinMapping
+  {
+    uint8_t m_Port;
+    uint8_t m_Bit;
+  };
+
+  const PinMapping PIN_MAP[HostHal::NUM_PINS] =
+  {
+    {PE,0}, {PE,1}, {PE,4}, {PE,5}, {PG,5}, {PE,3}, {PH,3}, {PH,4}, {PH,5}, {PH,6},   //  0 -  9
+    {PB,4}, {PB,5}, {PB,6}, {PB,7}, {PJ,1}, {PJ,0}, {PH,1}, {PH,0}, {PD,3}, {PD,2},   // 10 - 19
+    {PD,1}, {PD,0}, {PA,0}, {PA,1}, {PA,2}, {PA,3}, {PA,4}, {PA,5}, {PA,6}, {PA,7},   // 20 - 29
+    {PC,7}, {PC,6}, {PC,5}, {PC,4}, {PC,3}, {PC,2}, {PC,1}, {PC,0}, {PD,7}, {PG,2},   // 30 - 39
+    {PG,1}, {PG,0}, {PL,7}, {PL,6}, {PL,5}, {PL,4}, {PL,3}, {PL,2}, {PL,1}, {PL,0},   // 40 - 49
+    {PB,3}, {PB,2}, {PB,1}, {PB,0}, {PF,0}, {PF,1}, {PF,2}, {PF,3}, {PF,4}, {PF,5},   // 50 - 59
+    {PF,6}, {PF,7}, {PK,0}, {PK,1}, {PK,2}, {PK,3}, {PK,4}, {PK,5}, {PK,6}, {PK,7}    // 60 - 69
+  };
+
+  // Arduino interrupt number to hardware vector (0 -> INT4, 1 -> INT5, 2 -> INT0, ...)
+  const int EXTERNAL_INTERRUPT_VECTORS[] = { 5, 6, 1, 2, 3, 4 };
+  const int NUM_EXTERNAL_INTERRUPTS = sizeof(EXTERNAL_INTERRUPT_VECTORS) / sizeof(EXTERNAL_INTERRUPT_VECTORS[0]);
+  const int EXTERNAL_INTERRUPT_PINS[] = { 2, 3, 21, 20, 19, 18 };
+
+  // Timer 4 output compare C
+  const uint8_t OC4C_PIN = 8;
+
+  struct CallbackEntry
+  {
+    unsigned long m_PeriodUs;
+    uint64_t m_NextTimeUs;
+    HostHal::Callback m_pCallback;
+    void * m_pContext;
+  };
+
+  struct OneShotCallbackEntry
+  {
+    uint64_t m_TimeUs;
+    HostHal::Callback m_pCallback;
+    void * m_pContext;
+  };
+
+  const uint64_t NEVER = ~0ULL;
+  const int NUM_ANALOG_CHANNELS = 16;
+  const unsigned CYCLES_PER_US = F_CPU / 1000000UL;
+
+  uint64_t g_TimeUs = 0ULL;
+  bool g_bInIsr = false;
+  bool g_bInCallback = false;
+  bool g_bPendingVectors[HostHal::NUM_VECTORS] = {};
+  int g_NumPendingVectors = 0;
+  void (*g_pExternalIsrs[NUM_EXTERNAL_INTERRUPTS])() = {};
+  int g_ExternalIsrModes[NUM_EXTERNAL_INTERRUPTS] = {};
+  bool g_bPinDriven[HostHal::NUM_PINS] = {};
+  int g_AnalogInputs[NUM_ANALOG_CHANNELS] = {};
+  int g_ServoPulsesUs[HostHal::NUM_PINS] = {};
+  uint8_t g_Eeprom[EEPROMClass::EEPROM_LENGTH_BYTES];
+  bool g_bEepromInitialized = false;
+  unsigned long g_EepromWriteCount = 0UL;
+  unsigned long g_EepromWriteLimit = ~0UL;
+  uint64_t g_EepromReadyUs = 0ULL;
+  std::vector<CallbackEntry> g_Callbacks;
+  std::vector<OneShotCallbackEntry> g_OneShotCallbacks;
+  uint64_t g_Timer2NextUs = NEVER;
+  uint64_t g_Timer2CompareBUs = NEVER;
+  uint64_t g_Timer4NextUs = NEVER;
+  uint64_t g_AdcNextUs = NEVER;
+  HostHal::PulseInHandler g_pPulseInHandler = nullptr;
+  void * g_pPulseInContext = nullptr;
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: SetPending
+  ///
+  /// Details:  Flags an interrupt vector as pending.
+  //////////////////////////////////////////////////////////////////////////////
+  void SetPending(int vectorNumber)
+  {
+    if (!g_bPendingVectors[vectorNumber])
+    {
+      g_bPendingVectors[vectorNumber] = true;
+      g_NumPendingVectors++;
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: GetTimer2PeriodUs
+  ///
+  /// Details:  Returns the Timer 2 compare match period in CTC mode, or zero
+  ///           if the compare interrupt is not running.
+  //////////////////////////////////////////////////////////////////////////////
+  unsigned long GetTimer2PeriodUs()
+  {
+    static const unsigned long TIMER2_PRESCALERS[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+    unsigned long prescaler = TIMER2_PRESCALERS[TCCR2B & 0x07];
+    if (((TIMSK2 & _BV(OCIE2A)) == 0) || (prescaler == 0))
+    {
+      return 0UL;
+    }
+    return ((OCR2A + 1UL) * prescaler) / (F_CPU / 1000000UL);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: GetTimer2CompareBDelayUs
+  ///
+  /// Details:  Returns how long after the start of a Timer 2 period the
+  ///           counter reaches OCR2B.
+  //////////////////////////////////////////////////////////////////////////////
+  unsigned long GetTimer2CompareBDelayUs()
+  {
+    static const unsigned long TIMER2_PRESCALERS[] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+    return ((OCR2B + 1UL) * TIMER2_PRESCALERS[TCCR2B & 0x07]) / (F_CPU / 1000000UL);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: GetTimer4PwmPrescaler
+  ///
+  /// Details:  Returns the Timer 4 prescaler in fast PWM mode with ICR4 as
+  ///           TOP (mode 14), or zero if it is not running that way.
+  //////////////////////////////////////////////////////////////////////////////
+  unsigned long GetTimer4PwmPrescaler()
+  {
+    static const unsigned long TIMER4_PRESCALERS[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    unsigned long prescaler = TIMER4_PRESCALERS[TCCR4B & 0x07];
+    bool bFastPwmIcrTop = ((TCCR4A & (_BV(WGM41) | _BV(WGM40))) == _BV(WGM41)) && ((TCCR4B & (_BV(WGM43) | _BV(WGM42))) == (_BV(WGM43) | _BV(WGM42)));
+    return bFastPwmIcrTop ? prescaler : 0UL;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: UpdateTimers
+  ///
+  /// Details:  Starts/stops the simulated timers based on their registers and
+  ///           flags any compare matches that are due.
+  //////////////////////////////////////////////////////////////////////////////
+  void UpdateTimers()
+  {
+    unsigned long timer2PeriodUs = GetTimer2PeriodUs();
+    if (timer2PeriodUs == 0UL)
+    {
+      g_Timer2NextUs = NEVER;
+    }
+    else if (g_Timer2NextUs == NEVER)
+    {
+      g_Timer2NextUs = g_TimeUs + timer2PeriodUs;
+    }
+    else if (g_Timer2NextUs <= g_TimeUs)
+    {
+      SetPending(HostHal::TIMER2_COMPA_VECTOR);
+      g_Timer2CompareBUs = g_Timer2NextUs + GetTimer2CompareBDelayUs();
+      g_Timer2NextUs += timer2PeriodUs;
+    }
+    else
+    {
+    }
+
+    // Compare B matches OCR2B counts into each period.  It is only looked
+    // for while its interrupt is on, and then at most once a period.
+    if (((TIMSK2 & _BV(OCIE2B)) != 0) && (g_Timer2CompareBUs <= g_TimeUs))
+    {
+      SetPending(HostHal::TIMER2_COMPB_VECTOR);
+      g_Timer2CompareBUs = NEVER;
+    }
+
+    // Each Timer 4 frame starts at BOTTOM, where the buffered OCR4C takes
+    // effect.  That pulse is what the speed controller on OC4C sees for the
+    // whole frame.  TOP, right before, is the overflow.
+    unsigned long timer4Prescaler = GetTimer4PwmPrescaler();
+    if (timer4Prescaler == 0UL)
+    {
+      g_Timer4NextUs = NEVER;
+    }
+    else if (g_Timer4NextUs == NEVER)
+    {
+      g_Timer4NextUs = g_TimeUs;
+    }
+    else
+    {
+    }
+    if (g_Timer4NextUs <= g_TimeUs)
+    {
+      if ((TCCR4A & (_BV(COM4C1) | _BV(COM4C0))) == _BV(COM4C1))
+      {
+        g_ServoPulsesUs[OC4C_PIN] = static_cast<int>(((OCR4C + 1UL) * timer4Prescaler) / CYCLES_PER_US);
+      }
+      TIFR4 |= _BV(TOV4);
+      if ((TIMSK4 & _BV(TOIE4)) != 0)
+      {
+        SetPending(HostHal::TIMER4_OVF_VECTOR);
+      }
+      g_Timer4NextUs += ((ICR4 + 1UL) * timer4Prescaler) / CYCLES_PER_US;
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: CaptureTimer5
+  ///
+  /// Details:  Timer 5 input capture.  The counter free runs in normal mode
+  ///           from time zero, so its value is just the time in timer ticks.
+  ///           An edge on ICP5 (PL1) that matches ICES5 latches it in ICR5.
+  //////////////////////////////////////////////////////////////////////////////
+  void CaptureTimer5(bool bRisingEdge)
+  {
+    static const unsigned long TIMER5_PRESCALERS[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    unsigned long prescaler = TIMER5_PRESCALERS[TCCR5B & 0x07];
+    if ((prescaler == 0) || (((TCCR5B & _BV(ICES5)) != 0) != bRisingEdge))
+    {
+      return;
+    }
+
+    ICR5 = static_cast<uint16_t>((g_TimeUs * (F_CPU / 1000000UL)) / prescaler);
+    TIFR5 |= _BV(ICF5);
+    if ((TIMSK5 & _BV(ICIE5)) != 0)
+    {
+      SetPending(HostHal::TIMER5_CAPT_VECTOR);
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: UpdateAdc
+  ///
+  /// Details:  Runs the ADC.  A conversion takes 13 ADC clocks.  When one
+  ///           completes the result and flag are set, and in free running mode
+  ///           (auto trigger with trigger source 0) the next one starts.
+  //////////////////////////////////////////////////////////////////////////////
+  void UpdateAdc()
+  {
+    const uint8_t ADC_CONVERSION_CLOCKS = 13;
+    const uint8_t AUTO_TRIGGER_SOURCE_MASK = 0x07;
+
+    if (((ADCSRA & _BV(ADEN)) == 0) || ((ADCSRA & _BV(ADSC)) == 0))
+    {
+      g_AdcNextUs = NEVER;
+      return;
+    }
+
+    unsigned long prescaler = 1UL << (ADCSRA & 0x07);
+    if (prescaler == 1UL)
+    {
+      prescaler = 2UL;
+    }
+    unsigned long conversionUs = (ADC_CONVERSION_CLOCKS * prescaler) / (F_CPU / 1000000UL);
+
+    if (g_AdcNextUs == NEVER)
+    {
+      g_AdcNextUs = g_TimeUs + conversionUs;
+    }
+    else if (g_AdcNextUs <= g_TimeUs)
+    {
+      uint8_t channel = (ADMUX & 0x07) | (((ADCSRB & _BV(MUX5)) != 0) ? 0x08 : 0x00);
+      int value = constrain(g_AnalogInputs[channel], 0, 1023);
+      ADC = ((ADMUX & _BV(ADLAR)) != 0) ? static_cast<uint16_t>(value << 6) : static_cast<uint16_t>(value);
+      ADCSRA |= _BV(ADIF);
+      if ((ADCSRA & _BV(ADIE)) != 0)
+      {
+        SetPending(HostHal::ADC_VECTOR);
+      }
+
+      if (((ADCSRA & _BV(ADATE)) != 0) && ((ADCSRB & AUTO_TRIGGER_SOURCE_MASK) == 0))
+      {
+        g_AdcNextUs += conversionUs;
+      }
+      else
+      {
+        ADCSRA &= ~_BV(ADSC);
+        g_AdcNextUs = NEVER;
+      }
+    }
+    else
+    {
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: CallVector
+  ///
+  /// Details:  Invokes the handler for a hardware interrupt vector.
+  //////////////////////////////////////////////////////////////////////////////
+  void CallVector(int vectorNumber)
+  {
+    for (int i = 0; i < NUM_EXTERNAL_INTERRUPTS; i++)
+    {
+      if ((EXTERNAL_INTERRUPT_VECTORS[i] == vectorNumber) && (g_pExternalIsrs[i] != nullptr))
+      {
+        g_pExternalIsrs[i]();
+        return;
+      }
+    }
+
+    switch (vectorNumber)
+    {
+      case HostHal::PCINT0_VECTOR:
+      {
+        PCIFR &= ~_BV(PCIF0);
+        if (PCINT0_vect != nullptr) { PCINT0_vect(); }
+        break;
+      }
+      case HostHal::PCINT1_VECTOR:
+      {
+        PCIFR &= ~_BV(PCIF1);
+        if (PCINT1_vect != nullptr) { PCINT1_vect(); }
+        break;
+      }
+      case HostHal::PCINT2_VECTOR:
+      {
+        PCIFR &= ~_BV(PCIF2);
+        if (PCINT2_vect != nullptr) { PCINT2_vect(); }
+        break;
+      }
+      case HostHal::TIMER2_COMPA_VECTOR:
+      {
+        if (TIMER2_COMPA_vect != nullptr) { TIMER2_COMPA_vect(); }
+        break;
+      }
+      case HostHal::TIMER2_COMPB_VECTOR:
+      {
+        if (TIMER2_COMPB_vect != nullptr) { TIMER2_COMPB_vect(); }
+        break;
+      }
+      case HostHal::TIMER4_OVF_VECTOR:
+      {
+        TIFR4 &= ~_BV(TOV4);
+        if (TIMER4_OVF_vect != nullptr) { TIMER4_OVF_vect(); }
+        break;
+      }
+      case HostHal::TIMER5_CAPT_VECTOR:
+      {
+        TIFR5 &= ~_BV(ICF5);
+        if (TIMER5_CAPT_vect != nullptr) { TIMER5_CAPT_vect(); }
+        break;
+      }
+      case HostHal::ADC_VECTOR:
+      {
+        ADCSRA &= ~_BV(ADIF);
+        if (ADC_vect != nullptr) { ADC_vect(); }
+        break;
+      }
+      default:
+      {
+        break;
+      }
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: SetPinLevel
+  ///
+  /// Details:  Changes the level seen on a pin and raises any external or pin
+  ///           change interrupt the edge should cause.
+  //////////////////////////////////////////////////////////////////////////////
+  void SetPinLevel(uint8_t pin, bool bValue)
+  {
+    if (pin >= HostHal::NUM_PINS)
+    {
+      return;
+    }
+
+    const PinMapping & rMapping = PIN_MAP[pin];
+    volatile uint8_t & rPinRegister = *PORTS[rMapping.m_Port].m_pPin;
+    uint8_t bit = _BV(rMapping.m_Bit);
+    bool bOldValue = ((rPinRegister & bit) != 0);
+    if (bOldValue == bValue)
+    {
+      return;
+    }
+
+    if (bValue)
+    {
+      rPinRegister |= bit;
+    }
+    else
+    {
+      rPinRegister &= ~bit;
+    }
+
+    // External interrupts
+    for (int i = 0; i < NUM_EXTERNAL_INTERRUPTS; i++)
+    {
+      if ((EXTERNAL_INTERRUPT_PINS[i] == pin) && (g_pExternalIsrs[i] != nullptr))
+      {
+        int mode = g_ExternalIsrModes[i];
+        if ((mode == CHANGE) || ((mode == RISING) && bValue) || ((mode == FALLING) && !bValue))
+        {
+          SetPending(EXTERNAL_INTERRUPT_VECTORS[i]);
+        }
+      }
+    }
+
+    // Timer 5 input capture
+    if ((rMapping.m_Port == PL) && (rMapping.m_Bit == 1))
+    {
+      CaptureTimer5(bValue);
+    }
+
+    // Pin change interrupts (port B, PE0/port J and port K)
+    volatile uint8_t * pMask = nullptr;
+    uint8_t maskBit = 0U;
+    int group = -1;
+    if (rMapping.m_Port == PB)
+    {
+      pMask = &PCMSK0;
+      maskBit = rMapping.m_Bit;
+      group = 0;
+    }
+    else if ((rMapping.m_Port == PE) && (rMapping.m_Bit == 0))
+    {
+      pMask = &PCMSK1;
+      maskBit = 0;
+      group = 1;
+    }
+    else if ((rMapping.m_Port == PJ) && (rMapping.m_Bit <= 6))
+    {
+      pMask = &PCMSK1;
+      maskBit = rMapping.m_Bit + 1;
+      group = 1;
+    }
+    else if (rMapping.m_Port == PK)
+    {
+      pMask = &PCMSK2;
+      maskBit = rMapping.m_Bit;
+      group = 2;
+    }
+    else
+    {
+    }
+
+    if ((pMask != nullptr) && ((*pMask & _BV(maskBit)) != 0))
+    {
+      PCIFR |= _BV(group);
+      if ((PCICR & _BV(group)) != 0)
+      {
+        SetPending(HostHal::PCINT0_VECTOR + group);
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// HostHal
+////////////////////////////////////////////////////////////////////////////////
+uint64_t HostHal::GetTimeUs()
+{
+  return g_TimeUs;
+}
+
+
+void HostHal::AdvanceTimeUs(uint64_t deltaUs)
+{
+  uint64_t targetTimeUs = g_TimeUs + deltaUs;
+
+  while (true)
+  {
+    UpdateTimers();
+    UpdateAdc();
+
+    // Step to the next thing that happens, or the target
+    uint64_t nextTimeUs = targetTimeUs;
+    if (g_Timer2NextUs < nextTimeUs)
+    {
+      nextTimeUs = g_Timer2NextUs;
+    }
+    if (((TIMSK2 & _BV(OCIE2B)) != 0) && (g_Timer2CompareBUs < nextTimeUs))
+    {
+      nextTimeUs = g_Timer2CompareBUs;
+    }
+    if (g_Timer4NextUs < nextTimeUs)
+    {
+      nextTimeUs = g_Timer4NextUs;
+    }
+    if (g_AdcNextUs < nextTimeUs)
+    {
+      nextTimeUs = g_AdcNextUs;
+    }
+    if (!g_bInCallback)
+    {
+      for (size_t i = 0; i < g_Callbacks.size(); i++)
+      {
+        if (g_Callbacks[i].m_NextTimeUs < nextTimeUs)
+        {
+          nextTimeUs = g_Callbacks[i].m_NextTimeUs;
+        }
+      }
+      for (size_t i = 0; i < g_OneShotCallbacks.size(); i++)
+      {
+        if (g_OneShotCallbacks[i].m_TimeUs < nextTimeUs)
+        {
+          nextTimeUs = g_OneShotCallbacks[i].m_TimeUs;
+        }
+      }
+    }
+
+    if (nextTimeUs > g_TimeUs)
+    {
+      g_TimeUs = nextTimeUs;
+    }
+
+    UpdateTimers();
+    UpdateAdc();
+
+    // Callbacks don't nest, time just moves if they call into the sketch API
+    if (!g_bInCallback)
+    {
+      g_bInCallback = true;
+      for (size_t i = 0; i < g_Callbacks.size(); i++)
+      {
+        CallbackEntry & rEntry = g_Callbacks[i];
+        if (rEntry.m_NextTimeUs <= g_TimeUs)
+        {
+          rEntry.m_NextTimeUs += rEntry.m_PeriodUs;
+          rEntry.m_pCallback(rEntry.m_pContext);
+        }
+      }
+      for (size_t i = 0; i < g_OneShotCallbacks.size(); )
+      {
+        if (g_OneShotCallbacks[i].m_TimeUs <= g_TimeUs)
+        {
+          // Remove first, the callback is allowed to schedule another
+          OneShotCallbackEntry entry = g_OneShotCallbacks[i];
+          g_OneShotCallbacks.erase(g_OneShotCallbacks.begin() + i);
+          entry.m_pCallback(entry.m_pContext);
+        }
+        else
+        {
+          i++;
+        }
+      }
+      g_bInCallback = false;
+    }
+
+    ServiceInterrupts();
+
+    if (g_TimeUs >= targetTimeUs)
+    {
+      break;
+    }
+  }
+}
+
+
+void HostHal::AddPeriodicCallback(unsigned long periodUs, Callback pCallback, void * pContext)
+{
+  CallbackEntry entry = { periodUs, g_TimeUs + periodUs, pCallback, pContext };
+  g_Callbacks.push_back(entry);
+}
+
+
+void HostHal::ScheduleCallback(uint64_t timeUs, Callback pCallback, void * pContext)
+{
+  OneShotCallbackEntry entry = { timeUs, pCallback, pContext };
+  g_OneShotCallbacks.push_back(entry);
+}
+
+
+void HostHal::SetDigitalInput(uint8_t pin, bool bValue)
+{
+  if (pin < NUM_PINS)
+  {
+    g_bPinDriven[pin] = true;
+    SetPinLevel(pin, bValue);
+  }
+}
+
+
+bool HostHal::GetDigitalOutput(uint8_t pin)
+{
+  if (pin >= NUM_PINS)
+  {
+    return false;
+  }
+  const PinMapping & rMapping = PIN_MAP[pin];
+  return ((*PORTS[rMapping.m_Port].m_pPort & _BV(rMapping.m_Bit)) != 0);
+}
+
+
+void HostHal::SetAnalogInput(uint8_t channel, int value)
+{
+  if (channel < NUM_ANALOG_CHANNELS)
+  {
+    g_AnalogInputs[channel] = value;
+  }
+}
+
+
+void HostHal::SetPulseInHandler(PulseInHandler pHandler, void * pContext)
+{
+  g_pPulseInHandler = pHandler;
+  g_pPulseInContext = pContext;
+}
+
+
+int HostHal::GetServoPulseUs(uint8_t pin)
+{
+  return (pin < NUM_PINS) ? g_ServoPulsesUs[pin] : 0;
+}
+
+
+uint8_t * HostHal::GetEeprom()
+{
+  if (!g_bEepromInitialized)
+  {
+    memset(g_Eeprom, 0xFF, sizeof(g_Eeprom));
+    g_bEepromInitialized = true;
+  }
+  return g_Eeprom;
+}
+
+
+unsigned long HostHal::GetEepromWriteCount()
+{
+  return g_EepromWriteCount;
+}
+
+
+// Writes after the limit take their time but are lost, like a power cut
+void HostHal::SetEepromWriteLimit(unsigned long writeCount)
+{
+  g_EepromWriteLimit = writeCount;
+}
+
+
+void HostHal::ServiceInterrupts()
+{
+  if (g_bInIsr || (g_NumPendingVectors == 0))
+  {
+    return;
+  }
+
+  // Lowest vector number wins, just like the AVR
+  bool bServiced = true;
+  while (bServiced && ((SREG & 0x80) != 0))
+  {
+    bServiced = false;
+    for (int vector = 0; vector < NUM_VECTORS; vector++)
+    {
+      if (g_bPendingVectors[vector])
+      {
+        g_bPendingVectors[vector] = false;
+        g_NumPendingVectors--;
+        g_bInIsr = true;
+        SREG &= ~0x80;
+        CallVector(vector);
+        SREG |= 0x80;
+        g_bInIsr = false;
+        bServiced = true;
+        break;
+      }
+    }
+  }
+}
+
+
+void HostHal::RequestInterrupt(int vectorNumber)
+{
+  if ((vectorNumber > 0) && (vectorNumber < NUM_VECTORS))
+  {
+    SetPending(vectorNumber);
+  }
+}
+
+
+void HostHal::SetExternalInterrupt(int interruptNumber, void (*pIsr)(), int mode)
+{
+  if ((interruptNumber >= 0) && (interruptNumber < NUM_EXTERNAL_INTERRUPTS))
+  {
+    g_pExternalIsrs[interruptNumber] = pIsr;
+    g_ExternalIsrModes[interruptNumber] = mode;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Arduino API
+////////////////////////////////////////////////////////////////////////////////
+void HostCli()
+{
+  SREG &= ~0x80;
+}
+
+
+void HostSei()
+{
+  SREG |= 0x80;
+  HostHal::ServiceInterrupts();
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= HostHal::NUM_PINS)
+  {
+    return;
+  }
+
+  HostHal::AdvanceTimeUs(HostHal::DIGITAL_IO_COST_US);
+
+  const PinMapping & rMapping = PIN_MAP[pin];
+  const PortRegisters & rPort = PORTS[rMapping.m_Port];
+  uint8_t bit = _BV(rMapping.m_Bit);
+  if (mode == OUTPUT)
+  {
+    *rPort.m_pDdr |= bit;
+  }
+  else
+  {
+    *rPort.m_pDdr &= ~bit;
+    if (mode == INPUT_PULLUP)
+    {
+      *rPort.m_pPort |= bit;
+
+      // Nothing is driving the pin yet, so the pull-up wins
+      if (!g_bPinDriven[pin])
+      {
+        SetPinLevel(pin, true);
+      }
+    }
+    else
+    {
+      *rPort.m_pPort &= ~bit;
+    }
+  }
+}
+
+
+int digitalRead(uint8_t pin)
+{
+  if (pin >= HostHal::NUM_PINS)
+  {
+    return LOW;
+  }
+
+  HostHal::AdvanceTimeUs(HostHal::DIGITAL_IO_COST_US);
+  const PinMapping & rMapping = PIN_MAP[pin];
+  return ((*PORTS[rMapping.m_Port].m_pPin & _BV(rMapping.m_Bit)) != 0) ? HIGH : LOW;
+}
+
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= HostHal::NUM_PINS)
+  {
+    return;
+  }
+
+  HostHal::AdvanceTimeUs(HostHal::DIGITAL_IO_COST_US);
+
+  const PinMapping & rMapping = PIN_MAP[pin];
+  const PortRegisters & rPort = PORTS[rMapping.m_Port];
+  uint8_t bit = _BV(rMapping.m_Bit);
+  if (value != LOW)
+  {
+    *rPort.m_pPort |= bit;
+  }
+  else
+  {
+    *rPort.m_pPort &= ~bit;
+  }
+
+  // An output pin reads back what it drives
+  if ((*rPort.m_pDdr & bit) != 0)
+  {
+    SetPinLevel(pin, value != LOW);
+  }
+}
+
+
+int analogRead(uint8_t pin)
+{
+  HostHal::AdvanceTimeUs(HostHal::ANALOG_READ_COST_US);
+
+  // Accept either the channel number or the A0-A15 pin number
+  uint8_t channel = (pin >= A0) ? (pin - A0) : pin;
+  return (channel < NUM_ANALOG_CHANNELS) ? g_AnalogInputs[channel] : 0;
+}
+
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeoutUs)
+{
+  if (g_pPulseInHandler != nullptr)
+  {
+    return g_pPulseInHandler(pin, state, timeoutUs, g_pPulseInContext);
+  }
+
+  // Nothing is generating pulses, so the call always times out
+  HostHal::AdvanceTimeUs(timeoutUs);
+  return 0UL;
+}
+
+
+unsigned long millis()
+{
+  HostHal::AdvanceTimeUs(HostHal::TIME_READ_COST_US);
+  return static_cast<unsigned long>(g_TimeUs / 1000ULL);
+}
+
+
+unsigned long micros()
+{
+  HostHal::AdvanceTimeUs(HostHal::TIME_READ_COST_US);
+  return static_cast<unsigned long>(g_TimeUs & 0xFFFFFFFFULL);
+}
+
+
+void delay(unsigned long ms)
+{
+  HostHal::AdvanceTimeUs(ms * 1000ULL);
+}
+
+
+void delayMicroseconds(unsigned int us)
+{
+  HostHal::AdvanceTimeUs(us);
+}
+
+
+void attachInterrupt(int interruptNumber, void (*pIsr)(), int mode)
+{
+  HostHal::SetExternalInterrupt(interruptNumber, pIsr, mode);
+}
+
+
+void detachInterrupt(int interruptNumber)
+{
+  HostHal::SetExternalInterrupt(interruptNumber, nullptr, 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// HardwareSerial
+////////////////////////////////////////////////////////////////////////////////
+HardwareSerial::HardwareSerial(int portNumber) :
+  m_PortNumber(portNumber),
+  m_ByteTimeUs(87UL),
+  m_TimeoutMs(1000UL),
+  m_TxDrainEndUs(0ULL),
+  m_Input(),
+  m_Output(),
+  m_bEcho(false)
+{
+}
+
+
+void HardwareSerial::begin(unsigned long baudRate)
+{
+  // Ten bits per byte on the wire (start + 8 data + stop)
+  m_ByteTimeUs = (10UL * 1000000UL + (baudRate / 2UL)) / baudRate;
+}
+
+
+int HardwareSerial::available()
+{
+  HostHal::AdvanceTimeUs(HostHal::SERIAL_CALL_COST_US);
+  return static_cast<int>(m_Input.size());
+}
+
+
+int HardwareSerial::peek()
+{
+  return m_Input.empty() ? -1 : static_cast<uint8_t>(m_Input[0]);
+}
+
+
+int HardwareSerial::read()
+{
+  HostHal::AdvanceTimeUs(HostHal::SERIAL_CALL_COST_US);
+  if (m_Input.empty())
+  {
+    return -1;
+  }
+  int value = static_cast<uint8_t>(m_Input[0]);
+  m_Input.erase(0, 1);
+  return value;
+}
+
+
+int HardwareSerial::availableForWrite()
+{
+  const uint64_t TX_BUFFER_SIZE = 64ULL;
+  uint64_t nowUs = HostHal::GetTimeUs();
+  uint64_t queued = (m_TxDrainEndUs > nowUs) ? ((m_TxDrainEndUs - nowUs + m_ByteTimeUs - 1) / m_ByteTimeUs) : 0ULL;
+  return (queued >= (TX_BUFFER_SIZE - 1)) ? 0 : static_cast<int>(TX_BUFFER_SIZE - 1 - queued);
+}
+
+
+void HardwareSerial::flush()
+{
+  uint64_t nowUs = HostHal::GetTimeUs();
+  if (m_TxDrainEndUs > nowUs)
+  {
+    HostHal::AdvanceTimeUs(m_TxDrainEndUs - nowUs);
+  }
+}
+
+
+String HardwareSerial::readString()
+{
+  // Stream::readString() keeps reading until the timeout expires with no data
+  std::string result;
+  while (true)
+  {
+    if (!m_Input.empty())
+    {
+      result += m_Input;
+      m_Input.clear();
+    }
+    HostHal::AdvanceTimeUs(m_TimeoutMs * 1000ULL);
+    if (m_Input.empty())
+    {
+      break;
+    }
+  }
+  return String(result);
+}
+
+
+size_t HardwareSerial::write(uint8_t data)
+{
+  HostHal::AdvanceTimeUs(HostHal::SERIAL_CALL_COST_US);
+
+  // Block while the transmit buffer is full
+  while (availableForWrite() == 0)
+  {
+    HostHal::AdvanceTimeUs(m_ByteTimeUs);
+  }
+
+  uint64_t nowUs = HostHal::GetTimeUs();
+  if (m_TxDrainEndUs < nowUs)
+  {
+    m_TxDrainEndUs = nowUs;
+  }
+  m_TxDrainEndUs += m_ByteTimeUs;
+
+  m_Output.push_back(static_cast<char>(data));
+  if (m_bEcho)
+  {
+    fwrite(&data, 1, 1, stdout);
+  }
+  return 1;
+}
+
+
+size_t HardwareSerial::write(const uint8_t * pData, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    write(pData[i]);
+  }
+  return length;
+}
+
+
+size_t HardwareSerial::print(long value, int base)
+{
+  if ((base == DEC) && (value < 0))
+  {
+    return write('-') + print(0UL - static_cast<unsigned long>(value), base);
+  }
+  return print(static_cast<unsigned long>(value), base);
+}
+
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+  char buffer[8 * sizeof(unsigned long) + 1];
+  char * pChar = &buffer[sizeof(buffer) - 1];
+  *pChar = '\0';
+  if (base < 2)
+  {
+    base = DEC;
+  }
+  do
+  {
+    unsigned long digit = value % base;
+    *--pChar = static_cast<char>((digit < 10) ? ('0' + digit) : ('A' + digit - 10));
+    value /= base;
+  } while (value != 0UL);
+  return write(pChar);
+}
+
+
+size_t HardwareSerial::print(double value, int digits)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return write(buffer);
+}
+
+
+void HardwareSerial::InjectInput(const char * pData)
+{
+  m_Input += pData;
+}
+
+
+void HardwareSerial::InjectInput(const uint8_t * pData, size_t length)
+{
+  m_Input.append(reinterpret_cast<const char *>(pData), length);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// EEPROMClass
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+  // Waits out a write in progress, the same as the avr-libc routines
+  void WaitForEepromReady()
+  {
+    uint64_t nowUs = HostHal::GetTimeUs();
+    if (nowUs < g_EepromReadyUs)
+    {
+      HostHal::AdvanceTimeUs(g_EepromReadyUs - nowUs);
+    }
+  }
+}
+
+
+bool eeprom_is_ready()
+{
+  HostHal::AdvanceTimeUs(HostHal::EEPROM_READ_COST_US);
+  return HostHal::GetTimeUs() >= g_EepromReadyUs;
+}
+
+
+uint8_t EEPROMClass::read(int address)
+{
+  WaitForEepromReady();
+  HostHal::AdvanceTimeUs(HostHal::EEPROM_READ_COST_US);
+  return HostHal::GetEeprom()[address % EEPROM_LENGTH_BYTES];
+}
+
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  WaitForEepromReady();
+  HostHal::AdvanceTimeUs(HostHal::EEPROM_WRITE_COST_US);
+  g_EepromReadyUs = HostHal::GetTimeUs() + HostHal::EEPROM_WRITE_BUSY_US;
+  if (g_EepromWriteCount < g_EepromWriteLimit)
+  {
+    HostHal::GetEeprom()[address % EEPROM_LENGTH_BYTES] = value;
+  }
+  g_EepromWriteCount++;
+}
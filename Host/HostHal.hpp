@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     HostHal.hpp
+/// Author:   David Stalter
+///
+/// Details:  Control interface for the simulated Mega used by the host build.
+///           The sketch only ever sees the Arduino API.  Test harnesses and
+///           simulators use this class to drive input pins, observe outputs,
+///           hook the virtual clock and inspect the simulated peripherals.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOSTHAL_HPP
+#define HOSTHAL_HPP
+
+// INCLUDES
+#include "Arduino.h"                  // for the simulated Arduino API
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: HostHal
+///
+/// Details:  Static access to the simulated hardware.
+////////////////////////////////////////////////////////////////////////////////
+class HostHal
+{
+public:
+
+  // Callback types
+  typedef void (*Callback)(void * pContext);
+  typedef unsigned long (*PulseInHandler)(uint8_t pin, uint8_t state, unsigned long timeoutUs, void * pContext);
+
+  // VIRTUAL CLOCK
+  static uint64_t GetTimeUs();
+  static void AdvanceTimeUs(uint64_t deltaUs);
+  static void AddPeriodicCallback(unsigned long periodUs, Callback pCallback, void * pContext);
+  static void ScheduleCallback(uint64_t timeUs, Callback pCallback, void * pContext);
+
+  // PINS
+  static void SetDigitalInput(uint8_t pin, bool bValue);
+  static bool GetDigitalOutput(uint8_t pin);
+  static void SetAnalogInput(uint8_t channel, int value);
+  static void SetPulseInHandler(PulseInHandler pHandler, void * pContext);
+  static int GetServoPulseUs(uint8_t pin);
+
+  // EEPROM
+  static uint8_t * GetEeprom();
+  static unsigned long GetEepromWriteCount();
+  static void SetEepromWriteLimit(unsigned long writeCount);
+
+  // INTERRUPTS
+  static void ServiceInterrupts();
+  static void RequestInterrupt(int vectorNumber);
+  static void SetExternalInterrupt(int interruptNumber, void (*pIsr)(), int mode);
+
+  // Cost of each simulated call, in microseconds
+  static const unsigned long DIGITAL_IO_COST_US   = 4;
+  static const unsigned long ANALOG_READ_COST_US  = 112;
+  static const unsigned long TIME_READ_COST_US    = 2;
+  static const unsigned long EEPROM_READ_COST_US  = 1;
+  static const unsigned long EEPROM_WRITE_COST_US = 2;
+  static const unsigned long EEPROM_WRITE_BUSY_US = 3300;
+  static const unsigned long SERIAL_CALL_COST_US  = 2;
+
+  // Cost of an idle pass through Run(): the mode switch read and the
+  // scheduler's scan of its task table, about 200 cycles on the Mega.  The
+  // harness charges it per pass so a loop that only polls still lets time
+  // move, without charging every port access.
+  static const unsigned long RUN_PASS_COST_US     = 12;
+
+  // Interrupt vector numbers (same order and priority as the ATmega2560)
+  static const int INT0_VECTOR          = 1;
+  static const int PCINT0_VECTOR        = 9;
+  static const int PCINT1_VECTOR        = 10;
+  static const int PCINT2_VECTOR        = 11;
+  static const int TIMER2_COMPA_VECTOR  = 13;
+  static const int TIMER2_COMPB_VECTOR  = 14;
+  static const int ADC_VECTOR           = 29;
+  static const int TIMER4_OVF_VECTOR    = 45;
+  static const int TIMER5_CAPT_VECTOR   = 46;
+  static const int NUM_VECTORS          = 57;
+
+  static const unsigned int NUM_PINS    = 70;
+
+private:
+  HostHal();
+};
+
+#endif // HOSTHAL_HPP
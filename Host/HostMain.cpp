@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     HostMain.cpp
+/// Author:   David Stalter
+///
+/// Details:  Host test executable for the soap box derby car.  It boots the
+///           real SoapBoxDerbyCar class against the simulated Mega, with the
+///           car model sitting at the starting gate and an RC transmitter
+///           attached so calibration and manual control have something to
+///           work with, then drives the car through a scripted session on the
+///           virtual clock.
+///
+/// Usage:    SoapBoxDerbyCarHost [-v] [-c commands] [-t file] [-e file] [seconds]
+///             -v        echo the car's console output
+///             -c        console commands to send one second before the end,
+///                       separated by ';' (for example "w;d")
+///             -t        request the car data stream at boot and save what
+///                       the car sends on Serial3 to file
+///             -e        EEPROM image to boot with (if it exists) and save
+///                       back at the end, so runs can follow each other
+///             seconds   simulated run time (default 60)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <stdio.h>                    // for printf
+#include <stdlib.h>                   // for atoi
+#include <string.h>                   // for strcmp
+#include <time.h>                     // for wall clock measurement
+#include "HostHal.hpp"                // for simulated hardware control
+#include "CarSimulator.hpp"           // for the steering model
+#include "RcTransmitter.hpp"          // for the controller
+#include "SoapBoxDerbyCar.hpp"        // for the car class
+#include "EEPROM.h"                   // for the EEPROM size
+
+// Sketch entry point (SoapBoxDerbyCar.ino).  loop() never returns, so the
+// harness calls Run() on the singleton itself.
+void setup();
+
+namespace
+{
+  // Mirrored from SoapBoxDerbyCar.hpp
+  const uint8_t AUTONOMOUS_SWITCH_PIN = 44;
+
+  // Car data stream request for -t (see SetCarDataStreamRate())
+  const char * const TELEMETRY_STREAM_REQUEST = "ps50";
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Host entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  unsigned long runTimeSec = 60UL;
+  const char * pCommands = nullptr;
+  const char * pTelemetryFile = nullptr;
+  const char * pEepromFile = nullptr;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-v") == 0)
+    {
+      Serial.SetEcho(true);
+    }
+    else if ((strcmp(argv[i], "-c") == 0) && ((i + 1) < argc))
+    {
+      pCommands = argv[++i];
+    }
+    else if ((strcmp(argv[i], "-t") == 0) && ((i + 1) < argc))
+    {
+      pTelemetryFile = argv[++i];
+    }
+    else if ((strcmp(argv[i], "-e") == 0) && ((i + 1) < argc))
+    {
+      pEepromFile = argv[++i];
+    }
+    else
+    {
+      runTimeSec = static_cast<unsigned long>(atoi(argv[i]));
+    }
+  }
+
+  // Transmitter on, sticks centered, brake off, master enable on
+  static CarSimulator car(CarSimulator::GetDefaultParameters());
+  static RcTransmitter transmitter;
+  HostHal::SetDigitalInput(AUTONOMOUS_SWITCH_PIN, false);
+  car.Attach();
+  transmitter.Attach();
+
+  if (pEepromFile != nullptr)
+  {
+    FILE * pFile = fopen(pEepromFile, "rb");
+    if (pFile != nullptr)
+    {
+      size_t numBytes = fread(HostHal::GetEeprom(), 1, EEPROMClass::EEPROM_LENGTH_BYTES, pFile);
+      fclose(pFile);
+      printf("EEPROM bytes loaded:     %zu\n", numBytes);
+    }
+  }
+
+  clock_t wallStart = clock();
+
+  setup();
+  uint64_t bootTimeUs = HostHal::GetTimeUs();
+
+  if (pTelemetryFile != nullptr)
+  {
+    Serial3.InjectInput(TELEMETRY_STREAM_REQUEST);
+  }
+
+  // Scripted session: sweep the steering stick and cycle the transmitter
+  unsigned long runPasses = 0UL;
+  uint64_t endTimeUs = bootTimeUs + (runTimeSec * 1000000ULL);
+  while (HostHal::GetTimeUs() < endTimeUs)
+  {
+    uint64_t sessionMs = (HostHal::GetTimeUs() - bootTimeUs) / 1000ULL;
+    transmitter.SetChannelPulseUs(RcTransmitter::YAW_CHANNEL, RcTransmitter::STEERING_NEUTRAL_US + static_cast<int>(400.0 * sin(sessionMs / 1000.0)));
+    transmitter.SetOn(((sessionMs / 10000ULL) % 6ULL) != 5ULL);
+
+    if ((pCommands != nullptr) && ((HostHal::GetTimeUs() + 1000000ULL) >= endTimeUs))
+    {
+      Serial.InjectInput(pCommands);
+      pCommands = nullptr;
+    }
+
+    SoapBoxDerbyCar::GetSingletonInstance()->Run();
+    HostHal::AdvanceTimeUs(HostHal::RUN_PASS_COST_US);
+    runPasses++;
+  }
+
+  double wallSec = static_cast<double>(clock() - wallStart) / CLOCKS_PER_SEC;
+  double simSec = HostHal::GetTimeUs() / 1000000.0;
+
+  printf("Boot (calibration) time: %.3f s simulated\n", bootTimeUs / 1000000.0);
+  printf("Simulated time:          %.3f s\n", simSec);
+  printf("Wall time:               %.3f s (%.0fx real time)\n", wallSec, (wallSec > 0.0) ? (simSec / wallSec) : 0.0);
+  printf("Run() passes:            %lu (%.1f us average)\n", runPasses, (runPasses > 0UL) ? (((simSec * 1000000.0) - bootTimeUs) / runPasses) : 0.0);
+  printf("Final steering position: %.3f\n", car.GetSteeringPosition());
+  printf("EEPROM writes:           %lu\n", HostHal::GetEepromWriteCount());
+
+  if (pTelemetryFile != nullptr)
+  {
+    FILE * pFile = fopen(pTelemetryFile, "wb");
+    if (pFile == nullptr)
+    {
+      perror(pTelemetryFile);
+      return 1;
+    }
+    const std::string & rTelemetry = Serial3.GetOutput();
+    fwrite(rTelemetry.data(), 1, rTelemetry.size(), pFile);
+    fclose(pFile);
+    printf("Telemetry bytes saved:   %zu\n", rTelemetry.size());
+  }
+
+  if (pEepromFile != nullptr)
+  {
+    FILE * pFile = fopen(pEepromFile, "wb");
+    if (pFile == nullptr)
+    {
+      perror(pEepromFile);
+      return 1;
+    }
+    fwrite(HostHal::GetEeprom(), 1, EEPROMClass::EEPROM_LENGTH_BYTES, pFile);
+    fclose(pFile);
+  }
+
+  return 0;
+}
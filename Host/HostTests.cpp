@@ -0,0 +1,970 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     HostTests.cpp
+/// Author:   David Stalter
+///
+/// Details:  Host tests for the soap box derby car sketch.  Each test prints
+///           PASS or FAIL, with the checks that failed, and the exit status
+///           is the number of failed tests.
+///
+///           Tests that need the car booted fork a child for each boot, the
+///           same way the race simulator forks its runs, because the sketch
+///           singleton can only be created once per process.
+///
+///           Journal power cut: the car logs until the journal has wrapped,
+///           then the EEPROM is cut off part way through a commit, once for
+///           a block moving into a reused slot and once for the newest block
+///           being extended, at every interesting point of the commit.  Each
+///           resulting EEPROM image is booted and the data log restored from
+///           it, which must skip the torn slot and keep every block before it.
+///
+///           Data log codec: deltas on both sides of the nibble escape and
+///           varints of every size round trip, the oldest block is found in
+///           every position of the ring, and LogData() spills records into
+///           the next block and wraps the ring with the log still decoding
+///           to exactly what was logged.
+///
+///           Serial command parser: names run straight into numbers, over
+///           long lines and names are reported and then forgotten, numbers
+///           are limited to nine digits, and a line that stops arriving
+///           completes IDLE_TIMEOUT_MS after its last byte.
+///
+/// Usage:    SoapBoxDerbyCarHostTests
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <math.h>                     // for sin
+#include <stdio.h>                    // for printf
+#include <string.h>                   // for memcpy/strcmp
+#include <unistd.h>                   // for fork/pipe
+#include <vector>                     // for the logged entries
+#include <sys/wait.h>                 // for waitpid
+#include "HostHal.hpp"                // for simulated hardware control
+#include "CarSimulator.hpp"           // for the car model
+#include "RcTransmitter.hpp"          // for the controller
+#include "SoapBoxDerbyCar.hpp"        // for the car class
+#include "SerialCommandParser.hpp"    // for the command parser
+#include "EEPROM.h"                   // for the EEPROM size
+
+// Sketch entry point (SoapBoxDerbyCar.ino)
+void setup();
+
+// Records a failed check in the current test
+#define CHECK(condition) Check((condition), #condition, __LINE__)
+
+namespace
+{
+  // Mirrored from SoapBoxDerbyCar.hpp
+  const uint8_t AUTONOMOUS_SWITCH_PIN = 44;
+
+  // Give up on reaching a test point after this much simulated time
+  const uint64_t MAX_LOGGING_TIME_US = 600000000ULL;
+
+  // Simulated time given to a torn commit to (not) finish
+  const uint64_t POWER_CUT_RUN_TIME_US = 2000000ULL;
+
+  // Entries LogData() is given, enough to go around the ring a few times
+  const unsigned NUM_LOGGED_ENTRIES = 2000U;
+
+  // One data log entry
+  struct LogEntry
+  {
+    int32_t m_Values[DataLogCodec::NUM_FIELDS];
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: NextRandom
+  ///
+  /// Details:  Small deterministic generator (xorshift) for test values.
+  //////////////////////////////////////////////////////////////////////////////
+  uint32_t NextRandom(uint32_t & rState)
+  {
+    rState ^= rState << 13;
+    rState ^= rState >> 17;
+    rState ^= rState << 5;
+    return rState;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ReadAll/WriteAll
+  ///
+  /// Details:  Pipe transfers that may take more than one call.
+  //////////////////////////////////////////////////////////////////////////////
+  bool ReadAll(int fd, void * pData, size_t numBytes)
+  {
+    uint8_t * pNext = static_cast<uint8_t *>(pData);
+    while (numBytes > 0U)
+    {
+      ssize_t numRead = read(fd, pNext, numBytes);
+      if (numRead <= 0)
+      {
+        return false;
+      }
+      pNext += numRead;
+      numBytes -= numRead;
+    }
+    return true;
+  }
+
+  bool WriteAll(int fd, const void * pData, size_t numBytes)
+  {
+    const uint8_t * pNext = static_cast<const uint8_t *>(pData);
+    while (numBytes > 0U)
+    {
+      ssize_t numWritten = write(fd, pNext, numBytes);
+      if (numWritten <= 0)
+      {
+        return false;
+      }
+      pNext += numWritten;
+      numBytes -= numWritten;
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ProcessString
+  ///
+  /// Details:  Feeds a string to a command parser, all bytes at the same
+  ///           time.  Returns whether the last byte completed a command.
+  //////////////////////////////////////////////////////////////////////////////
+  bool ProcessString(SerialCommandParser & rParser, const char * pText, unsigned long timeStampMs)
+  {
+    bool bCommand = false;
+    while (*pText != '\0')
+    {
+      bCommand = rParser.ProcessByte(*pText++, timeStampMs);
+    }
+    return bCommand;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: IsCommand
+  ///
+  /// Details:  Checks a parser holds a good command with the given name and
+  ///           arguments.
+  //////////////////////////////////////////////////////////////////////////////
+  bool IsCommand(const SerialCommandParser & rParser, const char * pName, uint8_t numArguments, long argument0 = 0L, long argument1 = 0L)
+  {
+    return (rParser.GetStatus() == SerialCommandParser::COMMAND_OK) &&
+           (strcmp(rParser.GetName(), pName) == 0) &&
+           (rParser.GetNumArguments() == numArguments) &&
+           (rParser.GetArgument(0U) == argument0) &&
+           (rParser.GetArgument(1U) == argument1);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: WaitForChild
+  ///
+  /// Details:  Waits for a forked child and returns whether it passed.
+  //////////////////////////////////////////////////////////////////////////////
+  bool WaitForChild(pid_t pid)
+  {
+    int status = 0;
+    return (pid > 0) && (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: SoapBoxDerbyCarHostTests
+///
+/// Details:  The host tests.  A friend of SoapBoxDerbyCar, so they can reach
+///           the journal directly.
+////////////////////////////////////////////////////////////////////////////////
+class SoapBoxDerbyCarHostTests
+{
+public:
+  static void Initialize(RcTransmitter * pTransmitter);
+  static void RunJournalPowerCutTests();
+  static void RunDataLogCodecTests();
+  static void RunSerialCommandParserTests();
+  static int GetNumFailures() { return m_NumFailures; }
+
+private:
+  // An EEPROM image from a torn journal commit and what restoring it must
+  // give: the newest block left in the journal, and whether the torn slot
+  // still holds a valid block
+  struct PowerCutImage
+  {
+    bool      m_bExtension;
+    uint16_t  m_CutWrites;
+    uint16_t  m_CommitWrites;
+    uint16_t  m_TornSequence;
+    bool      m_bExpectTornSlotValid;
+    uint16_t  m_ExpectedSequence;
+    uint16_t  m_ExpectedLength;
+    uint8_t   m_Eeprom[EEPROMClass::EEPROM_LENGTH_BYTES];
+  };
+
+  static void BeginTest(const char * pName);
+  static void EndTest();
+  static void Check(bool bCondition, const char * pCondition, int line);
+  static void ExitChild();
+  static void RunInBootedCar(void (*pTest)());
+
+  static void RunCar(uint64_t durationUs);
+  static bool RunCarUntilCommit(bool bExtension);
+  static bool CutCommit(bool bExtension, int imageFd);
+  static void CheckRestoredLog(const PowerCutImage & rImage);
+
+  static void TestCodecRoundTrip();
+  static void TestOldestBlockOffset();
+  static void TestLogDataSpillAndWrap();
+  static bool CheckDataLogRing(const std::vector<LogEntry> & rLogged, uint16_t & rNumSpilledBlocks);
+
+  static RcTransmitter * m_pTransmitter;
+  static const char * m_pTestName;
+  static bool m_bTestFailed;
+  static int m_NumFailures;
+};
+
+RcTransmitter * SoapBoxDerbyCarHostTests::m_pTransmitter = nullptr;
+const char * SoapBoxDerbyCarHostTests::m_pTestName = "";
+bool SoapBoxDerbyCarHostTests::m_bTestFailed = false;
+int SoapBoxDerbyCarHostTests::m_NumFailures = 0;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Initialize
+///
+/// Details:  Keeps the transmitter the booted tests drive the car with.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::Initialize(RcTransmitter * pTransmitter)
+{
+  m_pTransmitter = pTransmitter;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: BeginTest/EndTest
+///
+/// Details:  Start and report a test.  The name must outlive the test.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::BeginTest(const char * pName)
+{
+  m_pTestName = pName;
+  m_bTestFailed = false;
+}
+
+void SoapBoxDerbyCarHostTests::EndTest()
+{
+  printf("%s %s\n", m_bTestFailed ? "FAIL" : "PASS", m_pTestName);
+  if (m_bTestFailed)
+  {
+    m_NumFailures++;
+  }
+  fflush(stdout);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Check
+///
+/// Details:  Fails the current test if the condition does not hold.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::Check(bool bCondition, const char * pCondition, int line)
+{
+  if (!bCondition)
+  {
+    printf("  line %d: %s\n", line, pCondition);
+    m_bTestFailed = true;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ExitChild
+///
+/// Details:  Ends a forked child, passing whether its checks held back to
+///           the parent.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::ExitChild()
+{
+  fflush(stdout);
+  _exit(m_bTestFailed ? 1 : 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunInBootedCar
+///
+/// Details:  Runs a test in a child with the car booted.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::RunInBootedCar(void (*pTest)())
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    setup();
+    pTest();
+    ExitChild();
+  }
+  CHECK(WaitForChild(pid));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunCar
+///
+/// Details:  Runs the booted car in manual mode with the steering stick
+///           sweeping, so every data log block differs from the last.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::RunCar(uint64_t durationUs)
+{
+  uint64_t endTimeUs = HostHal::GetTimeUs() + durationUs;
+  while (HostHal::GetTimeUs() < endTimeUs)
+  {
+    double timeSec = HostHal::GetTimeUs() / 1000000.0;
+    m_pTransmitter->SetChannelPulseUs(RcTransmitter::YAW_CHANNEL, RcTransmitter::STEERING_NEUTRAL_US + static_cast<int>(400.0 * sin(timeSec)));
+
+    SoapBoxDerbyCar::GetSingletonInstance()->Run();
+    HostHal::AdvanceTimeUs(HostHal::RUN_PASS_COST_US);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunCarUntilCommit
+///
+/// Details:  Runs the car until a journal commit has just started, after the
+///           journal has wrapped so the slot already holds an older block.
+///           The commit either moves a new block into its slot or extends
+///           the newest block in place.  Returns false if none came.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCarHostTests::RunCarUntilCommit(bool bExtension)
+{
+  const SoapBoxDerbyCar::DataLogJournal & rJournal = SoapBoxDerbyCar::m_DataLogJournal;
+  uint64_t endTimeUs = HostHal::GetTimeUs() + MAX_LOGGING_TIME_US;
+  while (HostHal::GetTimeUs() < endTimeUs)
+  {
+    SoapBoxDerbyCar::DataLogJournalState previousState = rJournal.m_State;
+    RunCar(1ULL);
+
+    if ((previousState == SoapBoxDerbyCar::JOURNAL_IDLE) &&
+        (rJournal.m_State == SoapBoxDerbyCar::JOURNAL_WRITING_DATA) &&
+        (rJournal.m_SlotHeader.m_Sequence > SoapBoxDerbyCar::DATA_LOG_JOURNAL_NUM_SLOTS) &&
+        ((rJournal.m_SlotHeader.m_Sequence == rJournal.m_CommittedSequence) == bExtension))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CutCommit
+///
+/// Details:  With a commit just started, counts the EEPROM writes left in it
+///           and forks a child for each cut point.  The child lets that many
+///           more writes through, cuts the power to the EEPROM, keeps running
+///           and sends back the EEPROM image with what restoring it must
+///           give.  Returns whether every child got its image out.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCarHostTests::CutCommit(bool bExtension, int imageFd)
+{
+  SoapBoxDerbyCar::DataLogJournal & rJournal = SoapBoxDerbyCar::m_DataLogJournal;
+  const DataLogCodec::JournalSlotHeader & rHeader = rJournal.m_SlotHeader;
+  const uint8_t * pEeprom = HostHal::GetEeprom();
+
+  // Only bytes that differ are written, data first and the header last
+  unsigned slotOffset = SoapBoxDerbyCar::GetSingletonInstance()->GetDataLogJournalSlotOffset(rHeader.m_Sequence);
+  unsigned dataOffset = slotOffset + sizeof(DataLogCodec::JournalSlotHeader);
+  uint16_t dataWrites = 0U;
+  for (uint16_t i = rJournal.m_CommitPosition; i < rHeader.m_Length; i++)
+  {
+    if (pEeprom[dataOffset + i] != SoapBoxDerbyCar::m_DataLog[rJournal.m_CommitRamOffset + i])
+    {
+      dataWrites++;
+    }
+  }
+  uint16_t headerWrites = 0U;
+  const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rHeader);
+  for (uint16_t i = 0U; i < sizeof(DataLogCodec::JournalSlotHeader); i++)
+  {
+    if (pEeprom[slotOffset + i] != pHeader[i])
+    {
+      headerWrites++;
+    }
+  }
+  uint16_t commitWrites = dataWrites + headerWrites;
+
+  // Nothing, half and all of the data, then all but the last header byte
+  // and the whole commit
+  const uint16_t NUM_CUTS = 5U;
+  uint16_t cuts[NUM_CUTS] = { 0U, static_cast<uint16_t>(dataWrites / 2U), dataWrites, static_cast<uint16_t>(commitWrites - 1U), commitWrites };
+
+  bool bAllSent = true;
+  for (uint16_t cut = 0U; cut < NUM_CUTS; cut++)
+  {
+    PowerCutImage image;
+    image.m_bExtension = bExtension;
+    image.m_CutWrites = cuts[cut];
+    image.m_CommitWrites = commitWrites;
+    image.m_TornSequence = rHeader.m_Sequence;
+
+    if (image.m_CutWrites >= commitWrites)
+    {
+      image.m_bExpectTornSlotValid = true;
+      image.m_ExpectedSequence = rHeader.m_Sequence;
+      image.m_ExpectedLength = rHeader.m_Length;
+    }
+    else if (bExtension && (image.m_CutWrites <= dataWrites))
+    {
+      // The old header still covers the old length, and only bytes after
+      // it have been written
+      image.m_bExpectTornSlotValid = true;
+      image.m_ExpectedSequence = rHeader.m_Sequence;
+      image.m_ExpectedLength = rJournal.m_CommittedLength;
+    }
+    else
+    {
+      image.m_bExpectTornSlotValid = false;
+      image.m_ExpectedSequence = DataLogCodec::RewindSequence(rHeader.m_Sequence, 1U, SoapBoxDerbyCar::DATA_LOG_SEQUENCE_MODULUS);
+      image.m_ExpectedLength = DataLogCodec::BLOCK_SIZE_BYTES;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      HostHal::SetEepromWriteLimit(HostHal::GetEepromWriteCount() + image.m_CutWrites);
+      RunCar(POWER_CUT_RUN_TIME_US);
+
+      memcpy(image.m_Eeprom, HostHal::GetEeprom(), sizeof(image.m_Eeprom));
+      _exit(WriteAll(imageFd, &image, sizeof(image)) ? 0 : 1);
+    }
+    bAllSent = WaitForChild(pid) && bAllSent;
+  }
+
+  return bAllSent;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CheckRestoredLog
+///
+/// Details:  Restores the data log from a torn EEPROM image in a freshly
+///           booted car and checks what came back.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::CheckRestoredLog(const PowerCutImage & rImage)
+{
+  SoapBoxDerbyCar * pCar = SoapBoxDerbyCar::GetSingletonInstance();
+  const SoapBoxDerbyCar::NonVolatileCarData & rCarData = SoapBoxDerbyCar::m_NonVolatileCarData;
+  const uint16_t NUM_SLOTS = SoapBoxDerbyCar::DATA_LOG_JOURNAL_NUM_SLOTS;
+
+  pCar->RestoreLogFromEeprom();
+
+  DataLogCodec::JournalSlotHeader header;
+  bool bTornSlotValid = pCar->ReadDataLogJournalSlot(rImage.m_TornSequence % NUM_SLOTS, header) &&
+                        (header.m_Sequence == rImage.m_TornSequence);
+  CHECK(bTornSlotValid == rImage.m_bExpectTornSlotValid);
+
+  // Restoring continues after the newest block left in the journal, with
+  // all the blocks before it
+  CHECK(rCarData.m_DataLogSequence == rImage.m_ExpectedSequence);
+  CHECK(pCar->ReadDataLogJournalSlot(rImage.m_ExpectedSequence % NUM_SLOTS, header));
+  CHECK(header.m_Length == rImage.m_ExpectedLength);
+  CHECK(rCarData.m_bDataLogOverflowed);
+
+  // Every restored block decodes, oldest first, in time order
+  int32_t lastTimeStampMs = -1;
+  uint16_t numEntries = 0U;
+  bool bInOrder = true;
+  for (uint16_t block = 0U; block < SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS; block++)
+  {
+    const uint8_t * pBlock = &SoapBoxDerbyCar::m_DataLog[block * DataLogCodec::BLOCK_SIZE_BYTES];
+    CHECK(pBlock[0] == DataLogCodec::KEYFRAME_TAG);
+
+    DataLogCodec::State state = {};
+    int32_t values[DataLogCodec::NUM_FIELDS];
+    uint16_t offset = 0U;
+    uint8_t recordSize = 0U;
+    while ((recordSize = DataLogCodec::DecodeRecord(state, &pBlock[offset], DataLogCodec::BLOCK_SIZE_BYTES - offset, values)) != 0U)
+    {
+      offset += recordSize;
+      bInOrder = bInOrder && (values[DataLogCodec::TIME_STAMP_MS] > lastTimeStampMs);
+      lastTimeStampMs = values[DataLogCodec::TIME_STAMP_MS];
+      numEntries++;
+    }
+  }
+  CHECK(bInOrder);
+  CHECK(numEntries > SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunJournalPowerCutTests
+///
+/// Details:  Tears journal commits in one booted car, then restores each
+///           torn EEPROM image in another.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::RunJournalPowerCutTests()
+{
+  BeginTest("journal power cut: log and tear commits");
+
+  int imagePipe[2];
+  CHECK(pipe(imagePipe) == 0);
+
+  fflush(stdout);
+  pid_t loggerPid = fork();
+  if (loggerPid == 0)
+  {
+    close(imagePipe[0]);
+    setup();
+
+    bool bNewSlotCut = RunCarUntilCommit(false) && CutCommit(false, imagePipe[1]);
+    CHECK(bNewSlotCut);
+    bool bExtensionCut = RunCarUntilCommit(true) && CutCommit(true, imagePipe[1]);
+    CHECK(bExtensionCut);
+    ExitChild();
+  }
+  close(imagePipe[1]);
+
+  // Read while the logger runs, the images do not all fit in the pipe
+  static PowerCutImage images[10];
+  uint16_t numImages = 0U;
+  while ((numImages < (sizeof(images) / sizeof(images[0]))) && ReadAll(imagePipe[0], &images[numImages], sizeof(images[0])))
+  {
+    numImages++;
+  }
+  close(imagePipe[0]);
+
+  CHECK(WaitForChild(loggerPid));
+  CHECK(numImages == (sizeof(images) / sizeof(images[0])));
+  EndTest();
+
+  for (uint16_t i = 0U; i < numImages; i++)
+  {
+    const PowerCutImage & rImage = images[i];
+    char name[100];
+    snprintf(name, sizeof(name), "journal power cut: %s, block %u, after %u of %u writes",
+             rImage.m_bExtension ? "extended block" : "new slot",
+             rImage.m_TornSequence, rImage.m_CutWrites, rImage.m_CommitWrites);
+    BeginTest(name);
+
+    memcpy(HostHal::GetEeprom(), rImage.m_Eeprom, sizeof(rImage.m_Eeprom));
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      setup();
+      CheckRestoredLog(rImage);
+      ExitChild();
+    }
+    CHECK(WaitForChild(pid));
+    EndTest();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: TestCodecRoundTrip
+///
+/// Details:  Encodes entries whose residuals sit on each side of the nibble
+///           escape and need varints of every size, then decodes them.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::TestCodecRoundTrip()
+{
+  // Zig-zag 14 is the largest residual that fits in a nibble, 15 is the
+  // escape.  The rest need one to five varint bytes.
+  const int32_t RESIDUALS[] = { 0, 1, -1, 7, -8, 8, 63, -64, 64, 8191, -8192, 8192, 1048575, -1048576, 1048576, 134217727, -134217728, 134217728 };
+  const unsigned NUM_RESIDUALS = sizeof(RESIDUALS) / sizeof(RESIDUALS[0]);
+
+  // A keyframe at each end of the range, then every residual in every
+  // field, alone and with the other fields changing too.  Each one follows
+  // a keyframe and a steady change, so predictions use the last change and
+  // values stay in range.
+  std::vector<LogEntry> entries;
+  std::vector<bool> keyframes;
+  LogEntry entry = {};
+  for (uint8_t field = 0U; field < DataLogCodec::NUM_FIELDS; field++)
+  {
+    entry.m_Values[field] = (field % 2U) ? INT32_MIN : INT32_MAX;
+  }
+  entries.push_back(entry);
+  keyframes.push_back(true);
+
+  for (uint8_t field = 0U; field < DataLogCodec::NUM_FIELDS; field++)
+  {
+    for (unsigned i = 0U; i < NUM_RESIDUALS; i++)
+    {
+      for (unsigned bAll = 0U; bAll < 2U; bAll++)
+      {
+        DataLogCodec::State state = {};
+        for (uint8_t other = 0U; other < DataLogCodec::NUM_FIELDS; other++)
+        {
+          entry.m_Values[other] = 1000;
+        }
+        entries.push_back(entry);
+        keyframes.push_back(true);
+        DataLogCodec::UpdateState(state, entry.m_Values, true);
+        for (uint8_t other = 0U; other < DataLogCodec::NUM_FIELDS; other++)
+        {
+          entry.m_Values[other] += 50;
+        }
+        entries.push_back(entry);
+        keyframes.push_back(false);
+        DataLogCodec::UpdateState(state, entry.m_Values, false);
+
+        for (uint8_t other = 0U; other < DataLogCodec::NUM_FIELDS; other++)
+        {
+          int32_t prediction = state.m_Values[other];
+          if ((DataLogCodec::SECOND_ORDER_FIELDS & (1U << other)) != 0U)
+          {
+            prediction += state.m_Deltas[other];
+          }
+          int32_t residual = (other == field) ? RESIDUALS[i] : (bAll ? RESIDUALS[(i + other) % NUM_RESIDUALS] : 0);
+          entry.m_Values[other] = prediction + residual;
+        }
+        entries.push_back(entry);
+        keyframes.push_back(false);
+
+        // A lone residual costs its nibble, or the escape and its varint
+        if (!bAll && (RESIDUALS[i] != 0))
+        {
+          uint8_t record[DataLogCodec::MAX_RECORD_SIZE_BYTES];
+          uint32_t zigZag = DataLogCodec::ZigZagEncode(RESIDUALS[i]);
+          uint8_t varint[DataLogCodec::MAX_VARINT_SIZE_BYTES];
+          uint8_t varintSize = static_cast<uint8_t>(DataLogCodec::WriteVarint(zigZag, varint) - varint);
+          uint8_t expectedSize = (zigZag < DataLogCodec::NIBBLE_ESCAPE) ? 2U : (1U + ((1U + (2U * varintSize) + 1U) / 2U));
+          CHECK(DataLogCodec::EncodeRecord(state, entry.m_Values, false, record) == expectedSize);
+        }
+      }
+    }
+  }
+
+  // Encode them all, then decode with a fresh state
+  DataLogCodec::State encoderState = {};
+  std::vector<uint8_t> encoded;
+  std::vector<uint8_t> recordSizes;
+  for (unsigned i = 0U; i < entries.size(); i++)
+  {
+    uint8_t record[DataLogCodec::MAX_RECORD_SIZE_BYTES];
+    uint8_t recordSize = DataLogCodec::EncodeRecord(encoderState, entries[i].m_Values, keyframes[i], record);
+    CHECK(recordSize <= DataLogCodec::MAX_RECORD_SIZE_BYTES);
+    DataLogCodec::UpdateState(encoderState, entries[i].m_Values, keyframes[i]);
+    encoded.insert(encoded.end(), record, record + recordSize);
+    recordSizes.push_back(recordSize);
+  }
+
+  DataLogCodec::State decoderState = {};
+  unsigned offset = 0U;
+  unsigned numMatched = 0U;
+  unsigned numTruncatedRejected = 0U;
+  for (unsigned i = 0U; i < entries.size(); i++)
+  {
+    // Cut one byte short, the record must not decode
+    int32_t values[DataLogCodec::NUM_FIELDS];
+    DataLogCodec::State truncatedState = decoderState;
+    if (DataLogCodec::DecodeRecord(truncatedState, &encoded[offset], recordSizes[i] - 1U, values) == 0U)
+    {
+      numTruncatedRejected++;
+    }
+
+    uint8_t recordSize = DataLogCodec::DecodeRecord(decoderState, &encoded[offset], encoded.size() - offset, values);
+    if ((recordSize == recordSizes[i]) && (memcmp(values, entries[i].m_Values, sizeof(values)) == 0))
+    {
+      numMatched++;
+    }
+    offset += recordSizes[i];
+  }
+  CHECK(numMatched == entries.size());
+  CHECK(numTruncatedRejected == entries.size());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: TestOldestBlockOffset
+///
+/// Details:  Finds the oldest block with the write offset in each part of
+///           the ring, before and after it has wrapped.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::TestOldestBlockOffset()
+{
+  const uint16_t BLOCK = DataLogCodec::BLOCK_SIZE_BYTES;
+  const uint16_t LOG_SIZE = SoapBoxDerbyCar::DATA_LOG_SIZE_BYTES;
+
+  // Not wrapped yet, the first block is the oldest
+  CHECK(DataLogCodec::GetOldestBlockOffset(0U, false, LOG_SIZE) == 0U);
+  CHECK(DataLogCodec::GetOldestBlockOffset((3U * BLOCK) + 5U, false, LOG_SIZE) == 0U);
+
+  // Part way through a block, the next one is the oldest
+  CHECK(DataLogCodec::GetOldestBlockOffset(1U, true, LOG_SIZE) == BLOCK);
+  CHECK(DataLogCodec::GetOldestBlockOffset((3U * BLOCK) + 5U, true, LOG_SIZE) == (4U * BLOCK));
+  CHECK(DataLogCodec::GetOldestBlockOffset((4U * BLOCK) - 1U, true, LOG_SIZE) == (4U * BLOCK));
+
+  // A full newest block, the next one has not been started
+  CHECK(DataLogCodec::GetOldestBlockOffset(4U * BLOCK, true, LOG_SIZE) == (4U * BLOCK));
+  CHECK(DataLogCodec::GetOldestBlockOffset(0U, true, LOG_SIZE) == 0U);
+
+  // Part way through the last block, the first one is the oldest
+  CHECK(DataLogCodec::GetOldestBlockOffset(LOG_SIZE - BLOCK + 1U, true, LOG_SIZE) == 0U);
+  CHECK(DataLogCodec::GetOldestBlockOffset(LOG_SIZE - 1U, true, LOG_SIZE) == 0U);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: TestLogDataSpillAndWrap
+///
+/// Details:  Logs entries with residuals of all sizes through LogData(), so
+///           records regularly do not fit at the end of a block, and checks
+///           the ring after every entry once it has wrapped.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::TestLogDataSpillAndWrap()
+{
+  SoapBoxDerbyCar * pCar = SoapBoxDerbyCar::GetSingletonInstance();
+  const SoapBoxDerbyCar::NonVolatileCarData & rCarData = SoapBoxDerbyCar::m_NonVolatileCarData;
+  pCar->ClearDataLog(SoapBoxDerbyCar::RAM_LOG);
+
+  std::vector<LogEntry> logged;
+  uint32_t random = 12345U;
+  uint16_t leftHallCount = 0U;
+  uint16_t rightHallCount = 0U;
+  unsigned numRingChecks = 0U;
+  unsigned numRingsGood = 0U;
+  unsigned numFullNewestBlocks = 0U;
+  uint16_t maxSpilledBlocks = 0U;
+  for (unsigned i = 0U; i < NUM_LOGGED_ENTRIES; i++)
+  {
+    // Mostly small steps, with a jump now and then
+    bool bJump = ((NextRandom(random) % 8U) == 0U);
+    leftHallCount += static_cast<uint16_t>(NextRandom(random) % (bJump ? 200U : 3U));
+    rightHallCount += static_cast<uint16_t>(NextRandom(random) % (bJump ? 200U : 3U));
+    pCar->m_LeftHallCount = leftHallCount;
+    pCar->m_RightHallCount = rightHallCount;
+    pCar->m_FrontAxlePotentiometerValue = static_cast<int>(NextRandom(random) % (bJump ? 1024U : 4U)) + (bJump ? 0 : 500);
+    pCar->m_Pose.m_XQ8 += static_cast<int32_t>(NextRandom(random) % (bJump ? 1000000U : 512U));
+    pCar->m_Pose.m_YQ8 = static_cast<int32_t>(NextRandom(random) % (bJump ? 100000U : 256U)) - (bJump ? 50000 : 128);
+    pCar->m_Pose.m_HeadingQ8 = static_cast<int32_t>(NextRandom(random) % 20000U) - 10000;
+
+    unsigned long timeStampMs = (i * SoapBoxDerbyCar::DATA_LOG_ENTRY_INTERVAL_MS) + (bJump ? 7UL : 0UL);
+    pCar->LogData(timeStampMs);
+
+    LogEntry entry;
+    entry.m_Values[DataLogCodec::TIME_STAMP_MS] = static_cast<int32_t>(timeStampMs);
+    entry.m_Values[DataLogCodec::LEFT_WHEEL_DISTANCE_INCHES] = SoapBoxDerbyCar::HallCountToInches(leftHallCount);
+    entry.m_Values[DataLogCodec::RIGHT_WHEEL_DISTANCE_INCHES] = SoapBoxDerbyCar::HallCountToInches(rightHallCount);
+    entry.m_Values[DataLogCodec::FRONT_AXLE_POTENTIOMETER] = pCar->m_FrontAxlePotentiometerValue;
+    entry.m_Values[DataLogCodec::POSE_X_INCHES] = pCar->m_Pose.m_XQ8 / SoapBoxDerbyCar::POSE_Q8_ONE;
+    entry.m_Values[DataLogCodec::POSE_Y_INCHES] = pCar->m_Pose.m_YQ8 / SoapBoxDerbyCar::POSE_Q8_ONE;
+    entry.m_Values[DataLogCodec::POSE_HEADING_CENTIDEGREES] = SoapBoxDerbyCar::PoseHeadingToCentidegrees(pCar->m_Pose.m_HeadingQ8);
+    logged.push_back(entry);
+
+    if (rCarData.m_bDataLogOverflowed)
+    {
+      uint16_t numSpilledBlocks = 0U;
+      numRingChecks++;
+      numRingsGood += CheckDataLogRing(logged, numSpilledBlocks) ? 1U : 0U;
+      numFullNewestBlocks += ((rCarData.m_DataLogIndex % DataLogCodec::BLOCK_SIZE_BYTES) == 0) ? 1U : 0U;
+      maxSpilledBlocks = (numSpilledBlocks > maxSpilledBlocks) ? numSpilledBlocks : maxSpilledBlocks;
+    }
+  }
+
+  // The ring wrapped more than once, records spilled over, and some filled
+  // the newest block exactly
+  CHECK((logged.size() - numRingChecks) < (NUM_LOGGED_ENTRIES / 2U));
+  CHECK(numRingsGood == numRingChecks);
+  CHECK(maxSpilledBlocks > (SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS / 2U));
+  CHECK(numFullNewestBlocks > 0U);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CheckDataLogRing
+///
+/// Details:  Decodes the RAM data log from the oldest block on and checks it
+///           holds the newest entries logged, every block starting with a
+///           keyframe and ending in END_TAG.  Counts the blocks a record
+///           spilled out of (END_TAG after the last record).
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCarHostTests::CheckDataLogRing(const std::vector<LogEntry> & rLogged, uint16_t & rNumSpilledBlocks)
+{
+  const SoapBoxDerbyCar::NonVolatileCarData & rCarData = SoapBoxDerbyCar::m_NonVolatileCarData;
+  uint16_t oldestOffset = DataLogCodec::GetOldestBlockOffset(rCarData.m_DataLogIndex, rCarData.m_bDataLogOverflowed, SoapBoxDerbyCar::DATA_LOG_SIZE_BYTES);
+
+  std::vector<LogEntry> decoded;
+  bool bGood = true;
+  for (uint16_t block = 0U; block < SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS; block++)
+  {
+    uint16_t blockOffset = (oldestOffset + (block * DataLogCodec::BLOCK_SIZE_BYTES)) % SoapBoxDerbyCar::DATA_LOG_SIZE_BYTES;
+    const uint8_t * pBlock = &SoapBoxDerbyCar::m_DataLog[blockOffset];
+    bGood = bGood && (pBlock[0] == DataLogCodec::KEYFRAME_TAG);
+
+    DataLogCodec::State state = {};
+    LogEntry entry;
+    uint16_t offset = 0U;
+    uint8_t recordSize = 0U;
+    while ((recordSize = DataLogCodec::DecodeRecord(state, &pBlock[offset], DataLogCodec::BLOCK_SIZE_BYTES - offset, entry.m_Values)) != 0U)
+    {
+      offset += recordSize;
+      decoded.push_back(entry);
+    }
+
+    // Whatever a record did not fill is END_TAG, in the newest block too
+    for (uint16_t i = offset; i < DataLogCodec::BLOCK_SIZE_BYTES; i++)
+    {
+      bGood = bGood && (pBlock[i] == DataLogCodec::END_TAG);
+    }
+    bool bNewest = (block == (SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS - 1U));
+    rNumSpilledBlocks += (!bNewest && (offset < DataLogCodec::BLOCK_SIZE_BYTES)) ? 1U : 0U;
+  }
+
+  // The newest entries logged, in order, with nothing missing
+  bGood = bGood && (decoded.size() > SoapBoxDerbyCar::DATA_LOG_NUM_BLOCKS) && (decoded.size() <= rLogged.size());
+  for (unsigned i = 0U; bGood && (i < decoded.size()); i++)
+  {
+    const LogEntry & rExpected = rLogged[rLogged.size() - decoded.size() + i];
+    bGood = (memcmp(decoded[i].m_Values, rExpected.m_Values, sizeof(rExpected.m_Values)) == 0);
+  }
+
+  return bGood;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunDataLogCodecTests
+///
+/// Details:  Runs the data log codec tests.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::RunDataLogCodecTests()
+{
+  BeginTest("data log codec: nibble escapes and varints round trip");
+  TestCodecRoundTrip();
+  EndTest();
+
+  BeginTest("data log codec: oldest block in every part of the ring");
+  TestOldestBlockOffset();
+  EndTest();
+
+  BeginTest("data log: LogData() spills into the next block and wraps the ring");
+  RunInBootedCar(TestLogDataSpillAndWrap);
+  EndTest();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunSerialCommandParserTests
+///
+/// Details:  Runs the serial command parser tests.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCarHostTests::RunSerialCommandParserTests()
+{
+  BeginTest("command parser: name followed directly by a number");
+  {
+    SerialCommandParser parser;
+    CHECK(ProcessString(parser, "ps50\n", 0UL) && IsCommand(parser, "ps", 1U, 50L));
+    CHECK(ProcessString(parser, "ps-5;", 0UL) && IsCommand(parser, "ps", 1U, -5L));
+    CHECK(ProcessString(parser, "sg2,-30\r", 0UL) && IsCommand(parser, "sg", 2U, 2L, -30L));
+    CHECK(ProcessString(parser, "  d \n", 0UL) && IsCommand(parser, "d", 0U));
+    CHECK(ProcessString(parser, "ps50x\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+    CHECK(ProcessString(parser, "ps 1 2 3\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+    CHECK(ProcessString(parser, "ps -\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+
+    // Blank lines, including the \n of a \r\n ending, are not commands
+    CHECK(!ProcessString(parser, "\n", 0UL));
+    CHECK(!ProcessString(parser, " ,\r", 0UL));
+  }
+  EndTest();
+
+  BeginTest("command parser: over long lines and names");
+  {
+    SerialCommandParser parser;
+    char line[SerialCommandParser::MAX_LINE_LENGTH + 2];
+
+    // Exactly MAX_LINE_LENGTH fits
+    memset(line, ' ', sizeof(line));
+    memcpy(line, "ps 7", 4U);
+    line[SerialCommandParser::MAX_LINE_LENGTH] = '\n';
+    line[SerialCommandParser::MAX_LINE_LENGTH + 1] = '\0';
+    CHECK(ProcessString(parser, line, 0UL) && IsCommand(parser, "ps", 1U, 7L));
+
+    // One more is too long, however it ends
+    line[SerialCommandParser::MAX_LINE_LENGTH] = ' ';
+    CHECK(!ProcessString(parser, line, 0UL));
+    CHECK(parser.ProcessByte(';', 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_TOO_LONG));
+    CHECK(!ProcessString(parser, line, 100UL));
+    CHECK(parser.CheckIdle(100UL + SerialCommandParser::IDLE_TIMEOUT_MS) && (parser.GetStatus() == SerialCommandParser::COMMAND_TOO_LONG));
+
+    // Nothing of it is left for the next line
+    CHECK(ProcessString(parser, "w\n", 200UL) && IsCommand(parser, "w", 0U));
+
+    // A name longer than MAX_NAME_LENGTH
+    CHECK(ProcessString(parser, "abcd 1\n", 200UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_TOO_LONG));
+    CHECK(ProcessString(parser, "abc 1\n", 200UL) && IsCommand(parser, "abc", 1U, 1L));
+  }
+  EndTest();
+
+  BeginTest("command parser: nine digit limit");
+  {
+    SerialCommandParser parser;
+    CHECK(ProcessString(parser, "w 999999999\n", 0UL) && IsCommand(parser, "w", 1U, 999999999L));
+    CHECK(ProcessString(parser, "w -999999999\n", 0UL) && IsCommand(parser, "w", 1U, -999999999L));
+    CHECK(ProcessString(parser, "w 000000001\n", 0UL) && IsCommand(parser, "w", 1U, 1L));
+    CHECK(ProcessString(parser, "w 1000000000\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+    CHECK(ProcessString(parser, "w 0000000001\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+    CHECK(ProcessString(parser, "w9999999999\n", 0UL) && (parser.GetStatus() == SerialCommandParser::COMMAND_BAD_ARGUMENTS));
+  }
+  EndTest();
+
+  BeginTest("command parser: idle timeout ends a line");
+  {
+    const unsigned long TIMEOUT_MS = SerialCommandParser::IDLE_TIMEOUT_MS;
+    SerialCommandParser parser;
+
+    // Nothing to complete
+    CHECK(!parser.CheckIdle(1000UL));
+
+    // Timed from the last byte, not the first
+    CHECK(!parser.ProcessByte('p', 1000UL));
+    CHECK(!parser.ProcessByte('s', 1030UL));
+    CHECK(!parser.CheckIdle(1030UL + TIMEOUT_MS - 1UL));
+    CHECK(!parser.ProcessByte('5', 1070UL));
+    CHECK(!parser.ProcessByte('0', 1075UL));
+    CHECK(!parser.CheckIdle(1075UL + TIMEOUT_MS - 1UL));
+    CHECK(parser.CheckIdle(1075UL + TIMEOUT_MS) && IsCommand(parser, "ps", 1U, 50L));
+
+    // Only once
+    CHECK(!parser.CheckIdle(2000UL));
+
+    // Blank input is not a command after the timeout either
+    CHECK(!ProcessString(parser, "  ", 3000UL));
+    CHECK(!parser.CheckIdle(3000UL + TIMEOUT_MS));
+
+    // Across the millis() rollover
+    unsigned long lastByteMs = static_cast<unsigned long>(-20L);
+    CHECK(!ProcessString(parser, "d", lastByteMs));
+    CHECK(!parser.CheckIdle(lastByteMs + TIMEOUT_MS - 1UL));
+    CHECK(parser.CheckIdle(lastByteMs + TIMEOUT_MS) && IsCommand(parser, "d", 0U));
+  }
+  EndTest();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Host tests entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main()
+{
+  // Car held at the gate, manual mode, transmitter on.  Nothing is booted
+  // in this process, so every test starts from a blank EEPROM and clock.
+  static CarSimulator car(CarSimulator::GetDefaultParameters());
+  static RcTransmitter transmitter;
+  HostHal::SetDigitalInput(AUTONOMOUS_SWITCH_PIN, false);
+  car.Attach();
+  transmitter.Attach();
+  SoapBoxDerbyCarHostTests::Initialize(&transmitter);
+
+  SoapBoxDerbyCarHostTests::RunJournalPowerCutTests();
+  SoapBoxDerbyCarHostTests::RunDataLogCodecTests();
+  SoapBoxDerbyCarHostTests::RunSerialCommandParserTests();
+
+  int numFailures = SoapBoxDerbyCarHostTests::GetNumFailures();
+  printf("%d failed\n", numFailures);
+  return numFailures;
+}
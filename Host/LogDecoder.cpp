@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     LogDecoder.cpp
+/// Author:   David Stalter
+///
+/// Details:  Host tool that turns the data log journal in the car's EEPROM
+///           back into readable entries.  The input is the console output of
+///           the display EEPROM command ('d').  Other console lines are
+///           ignored, so a whole session capture can be passed in.  Every
+///           valid journal block is decoded, oldest first, using the same
+///           codec as the sketch, and the entries are printed as CSV.
+///
+/// Usage:    SoapBoxDerbyCarLogDecoder [file]
+///             file      captured console output (default: stdin)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <stdio.h>                    // for printf/fopen
+#include <stdlib.h>                   // for strtoul
+#include <string.h>                   // for strncmp
+#include "DataLogCodec.hpp"           // for the data log record format
+
+namespace
+{
+  // Mirrored from SoapBoxDerbyCar.hpp
+  const unsigned EEPROM_SIZE_BYTES              = 4 * 1024;
+  const unsigned JOURNAL_EEPROM_OFFSET          = 256;
+  const unsigned FLIGHT_RECORDER_SIZE_BYTES     = 12 + (32 * 12);   // Snapshot header and samples
+  const unsigned JOURNAL_NUM_SLOTS              = (EEPROM_SIZE_BYTES - JOURNAL_EEPROM_OFFSET - FLIGHT_RECORDER_SIZE_BYTES) / DataLogCodec::JOURNAL_SLOT_SIZE_BYTES;
+  const uint16_t JOURNAL_SEQUENCE_MODULUS       = JOURNAL_NUM_SLOTS * (0xFFFFU / JOURNAL_NUM_SLOTS);
+  const unsigned EEPROM_LAYOUT_VERSION_OFFSET   = 34;               // NonVolatileCarData::m_EepromLayoutVersion
+  const uint16_t EEPROM_LAYOUT_VERSION          = 1;
+
+  const char * const FIELD_NAMES[DataLogCodec::NUM_FIELDS] =
+  {
+    "time_ms", "left_in", "right_in", "pot", "pose_x_in", "pose_y_in", "heading_cdeg"
+  };
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ReadEepromDump
+  ///
+  /// Details:  Fills the EEPROM image from "0xADDR: B B B ..." lines, as
+  ///           printed by DisplayEeprom().  Returns the number of bytes read.
+  //////////////////////////////////////////////////////////////////////////////
+  unsigned ReadEepromDump(FILE * pFile, uint8_t * pEeprom)
+  {
+    unsigned numBytes = 0U;
+    char line[256];
+    while (fgets(line, sizeof(line), pFile) != nullptr)
+    {
+      if (strncmp(line, "0x", 2) != 0)
+      {
+        continue;
+      }
+
+      char * pNext = nullptr;
+      unsigned long address = strtoul(line + 2, &pNext, 16);
+      if ((pNext == nullptr) || (*pNext != ':'))
+      {
+        continue;
+      }
+      pNext++;
+
+      while (address < EEPROM_SIZE_BYTES)
+      {
+        char * pEnd = nullptr;
+        unsigned long value = strtoul(pNext, &pEnd, 16);
+        if ((pEnd == pNext) || (value > 0xFFUL))
+        {
+          break;
+        }
+        pEeprom[address++] = static_cast<uint8_t>(value);
+        pNext = pEnd;
+        numBytes++;
+      }
+    }
+
+    return numBytes;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ReadSlot
+  ///
+  /// Details:  Gets a journal slot's header and data.  Returns whether the
+  ///           slot holds a valid block (the same checks as the sketch).
+  //////////////////////////////////////////////////////////////////////////////
+  bool ReadSlot(const uint8_t * pEeprom, unsigned slot, DataLogCodec::JournalSlotHeader & rHeader, const uint8_t *& rpData)
+  {
+    const uint8_t * pSlot = pEeprom + JOURNAL_EEPROM_OFFSET + (slot * DataLogCodec::JOURNAL_SLOT_SIZE_BYTES);
+    memcpy(&rHeader, pSlot, sizeof(rHeader));
+    rpData = pSlot + sizeof(rHeader);
+
+    if ((rHeader.m_Length == 0U) ||
+        (rHeader.m_Length > DataLogCodec::BLOCK_SIZE_BYTES) ||
+        (rHeader.m_Sequence >= JOURNAL_SEQUENCE_MODULUS) ||
+        ((rHeader.m_Sequence % JOURNAL_NUM_SLOTS) != slot))
+    {
+      return false;
+    }
+
+    uint16_t crc = DataLogCodec::StartSlotCrc(rHeader);
+    for (unsigned i = 0U; i < rHeader.m_Length; i++)
+    {
+      crc = DataLogCodec::UpdateCrc(crc, rpData[i]);
+    }
+    return (crc == rHeader.m_Crc);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Log decoder entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  FILE * pFile = stdin;
+  if (argc > 1)
+  {
+    pFile = fopen(argv[1], "r");
+    if (pFile == nullptr)
+    {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  static uint8_t eeprom[EEPROM_SIZE_BYTES];
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  unsigned numBytes = ReadEepromDump(pFile, eeprom);
+  if (pFile != stdin)
+  {
+    fclose(pFile);
+  }
+
+  if (numBytes < EEPROM_SIZE_BYTES)
+  {
+    fprintf(stderr, "Only %u EEPROM bytes found, expected %u.\n", numBytes, EEPROM_SIZE_BYTES);
+    return 1;
+  }
+
+  // An older layout puts the slots somewhere else
+  uint16_t layoutVersion = 0U;
+  memcpy(&layoutVersion, &eeprom[EEPROM_LAYOUT_VERSION_OFFSET], sizeof(layoutVersion));
+  if (layoutVersion != EEPROM_LAYOUT_VERSION)
+  {
+    fprintf(stderr, "EEPROM layout version %u, expected %u.\n", layoutVersion, EEPROM_LAYOUT_VERSION);
+    return 1;
+  }
+
+  // The newest block sets where the sequence numbers start
+  bool bFound = false;
+  uint16_t newestSequence = 0U;
+  for (unsigned slot = 0U; slot < JOURNAL_NUM_SLOTS; slot++)
+  {
+    DataLogCodec::JournalSlotHeader header;
+    const uint8_t * pData = nullptr;
+    if (ReadSlot(eeprom, slot, header, pData) && (!bFound || DataLogCodec::IsNewerSequence(header.m_Sequence, newestSequence, JOURNAL_SEQUENCE_MODULUS)))
+    {
+      newestSequence = header.m_Sequence;
+      bFound = true;
+    }
+  }
+
+  if (!bFound)
+  {
+    fprintf(stderr, "No data log in the EEPROM journal.\n");
+    return 1;
+  }
+
+  printf("entry");
+  for (unsigned field = 0U; field < DataLogCodec::NUM_FIELDS; field++)
+  {
+    printf(",%s", FIELD_NAMES[field]);
+  }
+  printf("\n");
+
+  DataLogCodec::State state = {};
+  int32_t values[DataLogCodec::NUM_FIELDS];
+  unsigned entry = 0U;
+  unsigned numBlocks = 0U;
+  for (unsigned i = 0U; i < JOURNAL_NUM_SLOTS; i++)
+  {
+    uint16_t sequence = DataLogCodec::RewindSequence(newestSequence, (JOURNAL_NUM_SLOTS - 1U) - i, JOURNAL_SEQUENCE_MODULUS);
+    DataLogCodec::JournalSlotHeader header;
+    const uint8_t * pData = nullptr;
+    if (!ReadSlot(eeprom, sequence % JOURNAL_NUM_SLOTS, header, pData) || (header.m_Sequence != sequence))
+    {
+      continue;
+    }
+    numBlocks++;
+
+    uint16_t offset = 0U;
+    uint8_t recordSize = 0U;
+    while ((recordSize = DataLogCodec::DecodeRecord(state, &pData[offset], header.m_Length - offset, values)) != 0U)
+    {
+      offset += recordSize;
+
+      printf("%u", entry++);
+      for (unsigned field = 0U; field < DataLogCodec::NUM_FIELDS; field++)
+      {
+        printf(",%d", static_cast<int>(values[field]));
+      }
+      printf("\n");
+    }
+  }
+
+  fprintf(stderr, "%u entries in %u of %u journal blocks, newest sequence number %u.\n", entry, numBlocks, JOURNAL_NUM_SLOTS, newestSequence);
+  return 0;
+}
@@ -0,0 +1,376 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     RaceMain.cpp
+/// Author:   David Stalter
+///
+/// Details:  Closed loop race simulator for the soap box derby car.  The real
+///           sketch is booted (and calibrated) once against the car model at
+///           the top of the hill.  Every run is then forked from that booted
+///           state, given its own randomized car imperfections, switched to
+///           autonomous and released down the hill.  Each run reports its
+///           time to finish and lateral drift, and the totals are summarized
+///           at the end.
+///
+///           Runs are deterministic: the same seed and options always give the
+///           same results, so two firmware builds can be compared directly.
+///
+/// Usage:    SoapBoxDerbyCarRaceSim [options]
+///             -n runs       number of runs (default 1000)
+///             -j jobs       runs in parallel (default: number of CPUs)
+///             -s seed       base random seed (default 1)
+///             -l feet       hill length (default 600)
+///             -g percent    hill grade (default 5)
+///             -w feet       lane width (default 10)
+///             -a degrees    steering alignment error std. dev. (default 0.25)
+///             -h degrees    initial heading error std. dev. (default 0.5)
+///             -d percent    wheel diameter error std. dev. (default 0.3)
+///             -v            print every run (CSV)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <math.h>                     // for sqrt, log, cos
+#include <stdio.h>                    // for printf
+#include <stdlib.h>                   // for atoi/atof
+#include <time.h>                     // for wall clock measurement
+#include <unistd.h>                   // for fork/pipe/getopt
+#include <sys/wait.h>                 // for wait
+#include "HostHal.hpp"                // for simulated hardware control
+#include "CarSimulator.hpp"           // for the car model
+#include "RcTransmitter.hpp"          // for the controller
+#include "SoapBoxDerbyCar.hpp"        // for the car class
+
+// Sketch entry point (SoapBoxDerbyCar.ino)
+void setup();
+
+namespace
+{
+  // Mirrored from SoapBoxDerbyCar.hpp
+  const uint8_t AUTONOMOUS_SWITCH_PIN = 44;
+
+  // Time from autonomous being switched on to the gate dropping
+  const uint64_t GATE_DELAY_US = 500000ULL;
+
+  // Give up on a run that has not ended after this long
+  const uint64_t MAX_RUN_TIME_US = 180000000ULL;
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Struct: RunOptions/RunResult
+  ///
+  /// Details:  Run configuration, and what a run sends back to the parent.
+  //////////////////////////////////////////////////////////////////////////////
+  struct RunOptions
+  {
+    CarSimulator::Parameters m_Parameters;
+    double m_AlignmentSigmaDegrees;
+    double m_HeadingSigmaDegrees;
+    double m_WheelSigmaPercent;
+    unsigned m_BaseSeed;
+  };
+
+  struct RunResult
+  {
+    int m_RunIndex;
+    bool m_bFinished;
+    bool m_bOffCourse;
+    double m_TimeSec;
+    double m_FinalOffsetInches;
+    double m_MaxOffsetInches;
+    double m_DistanceFeet;
+    double m_AlignmentDegrees;
+    double m_HeadingDegrees;
+  };
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Class: RunRandom
+  ///
+  /// Details:  Small deterministic generator for the per-run imperfections.
+  //////////////////////////////////////////////////////////////////////////////
+  class RunRandom
+  {
+  public:
+    explicit RunRandom(uint32_t seed) : m_State((seed != 0U) ? seed : 1U)
+    {
+      // Mix the seed so consecutive run numbers diverge right away
+      for (int i = 0; i < 8; i++)
+      {
+        Next();
+      }
+    }
+
+    inline uint32_t Next()
+    {
+      m_State ^= m_State << 13;
+      m_State ^= m_State >> 17;
+      m_State ^= m_State << 5;
+      return m_State;
+    }
+
+    // Normally distributed (Box-Muller)
+    inline double Gaussian(double sigma)
+    {
+      double u1 = (Next() + 1.0) / 4294967297.0;
+      double u2 = (Next() + 1.0) / 4294967297.0;
+      return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+    }
+
+  private:
+    uint32_t m_State;
+  };
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: GetWallTimeSec
+  ///
+  /// Details:  Monotonic wall clock time (the runs happen in other processes,
+  ///           so CPU time of this one means nothing).
+  //////////////////////////////////////////////////////////////////////////////
+  double GetWallTimeSec()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (now.tv_nsec / 1000000000.0);
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ReleaseCallback
+  ///
+  /// Details:  Drops the starting gate.
+  //////////////////////////////////////////////////////////////////////////////
+  void ReleaseCallback(void * pContext)
+  {
+    static_cast<CarSimulator *>(pContext)->Release();
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: EndOfRunCallback
+  ///
+  /// Details:  Watches for the end of the run and flips the autonomous switch
+  ///           off so the sketch leaves AutonomousRoutine() and Run() returns.
+  //////////////////////////////////////////////////////////////////////////////
+  void EndOfRunCallback(void * pContext)
+  {
+    CarSimulator * pCar = static_cast<CarSimulator *>(pContext);
+    if (pCar->IsRunOver())
+    {
+      HostHal::SetDigitalInput(AUTONOMOUS_SWITCH_PIN, false);
+    }
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ExecuteRun
+  ///
+  /// Details:  Runs one trip down the hill from the booted state and writes
+  ///           the result to the pipe.  Called in a forked child.
+  //////////////////////////////////////////////////////////////////////////////
+  void ExecuteRun(int runIndex, const RunOptions & rOptions, CarSimulator & rCar, int resultFd)
+  {
+    RunRandom random(rOptions.m_BaseSeed * 1000003U + static_cast<uint32_t>(runIndex));
+
+    CarSimulator::Parameters parameters = rOptions.m_Parameters;
+    parameters.m_SteeringAlignmentDegrees = random.Gaussian(rOptions.m_AlignmentSigmaDegrees);
+    parameters.m_InitialHeadingDegrees = random.Gaussian(rOptions.m_HeadingSigmaDegrees);
+    parameters.m_LeftWheelScale = 1.0 + (random.Gaussian(rOptions.m_WheelSigmaPercent) / 100.0);
+    parameters.m_RightWheelScale = 1.0 + (random.Gaussian(rOptions.m_WheelSigmaPercent) / 100.0);
+    parameters.m_Seed = random.Next();
+    rCar.SetParameters(parameters);
+
+    // Autonomous on, then the gate drops
+    HostHal::SetDigitalInput(AUTONOMOUS_SWITCH_PIN, true);
+    HostHal::ScheduleCallback(HostHal::GetTimeUs() + GATE_DELAY_US, ReleaseCallback, &rCar);
+    HostHal::AddPeriodicCallback(1000UL, EndOfRunCallback, &rCar);
+
+    uint64_t endTimeUs = HostHal::GetTimeUs() + MAX_RUN_TIME_US;
+    while (!rCar.IsRunOver() && (HostHal::GetTimeUs() < endTimeUs))
+    {
+      SoapBoxDerbyCar::GetSingletonInstance()->Run();
+      HostHal::AdvanceTimeUs(HostHal::RUN_PASS_COST_US);
+    HostHal::AdvanceTimeUs(HostHal::RUN_PASS_COST_US);
+    }
+
+    RunResult result;
+    result.m_RunIndex = runIndex;
+    result.m_bFinished = rCar.IsFinished();
+    result.m_bOffCourse = rCar.IsOffCourse();
+    result.m_TimeSec = rCar.GetElapsedSec();
+    result.m_FinalOffsetInches = rCar.GetLateralOffsetInches();
+    result.m_MaxOffsetInches = rCar.GetMaxLateralOffsetInches();
+    result.m_DistanceFeet = rCar.GetDistanceFeet();
+    result.m_AlignmentDegrees = parameters.m_SteeringAlignmentDegrees;
+    result.m_HeadingDegrees = parameters.m_InitialHeadingDegrees;
+
+    // Results are far smaller than PIPE_BUF, so writes from children never interleave
+    ssize_t written = write(resultFd, &result, sizeof(result));
+    _exit((written == static_cast<ssize_t>(sizeof(result))) ? 0 : 1);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Race simulator entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  RunOptions options;
+  options.m_Parameters = CarSimulator::GetDefaultParameters();
+  options.m_AlignmentSigmaDegrees = 0.25;
+  options.m_HeadingSigmaDegrees = 0.5;
+  options.m_WheelSigmaPercent = 0.3;
+  options.m_BaseSeed = 1U;
+
+  int numRuns = 1000;
+  long numJobs = sysconf(_SC_NPROCESSORS_ONLN);
+  bool bVerbose = false;
+
+  int option = 0;
+  while ((option = getopt(argc, argv, "n:j:s:l:g:w:a:h:d:v")) != -1)
+  {
+    switch (option)
+    {
+      case 'n': numRuns = atoi(optarg); break;
+      case 'j': numJobs = atol(optarg); break;
+      case 's': options.m_BaseSeed = static_cast<unsigned>(atol(optarg)); break;
+      case 'l': options.m_Parameters.m_HillLengthFeet = atof(optarg); break;
+      case 'g': options.m_Parameters.m_HillGradePercent = atof(optarg); break;
+      case 'w': options.m_Parameters.m_LaneWidthFeet = atof(optarg); break;
+      case 'a': options.m_AlignmentSigmaDegrees = atof(optarg); break;
+      case 'h': options.m_HeadingSigmaDegrees = atof(optarg); break;
+      case 'd': options.m_WheelSigmaPercent = atof(optarg); break;
+      case 'v': bVerbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-n runs] [-j jobs] [-s seed] [-l feet] [-g percent] [-w feet] [-a deg] [-h deg] [-d percent] [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (numJobs < 1)
+  {
+    numJobs = 1;
+  }
+
+  // Boot once with the car held at the gate, manual mode, transmitter on
+  static CarSimulator car(options.m_Parameters);
+  static RcTransmitter transmitter;
+  HostHal::SetDigitalInput(AUTONOMOUS_SWITCH_PIN, false);
+  car.Attach();
+  transmitter.Attach();
+
+  double wallStartSec = GetWallTimeSec();
+  setup();
+  printf("Boot (calibration) time: %.3f s simulated\n", HostHal::GetTimeUs() / 1000000.0);
+
+  // Flush before forking so buffered output isn't duplicated in every child
+  fflush(stdout);
+
+  int resultPipe[2];
+  if (pipe(resultPipe) != 0)
+  {
+    perror("pipe");
+    return 1;
+  }
+
+  if (bVerbose)
+  {
+    printf("run,finished,off_course,time_s,final_offset_in,max_offset_in,distance_ft,alignment_deg,heading_deg\n");
+  }
+
+  int launched = 0;
+  int running = 0;
+  int crashed = 0;
+  int finished = 0;
+  int offCourse = 0;
+  double timeSum = 0.0;
+  double timeMin = 1.0e9;
+  double timeMax = 0.0;
+  double offsetSquareSum = 0.0;
+  double offsetAbsMax = 0.0;
+  double maxOffsetSum = 0.0;
+  int numResults = 0;
+
+  double runsStartSec = GetWallTimeSec();
+  while ((launched < numRuns) || (running > 0))
+  {
+    while ((launched < numRuns) && (running < numJobs))
+    {
+      pid_t pid = fork();
+      if (pid == 0)
+      {
+        close(resultPipe[0]);
+        ExecuteRun(launched, options, car, resultPipe[1]);
+      }
+      else if (pid < 0)
+      {
+        perror("fork");
+        return 1;
+      }
+      launched++;
+      running++;
+    }
+
+    int status = 0;
+    if (wait(&status) <= 0)
+    {
+      break;
+    }
+    running--;
+
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+      crashed++;
+      continue;
+    }
+
+    RunResult result;
+    if (read(resultPipe[0], &result, sizeof(result)) != static_cast<ssize_t>(sizeof(result)))
+    {
+      crashed++;
+      continue;
+    }
+
+    numResults++;
+    maxOffsetSum += result.m_MaxOffsetInches;
+    if (result.m_bFinished)
+    {
+      finished++;
+      timeSum += result.m_TimeSec;
+      timeMin = fmin(timeMin, result.m_TimeSec);
+      timeMax = fmax(timeMax, result.m_TimeSec);
+      offsetSquareSum += result.m_FinalOffsetInches * result.m_FinalOffsetInches;
+      offsetAbsMax = fmax(offsetAbsMax, fabs(result.m_FinalOffsetInches));
+    }
+    if (result.m_bOffCourse)
+    {
+      offCourse++;
+    }
+
+    if (bVerbose)
+    {
+      printf("%d,%d,%d,%.4f,%.2f,%.2f,%.1f,%.3f,%.3f\n", result.m_RunIndex, result.m_bFinished, result.m_bOffCourse,
+             result.m_TimeSec, result.m_FinalOffsetInches, result.m_MaxOffsetInches, result.m_DistanceFeet,
+             result.m_AlignmentDegrees, result.m_HeadingDegrees);
+    }
+  }
+  double wallEndSec = GetWallTimeSec();
+
+  printf("Runs:                    %d (%d finished, %d off course, %d did not finish, %d crashed)\n",
+         numRuns, finished, offCourse, numResults - finished - offCourse, crashed);
+  if (finished > 0)
+  {
+    printf("Time to finish (s):      min %.3f / avg %.3f / max %.3f\n", timeMin, timeSum / finished, timeMax);
+    printf("Drift at finish (in):    rms %.2f / max %.2f\n", sqrt(offsetSquareSum / finished), offsetAbsMax);
+  }
+  if (numResults > 0)
+  {
+    printf("Max drift per run (in):  avg %.2f\n", maxOffsetSum / numResults);
+  }
+  printf("Wall time:               %.3f s boot, %.3f s runs (%.0f runs/minute)\n",
+         runsStartSec - wallStartSec, wallEndSec - runsStartSec,
+         (wallEndSec > runsStartSec) ? (60.0 * numRuns / (wallEndSec - runsStartSec)) : 0.0);
+
+  return ((crashed == 0) && (numResults == numRuns)) ? 0 : 1;
+}
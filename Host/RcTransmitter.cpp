@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     RcTransmitter.cpp
+/// Author:   David Stalter
+///
+/// Details:  Implementation of the simulated RC transmitter and receiver.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "RcTransmitter.hpp"          // for class declaration
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RcTransmitter
+///
+/// Details:  Starts with the transmitter on, the sticks centered, the brake
+///           switch off and master enable on.
+////////////////////////////////////////////////////////////////////////////////
+RcTransmitter::RcTransmitter() :
+  m_ChannelPulsesUs(),
+  m_bOn(true),
+  m_CurrentChannel(0)
+{
+  for (int channel = 1; channel <= NUM_CHANNELS; channel++)
+  {
+    SetChannelPulseUs(channel, STICK_NEUTRAL_US);
+  }
+  SetChannelPulseUs(YAW_CHANNEL, STEERING_NEUTRAL_US);
+  SetChannelPulseUs(BRAKE_CHANNEL, SWITCH_OFF_US);
+  SetChannelPulseUs(MASTER_ENABLE_CHANNEL, SWITCH_ON_US);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: Attach
+///
+/// Details:  Starts the receiver frames on the virtual clock.
+////////////////////////////////////////////////////////////////////////////////
+void RcTransmitter::Attach()
+{
+  HostHal::AddPeriodicCallback(FRAME_PERIOD_US, FrameCallback, this);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: FrameCallback
+///
+/// Details:  Starts a receiver frame, if the transmitter is on.
+////////////////////////////////////////////////////////////////////////////////
+void RcTransmitter::FrameCallback(void * pContext)
+{
+  RcTransmitter * pTransmitter = static_cast<RcTransmitter *>(pContext);
+  if (pTransmitter->m_bOn)
+  {
+    pTransmitter->m_CurrentChannel = 0;
+    ChannelStartCallback(pContext);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ChannelStartCallback
+///
+/// Details:  Raises the current channel output for its pulse width.
+////////////////////////////////////////////////////////////////////////////////
+void RcTransmitter::ChannelStartCallback(void * pContext)
+{
+  RcTransmitter * pTransmitter = static_cast<RcTransmitter *>(pContext);
+  HostHal::SetDigitalInput(CH1_INPUT_PIN + pTransmitter->m_CurrentChannel, true);
+  HostHal::ScheduleCallback(HostHal::GetTimeUs() + pTransmitter->m_ChannelPulsesUs[pTransmitter->m_CurrentChannel], ChannelEndCallback, pContext);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ChannelEndCallback
+///
+/// Details:  Ends the current channel pulse and starts the next one after a
+///           short gap.
+////////////////////////////////////////////////////////////////////////////////
+void RcTransmitter::ChannelEndCallback(void * pContext)
+{
+  RcTransmitter * pTransmitter = static_cast<RcTransmitter *>(pContext);
+  HostHal::SetDigitalInput(CH1_INPUT_PIN + pTransmitter->m_CurrentChannel, false);
+  if (++pTransmitter->m_CurrentChannel < NUM_CHANNELS)
+  {
+    HostHal::ScheduleCallback(HostHal::GetTimeUs() + CHANNEL_GAP_US, ChannelStartCallback, pContext);
+  }
+}
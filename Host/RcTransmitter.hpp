@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     RcTransmitter.hpp
+/// Author:   David Stalter
+///
+/// Details:  Simulated RC transmitter and receiver for the host build.  The
+///           receiver outputs one pulse per channel, in sequence, every frame
+///           on the controller input pins, the same way the real receiver
+///           walks its outputs.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef RCTRANSMITTER_HPP
+#define RCTRANSMITTER_HPP
+
+// INCLUDES
+#include "HostHal.hpp"                // for simulated hardware control
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class: RcTransmitter
+///
+/// Details:  Holds the stick/switch positions (as pulse widths) and drives
+///           the receiver output pins from the virtual clock.
+////////////////////////////////////////////////////////////////////////////////
+class RcTransmitter
+{
+public:
+  // Channel numbers match the sketch (1 based)
+  static const int NUM_CHANNELS             = 6;
+  static const int YAW_CHANNEL              = 1;
+  static const int RECALIBRATE_CHANNEL      = 4;
+  static const int BRAKE_CHANNEL            = 5;
+  static const int MASTER_ENABLE_CHANNEL    = 6;
+
+  // Common pulse widths
+  static const int STEERING_NEUTRAL_US      = 1490;
+  static const int STICK_NEUTRAL_US         = 1500;
+  static const int SWITCH_OFF_US            = 1000;
+  static const int SWITCH_ON_US             = 1900;
+
+  RcTransmitter();
+
+  // Starts generating receiver frames
+  void Attach();
+
+  inline void SetOn(bool bOn) { m_bOn = bOn; }
+  inline bool IsOn() const { return m_bOn; }
+  inline void SetChannelPulseUs(int channel, int pulseUs) { m_ChannelPulsesUs[channel - 1] = pulseUs; }
+  inline int GetChannelPulseUs(int channel) const { return m_ChannelPulsesUs[channel - 1]; }
+
+private:
+  static void FrameCallback(void * pContext);
+  static void ChannelStartCallback(void * pContext);
+  static void ChannelEndCallback(void * pContext);
+
+  static const uint8_t        CH1_INPUT_PIN       = 62;     // Mirrored from SoapBoxDerbyCar.hpp
+  static const unsigned long  FRAME_PERIOD_US     = 20000;
+  static const unsigned long  CHANNEL_GAP_US      = 500;
+
+  int m_ChannelPulsesUs[NUM_CHANNELS];
+  bool m_bOn;
+  int m_CurrentChannel;
+};
+
+#endif // RCTRANSMITTER_HPP
@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     TelemetryReceiver.cpp
+/// Author:   David Stalter
+///
+/// Details:  Host stand-in for the Raspberry Pi end of the car's telemetry
+///           link.  Reads the binary frames the car sends on Serial3 from a
+///           serial device, a file (such as a SoapBoxDerbyCarHost -t
+///           capture) or stdin, decodes them with the same protocol header
+///           as the sketch and prints each car state frame as CSV.  Memory
+///           usage frames and the link statistics at the end go to stderr.
+///
+///           A serial device is set to raw 115200 8N1 and sent any requests
+///           given first.  It is read until interrupted (Ctrl-C).
+///
+/// Usage:    SoapBoxDerbyCarTelemetryReceiver [-r rate] [-m] [source]
+///             -r        stream rate in Hz to request (serial devices only)
+///             -m        request the car's memory usage (serial devices only)
+///             source    serial device or capture file (default: stdin)
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include <fcntl.h>                    // for open
+#include <signal.h>                   // for SIGINT handling
+#include <stdio.h>                    // for printf
+#include <stdlib.h>                   // for atoi
+#include <string.h>                   // for strcmp
+#include <termios.h>                  // for serial port setup
+#include <unistd.h>                   // for read/write
+#include "TelemetryProtocol.hpp"      // for the frame format
+
+namespace
+{
+  const char * const FIELD_NAMES[TelemetryProtocol::NUM_CAR_STATE_FIELDS] =
+  {
+    "time_ms", "flags", "steering", "left_hall", "right_hall", "pot", "pose_x_q8", "pose_y_q8", "heading_q8", "target_clicks", "wall_in"
+  };
+
+  volatile sig_atomic_t g_bStop = 0;
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: HandleSignal
+  ///
+  /// Details:  Stops the read loop so the statistics still get printed.
+  //////////////////////////////////////////////////////////////////////////////
+  void HandleSignal(int signal)
+  {
+    g_bStop = 1;
+  }
+
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// Function: ConfigureSerialDevice
+  ///
+  /// Details:  Puts a tty in raw mode at the car's baud rate.  Returns false
+  ///           if it could not be configured.
+  //////////////////////////////////////////////////////////////////////////////
+  bool ConfigureSerialDevice(int fd)
+  {
+    struct termios settings;
+    if (tcgetattr(fd, &settings) != 0)
+    {
+      return false;
+    }
+
+    cfmakeraw(&settings);
+    cfsetispeed(&settings, B115200);
+    cfsetospeed(&settings, B115200);
+    settings.c_cflag |= CLOCAL | CREAD;
+    settings.c_cc[VMIN] = 1;
+    settings.c_cc[VTIME] = 0;
+
+    return (tcsetattr(fd, TCSANOW, &settings) == 0);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Function: main
+///
+/// Details:  Telemetry receiver entry point.
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+  int requestRateHz = -1;
+  bool bRequestMemoryUsage = false;
+  const char * pSource = nullptr;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-r") == 0) && ((i + 1) < argc))
+    {
+      requestRateHz = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-m") == 0)
+    {
+      bRequestMemoryUsage = true;
+    }
+    else
+    {
+      pSource = argv[i];
+    }
+  }
+
+  int fd = STDIN_FILENO;
+  if (pSource != nullptr)
+  {
+    fd = open(pSource, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+      fd = open(pSource, O_RDONLY);
+    }
+    if (fd < 0)
+    {
+      perror(pSource);
+      return 1;
+    }
+  }
+
+  if (isatty(fd))
+  {
+    if (!ConfigureSerialDevice(fd))
+    {
+      perror("tcsetattr");
+      return 1;
+    }
+
+    if (requestRateHz >= 0)
+    {
+      char request[16];
+      int length = snprintf(request, sizeof(request), "ps%d\n", requestRateHz);
+      if (write(fd, request, static_cast<size_t>(length)) != length)
+      {
+        perror("write");
+        return 1;
+      }
+    }
+
+    if (bRequestMemoryUsage)
+    {
+      const char REQUEST[] = "pm\n";
+      if (write(fd, REQUEST, sizeof(REQUEST) - 1U) != static_cast<ssize_t>(sizeof(REQUEST) - 1U))
+      {
+        perror("write");
+        return 1;
+      }
+    }
+  }
+
+  signal(SIGINT, HandleSignal);
+
+  printf("seq");
+  for (unsigned field = 0U; field < TelemetryProtocol::NUM_CAR_STATE_FIELDS; field++)
+  {
+    printf(",%s", FIELD_NAMES[field]);
+  }
+  printf("\n");
+
+  TelemetryDecoder decoder;
+  unsigned long numOtherFrames = 0UL;
+  uint8_t buffer[256];
+  ssize_t numBytes = 0;
+  while ((g_bStop == 0) && ((numBytes = read(fd, buffer, sizeof(buffer))) > 0))
+  {
+    for (ssize_t i = 0; i < numBytes; i++)
+    {
+      if (!decoder.ProcessByte(buffer[i]))
+      {
+        continue;
+      }
+
+      int32_t fields[TelemetryProtocol::NUM_CAR_STATE_FIELDS];
+      if ((decoder.GetType() == TelemetryProtocol::MEMORY_USAGE_FRAME) &&
+          (decoder.GetFields(fields, TelemetryProtocol::NUM_MEMORY_USAGE_FIELDS) == TelemetryProtocol::NUM_MEMORY_USAGE_FIELDS))
+      {
+        fprintf(stderr, "Memory (bytes): static data %d, heap/high-water %d/%d, max stack %d, free/min free %d/%d\n",
+                static_cast<int>(fields[TelemetryProtocol::STATIC_DATA_BYTES]),
+                static_cast<int>(fields[TelemetryProtocol::HEAP_BYTES]),
+                static_cast<int>(fields[TelemetryProtocol::HEAP_HIGH_WATER_BYTES]),
+                static_cast<int>(fields[TelemetryProtocol::MAX_STACK_BYTES]),
+                static_cast<int>(fields[TelemetryProtocol::FREE_BYTES]),
+                static_cast<int>(fields[TelemetryProtocol::MIN_FREE_BYTES]));
+        continue;
+      }
+
+      if ((decoder.GetType() != TelemetryProtocol::CAR_STATE_FRAME) ||
+          (decoder.GetFields(fields, TelemetryProtocol::NUM_CAR_STATE_FIELDS) != TelemetryProtocol::NUM_CAR_STATE_FIELDS))
+      {
+        numOtherFrames++;
+        continue;
+      }
+
+      printf("%u", decoder.GetSequence());
+      for (unsigned field = 0U; field < TelemetryProtocol::NUM_CAR_STATE_FIELDS; field++)
+      {
+        printf(",%d", static_cast<int>(fields[field]));
+      }
+      printf("\n");
+    }
+    fflush(stdout);
+  }
+
+  if (fd != STDIN_FILENO)
+  {
+    close(fd);
+  }
+
+  fprintf(stderr, "Frames: %lu, other/malformed: %lu, missed: %lu, CRC errors: %lu, bytes skipped: %lu\n",
+          decoder.GetNumFrames(), numOtherFrames, decoder.GetNumMissedFrames(), decoder.GetNumCrcErrors(), decoder.GetNumSkippedBytes());
+
+  return ((decoder.GetNumFrames() > 0UL) && (decoder.GetNumCrcErrors() == 0UL)) ? 0 : 1;
+}
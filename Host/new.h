@@ -0,0 +1,17 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     new.h
+/// Author:   David Stalter
+///
+/// Details:  Host (Linux) stand in for the Arduino core's new.h, which is
+///           where the Mega gets placement new from.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HOST_NEW_H
+#define HOST_NEW_H
+
+// INCLUDES
+#include <new>                        // for placement new
+
+#endif // HOST_NEW_H
@@ -25,7 +25,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 bool SoapBoxDerbyCar::IsAutonomousSwitchSet()
 {
-  return (digitalRead(AUTONOMOUS_SWITCH_PIN) == 1);
+  return DigitalPin<AUTONOMOUS_SWITCH_PIN>::Read();
 }
 
 
@@ -40,16 +40,21 @@ void SoapBoxDerbyCar::AutonomousRoutine()
 
   // Give a visual indication that the car is ready to begin
   // autonomous (i.e. the wheels start moving).
-  digitalWrite(AUTONOMOUS_READY_LED_PIN, HIGH);
+  DigitalPin<AUTONOMOUS_READY_LED_PIN>::SetHigh();
   
   // Reset the hall sensor encoders for this autonomous run
   ResetHallSensorCounts();
+  ReadPotentiometers();
+  ResetSteeringController();
 
   // Autonomous truly starts when the wheels start moving
   while ((m_LeftHallCount < AUTO_HALL_SENSOR_LAUNCH_COUNT) && (m_RightHallCount < AUTO_HALL_SENSOR_LAUNCH_COUNT))
   {
     // Update the status light
     BlinkStatusLight();
+
+    // Keep the pre-trigger samples coming for the launch
+    UpdateFlightRecorder();
     
     // Watch for autonomous to be cancelled
     if (!IsAutonomousSwitchSet())
@@ -65,10 +70,12 @@ void SoapBoxDerbyCar::AutonomousRoutine()
   // Indicate autonomous is executing, in case any logic
   // elsewhere with the sensors/motor controllers cares.
   m_bIsAutonomousExecuting = true;
-  digitalWrite(AUTONOMOUS_EXECUTING_LED_PIN, HIGH);
+  DigitalPin<AUTONOMOUS_EXECUTING_LED_PIN>::SetHigh();
+  TriggerFlightRecorder(FLIGHT_RECORDER_AUTONOMOUS_LAUNCH);
   
   // Execute only for as long as autonomous is allowed
   unsigned long autonomousStartTimeMs = GetTimeStampMs();
+  unsigned long lastLogTimeStampMs = autonomousStartTimeMs;
   while (CalcDeltaTimeMs(autonomousStartTimeMs) < AUTO_MAX_LENGTH_MS)
   {
     // Update the status light
@@ -85,28 +92,29 @@ void SoapBoxDerbyCar::AutonomousRoutine()
     // Hall sensors are interrupt driven.
     ReadLimitSwitches();
     ReadPotentiometers();
+    ReadSonarSensors();
     
-    // PID to try and control driving.
-    
-    // If the left side is reading ahead, the car is drifting
-    // right and we need to turn back left.
-    if (m_LeftHallCount >= (m_RightHallCount + AUTO_HALL_SENSOR_COUNT_MAX_DIFF))
-    {
-      SetSteeringSpeedControllerValue(AUTO_TURN_LEFT_SPEED);
-    }
-    // If the right side is reading ahead, the car is drifting
-    // left and we need to turn back right.
-    else if (m_RightHallCount >= (m_LeftHallCount + AUTO_HALL_SENSOR_COUNT_MAX_DIFF))
-    {
-      SetSteeringSpeedControllerValue(AUTO_TURN_RIGHT_SPEED);
-    }
-    // Tracking equally, no steering adjustment needed.
-    else
+    // PID to try and control driving (runs at a fixed rate internally)
+    UpdateSteeringController();
+
+    // The scheduler is not running during autonomous, so pace the log here
+    if (CalcDeltaTimeMs(lastLogTimeStampMs) >= DATA_LOG_ENTRY_INTERVAL_MS)
     {
-      CenterSteeringByPotentiometer();
+      LogData(CalcDeltaTimeMs(autonomousStartTimeMs));
+      lastLogTimeStampMs = GetTimeStampMs();
     }
 
-    LogData(CalcDeltaTimeMs(autonomousStartTimeMs));
+    // Copy the log to EEPROM a byte at a time as it fills
+    UpdateDataLogJournal();
+
+    // Flight recorder samples and snapshot saves (paced internally)
+    UpdateFlightRecorder();
+
+    // Keep the car data stream going (paced internally)
+    TransmitCarDataIfRequested();
+
+    // Send debug messages when the console has room
+    DrainDebugLog();
   } // End main autonomous while loop
 
   // Perform common autonomous completion activities
@@ -125,22 +133,30 @@ void SoapBoxDerbyCar::ExitAutonomous()
 {
   Serial.println(F("Autonomous: Exiting..."));
 
+  // Ahead of the brake, so the snapshot is for the exit (only a run that
+  // launched has one; cancelling from ready is not an exit)
+  if (m_bIsAutonomousExecuting)
+  {
+    TriggerFlightRecorder(FLIGHT_RECORDER_AUTONOMOUS_EXIT);
+  }
+
   // Apply the brake
   ApplyBrake();
   
   // Stop the motors
   SetSteeringSpeedControllerValue(OFF);
   
-  // Reset the Hall sensor counters
-  ResetHallSensorCounts();
+  // The Hall sensor counts are left alone: the post-trigger samples are
+  // still being recorded, and the next launch resets them
   
   // Autonomous is no longer executing
   m_bIsAutonomousExecuting = false;
-  digitalWrite(AUTONOMOUS_READY_LED_PIN, LOW);
-  digitalWrite(AUTONOMOUS_EXECUTING_LED_PIN, LOW);
+  DigitalPin<AUTONOMOUS_READY_LED_PIN>::SetLow();
+  DigitalPin<AUTONOMOUS_EXECUTING_LED_PIN>::SetLow();
 
-  // Write the logged data values to EEPROM
-  //WriteLogToEeprom(true);
+  // Write the logged data values to EEPROM (the journal
+  // commit finishes in the loop below)
+  WriteLogToEeprom(true);
   
   // Let autonomous only execute once until the
   // switch is flipped back to manual control
@@ -148,6 +164,9 @@ void SoapBoxDerbyCar::ExitAutonomous()
   {
     // Update the status light
     BlinkStatusLight();
+    UpdateDataLogJournal();
+    UpdateFlightRecorder();
+    DrainDebugLog();
   }
 
   Serial.println(F("Autonomous: Entering manual control from auto."));
@@ -25,11 +25,17 @@
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ApplyBrake()
 {
+  // Only the brake dropping is an event, not holding it down
+  if (!m_bBrakeApplied)
+  {
+    TriggerFlightRecorder(FLIGHT_RECORDER_BRAKE);
+  }
+
   // Turn off the relay to the magnet to drop the brake
-  digitalWrite(BRAKE_MAGNET_RELAY_PIN, LOW);
+  DigitalPin<BRAKE_MAGNET_RELAY_PIN>::SetLow();
 
   // Give a visual indication of the magnetic field state
-  digitalWrite(BRAKE_MAGNET_RELAY_LED_PIN, LOW);
+  DigitalPin<BRAKE_MAGNET_RELAY_LED_PIN>::SetLow();
   
   // Indicate the brake has been applied so calls to release it
   // properly complete.
@@ -45,10 +51,10 @@ void SoapBoxDerbyCar::ApplyBrake()
 void SoapBoxDerbyCar::ArmBrake()
 {
   // Turn the relay on to apply a magnetic field and hold the brake up
-  digitalWrite(BRAKE_MAGNET_RELAY_PIN, HIGH);
+  DigitalPin<BRAKE_MAGNET_RELAY_PIN>::SetHigh();
 
   // Give a visual indication of the magnetic field state
-  digitalWrite(BRAKE_MAGNET_RELAY_LED_PIN, HIGH);
+  DigitalPin<BRAKE_MAGNET_RELAY_LED_PIN>::SetHigh();
   
   // Indicate the brake has not been applied so calls to apply it
   // properly complete.
@@ -13,6 +13,12 @@
 ///       5. SWA
 ///       6. SWD
 ///
+///       The receiver outputs are captured in the background by a pin change
+///       interrupt on port K.  Each edge is timestamped, and the most recent
+///       pulse width and the time it completed are published per channel.
+///       Reading the controller only copies those values out, so it never
+///       blocks waiting on a pulse the way pulseIn() does.
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -20,12 +26,25 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+volatile uint16_t       SoapBoxDerbyCar::m_ControllerPulseWidthUs[NUM_CONTROLLER_INPUT_CHANNELS + 1]      = {};
+volatile unsigned long  SoapBoxDerbyCar::m_ControllerPulseTimeStampUs[NUM_CONTROLLER_INPUT_CHANNELS + 1]  = {};
+unsigned long           SoapBoxDerbyCar::m_ControllerPulseStartUs[NUM_CONTROLLER_INPUT_CHANNELS + 1]      = {};
 
 // GLOBALS
 // (none)
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR(PCINT2_vect)
+///
+/// Details:  Pin change interrupt vector for port K (controller inputs).
+////////////////////////////////////////////////////////////////////////////////
+ISR(PCINT2_vect)
+{
+  SoapBoxDerbyCar::ControllerInputInterruptHandler();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ConfigureController
 ///
@@ -40,31 +59,74 @@ void SoapBoxDerbyCar::ConfigureController()
   pinMode(CH4_INPUT_PIN, INPUT);
   pinMode(CH5_INPUT_PIN, INPUT);
   pinMode(CH6_INPUT_PIN, INPUT);
+  
+  // Enable the pin change interrupts for the receiver channels.  The handler
+  // only touches static data, so it is safe to turn on before the singleton
+  // has finished being constructed.
+  PCMSK2 |= CONTROLLER_INPUT_PORT_MASK;
+  PCIFR = _BV(PCIF2);
+  PCICR |= _BV(PCIE2);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Method: IsControllerOn
+/// Method: ControllerInputInterruptHandler
 ///
-/// Details:  Checks all controller inputs and returns whether the controller
-///           is on.
+/// Details:  Interrupt handler for any edge on the controller input pins.  A
+///           rising edge starts a pulse and a falling edge completes it.
+///           Completed pulses outside the valid receiver range are dropped.
 ////////////////////////////////////////////////////////////////////////////////
-bool SoapBoxDerbyCar::IsControllerOn()
+void SoapBoxDerbyCar::ControllerInputInterruptHandler()
 {
-  bool bOn = false;
+  // See the Hall sensor handlers for notes on interrupt enabling.
+  // One vector is shared by the whole port, so figure out which
+  // pins actually changed since the last interrupt.
+  static uint8_t previousPinState = 0U;
   
-  // Loop over all the input channels
-  for (int i = 1; i <= NUM_CONTROLLER_INPUT_CHANNELS; i++)
+  unsigned long currentTimeUs = GetTimeStampUs();
+  uint8_t currentPinState = PINK & CONTROLLER_INPUT_PORT_MASK;
+  uint8_t changedPins = currentPinState ^ previousPinState;
+  previousPinState = currentPinState;
+
+  // Bit 'n' of the port is channel 'n + 1'
+  for (int channel = 1; changedPins != 0U; channel++)
   {
-    // If something sent a non-zero value, controller is on
-    if (m_ControllerChannelInputs[i] != 0)
+    uint8_t channelBit = _BV(channel - 1);
+    if ((changedPins & channelBit) == 0U)
     {
-      bOn = true;
-      break;
+      continue;
+    }
+    changedPins &= ~channelBit;
+
+    if ((currentPinState & channelBit) != 0U)
+    {
+      // Rising edge, a new pulse is starting
+      m_ControllerPulseStartUs[channel] = currentTimeUs;
+    }
+    else
+    {
+      // Falling edge, the pulse is complete
+      unsigned long pulseWidthUs = currentTimeUs - m_ControllerPulseStartUs[channel];
+      if ((pulseWidthUs >= CONTROLLER_MIN_VALID_PULSE_US) && (pulseWidthUs <= CONTROLLER_MAX_VALID_PULSE_US))
+      {
+        m_ControllerPulseWidthUs[channel] = static_cast<uint16_t>(pulseWidthUs);
+        m_ControllerPulseTimeStampUs[channel] = currentTimeUs;
+      }
     }
   }
-  
-  return bOn;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: IsControllerOn
+///
+/// Details:  Checks the controller input signal state and returns whether the
+///           controller is on.  Every channel the car relies on must have a
+///           live signal.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::IsControllerOn()
+{
+  return ((m_ControllerSignalLostMask & CONTROLLER_REQUIRED_CHANNELS_MASK) == 0U);
 }
 
 
@@ -78,8 +140,8 @@ bool SoapBoxDerbyCar::IsRecalibrationRequested()
   const int RECALIBRATE_INPUT_CHANNEL_THRESHOLD = 1100;
   
   // Make sure the controller is on and the input stick was moved sufficiently far
-  if ((m_ControllerChannelInputs[RECALIBRATE_INPUT_CHANNEL] != 0)
-      &&(m_ControllerChannelInputs[RECALIBRATE_INPUT_CHANNEL] < RECALIBRATE_INPUT_CHANNEL_THRESHOLD))
+  if (!IsControllerChannelLost(RECALIBRATE_INPUT_CHANNEL)
+      && (m_ControllerChannelInputs[RECALIBRATE_INPUT_CHANNEL] < RECALIBRATE_INPUT_CHANNEL_THRESHOLD))
   {
     return true;
   }
@@ -90,20 +152,66 @@ bool SoapBoxDerbyCar::IsRecalibrationRequested()
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetControllerChannelAgeUs
+///
+/// Details:  Returns how long ago the last valid pulse on a channel completed.
+///           A channel that has never received a pulse reports the maximum
+///           value.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long SoapBoxDerbyCar::GetControllerChannelAgeUs(int channel)
+{
+  // The timestamp is multi-byte and written by the ISR
+  noInterrupts();
+  unsigned long pulseTimeStampUs = m_ControllerPulseTimeStampUs[channel];
+  uint16_t pulseWidthUs = m_ControllerPulseWidthUs[channel];
+  interrupts();
+
+  if (pulseWidthUs == 0U)
+  {
+    return ~0UL;
+  }
+  
+  return CalcDeltaTimeUs(pulseTimeStampUs);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ReadControllerInput
 ///
-/// Details:  Reads and stores all controller input values via pulseIn().
+/// Details:  Reads and stores all controller input values from the latest
+///           pulses captured by the pin change interrupt.  A channel whose
+///           last pulse is too old is marked as lost and reads as zero.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ReadControllerInput()
 {
-  // Pins 2,3,4 are currently not utilized
-  m_ControllerChannelInputs[YAW_INPUT_CHANNEL]            = pulseIn(CH1_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-  //m_ControllerChannelInputs[2]                            = pulseIn(CH2_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-  //m_ControllerChannelInputs[3]                            = pulseIn(CH3_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-  m_ControllerChannelInputs[RECALIBRATE_INPUT_CHANNEL]    = pulseIn(CH4_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-  m_ControllerChannelInputs[BRAKE_INPUT_CHANNEL]          = pulseIn(CH5_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-  m_ControllerChannelInputs[MASTER_ENABLE_INPUT_CHANNEL]  = pulseIn(CH6_INPUT_PIN, HIGH, PULSE_IN_TIMEOUT_US);
+  m_ControllerSignalLostMask = 0U;
+  
+  for (int channel = 1; channel <= NUM_CONTROLLER_INPUT_CHANNELS; channel++)
+  {
+    // The pulse is multi-byte and written by the ISR.  The age check and
+    // forgetting a stale pulse (so its age can't wrap back around to valid)
+    // are done together, so a pulse that completes in between is not lost.
+    noInterrupts();
+    uint16_t pulseWidthUs = m_ControllerPulseWidthUs[channel];
+    bool bSignalLost = (pulseWidthUs == 0U) ||
+                       (CalcDeltaTimeUs(m_ControllerPulseTimeStampUs[channel]) > CONTROLLER_SIGNAL_LOST_TIMEOUT_US);
+    if (bSignalLost)
+    {
+      m_ControllerPulseWidthUs[channel] = 0U;
+    }
+    interrupts();
+
+    if (bSignalLost)
+    {
+      m_ControllerSignalLostMask |= (1U << channel);
+      m_ControllerChannelInputs[channel] = 0;
+    }
+    else
+    {
+      m_ControllerChannelInputs[channel] = pulseWidthUs;
+    }
+  }
   
   // Inputs range from ~1000 (off) to ~1500 (on).
   // Pick a value approximately in the middle.
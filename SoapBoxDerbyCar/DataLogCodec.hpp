@@ -0,0 +1,377 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     DataLogCodec.hpp
+/// Author:   David Stalter
+///
+/// Details:  Compressed record format for the soap box derby car data log.
+///           Shared by the sketch (encoding and DisplayDataLog()) and the
+///           host log decoder, so it only depends on the standard integer
+///           types.
+///
+///           The log is a ring of fixed size blocks.  Each block starts with
+///           a keyframe holding every field in full, followed by delta
+///           records until the next record would not fit.  Unused bytes at
+///           the end of a block are END_TAG (0xFF, erased EEPROM), so any
+///           block can be decoded on its own and the oldest block can be
+///           overwritten once the ring is full.
+///
+///           Keyframe fields are zig-zag varints.  A delta record is a mask
+///           byte with one bit per field whose value differs from the
+///           prediction, followed by the zig-zag encoded differences packed
+///           into nibbles (high nibble first).  A difference that does not fit
+///           in a nibble is NIBBLE_ESCAPE followed by its varint bytes, two
+///           nibbles each.  Fields that grow steadily (time and distances) are
+///           predicted from the last value plus the last change, the rest
+///           from the last value alone.  At 20Hz a car rolling down the hill
+///           averages about three bytes per record.
+///
+///           Blocks are saved to an EEPROM journal of slots, each a
+///           JournalSlotHeader followed by the block.  The header holds the
+///           block's sequence number, how many of its bytes are saved and a
+///           CRC-16 over both and the data.  It is written after the data, so
+///           a slot torn by a power cut fails its CRC and is skipped.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DATALOGCODEC_HPP
+#define DATALOGCODEC_HPP
+
+// INCLUDES
+#include <stddef.h>                   // for offsetof
+#include <stdint.h>                   // for fixed width integer types
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  DataLogCodec
+///
+/// Details:  Encodes and decodes data log records.  All state lives in the
+///           caller's State, so one encoder and any number of decoders can be
+///           in use at once.
+////////////////////////////////////////////////////////////////////////////////
+class DataLogCodec
+{
+public:
+  // The fields of one log entry, in record order
+  enum Field
+  {
+    TIME_STAMP_MS,
+    LEFT_WHEEL_DISTANCE_INCHES,
+    RIGHT_WHEEL_DISTANCE_INCHES,
+    FRONT_AXLE_POTENTIOMETER,
+    POSE_X_INCHES,
+    POSE_Y_INCHES,
+    POSE_HEADING_CENTIDEGREES,
+    NUM_FIELDS
+  };
+
+  // Last record encoded or decoded, which the next one is predicted from
+  struct State
+  {
+    int32_t m_Values[NUM_FIELDS];
+    int32_t m_Deltas[NUM_FIELDS];
+  };
+
+  // Start of each EEPROM journal slot
+  struct JournalSlotHeader
+  {
+    uint16_t m_Sequence;
+    uint16_t m_Length;
+    uint16_t m_Crc;
+  };
+
+  static const uint8_t  KEYFRAME_TAG                = 0x80;
+  static const uint8_t  END_TAG                     = 0xFF;
+  static const uint8_t  MAX_VARINT_SIZE_BYTES       = 5;
+  static const uint8_t  NIBBLE_ESCAPE               = 0x0F;
+  static const uint8_t  MAX_RECORD_SIZE_BYTES       = 1 + (((NUM_FIELDS * (1 + (2 * MAX_VARINT_SIZE_BYTES))) + 1) / 2);
+  static const uint16_t BLOCK_SIZE_BYTES            = 128;
+  static const uint16_t JOURNAL_SLOT_SIZE_BYTES     = sizeof(JournalSlotHeader) + BLOCK_SIZE_BYTES;
+  static const uint16_t CRC_SEED                    = 0xFFFF;
+
+  // Fields predicted from the last value plus the last change
+  static const uint8_t  SECOND_ORDER_FIELDS         = (1U << TIME_STAMP_MS) |
+                                                      (1U << LEFT_WHEEL_DISTANCE_INCHES) |
+                                                      (1U << RIGHT_WHEEL_DISTANCE_INCHES) |
+                                                      (1U << POSE_X_INCHES);
+
+  static_assert(NUM_FIELDS < 8, "Delta record mask overlaps the tags!");
+  static_assert((1 + (NUM_FIELDS * MAX_VARINT_SIZE_BYTES)) <= MAX_RECORD_SIZE_BYTES, "Keyframe will not fit in a record!");
+  static_assert(MAX_RECORD_SIZE_BYTES <= BLOCK_SIZE_BYTES, "Record will not fit in a block!");
+
+  // Encodes one entry into pRecord (at least MAX_RECORD_SIZE_BYTES).  The
+  // state is not changed, so the caller can throw the record away if it does
+  // not fit.  Returns the number of bytes used.
+  static uint8_t EncodeRecord(const State & rState, const int32_t * pValues, bool bKeyframe, uint8_t * pRecord)
+  {
+    if (bKeyframe)
+    {
+      uint8_t * pNext = pRecord + 1;
+      *pRecord = KEYFRAME_TAG;
+      for (uint8_t field = 0U; field < NUM_FIELDS; field++)
+      {
+        pNext = WriteVarint(ZigZagEncode(pValues[field]), pNext);
+      }
+      return static_cast<uint8_t>(pNext - pRecord);
+    }
+
+    uint8_t * pNibbles = pRecord + 1;
+    uint8_t numNibbles = 0U;
+    uint8_t mask = 0U;
+    for (uint8_t field = 0U; field < NUM_FIELDS; field++)
+    {
+      int32_t residual = pValues[field] - Predict(rState, field);
+      if (residual == 0)
+      {
+        continue;
+      }
+
+      mask |= static_cast<uint8_t>(1U << field);
+      uint32_t zigZag = ZigZagEncode(residual);
+      if (zigZag < NIBBLE_ESCAPE)
+      {
+        PutNibble(pNibbles, numNibbles++, static_cast<uint8_t>(zigZag));
+      }
+      else
+      {
+        uint8_t varint[MAX_VARINT_SIZE_BYTES];
+        uint8_t varintSize = static_cast<uint8_t>(WriteVarint(zigZag, varint) - varint);
+        PutNibble(pNibbles, numNibbles++, NIBBLE_ESCAPE);
+        for (uint8_t i = 0U; i < varintSize; i++)
+        {
+          PutNibble(pNibbles, numNibbles++, varint[i] >> 4);
+          PutNibble(pNibbles, numNibbles++, varint[i] & 0x0FU);
+        }
+      }
+    }
+    *pRecord = mask;
+
+    return 1U + ((numNibbles + 1U) / 2U);
+  }
+
+  // Records an entry as the last one, after it has been encoded or decoded
+  static void UpdateState(State & rState, const int32_t * pValues, bool bKeyframe)
+  {
+    for (uint8_t field = 0U; field < NUM_FIELDS; field++)
+    {
+      // There is no change to predict from at a keyframe
+      rState.m_Deltas[field] = bKeyframe ? 0 : (pValues[field] - rState.m_Values[field]);
+      rState.m_Values[field] = pValues[field];
+    }
+  }
+
+  // Decodes one record of at most maxBytes into pValues and updates the
+  // state.  Returns the number of bytes used, or zero at the end of a block
+  // or if the record is corrupt.
+  static uint8_t DecodeRecord(State & rState, const uint8_t * pRecord, uint16_t maxBytes, int32_t * pValues)
+  {
+    if ((maxBytes == 0U) || (*pRecord == END_TAG))
+    {
+      return 0U;
+    }
+
+    if (*pRecord == KEYFRAME_TAG)
+    {
+      uint16_t offset = 1U;
+      for (uint8_t field = 0U; field < NUM_FIELDS; field++)
+      {
+        uint32_t zigZag = 0U;
+        uint8_t varintSize = ReadVarint(pRecord + offset, maxBytes - offset, zigZag);
+        if (varintSize == 0U)
+        {
+          return 0U;
+        }
+        offset += varintSize;
+        pValues[field] = ZigZagDecode(zigZag);
+      }
+
+      UpdateState(rState, pValues, true);
+      return static_cast<uint8_t>(offset);
+    }
+
+    if ((*pRecord & KEYFRAME_TAG) != 0U)
+    {
+      return 0U;
+    }
+
+    const uint8_t * pNibbles = pRecord + 1;
+    uint16_t maxNibbles = (maxBytes - 1U) * 2U;
+    uint16_t numNibbles = 0U;
+    uint8_t mask = *pRecord;
+    for (uint8_t field = 0U; field < NUM_FIELDS; field++)
+    {
+      pValues[field] = Predict(rState, field);
+      if ((mask & (1U << field)) == 0U)
+      {
+        continue;
+      }
+
+      if (numNibbles >= maxNibbles)
+      {
+        return 0U;
+      }
+
+      uint32_t zigZag = GetNibble(pNibbles, numNibbles++);
+      if (zigZag == NIBBLE_ESCAPE)
+      {
+        // Reassemble the varint bytes from nibble pairs
+        uint8_t varint[MAX_VARINT_SIZE_BYTES];
+        uint8_t varintSize = 0U;
+        do
+        {
+          if (((numNibbles + 2U) > maxNibbles) || (varintSize == MAX_VARINT_SIZE_BYTES))
+          {
+            return 0U;
+          }
+          varint[varintSize] = static_cast<uint8_t>(GetNibble(pNibbles, numNibbles) << 4) | GetNibble(pNibbles, numNibbles + 1U);
+          numNibbles += 2U;
+        } while ((varint[varintSize++] & 0x80U) != 0U);
+
+        if (ReadVarint(varint, varintSize, zigZag) == 0U)
+        {
+          return 0U;
+        }
+      }
+      pValues[field] += ZigZagDecode(zigZag);
+    }
+
+    UpdateState(rState, pValues, false);
+    return static_cast<uint8_t>(1U + ((numNibbles + 1U) / 2U));
+  }
+
+  // Offset of the oldest block in a log of logSizeBytes, given where the
+  // next record will be written
+  static uint16_t GetOldestBlockOffset(uint16_t writeOffset, bool bOverflowed, uint16_t logSizeBytes)
+  {
+    if (!bOverflowed)
+    {
+      return 0U;
+    }
+
+    // The block being written is the newest, the one after it the oldest.
+    // If the newest block is full, the next one has not been started yet.
+    uint16_t oldestBlockOffset = ((writeOffset + BLOCK_SIZE_BYTES - 1U) / BLOCK_SIZE_BYTES) * BLOCK_SIZE_BYTES;
+    return (oldestBlockOffset >= logSizeBytes) ? 0U : oldestBlockOffset;
+  }
+
+  // CRC-16-CCITT (polynomial 0x1021), one byte at a time
+  static uint16_t UpdateCrc(uint16_t crc, uint8_t data)
+  {
+    crc ^= static_cast<uint16_t>(data) << 8;
+    for (uint8_t bit = 0U; bit < 8U; bit++)
+    {
+      crc = ((crc & 0x8000U) != 0U) ? static_cast<uint16_t>((crc << 1) ^ 0x1021U) : static_cast<uint16_t>(crc << 1);
+    }
+    return crc;
+  }
+
+  // CRC over the slot header fields before m_Crc.  Continue it with
+  // UpdateCrc() over the m_Length data bytes.
+  static uint16_t StartSlotCrc(const JournalSlotHeader & rHeader)
+  {
+    const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rHeader);
+    uint16_t crc = CRC_SEED;
+    for (uint8_t i = 0U; i < offsetof(JournalSlotHeader, m_Crc); i++)
+    {
+      crc = UpdateCrc(crc, pHeader[i]);
+    }
+    return crc;
+  }
+
+  // Journal sequence numbers count up to a modulus and wrap to zero.  The
+  // modulus is a multiple of the number of journal slots, so a block's slot
+  // (sequence % slots) still follows the one before it across the wrap.
+  // Sequences and counts must be less than the modulus.
+  static uint16_t AdvanceSequence(uint16_t sequence, uint16_t count, uint16_t modulus)
+  {
+    return (sequence < (modulus - count)) ? (sequence + count) : (sequence - (modulus - count));
+  }
+
+  static uint16_t RewindSequence(uint16_t sequence, uint16_t count, uint16_t modulus)
+  {
+    return (sequence >= count) ? (sequence - count) : (sequence + (modulus - count));
+  }
+
+  // How far newer is ahead of older, going forward
+  static uint16_t GetSequenceDistance(uint16_t newer, uint16_t older, uint16_t modulus)
+  {
+    return (newer >= older) ? (newer - older) : (newer + (modulus - older));
+  }
+
+  // Sequence numbers wrap, so compare them by distance
+  static bool IsNewerSequence(uint16_t sequence, uint16_t reference, uint16_t modulus)
+  {
+    uint16_t distance = GetSequenceDistance(sequence, reference, modulus);
+    return (distance != 0U) && (distance < (modulus / 2U));
+  }
+
+  // The zig-zag and varint helpers are also used by the telemetry frames.
+  // Small magnitudes of either sign map to small unsigned values.
+  static uint32_t ZigZagEncode(int32_t value)
+  {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+  }
+
+  static int32_t ZigZagDecode(uint32_t value)
+  {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1U);
+  }
+
+  // Seven bits per byte, least significant first, high bit set if more follow
+  static uint8_t * WriteVarint(uint32_t value, uint8_t * pNext)
+  {
+    while (value >= 0x80U)
+    {
+      *pNext++ = static_cast<uint8_t>(value) | 0x80U;
+      value >>= 7;
+    }
+    *pNext++ = static_cast<uint8_t>(value);
+    return pNext;
+  }
+
+  // Reads a varint of at most maxBytes.  Returns its size, or zero if it
+  // does not end in time.
+  static uint8_t ReadVarint(const uint8_t * pData, uint16_t maxBytes, uint32_t & rValue)
+  {
+    rValue = 0U;
+    for (uint8_t i = 0U; (i < MAX_VARINT_SIZE_BYTES) && (i < maxBytes); i++)
+    {
+      rValue |= static_cast<uint32_t>(pData[i] & 0x7FU) << (7U * i);
+      if ((pData[i] & 0x80U) == 0U)
+      {
+        return i + 1U;
+      }
+    }
+    return 0U;
+  }
+
+private:
+  static int32_t Predict(const State & rState, uint8_t field)
+  {
+    int32_t prediction = rState.m_Values[field];
+    if ((SECOND_ORDER_FIELDS & (1U << field)) != 0U)
+    {
+      prediction += rState.m_Deltas[field];
+    }
+    return prediction;
+  }
+
+  static void PutNibble(uint8_t * pNibbles, uint8_t index, uint8_t nibble)
+  {
+    if ((index % 2U) == 0U)
+    {
+      pNibbles[index / 2U] = static_cast<uint8_t>(nibble << 4);
+    }
+    else
+    {
+      pNibbles[index / 2U] |= nibble;
+    }
+  }
+
+  static uint8_t GetNibble(const uint8_t * pNibbles, uint16_t index)
+  {
+    uint8_t data = pNibbles[index / 2U];
+    return ((index % 2U) == 0U) ? (data >> 4) : (data & 0x0FU);
+  }
+};
+
+#endif // DATALOGCODEC_HPP
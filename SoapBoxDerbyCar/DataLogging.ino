@@ -6,6 +6,11 @@
 ///           soap box derby car.  At least one of the non-default ports is used
 ///           to transmit data to another microcontroller.
 ///
+///           The data log is saved to an EEPROM journal as it is written (see
+///           DataLogCodec.hpp for the slot format).  UpdateDataLogJournal()
+///           writes at most one byte per call and only when the EEPROM is
+///           ready, so it never waits out the ~3.3ms a write takes.
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -29,7 +34,7 @@ IGNORE_FLAGS("-Wignored-qualifiers")  // Silence warnings in EEPROM.h header
 template <typename TypeToRead>
 void SoapBoxDerbyCar::GenericReadFromEeprom(TypeToRead & rDataToRead, unsigned offset)
 {
-  digitalWrite(EEPROM_RW_LED_PIN, HIGH);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetHigh();
   
   byte * pData = reinterpret_cast<byte *>(&rDataToRead);
   for (size_t i = 0; i < sizeof(TypeToRead); i++)
@@ -37,7 +42,7 @@ void SoapBoxDerbyCar::GenericReadFromEeprom(TypeToRead & rDataToRead, unsigned o
     *pData++ = EEPROM.read(offset + i);
   }
 
-  digitalWrite(EEPROM_RW_LED_PIN, LOW);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
 }
 
 
@@ -49,7 +54,7 @@ void SoapBoxDerbyCar::GenericReadFromEeprom(TypeToRead & rDataToRead, unsigned o
 template <typename TypeToWrite>
 void SoapBoxDerbyCar::GenericWriteToEeprom(const TypeToWrite & rDataToWrite, unsigned offset)
 {
-  digitalWrite(EEPROM_RW_LED_PIN, HIGH);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetHigh();
   
   const byte * pData = reinterpret_cast<const byte *>(&rDataToWrite);
   for (size_t i = 0; i < sizeof(TypeToWrite); i++)
@@ -63,7 +68,7 @@ void SoapBoxDerbyCar::GenericWriteToEeprom(const TypeToWrite & rDataToWrite, uns
     pData++;
   }
 
-  digitalWrite(EEPROM_RW_LED_PIN, LOW);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
 }
 
 
@@ -75,7 +80,7 @@ void SoapBoxDerbyCar::GenericWriteToEeprom(const TypeToWrite & rDataToWrite, uns
 template <typename TypeToErase>
 void SoapBoxDerbyCar::GenericEraseEeprom(const TypeToErase & rDataToErase, unsigned offset)
 {
-  digitalWrite(EEPROM_RW_LED_PIN, HIGH);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetHigh();
 
   // Since this template method uses the size of the type
   // that instantiated it to determine how much to erase,
@@ -97,65 +102,159 @@ void SoapBoxDerbyCar::GenericEraseEeprom(const TypeToErase & rDataToErase, unsig
       }
   }
 
-  digitalWrite(EEPROM_RW_LED_PIN, LOW);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CalculateNonVolatileChecksum
+///
+/// Details:  Computes the checksum used to validate a block of the
+///           non-volatile car data.  Each block has its own seed so that
+///           erased (0xFF) or zeroed EEPROM does not pass, and one block's
+///           bytes can't pass as another's.
+////////////////////////////////////////////////////////////////////////////////
+uint16_t SoapBoxDerbyCar::CalculateNonVolatileChecksum(const void * pData, size_t length, uint16_t seed)
+{
+  const byte * pBytes = reinterpret_cast<const byte *>(pData);
+  uint16_t checksum = seed;
+  for (size_t i = 0; i < length; i++)
+  {
+    // Rotate and add so swapped bytes still change the result
+    checksum = static_cast<uint16_t>((checksum << 1) | (checksum >> 15)) + *pBytes++;
+  }
+
+  return checksum;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: WriteEepromCarDataHeader
+///
+/// Details:  Writes the header that marks the non-volatile car data in EEPROM
+///           as ours.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::WriteEepromCarDataHeader()
+{
+  // This is a little bit of a hack.  The header size in the struct declaration
+  // is 32-bits.  The header is filled with four characters, which is the same
+  // size.  This is exploited to easily read/write the header, even though the
+  // types are fundamentally different (uint32_t vs. String).
+  for (size_t i = 0; i < sizeof(m_NonVolatileCarData.m_Header); i++)
+  {
+    GenericWriteToEeprom(NON_VOLATILE_CAR_DATA_HEADER[i], offsetof(NonVolatileCarData, m_Header) + i);
+  }
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: LogData
 ///
-/// Details:  Adds an entry to the data log.
+/// Details:  Adds an entry to the data log.  Callers are responsible for
+///           pacing entries at DATA_LOG_ENTRY_INTERVAL_MS.  A record that
+///           does not fit in the current block starts the next one with a
+///           keyframe, overwriting the oldest block once the log is full.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::LogData(unsigned long entryTimeStampMs)
 {
-  static unsigned long lastTimeStamp = 0;
-  unsigned long currentTimeStamp = GetTimeStampMs();
-
-  // If enough time hasn't elapsed, don't add another entry
-  if (CalcDeltaTimeMs(lastTimeStamp) < DATA_LOG_ENTRY_INTERVAL_MS)
+  if (m_NonVolatileCarData.m_bDataLogOverflowed && !DATA_LOG_OVERFLOW_ALLOWED)
   {
     return;
   }
-  
-  if (!m_NonVolatileCarData.m_bDataLogOverflowed || DATA_LOG_OVERFLOW_ALLOWED)
+
+  noInterrupts();
+  uint16_t leftHallCount = m_LeftHallCount;
+  uint16_t rightHallCount = m_RightHallCount;
+  interrupts();
+
+  int32_t values[DataLogCodec::NUM_FIELDS];
+  values[DataLogCodec::TIME_STAMP_MS] = static_cast<int32_t>(entryTimeStampMs);
+  values[DataLogCodec::LEFT_WHEEL_DISTANCE_INCHES] = HallCountToInches(leftHallCount);
+  values[DataLogCodec::RIGHT_WHEEL_DISTANCE_INCHES] = HallCountToInches(rightHallCount);
+  values[DataLogCodec::FRONT_AXLE_POTENTIOMETER] = m_FrontAxlePotentiometerValue;
+  values[DataLogCodec::POSE_X_INCHES] = m_Pose.m_XQ8 / POSE_Q8_ONE;
+  values[DataLogCodec::POSE_Y_INCHES] = m_Pose.m_YQ8 / POSE_Q8_ONE;
+  values[DataLogCodec::POSE_HEADING_CENTIDEGREES] = PoseHeadingToCentidegrees(m_Pose.m_HeadingQ8);
+
+  int offset = m_NonVolatileCarData.m_DataLogIndex;
+  int blockEnd = ((offset / DataLogCodec::BLOCK_SIZE_BYTES) + 1) * DataLogCodec::BLOCK_SIZE_BYTES;
+  bool bKeyframe = ((offset % DataLogCodec::BLOCK_SIZE_BYTES) == 0);
+
+  uint8_t record[DataLogCodec::MAX_RECORD_SIZE_BYTES];
+  uint8_t recordSize = DataLogCodec::EncodeRecord(m_DataLogEncoderState, values, bKeyframe, record);
+
+  if ((offset + recordSize) > blockEnd)
   {
-    m_DataLog[m_NonVolatileCarData.m_DataLogIndex].m_TimeStampMs = entryTimeStampMs;
-    m_DataLog[m_NonVolatileCarData.m_DataLogIndex].m_LeftWheelDistanceInches = m_LeftWheelDistanceInches;
-    m_DataLog[m_NonVolatileCarData.m_DataLogIndex].m_RightWheelDistanceInches = m_RightWheelDistanceInches;
-    m_DataLog[m_NonVolatileCarData.m_DataLogIndex].m_FrontAxlePotentiometer = m_FrontAxlePotentiometerValue;
+    // Move to the next block, the rest of this one is already END_TAG
+    offset = blockEnd;
+    if (offset >= DATA_LOG_SIZE_BYTES)
+    {
+      m_NonVolatileCarData.m_bDataLogOverflowed = true;
+      if (!DATA_LOG_OVERFLOW_ALLOWED)
+      {
+        return;
+      }
+      offset = 0;
+    }
+
+    bKeyframe = true;
+    recordSize = DataLogCodec::EncodeRecord(m_DataLogEncoderState, values, bKeyframe, record);
   }
-  else
+
+  // A new block may hold records from the last time around the ring
+  if (bKeyframe)
   {
-    return;
+    memset(&m_DataLog[offset], DataLogCodec::END_TAG, DataLogCodec::BLOCK_SIZE_BYTES);
+    m_NonVolatileCarData.m_DataLogSequence = DataLogCodec::AdvanceSequence(m_NonVolatileCarData.m_DataLogSequence, 1U, DATA_LOG_SEQUENCE_MODULUS);
+    m_DataLogJournal.m_BlockOffset = offset;
+    m_DataLogJournal.m_BlockLength = 0U;
   }
 
-  // Check for the log to have overflowed
-  m_NonVolatileCarData.m_DataLogIndex++;
-  if (m_NonVolatileCarData.m_DataLogIndex == MAX_DATA_LOG_ENTRIES)
+  memcpy(&m_DataLog[offset], record, recordSize);
+  DataLogCodec::UpdateState(m_DataLogEncoderState, values, bKeyframe);
+  m_DataLogJournal.m_BlockLength += recordSize;
+
+  offset += recordSize;
+  if (offset >= DATA_LOG_SIZE_BYTES)
   {
-    m_NonVolatileCarData.m_DataLogIndex = 0;
+    offset = 0;
     m_NonVolatileCarData.m_bDataLogOverflowed = true;
   }
-
-  lastTimeStamp = currentTimeStamp;
+  m_NonVolatileCarData.m_DataLogIndex = offset;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ClearDataLog
 ///
-/// Details:  Clears the full data log from EEPROM.
+/// Details:  Clears the full data log from RAM or EEPROM.  Clearing the RAM
+///           log drops anything not yet in the journal.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ClearDataLog(LogLocation logLocation)
 {
   if (logLocation == RAM_LOG)
   {
-    memset(&m_DataLog, 0, sizeof(m_DataLog));
+    memset(&m_DataLog, DataLogCodec::END_TAG, sizeof(m_DataLog));
+    m_NonVolatileCarData.m_DataLogIndex = 0;
+    m_NonVolatileCarData.m_bDataLogOverflowed = false;
+
+    // The next record starts a new block and sequence number
+    m_DataLogJournal.m_State = JOURNAL_IDLE;
+    m_DataLogJournal.m_BlockOffset = 0U;
+    m_DataLogJournal.m_BlockLength = DataLogCodec::BLOCK_SIZE_BYTES;
+    m_DataLogJournal.m_CommittedSequence = m_NonVolatileCarData.m_DataLogSequence;
+    m_DataLogJournal.m_CommittedLength = DataLogCodec::BLOCK_SIZE_BYTES;
+    m_DataLogJournal.m_bFlushRequested = false;
+    DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
   }
   else if (logLocation == EEPROM_LOG)
   {
-    // Data log is offset in EEPROM
-    GenericEraseEeprom(m_DataLog, DATA_LOG_EEPROM_OFFSET);
+    // Erasing the slot headers is enough to empty the journal
+    DataLogCodec::JournalSlotHeader slotHeader;
+    for (uint16_t slot = 0U; slot < DATA_LOG_JOURNAL_NUM_SLOTS; slot++)
+    {
+      GenericEraseEeprom(slotHeader, GetDataLogJournalSlotOffset(slot));
+    }
   }
   else
   {
@@ -166,22 +265,53 @@ void SoapBoxDerbyCar::ClearDataLog(LogLocation logLocation)
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: DisplayDataLog
 ///
-/// Details:  Displays the full data log out the serial port.
+/// Details:  Decodes and displays the data log out the serial port, oldest
+///           entry first.  Entries before firstEntry are decoded but not
+///           displayed.
 ////////////////////////////////////////////////////////////////////////////////
-void SoapBoxDerbyCar::DisplayDataLog()
+void SoapBoxDerbyCar::DisplayDataLog(long firstEntry)
 {
-  for (int i = 0; i < MAX_DATA_LOG_ENTRIES; i++)
+  DataLogCodec::State decoderState = {};
+  int32_t values[DataLogCodec::NUM_FIELDS];
+  unsigned entry = 0U;
+
+  uint16_t blockOffset = DataLogCodec::GetOldestBlockOffset(m_NonVolatileCarData.m_DataLogIndex, m_NonVolatileCarData.m_bDataLogOverflowed, DATA_LOG_SIZE_BYTES);
+  for (int block = 0; block < (DATA_LOG_SIZE_BYTES / DataLogCodec::BLOCK_SIZE_BYTES); block++)
   {
-    Serial.print(F("Entry #"));
-    Serial.print(i);
-    Serial.print(F(" - Timestamp (ms): "));
-    Serial.print(m_DataLog[i].m_TimeStampMs);
-    Serial.print(F(", Left Wheel Distance (in.): "));
-    Serial.print(m_DataLog[i].m_LeftWheelDistanceInches);
-    Serial.print(F(", Right Wheel Distance (in.): "));
-    Serial.print(m_DataLog[i].m_RightWheelDistanceInches);
-    Serial.print(F(", Front Axle Potentiometer: "));
-    Serial.println(m_DataLog[i].m_FrontAxlePotentiometer);
+    uint16_t offset = 0U;
+    uint8_t recordSize = 0U;
+    while ((recordSize = DataLogCodec::DecodeRecord(decoderState, &m_DataLog[blockOffset + offset], DataLogCodec::BLOCK_SIZE_BYTES - offset, values)) != 0U)
+    {
+      offset += recordSize;
+      if (static_cast<long>(entry) < firstEntry)
+      {
+        entry++;
+        continue;
+      }
+
+      Serial.print(F("Entry #"));
+      Serial.print(entry++);
+      Serial.print(F(" - Timestamp (ms): "));
+      Serial.print(values[DataLogCodec::TIME_STAMP_MS]);
+      Serial.print(F(", Left Wheel Distance (in.): "));
+      Serial.print(values[DataLogCodec::LEFT_WHEEL_DISTANCE_INCHES]);
+      Serial.print(F(", Right Wheel Distance (in.): "));
+      Serial.print(values[DataLogCodec::RIGHT_WHEEL_DISTANCE_INCHES]);
+      Serial.print(F(", Front Axle Potentiometer: "));
+      Serial.print(values[DataLogCodec::FRONT_AXLE_POTENTIOMETER]);
+      Serial.print(F(", Pose X/Y (in.): "));
+      Serial.print(values[DataLogCodec::POSE_X_INCHES]);
+      Serial.print(F("/"));
+      Serial.print(values[DataLogCodec::POSE_Y_INCHES]);
+      Serial.print(F(", Heading (deg/100): "));
+      Serial.println(values[DataLogCodec::POSE_HEADING_CENTIDEGREES]);
+    }
+
+    blockOffset += DataLogCodec::BLOCK_SIZE_BYTES;
+    if (blockOffset >= DATA_LOG_SIZE_BYTES)
+    {
+      blockOffset = 0U;
+    }
   }
 
   Serial.println();
@@ -196,7 +326,7 @@ void SoapBoxDerbyCar::DisplayDataLog()
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::DisplayEeprom()
 {
-  digitalWrite(EEPROM_RW_LED_PIN, HIGH);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetHigh();
 
   Serial.println(F("EEPROM"));
   Serial.println(F("------"));
@@ -219,51 +349,330 @@ void SoapBoxDerbyCar::DisplayEeprom()
   Serial.println();
   Serial.println();
   
-  digitalWrite(EEPROM_RW_LED_PIN, LOW);
+  DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ReadDataLogJournalSlot
+///
+/// Details:  Reads a journal slot header and checks its CRC against the data
+///           in the slot, optionally copying the data out as well.  Returns
+///           whether the slot holds a valid block.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::ReadDataLogJournalSlot(uint16_t slot, DataLogCodec::JournalSlotHeader & rHeader, uint8_t * pData)
+{
+  unsigned offset = GetDataLogJournalSlotOffset(slot);
+  GenericReadFromEeprom(rHeader, offset);
+
+  if ((rHeader.m_Length == 0U) ||
+      (rHeader.m_Length > DataLogCodec::BLOCK_SIZE_BYTES) ||
+      (rHeader.m_Sequence >= DATA_LOG_SEQUENCE_MODULUS) ||
+      ((rHeader.m_Sequence % DATA_LOG_JOURNAL_NUM_SLOTS) != slot))
+  {
+    return false;
+  }
+
+  offset += sizeof(rHeader);
+  uint16_t crc = DataLogCodec::StartSlotCrc(rHeader);
+  for (uint16_t i = 0U; i < rHeader.m_Length; i++)
+  {
+    uint8_t data = EEPROM.read(offset + i);
+    crc = DataLogCodec::UpdateCrc(crc, data);
+    if (pData != nullptr)
+    {
+      pData[i] = data;
+    }
+  }
+
+  return (crc == rHeader.m_Crc);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: FindNewestDataLogJournalSlot
+///
+/// Details:  Finds the sequence number of the newest valid block in the
+///           journal.  Returns false if there are none.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::FindNewestDataLogJournalSlot(uint16_t & rSequence)
+{
+  bool bFound = false;
+  for (uint16_t slot = 0U; slot < DATA_LOG_JOURNAL_NUM_SLOTS; slot++)
+  {
+    DataLogCodec::JournalSlotHeader slotHeader;
+    if (ReadDataLogJournalSlot(slot, slotHeader) &&
+        (!bFound || DataLogCodec::IsNewerSequence(slotHeader.m_Sequence, rSequence, DATA_LOG_SEQUENCE_MODULUS)))
+    {
+      rSequence = slotHeader.m_Sequence;
+      bFound = true;
+    }
+  }
+
+  return bFound;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CheckEepromLayoutVersion
+///
+/// Details:  Erases the journal slot headers and the flight recorder
+///           snapshot header if the EEPROM was written with a different
+///           layout (a different number of journal slots moves every slot
+///           after the first and puts the snapshot on top of old slots).
+///           Without their headers, the old blocks and snapshot read as
+///           empty instead of being mistaken for new ones.  The rest of the
+///           non-volatile car data keeps its layout and is left alone.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::CheckEepromLayoutVersion(const NonVolatileCarData & rEepromCarData)
+{
+  m_NonVolatileCarData.m_EepromLayoutVersion = EEPROM_LAYOUT_VERSION;
+  if (rEepromCarData.m_EepromLayoutVersion == EEPROM_LAYOUT_VERSION)
+  {
+    return;
+  }
+
+  LogDebugMessage(DebugLogMessages::LOG_EEPROM_LAYOUT_CHANGED, rEepromCarData.m_EepromLayoutVersion, EEPROM_LAYOUT_VERSION);
+
+  DataLogCodec::JournalSlotHeader slotHeader;
+  for (uint16_t slot = 0U; slot < DATA_LOG_JOURNAL_NUM_SLOTS; slot++)
+  {
+    GenericEraseEeprom(slotHeader, GetDataLogJournalSlotOffset(slot));
+  }
+
+  FlightRecorderSnapshotHeader snapshotHeader;
+  GenericEraseEeprom(snapshotHeader, FLIGHT_RECORDER_EEPROM_OFFSET);
+
+  // Passed by reference, so it needs an object (the constant has no
+  // definition outside the class)
+  const uint16_t layoutVersion = EEPROM_LAYOUT_VERSION;
+  GenericWriteToEeprom(layoutVersion, offsetof(NonVolatileCarData, m_EepromLayoutVersion));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: InitializeDataLogJournal
+///
+/// Details:  Continues the sequence numbers after the newest block in the
+///           journal, so the blocks from before a reset or power cut are kept
+///           until their slots come around again.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::InitializeDataLogJournal()
+{
+  uint16_t newestSequence = 0U;
+  if (FindNewestDataLogJournalSlot(newestSequence))
+  {
+    m_NonVolatileCarData.m_DataLogSequence = newestSequence;
+  }
+
+  // Nothing in the (empty) RAM log needs to be committed
+  m_DataLogJournal.m_CommittedSequence = m_NonVolatileCarData.m_DataLogSequence;
+  m_DataLogJournal.m_CommittedLength = DataLogCodec::BLOCK_SIZE_BYTES;
+  m_DataLogJournal.m_LastCommitTimeMs = GetTimeStampMs();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: StartDataLogJournalCommit
+///
+/// Details:  Picks the next block data to commit to the journal.  Finished
+///           blocks are committed as soon as possible.  The block still being
+///           logged is committed when a flush is requested or the last commit
+///           is DATA_LOG_JOURNAL_COMMIT_INTERVAL_MS old.  Returns whether a
+///           commit was started.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::StartDataLogJournalCommit()
+{
+  DataLogJournal & rJournal = m_DataLogJournal;
+  uint16_t currentSequence = m_NonVolatileCarData.m_DataLogSequence;
+
+  uint16_t sequence = rJournal.m_CommittedSequence;
+  uint16_t committedLength = rJournal.m_CommittedLength;
+  if ((sequence != currentSequence) && (committedLength == DataLogCodec::BLOCK_SIZE_BYTES))
+  {
+    sequence = DataLogCodec::AdvanceSequence(sequence, 1U, DATA_LOG_SEQUENCE_MODULUS);
+    committedLength = 0U;
+  }
+
+  // Blocks already overwritten in RAM are lost
+  uint16_t blocksBack = DataLogCodec::GetSequenceDistance(currentSequence, sequence, DATA_LOG_SEQUENCE_MODULUS);
+  if (blocksBack >= DATA_LOG_NUM_BLOCKS)
+  {
+    blocksBack = DATA_LOG_NUM_BLOCKS - 1U;
+    sequence = DataLogCodec::RewindSequence(currentSequence, blocksBack, DATA_LOG_SEQUENCE_MODULUS);
+    committedLength = 0U;
+  }
+
+  bool bCurrentBlock = (blocksBack == 0U);
+  uint16_t length = bCurrentBlock ? rJournal.m_BlockLength : DataLogCodec::BLOCK_SIZE_BYTES;
+  if (length <= committedLength)
+  {
+    rJournal.m_bFlushRequested = false;
+    return false;
+  }
+
+  if (bCurrentBlock && !rJournal.m_bFlushRequested &&
+      (CalcDeltaTimeMs(rJournal.m_LastCommitTimeMs) < DATA_LOG_JOURNAL_COMMIT_INTERVAL_MS))
+  {
+    return false;
+  }
+
+  int ramBlock = (rJournal.m_BlockOffset / DataLogCodec::BLOCK_SIZE_BYTES) - static_cast<int>(blocksBack);
+  if (ramBlock < 0)
+  {
+    ramBlock += DATA_LOG_NUM_BLOCKS;
+  }
+  rJournal.m_CommitRamOffset = ramBlock * DataLogCodec::BLOCK_SIZE_BYTES;
+
+  // The bytes up to length never change while the block is in RAM, so the
+  // CRC can be taken now
+  rJournal.m_SlotHeader.m_Sequence = sequence;
+  rJournal.m_SlotHeader.m_Length = length;
+  uint16_t crc = DataLogCodec::StartSlotCrc(rJournal.m_SlotHeader);
+  for (uint16_t i = 0U; i < length; i++)
+  {
+    crc = DataLogCodec::UpdateCrc(crc, m_DataLog[rJournal.m_CommitRamOffset + i]);
+  }
+  rJournal.m_SlotHeader.m_Crc = crc;
+
+  // A block that moved to a new slot has to be written in full
+  rJournal.m_CommitPosition = (sequence == rJournal.m_CommittedSequence) ? committedLength : 0U;
+  rJournal.m_State = JOURNAL_WRITING_DATA;
+  DigitalPin<EEPROM_RW_LED_PIN>::SetHigh();
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateDataLogJournal
+///
+/// Details:  Advances the journal commit in progress by one byte, or starts
+///           the next one.  Returns right away while the EEPROM is busy, so
+///           it is safe to call as often as desired.  Bytes that already
+///           match are skipped without writing.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateDataLogJournal()
+{
+  if (!eeprom_is_ready())
+  {
+    return;
+  }
+
+  DataLogJournal & rJournal = m_DataLogJournal;
+  if ((rJournal.m_State == JOURNAL_IDLE) && !StartDataLogJournalCommit())
+  {
+    return;
+  }
+
+  unsigned slotOffset = GetDataLogJournalSlotOffset(rJournal.m_SlotHeader.m_Sequence);
+
+  if (rJournal.m_State == JOURNAL_WRITING_DATA)
+  {
+    unsigned dataOffset = slotOffset + sizeof(DataLogCodec::JournalSlotHeader);
+    while (rJournal.m_CommitPosition < rJournal.m_SlotHeader.m_Length)
+    {
+      uint8_t data = m_DataLog[rJournal.m_CommitRamOffset + rJournal.m_CommitPosition];
+      unsigned address = dataOffset + rJournal.m_CommitPosition++;
+      if (EEPROM.read(address) != data)
+      {
+        EEPROM.write(address, data);
+        return;
+      }
+    }
+
+    rJournal.m_CommitPosition = 0U;
+    rJournal.m_State = JOURNAL_WRITING_HEADER;
+  }
+
+  // The header goes last, so a torn commit leaves a bad CRC
+  const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rJournal.m_SlotHeader);
+  while (rJournal.m_CommitPosition < sizeof(DataLogCodec::JournalSlotHeader))
+  {
+    unsigned address = slotOffset + rJournal.m_CommitPosition;
+    uint8_t data = pHeader[rJournal.m_CommitPosition++];
+    if (EEPROM.read(address) != data)
+    {
+      EEPROM.write(address, data);
+      return;
+    }
+  }
+
+  rJournal.m_CommittedSequence = rJournal.m_SlotHeader.m_Sequence;
+  rJournal.m_CommittedLength = rJournal.m_SlotHeader.m_Length;
+  rJournal.m_LastCommitTimeMs = GetTimeStampMs();
+  rJournal.m_State = JOURNAL_IDLE;
+  DigitalPin<EEPROM_RW_LED_PIN>::SetLow();
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: RestoreLogFromEeprom
 ///
-/// Details:  Restores the full data log from non-volatile EEPROM.
+/// Details:  Restores the data log from the newest valid blocks in the EEPROM
+///           journal, skipping any torn by a power cut.  Logging continues in
+///           a new block after them.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::RestoreLogFromEeprom()
 {
-  GenericReadFromEeprom(m_DataLog, DATA_LOG_EEPROM_OFFSET);
-  GenericReadFromEeprom(m_NonVolatileCarData.m_bDataLogOverflowed, offsetof(NonVolatileCarData, m_bDataLogOverflowed));
-  GenericReadFromEeprom(m_NonVolatileCarData.m_DataLogIndex, offsetof(NonVolatileCarData, m_DataLogIndex));
+  uint16_t newestSequence = 0U;
+  if (!FindNewestDataLogJournalSlot(newestSequence))
+  {
+    Serial.println(F("No data log in EEPROM."));
+    return;
+  }
+
+  ClearDataLog(RAM_LOG);
+
+  // Oldest first, so the RAM log is in order
+  uint16_t numBlocks = 0U;
+  for (uint16_t i = 0U; i < DATA_LOG_NUM_BLOCKS; i++)
+  {
+    uint16_t sequence = DataLogCodec::RewindSequence(newestSequence, (DATA_LOG_NUM_BLOCKS - 1U) - i, DATA_LOG_SEQUENCE_MODULUS);
+    DataLogCodec::JournalSlotHeader slotHeader;
+    uint8_t * pBlock = &m_DataLog[numBlocks * DataLogCodec::BLOCK_SIZE_BYTES];
+    if (ReadDataLogJournalSlot(sequence % DATA_LOG_JOURNAL_NUM_SLOTS, slotHeader, pBlock) &&
+        (slotHeader.m_Sequence == sequence))
+    {
+      numBlocks++;
+    }
+    else
+    {
+      memset(pBlock, DataLogCodec::END_TAG, DataLogCodec::BLOCK_SIZE_BYTES);
+    }
+  }
+
+  // All of it is already in the journal
+  m_NonVolatileCarData.m_DataLogSequence = newestSequence;
+  m_NonVolatileCarData.m_DataLogIndex = (numBlocks % DATA_LOG_NUM_BLOCKS) * DataLogCodec::BLOCK_SIZE_BYTES;
+  m_NonVolatileCarData.m_bDataLogOverflowed = (numBlocks == DATA_LOG_NUM_BLOCKS);
+  m_DataLogJournal.m_BlockOffset = (numBlocks - 1U) * DataLogCodec::BLOCK_SIZE_BYTES;
+  m_DataLogJournal.m_CommittedSequence = newestSequence;
+
+  Serial.print(F("Restored data log blocks: "));
+  Serial.println(numBlocks);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: WriteLogToEeprom
 ///
-/// Details:  Writes the full data log to non-volatile EEPROM.
+/// Details:  Writes the non-volatile car data to EEPROM and asks for the
+///           data log still in RAM to be committed to the journal.  The
+///           journal commit finishes in the background.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::WriteLogToEeprom(bool bFromAuto)
 {
-  GenericWriteToEeprom(m_DataLog, DATA_LOG_EEPROM_OFFSET);
+  m_DataLogJournal.m_bFlushRequested = true;
 
-  NonVolatileCarData eepromCarData;
-  GetEepromCarData(eepromCarData);
-
-  // This is a little bit of a hack.  The header size in the struct declaration
-  // is 32-bits.  The header is filled with four characters, which is the same
-  // size.  This is exploited to easily read/write the header, even though the
-  // types are fundamentally different (uint32_t vs. String).
-  for (size_t i = 0; i < sizeof(eepromCarData.m_Header); i++)
-  {
-    GenericWriteToEeprom(NON_VOLATILE_CAR_DATA_HEADER[i], offsetof(NonVolatileCarData, m_Header) + i);
-  }
+  WriteEepromCarDataHeader();
   
   GenericWriteToEeprom(m_NonVolatileCarData.m_Incarnation, offsetof(NonVolatileCarData, m_Incarnation));
   
   m_NonVolatileCarData.m_bSavedByAuto = bFromAuto;
   GenericWriteToEeprom(bFromAuto, offsetof(NonVolatileCarData, m_bSavedByAuto));
   
-  GenericWriteToEeprom(m_NonVolatileCarData.m_bDataLogOverflowed, offsetof(NonVolatileCarData, m_bDataLogOverflowed));
-  GenericWriteToEeprom(m_NonVolatileCarData.m_DataLogIndex, offsetof(NonVolatileCarData, m_DataLogIndex));
+  GenericWriteToEeprom(m_NonVolatileCarData.m_SteeringGains, offsetof(NonVolatileCarData, m_SteeringGains));
+  GenericWriteToEeprom(m_NonVolatileCarData.m_SteeringCalibration, offsetof(NonVolatileCarData, m_SteeringCalibration));
 }
 
 
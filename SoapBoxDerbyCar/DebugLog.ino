@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     DebugLog.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains the deferred debug log for a soap box derby car.
+///           Logging a message only encodes its ID, the time and its integer
+///           arguments into a RAM ring, which takes a few tens of
+///           microseconds.  A low priority scheduler task sends the messages
+///           out the console as binary frames when the transmit buffer has
+///           room, so debug output never stalls the control loops and can
+///           stay on during real runs.
+///
+///           The frames are turned back into text on the host by
+///           SoapBoxDerbyCarDebugLogExpander, which passes the rest of the
+///           console output through unchanged.  The message text only exists
+///           in DebugLogMessages.hpp on the host side.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+uint8_t           SoapBoxDerbyCar::m_DebugLogRing[DEBUG_LOG_RING_SIZE_BYTES]  = {};
+volatile uint8_t  SoapBoxDerbyCar::m_DebugLogHead                             = 0U;
+volatile uint8_t  SoapBoxDerbyCar::m_DebugLogTail                             = 0U;
+uint16_t          SoapBoxDerbyCar::m_DebugLogDroppedCount                     = 0U;
+uint8_t           SoapBoxDerbyCar::m_DebugLogSequence                         = 0U;
+
+// GLOBALS
+// (none)
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LogDebugMessage
+///
+/// Details:  Adds a message to the debug log.  If the ring is full the
+///           message is dropped and counted, and the count is logged once
+///           there is room.  Must not be called from an interrupt.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::LogDebugMessage(DebugLogMessages::Id id, const int32_t * pArguments, uint8_t numArguments)
+{
+  ASSERT(numArguments <= DebugLogMessages::MAX_ARGUMENTS);
+
+  int32_t fields[DebugLogMessages::MAX_FIELDS];
+  fields[0] = static_cast<int32_t>(GetTimeStampMs());
+  fields[1] = id;
+  for (uint8_t i = 0U; i < numArguments; i++)
+  {
+    fields[i + 2U] = pArguments[i];
+  }
+
+  // A length byte, then the payload
+  uint8_t record[1 + (DebugLogMessages::MAX_FIELDS * DataLogCodec::MAX_VARINT_SIZE_BYTES)];
+  record[0] = TelemetryProtocol::EncodeFields(fields, numArguments + 2U, &record[1]);
+  uint8_t recordSize = record[0] + 1U;
+
+  uint8_t head = m_DebugLogHead;
+  uint8_t freeBytes = static_cast<uint8_t>(m_DebugLogTail - head - 1U);
+  if (recordSize > freeBytes)
+  {
+    if (m_DebugLogDroppedCount < UINT16_MAX)
+    {
+      m_DebugLogDroppedCount++;
+    }
+    return;
+  }
+
+  for (uint8_t i = 0U; i < recordSize; i++)
+  {
+    m_DebugLogRing[head++] = record[i];
+  }
+
+  // Publish the record only once it is all there
+  m_DebugLogHead = head;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: WriteDebugLog
+///
+/// Details:  Sends logged messages out the console.  Normally it stops at the
+///           first message the transmit buffer does not have room for and
+///           picks up there next time.  If bWait is set it sends everything,
+///           waiting on the port as needed (for use when nothing else
+///           matters, like an assert).
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::WriteDebugLog(bool bWait)
+{
+  uint8_t tail = m_DebugLogTail;
+  while (tail != m_DebugLogHead)
+  {
+    uint8_t payloadSize = m_DebugLogRing[tail];
+    uint8_t frameSize = TelemetryProtocol::HEADER_SIZE_BYTES + payloadSize + TelemetryProtocol::CRC_SIZE_BYTES;
+    if (!bWait && (Serial.availableForWrite() < frameSize))
+    {
+      break;
+    }
+    tail++;
+
+    uint8_t frame[TelemetryProtocol::MAX_FRAME_SIZE_BYTES];
+    for (uint8_t i = 0U; i < payloadSize; i++)
+    {
+      frame[TelemetryProtocol::HEADER_SIZE_BYTES + i] = m_DebugLogRing[tail++];
+    }
+    (void)TelemetryProtocol::FinishFrame(TelemetryProtocol::DEBUG_LOG_FRAME, m_DebugLogSequence++, payloadSize, frame);
+    Serial.write(frame, frameSize);
+
+    m_DebugLogTail = tail;
+  }
+
+  // Report dropped messages once the ring has emptied out
+  if ((tail == m_DebugLogHead) && (m_DebugLogDroppedCount != 0U))
+  {
+    uint16_t droppedCount = m_DebugLogDroppedCount;
+    m_DebugLogDroppedCount = 0U;
+    LogDebugMessage(DebugLogMessages::LOG_MESSAGES_DROPPED, droppedCount);
+  }
+}
@@ -0,0 +1,78 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     DebugLogMessages.hpp
+/// Author:   David Stalter
+///
+/// Details:  The messages the car can put in its deferred debug log.  Only
+///           the message IDs are compiled into the sketch.  A message is
+///           logged as its ID and integer arguments and sent out the console
+///           later as a binary frame (see TelemetryProtocol.hpp).  The host
+///           debug log expander builds its format string table from this same
+///           list, so the two always agree.
+///
+///           To add a message, add a line to DEBUG_LOG_MESSAGES with its ID,
+///           number of arguments (at most MAX_ARGUMENTS) and printf format.
+///           Every argument is printed as a long (%ld, %lx, etc.).  New
+///           messages go at the end so old captures still expand.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DEBUGLOGMESSAGES_HPP
+#define DEBUGLOGMESSAGES_HPP
+
+// INCLUDES
+#include <stdint.h>                   // for fixed width integer types
+
+// MESSAGE(ID, number of arguments, format)
+#define DEBUG_LOG_MESSAGES(MESSAGE)                                                                                                     \
+  MESSAGE(LOG_MESSAGES_DROPPED,             1,  "%ld debug log messages dropped")                                                     \
+  MESSAGE(LOG_POT_CALIBRATION_START,        1,  "Centering steering by pot, calibration attempt #%ld")                                \
+  MESSAGE(LOG_POT_CALIBRATION_COMPLETE,     4,  "Pot calibration left/right/center: %ld/%ld/%ld, final position: %ld")                \
+  MESSAGE(LOG_ENCODER_CENTERING_START,      0,  "Centering steering by encoder...")                                                   \
+  MESSAGE(LOG_ENCODER_CALIBRATION_VALUES,   4,  "Encoder value: %ld, multiplier: %ld, left/right calibration: %ld/%ld")               \
+  MESSAGE(LOG_ENCODER_CALIBRATION_RANGES,   4,  "Encoder range left/right/total: %ld/%ld/%ld, center position: %ld")                  \
+  MESSAGE(LOG_ENCODER_CENTERING_FAILED,     0,  "CALIBRATION FAILED!!!")                                                              \
+  MESSAGE(LOG_ENCODER_CENTERING_SUCCESSFUL, 0,  "CALIBRATION SUCCESSFUL")                                                             \
+  MESSAGE(LOG_DEBUG_CONTROLLER_INPUTS,      4,  "Steering/brake/emergency stop inputs: %ld/%ld/%ld, signal lost mask: 0x%lx")         \
+  MESSAGE(LOG_DEBUG_WHEELS,                 4,  "Hall counts left/right: %ld/%ld, pose X/Y (in.): %ld/%ld")                           \
+  MESSAGE(LOG_DEBUG_STEERING,               4,  "Heading (deg/100): %ld, pot: %ld, limit switches left/right: %ld/%ld")               \
+  MESSAGE(LOG_DEBUG_DATA_LOG,               4,  "Brake: %ld, data log index: %ld, sequence/journaled: %ld/%ld")                       \
+  MESSAGE(LOG_CAR_DATA_FRAME_SENT,          2,  "Car data frame #%ld, dropped: %ld")                                                  \
+  MESSAGE(LOG_CAR_DATA_STREAM_PERIOD,       1,  "Car data stream period (ms): %ld")                                                   \
+  MESSAGE(LOG_ENCODER_CENTERING_POSITIONS,  4,  "Encoder position left/right/center/final: %ld/%ld/%ld/%ld")                          \
+  MESSAGE(LOG_POT_CALIBRATION_NOT_SAVED,    0,  "No saved pot calibration")                                                           \
+  MESSAGE(LOG_POT_CALIBRATION_REJECTED,     2,  "Saved pot calibration rejected, limit switch pot value expected/measured: %ld/%ld")  \
+  MESSAGE(LOG_POT_CALIBRATION_VALIDATED,    4,  "Saved pot calibration left/right/center: %ld/%ld/%ld checked, final position: %ld")  \
+  MESSAGE(LOG_POT_SETTLED,                  2,  "Pot settled at %ld after %ld ms")                                                    \
+  MESSAGE(LOG_DEBUG_WHEEL_SPEEDS,           4,  "Wheel speed left/right (in/s): %ld/%ld, acceleration left/right (in/s^2): %ld/%ld")  \
+  MESSAGE(LOG_DEBUG_WHEEL_SLIP,             2,  "Wheel speed ratio left/right (x1000): %ld, Hall edges rejected: %ld")                \
+  MESSAGE(LOG_DEBUG_LIMIT_SWITCHES,         2,  "Limit switch glitches: %ld, unconfirmed trips mask: 0x%lx")                          \
+  MESSAGE(LOG_DEBUG_SONAR,                  4,  "Wall distance (in.): %ld, valid: %ld, sonar valid mask: 0x%lx, no echoes: %ld")      \
+  MESSAGE(LOG_DEBUG_MEMORY,                 4,  "Memory (bytes) heap high-water: %ld, max stack: %ld, free/min free: %ld/%ld")        \
+  MESSAGE(LOG_FLIGHT_RECORDER_SAVED,        3,  "Flight recorder snapshot saved, event: %ld, samples before/after: %ld/%ld")          \
+  MESSAGE(LOG_EEPROM_LAYOUT_CHANGED,        2,  "EEPROM layout version %ld, expected %ld, journal and snapshot erased")
+
+#define DEBUG_LOG_MESSAGE_ID(id, numArguments, format)   id,
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  DebugLogMessages
+///
+/// Details:  Message IDs and limits for the deferred debug log.
+////////////////////////////////////////////////////////////////////////////////
+class DebugLogMessages
+{
+public:
+  enum Id
+  {
+    DEBUG_LOG_MESSAGES(DEBUG_LOG_MESSAGE_ID)
+    NUM_MESSAGES
+  };
+
+  // A message's frame payload is the time stamp (ms), the ID and then the
+  // arguments, each a zig-zag varint
+  static const uint8_t MAX_ARGUMENTS  = 4;
+  static const uint8_t MAX_FIELDS     = MAX_ARGUMENTS + 2;
+};
+
+#endif // DEBUGLOGMESSAGES_HPP
@@ -24,8 +24,7 @@ const unsigned int SoapBoxDerbyCar::UNUSED_PINS[] =
   PIN_38_RESERVED,            PIN_39_RESERVED,
   PIN_40_RESERVED,            PIN_41_RESERVED,
   PIN_42_RESERVED,            PIN_43_RESERVED,
-  PIN_48_RESERVED,            PIN_49_RESERVED,
-  PIN_50_RESERVED
+  PIN_50_RESERVED,            PIN_51_RESERVED
 };
 
 // GLOBALS
@@ -66,11 +65,33 @@ void SoapBoxDerbyCar::ConfigureDebugPins()
 ///
 /// Details:  Function called when an ASSERT in the code occurs.  For the soap
 ///           box derby car, it will cause an emergency stop and strobe the
-///           debug LEDs.  This function is fatal and cannot be recovered from
-///           without power cycling.
+///           debug LEDs.  The car is stopped before anything is printed, and
+///           the debug log is flushed so the messages leading up to the
+///           assert are not lost.  The flight recorder snapshot of what led
+///           up to it is saved to EEPROM before the loop below.  This
+///           function is fatal and cannot be recovered from without power
+///           cycling.
 ////////////////////////////////////////////////////////////////////////////////
-void SoapBoxDerbyCar::ProcessAssert()
+void SoapBoxDerbyCar::ProcessAssert(const __FlashStringHelper * pFile, int line)
 {
+  // Triggered first, so the snapshot is for the assert and not the stop
+  TriggerFlightRecorder(FLIGHT_RECORDER_ASSERT);
+
+  if (m_pSoapBoxDerbyCar != nullptr)
+  {
+    EmergencyStop(m_pSoapBoxDerbyCar);
+  }
+
+  SaveFlightRecorderOnAssert();
+
+  WriteDebugLog(true);
+  Serial.println();
+  Serial.println(F("ASSERT!"));
+  Serial.print(F("File: "));
+  Serial.println(pFile);
+  Serial.print(F("Line: "));
+  Serial.println(line);
+
   bool ledState = static_cast<bool>(HIGH);
   while (true)
   {
@@ -99,65 +120,151 @@ void SoapBoxDerbyCar::ProcessAssert()
 /// Details:  Displays debug information about the inputs, sensors and other
 ///           state control variables.
 ////////////////////////////////////////////////////////////////////////////////
-void SoapBoxDerbyCar::DisplayValues(bool bShowImmediately)
+void SoapBoxDerbyCar::DisplayValues()
 {
-  static unsigned long currentTimeStamp = 0;
-  static unsigned long oldTimeStamp = 0;
   static int displayCount = 0;
 
-  // Only display things every so often to not hog the CPU
-  currentTimeStamp = GetTimeStampMs();
-  if (bShowImmediately || ((currentTimeStamp - oldTimeStamp) > DEBUG_PRINT_INTERVAL_MS))
+  Serial.print(F("Debug print #"));
+  Serial.print(displayCount++);
+  Serial.print(F(", "));
+  Serial.print(F("Time: "));
+  Serial.println(GetTimeStampMs());
+  
+  Serial.print(F("Steering input: "));
+  Serial.println(m_ControllerChannelInputs[YAW_INPUT_CHANNEL]);
+  Serial.print(F("Brake input: "));
+  Serial.println(m_ControllerChannelInputs[BRAKE_INPUT_CHANNEL]);
+  Serial.print(F("Emergency stop input: "));
+  Serial.println(m_ControllerChannelInputs[MASTER_ENABLE_INPUT_CHANNEL]);
+  Serial.print(F("Controller signal lost mask: 0x"));
+  Serial.println(m_ControllerSignalLostMask, HEX);
+  Serial.print(F("Steering input age (us): "));
+  Serial.println(GetControllerChannelAgeUs(YAW_INPUT_CHANNEL));
+  Serial.print(F("Steering encoder position: "));
+  Serial.print(m_SteeringEncoderPosition);
+  if (!m_bSteeringEncoderValid)
   {
-    Serial.print(F("Debug print #"));
-    Serial.print(displayCount++);
-    Serial.print(F(", "));
-    Serial.print(F("Time: "));
-    Serial.println(currentTimeStamp);
-    
-    Serial.print(F("Steering input: "));
-    Serial.println(m_ControllerChannelInputs[YAW_INPUT_CHANNEL]);
-    Serial.print(F("Brake input: "));
-    Serial.println(m_ControllerChannelInputs[BRAKE_INPUT_CHANNEL]);
-    Serial.print(F("Emergency stop input: "));
-    Serial.println(m_ControllerChannelInputs[MASTER_ENABLE_INPUT_CHANNEL]);
-    Serial.print(F("Steering encoder: "));
-    Serial.println(m_SteeringEncoderValue);
-    Serial.print(F("Steering encoder multiplier: "));
-    Serial.println(m_SteeringEncoderMultiplier);
-    
-    Serial.print(F("Left hall count: "));
-    Serial.println(m_LeftHallCount);
-    Serial.print(F("Right hall count: "));
-    Serial.println(m_RightHallCount);
-    Serial.print(F("Left wheel distance (ft.): "));
-    Serial.println(m_LeftWheelDistanceInches / INCHES_PER_FOOT);
-    Serial.print(F("Right wheel distance (ft.): "));
-    Serial.println(m_RightWheelDistanceInches / INCHES_PER_FOOT);
-    
-    Serial.print(F("Left limit switch: "));
-    Serial.println(m_LeftSteeringLimitSwitchValue);
-    Serial.print(F("Right limit switch: "));
-    Serial.println(m_RightSteeringLimitSwitchValue);
-    Serial.print(F("Brake relay state: "));
-    Serial.println(m_bBrakeApplied);
-    
-    Serial.print(F("Front axle potentiometer: "));
-    Serial.println(m_FrontAxlePotentiometerValue);
-    
-    Serial.print(F("Sonar sensor: "));
-    Serial.println(m_SonarDistanceInches);
-
-    Serial.print(F("Data log index: "));
-    Serial.println(m_NonVolatileCarData.m_DataLogIndex);
-    Serial.print(F("Data log overflowed: "));
-    Serial.println(m_NonVolatileCarData.m_bDataLogOverflowed ? "true" : "false");
+    Serial.print(F(" (no signal)"));
+  }
+  Serial.println();
   
-    Serial.println();
-    Serial.println();
-
-    oldTimeStamp = currentTimeStamp;
+  Serial.print(F("Left hall count: "));
+  Serial.println(m_LeftHallCount);
+  Serial.print(F("Right hall count: "));
+  Serial.println(m_RightHallCount);
+  Serial.print(F("Left wheel distance (in.): "));
+  Serial.println(HallCountToInches(m_LeftHallCount));
+  Serial.print(F("Right wheel distance (in.): "));
+  Serial.println(HallCountToInches(m_RightHallCount));
+  Serial.print(F("Pose X/Y (in.): "));
+  Serial.print(m_Pose.m_XQ8 / POSE_Q8_ONE);
+  Serial.print(F("/"));
+  Serial.println(m_Pose.m_YQ8 / POSE_Q8_ONE);
+  Serial.print(F("Pose heading (deg/100): "));
+  Serial.println(PoseHeadingToCentidegrees(m_Pose.m_HeadingQ8));
+  
+  Serial.print(F("Left limit switch: "));
+  Serial.println(m_LeftSteeringLimitSwitchValue);
+  Serial.print(F("Right limit switch: "));
+  Serial.println(m_RightSteeringLimitSwitchValue);
+  Serial.print(F("Brake relay state: "));
+  Serial.println(m_bBrakeApplied);
+  
+  Serial.print(F("Front axle potentiometer: "));
+  Serial.println(m_FrontAxlePotentiometerValue);
+  
+  for (uint8_t sensor = 0U; sensor < NUM_SONAR_SENSORS; sensor++)
+  {
+    Serial.print(F("Sonar sensor "));
+    Serial.print(sensor);
+    Serial.print(F(": "));
+    if ((m_SonarValidMask & (1U << sensor)) != 0U)
+    {
+      Serial.println(m_SonarDistancesInches[sensor]);
+    }
+    else
+    {
+      Serial.println(F("no echo"));
+    }
   }
+
+  Serial.print(F("Data log index: "));
+  Serial.println(m_NonVolatileCarData.m_DataLogIndex);
+  Serial.print(F("Data log overflowed: "));
+  Serial.println(m_NonVolatileCarData.m_bDataLogOverflowed ? "true" : "false");
+  Serial.print(F("Data log sequence/journaled: "));
+  Serial.print(m_NonVolatileCarData.m_DataLogSequence);
+  Serial.print(F("/"));
+  Serial.println(m_DataLogJournal.m_CommittedSequence);
+
+  Serial.println();
+  Serial.println();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LogDebugValues
+///
+/// Details:  Puts a summary of the inputs, sensors and state in the debug
+///           log.  This is the periodic debug print; unlike DisplayValues()
+///           it does not wait on the console, so it is safe to leave on.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::LogDebugValues()
+{
+  noInterrupts();
+  uint16_t leftHallCount = m_LeftHallCount;
+  uint16_t rightHallCount = m_RightHallCount;
+  interrupts();
+
+  UpdateWheelMotion();
+
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_CONTROLLER_INPUTS,
+                  m_ControllerChannelInputs[YAW_INPUT_CHANNEL],
+                  m_ControllerChannelInputs[BRAKE_INPUT_CHANNEL],
+                  m_ControllerChannelInputs[MASTER_ENABLE_INPUT_CHANNEL],
+                  m_ControllerSignalLostMask);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_WHEELS,
+                  leftHallCount,
+                  rightHallCount,
+                  m_Pose.m_XQ8 / POSE_Q8_ONE,
+                  m_Pose.m_YQ8 / POSE_Q8_ONE);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_STEERING,
+                  PoseHeadingToCentidegrees(m_Pose.m_HeadingQ8),
+                  m_FrontAxlePotentiometerValue,
+                  m_LeftSteeringLimitSwitchValue,
+                  m_RightSteeringLimitSwitchValue);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_DATA_LOG,
+                  m_bBrakeApplied,
+                  m_NonVolatileCarData.m_DataLogIndex,
+                  m_NonVolatileCarData.m_DataLogSequence,
+                  m_DataLogJournal.m_CommittedSequence);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_WHEEL_SPEEDS,
+                  m_LeftWheelMotion.m_SpeedQ8 / POSE_Q8_ONE,
+                  m_RightWheelMotion.m_SpeedQ8 / POSE_Q8_ONE,
+                  m_LeftWheelMotion.m_AccelerationQ8 / POSE_Q8_ONE,
+                  m_RightWheelMotion.m_AccelerationQ8 / POSE_Q8_ONE);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_WHEEL_SLIP,
+                  (GetWheelSpeedRatioQ8() * 1000) / POSE_Q8_ONE,
+                  m_HallRejectedEdgeCount);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_LIMIT_SWITCHES,
+                  m_LimitSwitchGlitchCount,
+                  m_LimitSwitchTrippedMask);
+
+  int wallDistanceInches = 0;
+  bool bWallDistanceValid = GetWallDistanceInches(wallDistanceInches);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_SONAR,
+                  wallDistanceInches,
+                  bWallDistanceValid,
+                  m_SonarValidMask,
+                  m_SonarNoEchoCount);
+
+  MemoryUsage memoryUsage;
+  GetMemoryUsage(memoryUsage);
+  LogDebugMessage(DebugLogMessages::LOG_DEBUG_MEMORY,
+                  memoryUsage.m_HeapHighWaterBytes,
+                  memoryUsage.m_MaxStackBytes,
+                  memoryUsage.m_FreeBytes,
+                  memoryUsage.m_MinFreeBytes);
 }
 
 
@@ -165,66 +272,11 @@ void SoapBoxDerbyCar::DisplayValues(bool bShowImmediately)
 /// Method: ReadSerialInput
 ///
 /// Details:  Gets any input from the serial console and takes action if a
-///           valid command is received.
+///           valid command is received (see SERIAL_COMMANDS, or send 'h').
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ReadSerialInput()
 {
-  if (Serial.available())
-  {
-    switch (Serial.read())
-    {
-      case COMMAND_DISPLAY_DEBUG_PRINTS:
-      {
-        DisplayValues(true);
-        break;
-      }
-      case COMMAND_DISPLAY_DATA_LOG:
-      {
-        DisplayDataLog();
-        break;
-      }
-      case COMMAND_CLEAR_DATA_LOG:
-      {
-        ClearDataLog(RAM_LOG);
-        break;
-      }
-      case COMMAND_SEND_SERIAL_DATA:
-      {
-        SendCarSerialData();
-        break;
-      }
-      case COMMAND_DISPLAY_EEPROM:
-      {
-        DisplayEeprom();
-        break;
-      }
-      case COMMAND_ERASE_EEPROM:
-      {
-        EraseEeprom();
-        break;
-      }
-      case COMMAND_RESTORE_FROM_EEPROM:
-      {
-        RestoreLogFromEeprom();
-        break;
-      }
-      case COMMAND_WRITE_TO_EEPROM:
-      {
-        WriteLogToEeprom();
-        break;
-      }
-      case COMMAND_NEW_LINE:
-      case COMMAND_CARRIAGE_RETURN:
-      {
-        break;
-      }
-      default:
-      {
-        Serial.println(F("Unrecognized input command."));
-        break;
-      }
-    }
-  }
+  ProcessSerialCommands(Serial, m_ConsoleCommandParser, true);
 }
 
 
@@ -237,9 +289,22 @@ void SoapBoxDerbyCar::BlinkStatusLight()
 {
   if (CalcDeltaTimeMs(m_StatusLedTimeStampMs) > STATUS_LED_BLINK_DELAY_MS)
   {
-    digitalWrite(STATUS_LED_PIN, static_cast<int>(m_bStatusLedState));
-    m_bStatusLedState = !m_bStatusLedState;
-    m_StatusLedTimeStampMs = GetTimeStampMs();
+    ToggleStatusLight();
   }
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ToggleStatusLight
+///
+/// Details:  Toggles the status LED.  The scheduler calls this directly at the
+///           blink rate, the blocking loops outside of it use
+///           BlinkStatusLight().
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ToggleStatusLight()
+{
+  DigitalPin<STATUS_LED_PIN>::Write(m_bStatusLedState);
+  m_bStatusLedState = !m_bStatusLedState;
+  m_StatusLedTimeStampMs = GetTimeStampMs();
+}
 
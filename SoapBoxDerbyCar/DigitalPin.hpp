@@ -0,0 +1,203 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     DigitalPin.hpp
+/// Author:   David Stalter
+///
+/// Details:  Direct port access for digital pins whose numbers are known at
+///           compile time.  digitalRead()/digitalWrite() look the pin up in
+///           the core's flash tables, check for a PWM timer and guard the
+///           write with interrupts off every call, which is around 50 cycles.
+///           DigitalPin<pin> resolves the pin to its PINx/PORTx register and
+///           bit while compiling, so a read or write is one or two
+///           instructions (SBIS/SBI/CBI on ports A-G).
+///
+///           Ports H-L are outside the range of the single bit instructions,
+///           so writes to them are a read-modify-write of the whole port.
+///           Those are done with interrupts off, since the car's ISRs write
+///           pins too (the Hall and limit switch LEDs, the sonar trigger),
+///           and one landing between the read and the write would have its
+///           change undone.  Those pins are all on ports A and B today, but
+///           the guard keeps a write safe if one moves.
+///
+///           The pin map is the Arduino Mega 2560's (pins_arduino.h in the
+///           core's mega variant).  Pin modes are still set with pinMode(),
+///           which only happens at start up.  Pins driven with analogWrite()
+///           should not be written this way since the PWM is not turned off.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DIGITALPIN_HPP
+#define DIGITALPIN_HPP
+
+// INCLUDES
+#include <Arduino.h>                  // for the port registers and SREG
+
+#if defined(__AVR__) && !defined(__AVR_ATmega2560__)
+#error "DigitalPin.hpp only has the pin map for the Mega 2560"
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  MegaPinMap
+///
+/// Details:  Compile time Arduino pin number to port and bit lookup.
+////////////////////////////////////////////////////////////////////////////////
+class MegaPinMap
+{
+public:
+  enum Port
+  {
+    PORT_A, PORT_B, PORT_C, PORT_D, PORT_E, PORT_F, PORT_G, PORT_H, PORT_J, PORT_K, PORT_L
+  };
+
+  static const unsigned int NUM_PINS = 70;
+
+  static constexpr bool IsValidPin(unsigned int pin) { return (pin < NUM_PINS); }
+  static constexpr Port GetPort(unsigned int pin) { return static_cast<Port>(PIN_MAP[pin] >> 3); }
+  static constexpr uint8_t GetBit(unsigned int pin) { return (PIN_MAP[pin] & 0x07); }
+
+  // True if the pin is the given port and bit, for checking wiring that
+  // depends on a particular hardware function of a pin
+  static constexpr bool IsPortBit(unsigned int pin, Port port, uint8_t bit)
+  {
+    return IsValidPin(pin) && (GetPort(pin) == port) && (GetBit(pin) == bit);
+  }
+
+private:
+  // Port in the upper bits, bit number in the lower three.  Only ever read
+  // while compiling, so it takes no SRAM.
+  #define MEGA_PIN(port, bit)   static_cast<uint8_t>((PORT_##port << 3) | (bit))
+  static constexpr uint8_t PIN_MAP[NUM_PINS] =
+  {
+    MEGA_PIN(E,0), MEGA_PIN(E,1), MEGA_PIN(E,4), MEGA_PIN(E,5), MEGA_PIN(G,5), MEGA_PIN(E,3), MEGA_PIN(H,3), MEGA_PIN(H,4), MEGA_PIN(H,5), MEGA_PIN(H,6),   //  0 -  9
+    MEGA_PIN(B,4), MEGA_PIN(B,5), MEGA_PIN(B,6), MEGA_PIN(B,7), MEGA_PIN(J,1), MEGA_PIN(J,0), MEGA_PIN(H,1), MEGA_PIN(H,0), MEGA_PIN(D,3), MEGA_PIN(D,2),   // 10 - 19
+    MEGA_PIN(D,1), MEGA_PIN(D,0), MEGA_PIN(A,0), MEGA_PIN(A,1), MEGA_PIN(A,2), MEGA_PIN(A,3), MEGA_PIN(A,4), MEGA_PIN(A,5), MEGA_PIN(A,6), MEGA_PIN(A,7),   // 20 - 29
+    MEGA_PIN(C,7), MEGA_PIN(C,6), MEGA_PIN(C,5), MEGA_PIN(C,4), MEGA_PIN(C,3), MEGA_PIN(C,2), MEGA_PIN(C,1), MEGA_PIN(C,0), MEGA_PIN(D,7), MEGA_PIN(G,2),   // 30 - 39
+    MEGA_PIN(G,1), MEGA_PIN(G,0), MEGA_PIN(L,7), MEGA_PIN(L,6), MEGA_PIN(L,5), MEGA_PIN(L,4), MEGA_PIN(L,3), MEGA_PIN(L,2), MEGA_PIN(L,1), MEGA_PIN(L,0),   // 40 - 49
+    MEGA_PIN(B,3), MEGA_PIN(B,2), MEGA_PIN(B,1), MEGA_PIN(B,0), MEGA_PIN(F,0), MEGA_PIN(F,1), MEGA_PIN(F,2), MEGA_PIN(F,3), MEGA_PIN(F,4), MEGA_PIN(F,5),   // 50 - 59
+    MEGA_PIN(F,6), MEGA_PIN(F,7), MEGA_PIN(K,0), MEGA_PIN(K,1), MEGA_PIN(K,2), MEGA_PIN(K,3), MEGA_PIN(K,4), MEGA_PIN(K,5), MEGA_PIN(K,6), MEGA_PIN(K,7)    // 60 - 69
+  };
+  #undef MEGA_PIN
+};
+
+// Spot checks of the table against the board: the LED on 13, the serial
+// ports, the external interrupts and the timer input captures
+static_assert(MegaPinMap::IsPortBit(13, MegaPinMap::PORT_B, 7), "Mega pin map: 13 is PB7 (LED)");
+static_assert(MegaPinMap::IsPortBit(0, MegaPinMap::PORT_E, 0) && MegaPinMap::IsPortBit(1, MegaPinMap::PORT_E, 1), "Mega pin map: 0/1 are PE0/PE1 (Serial)");
+static_assert(MegaPinMap::IsPortBit(15, MegaPinMap::PORT_J, 0) && MegaPinMap::IsPortBit(14, MegaPinMap::PORT_J, 1), "Mega pin map: 15/14 are PJ0/PJ1 (Serial3)");
+static_assert(MegaPinMap::IsPortBit(21, MegaPinMap::PORT_D, 0) && MegaPinMap::IsPortBit(18, MegaPinMap::PORT_D, 3), "Mega pin map: 21-18 are PD0-PD3 (INT0-INT3)");
+static_assert(MegaPinMap::IsPortBit(2, MegaPinMap::PORT_E, 4) && MegaPinMap::IsPortBit(3, MegaPinMap::PORT_E, 5), "Mega pin map: 2/3 are PE4/PE5 (INT4/INT5)");
+static_assert(MegaPinMap::IsPortBit(49, MegaPinMap::PORT_L, 0) && MegaPinMap::IsPortBit(48, MegaPinMap::PORT_L, 1), "Mega pin map: 49/48 are PL0/PL1 (ICP4/ICP5)");
+static_assert(MegaPinMap::IsPortBit(62, MegaPinMap::PORT_K, 0) && MegaPinMap::IsPortBit(69, MegaPinMap::PORT_K, 7), "Mega pin map: A8-A15 are port K");
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  DigitalPin
+///
+/// Details:  Reads and writes one digital pin through its port registers.
+///           Everything is static, so the class is only ever used as
+///           DigitalPin<pin>::Read() etc.
+////////////////////////////////////////////////////////////////////////////////
+template <unsigned int PIN>
+class DigitalPin
+{
+  static_assert(MegaPinMap::IsValidPin(PIN), "Not a Mega 2560 digital pin!");
+
+public:
+  // Current level of the pin
+  static inline __attribute__((always_inline)) bool Read()
+  {
+    return ((GetPinRegister() & BIT_MASK) != 0U);
+  }
+
+  // Drives an output pin (or turns the pull-up of an input on/off)
+  static inline __attribute__((always_inline)) void Write(bool bHigh)
+  {
+    if (bHigh)
+    {
+      SetHigh();
+    }
+    else
+    {
+      SetLow();
+    }
+  }
+
+  static inline __attribute__((always_inline)) void SetHigh()
+  {
+    if (IS_BIT_ADDRESSABLE)
+    {
+      GetPortRegister() |= BIT_MASK;
+    }
+    else
+    {
+      uint8_t oldSreg = SREG;
+      cli();
+      GetPortRegister() |= BIT_MASK;
+      SREG = oldSreg;
+    }
+  }
+
+  static inline __attribute__((always_inline)) void SetLow()
+  {
+    if (IS_BIT_ADDRESSABLE)
+    {
+      GetPortRegister() &= static_cast<uint8_t>(~BIT_MASK);
+    }
+    else
+    {
+      uint8_t oldSreg = SREG;
+      cli();
+      GetPortRegister() &= static_cast<uint8_t>(~BIT_MASK);
+      SREG = oldSreg;
+    }
+  }
+
+private:
+  static const MegaPinMap::Port PORT        = MegaPinMap::GetPort(PIN);
+  static const uint8_t          BIT_MASK    = static_cast<uint8_t>(1U << MegaPinMap::GetBit(PIN));
+
+  // Ports A-G are in the low I/O space that SBI/CBI reach
+  static const bool             IS_BIT_ADDRESSABLE  = (PORT <= MegaPinMap::PORT_G);
+
+  // The switches fold away since PORT is a constant
+  static inline __attribute__((always_inline)) volatile uint8_t & GetPinRegister()
+  {
+    switch (PORT)
+    {
+      case MegaPinMap::PORT_A:  return PINA;
+      case MegaPinMap::PORT_B:  return PINB;
+      case MegaPinMap::PORT_C:  return PINC;
+      case MegaPinMap::PORT_D:  return PIND;
+      case MegaPinMap::PORT_E:  return PINE;
+      case MegaPinMap::PORT_F:  return PINF;
+      case MegaPinMap::PORT_G:  return PING;
+      case MegaPinMap::PORT_H:  return PINH;
+      case MegaPinMap::PORT_J:  return PINJ;
+      case MegaPinMap::PORT_K:  return PINK;
+      case MegaPinMap::PORT_L:
+      default:                  return PINL;
+    }
+  }
+
+  static inline __attribute__((always_inline)) volatile uint8_t & GetPortRegister()
+  {
+    switch (PORT)
+    {
+      case MegaPinMap::PORT_A:  return PORTA;
+      case MegaPinMap::PORT_B:  return PORTB;
+      case MegaPinMap::PORT_C:  return PORTC;
+      case MegaPinMap::PORT_D:  return PORTD;
+      case MegaPinMap::PORT_E:  return PORTE;
+      case MegaPinMap::PORT_F:  return PORTF;
+      case MegaPinMap::PORT_G:  return PORTG;
+      case MegaPinMap::PORT_H:  return PORTH;
+      case MegaPinMap::PORT_J:  return PORTJ;
+      case MegaPinMap::PORT_K:  return PORTK;
+      case MegaPinMap::PORT_L:
+      default:                  return PORTL;
+    }
+  }
+};
+
+#endif // DIGITALPIN_HPP
@@ -5,6 +5,19 @@
 /// Details:  Contains the main logic and workflow for encoders on a soap box
 ///           derby car.
 ///
+///           The CTRE magnetic encoder's absolute output is a PWM signal whose
+///           duty cycle is the position within one turn.  It is measured by
+///           the Timer 5 input capture unit: the interrupt timestamps each
+///           edge in hardware, turns the high time over the period into a
+///           position, and unwraps it across turns by taking the shortest way
+///           around from the last sample.  That is safe as long as the shaft
+///           turns less than half a turn per PWM period (~4.1ms), which the
+///           steering can't come close to.  Readers just copy the unwrapped
+///           position, so it is available at any loop rate without waiting
+///           on the signal (new samples still only arrive at the PWM rate).
+///
+/// Note: http://www.ctr-electronics.com/downloads/pdf/Magnetic%20Encoder%20User's%20Guide.pdf
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -12,92 +25,226 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+volatile int32_t  SoapBoxDerbyCar::m_SteeringEncoderIsrPosition     = 0;
+volatile uint16_t SoapBoxDerbyCar::m_SteeringEncoderSampleCount     = 0U;
+uint16_t          SoapBoxDerbyCar::m_SteeringEncoderRiseTicks       = 0U;
+uint16_t          SoapBoxDerbyCar::m_SteeringEncoderHighTicks       = 0U;
+uint16_t          SoapBoxDerbyCar::m_SteeringEncoderLastValue       = 0U;
 
 // GLOBALS
 // (none)
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR
+///
+/// Details:  Timer 5 input capture vector (steering encoder PWM).
+////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER5_CAPT_vect)
+{
+  SoapBoxDerbyCar::SteeringEncoderCaptureInterruptHandler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ConfigureSteeringEncoderCapture
+///
+/// Details:  Sets Timer 5 free running in normal mode as the input capture
+///           time base and starts capturing the encoder PWM.  The Arduino
+///           core sets the timer up for analogWrite() on pins 44-46, which is
+///           not used (those are switch inputs).  Timer 4 is the steering
+///           speed controller's, see PwmSpeedController.hpp.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ConfigureSteeringEncoderCapture()
+{
+  static_assert((ENCODER_MIN_PERIOD_TICKS * 2UL) > ENCODER_MAX_PERIOD_TICKS, "Encoder period check can't catch a missed edge!");
+  
+  noInterrupts();
+
+  m_SteeringEncoderIsrPosition = 0;
+  m_SteeringEncoderSampleCount = 0U;
+  m_SteeringEncoderHighTicks = 0U;
+
+  // Normal mode, no output compare pins
+  TCCR5A = 0U;
+
+  // Noise canceler, first capture on a rising edge
+  TCCR5B = _BV(ICNC5) | _BV(ICES5) | ENCODER_TIMER_PRESCALER_BITS;
+
+  // Only the capture interrupt, clear anything stale
+  TIMSK5 = _BV(ICIE5);
+  TIFR5 = _BV(ICF5);
+
+  interrupts();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SteeringEncoderCaptureInterruptHandler
+///
+/// Details:  Handles one captured encoder PWM edge.  A falling edge ends the
+///           high time.  A rising edge ends the period, and the high time
+///           over the period is the position within the turn, which is then
+///           unwrapped.  Samples with a period out of range are dropped; that
+///           is what a missed edge looks like (the pulse is too short at
+///           either end of the turn to switch edges in time), and the unwrap
+///           picks back up from the next good one.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SteeringEncoderCaptureInterruptHandler()
+{
+  uint16_t captureTicks = ICR5;
+  
+  // Changing the edge can set the flag, clear it after each change
+  if ((TCCR5B & _BV(ICES5)) == 0U)
+  {
+    m_SteeringEncoderHighTicks = captureTicks - m_SteeringEncoderRiseTicks;
+    TCCR5B |= _BV(ICES5);
+    TIFR5 = _BV(ICF5);
+    return;
+  }
+
+  uint16_t periodTicks = captureTicks - m_SteeringEncoderRiseTicks;
+  uint16_t highTicks = m_SteeringEncoderHighTicks;
+  m_SteeringEncoderRiseTicks = captureTicks;
+  m_SteeringEncoderHighTicks = 0U;
+  TCCR5B &= ~_BV(ICES5);
+  TIFR5 = _BV(ICF5);
+
+  if ((highTicks == 0U) || (highTicks >= periodTicks) || (periodTicks < ENCODER_MIN_PERIOD_TICKS) || (periodTicks > ENCODER_MAX_PERIOD_TICKS))
+  {
+    return;
+  }
+
+  // Duty cycle relative to the measured period, so the encoder's clock
+  // tolerance does not matter
+  uint16_t value = static_cast<uint16_t>((static_cast<uint32_t>(highTicks) * ENCODER_MAX_VALUE) / periodTicks);
+
+  if (m_SteeringEncoderSampleCount == 0U)
+  {
+    m_SteeringEncoderIsrPosition = value;
+  }
+  else
+  {
+    int16_t delta = static_cast<int16_t>(value - m_SteeringEncoderLastValue);
+    if (delta > (ENCODER_MAX_VALUE / 2))
+    {
+      delta -= ENCODER_MAX_VALUE;
+    }
+    else if (delta < -(ENCODER_MAX_VALUE / 2))
+    {
+      delta += ENCODER_MAX_VALUE;
+    }
+    else
+    {
+    }
+    m_SteeringEncoderIsrPosition += delta;
+  }
+  m_SteeringEncoderLastValue = value;
+
+  // Zero means no samples yet
+  if (++m_SteeringEncoderSampleCount == 0U)
+  {
+    m_SteeringEncoderSampleCount = 1U;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ReadEncoders
+///
+/// Details:  Reads and stores all encoder values.  The position is only
+///           valid while samples keep arriving.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ReadEncoders()
+{
+  noInterrupts();
+  uint16_t sampleCount = m_SteeringEncoderSampleCount;
+  int32_t position = m_SteeringEncoderIsrPosition;
+  interrupts();
+
+  if (sampleCount != m_SteeringEncoderLastSampleCount)
+  {
+    m_SteeringEncoderLastSampleCount = sampleCount;
+    m_SteeringEncoderSampleTimeStampMs = GetTimeStampMs();
+    m_SteeringEncoderPosition = position;
+  }
+
+  m_bSteeringEncoderValid = (sampleCount != 0U) && (CalcDeltaTimeMs(m_SteeringEncoderSampleTimeStampMs) < ENCODER_SIGNAL_LOST_TIMEOUT_MS);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: CenterSteeringByEncoder
 ///
 /// Details:  Automatically turns the steering to max left, then to max right,
-///           and finally attempts to move back to true center.
+///           and finally attempts to move back to true center.  The encoder
+///           counts down turning right, but nothing here depends on which
+///           way it counts.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::CenterSteeringByEncoder()
 {
   // @todo: This should be part of calibrate, not center.
   
-  Serial.println(F("Centering steering by encoder..."));
+  LogDebugMessage(DebugLogMessages::LOG_ENCODER_CENTERING_START);
+
+  ReadEncoders();
+  if (!m_bSteeringEncoderValid)
+  {
+    LogDebugMessage(DebugLogMessages::LOG_ENCODER_CENTERING_FAILED);
+    return;
+  }
   
   // Calibrate max left
   SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_LEFT_SPEED);
-  while (m_LeftSteeringLimitSwitchValue != 1)
+  do
   {
     ReadLimitSwitches();
     ReadEncoders();
-  }
+  } while ((m_LeftSteeringLimitSwitchValue != 1) && m_bSteeringEncoderValid);
   SetSteeringSpeedControllerValue(OFF);
-  int leftEncoderCalibrationValue = m_SteeringEncoderValue;
-  int leftEncoderRange = (ENCODER_MAX_VALUE * m_SteeringEncoderMultiplier) + leftEncoderCalibrationValue;
+  int32_t leftEncoderPosition = m_SteeringEncoderPosition;
 
   // Calibrate max right
   SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_RIGHT_SPEED);
-  while (m_RightSteeringLimitSwitchValue != 1)
+  do
   {
     ReadLimitSwitches();
-    ReadEncoders();   
-  }
+    ReadEncoders();
+  } while ((m_RightSteeringLimitSwitchValue != 1) && m_bSteeringEncoderValid);
   SetSteeringSpeedControllerValue(OFF);
-  int rightEncoderCalibrationValue = m_SteeringEncoderValue;
-  int rightEncoderRange = (ENCODER_MAX_VALUE * m_SteeringEncoderMultiplier) + rightEncoderCalibrationValue;
+  int32_t rightEncoderPosition = m_SteeringEncoderPosition;
 
-  // @todo: Check and update based on the multiplier to calculate max left/right.
-  
-  // Attempt to find and move to center
-  int totalEncoderRange = rightEncoderRange - leftEncoderRange;
-  int centerEncoderPosition = rightEncoderRange - (totalEncoderRange / 2);
+  // Head back left until the position crosses the center
+  int32_t centerEncoderPosition = leftEncoderPosition + ((rightEncoderPosition - leftEncoderPosition) / 2);
+  bool bCountsUpGoingLeft = (leftEncoderPosition > rightEncoderPosition);
   SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_LEFT_SPEED);
-  while (((m_SteeringEncoderValue + (ENCODER_MAX_VALUE * m_SteeringEncoderMultiplier)) > centerEncoderPosition) && (m_LeftSteeringLimitSwitchValue != 1))
+  while ((m_LeftSteeringLimitSwitchValue != 1) && m_bSteeringEncoderValid &&
+         (bCountsUpGoingLeft ? (m_SteeringEncoderPosition < centerEncoderPosition) : (m_SteeringEncoderPosition > centerEncoderPosition)))
   {
     ReadLimitSwitches();
     ReadEncoders();
   }
   SetSteeringSpeedControllerValue(OFF);
 
-  // @todo: If the starting position is very
-  // far right, the center value ends up
-  // being negative and we fail to calibrate.
-  Serial.print(F("Current value: "));
-  Serial.println(m_SteeringEncoderValue);
-  Serial.print(F("Multiplier: "));
-  Serial.println(m_SteeringEncoderMultiplier);
-  Serial.print(F("Left encoder calibration: "));
-  Serial.println(leftEncoderCalibrationValue);
-  Serial.print(F("Right encoder calibration: "));
-  Serial.println(rightEncoderCalibrationValue);
-  Serial.print(F("Left encoder range: "));
-  Serial.println(leftEncoderRange);
-  Serial.print(F("Right encoder range: "));
-  Serial.println(rightEncoderRange);
-  Serial.print(F("Total range: "));
-  Serial.println(totalEncoderRange);
-  Serial.print(F("Center encoder position: "));
-  Serial.println(centerEncoderPosition);
-  Serial.println();
+  LogDebugMessage(DebugLogMessages::LOG_ENCODER_CENTERING_POSITIONS,
+                  leftEncoderPosition,
+                  rightEncoderPosition,
+                  centerEncoderPosition,
+                  m_SteeringEncoderPosition);
 
   // If the left limit switch tripped again, we
   // went all the way back to the left and failed
   // to properly find the center.  If the right
-  // limit switch tripped, we never tried to go
-  // back to the center.
-  if (m_LeftSteeringLimitSwitchValue == 1 || m_RightSteeringLimitSwitchValue == 1)
+  // limit switch is still tripped, we never tried
+  // to go back to the center.  Losing the encoder
+  // signal anywhere along the way also fails.
+  if ((m_LeftSteeringLimitSwitchValue == 1) || (m_RightSteeringLimitSwitchValue == 1) || !m_bSteeringEncoderValid)
   {
-    Serial.println(F("CALIBRATION FAILED!!!"));
+    LogDebugMessage(DebugLogMessages::LOG_ENCODER_CENTERING_FAILED);
   }
   else
   {
-    Serial.println(F("CALIBRATION SUCCESSFUL"));
+    LogDebugMessage(DebugLogMessages::LOG_ENCODER_CENTERING_SUCCESSFUL);
   }
 }
 
@@ -105,7 +252,8 @@ void SoapBoxDerbyCar::CenterSteeringByEncoder()
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: CalibrateSteeringEncoder
 ///
-/// Details:  Gathers information about the encoder and its readings.
+/// Details:  Gathers information about the encoder and its readings by
+///           pulsing the steering motor and measuring how far it moves.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::CalibrateSteeringEncoder()
 {
@@ -113,176 +261,62 @@ void SoapBoxDerbyCar::CalibrateSteeringEncoder()
   // @todo: Iterate left/right, relying on the limit switches
   // Use caution with this loop - it does not look at the limit switches.
   // Right now it should only be called with no load.
-  for (uint32_t i = 0U; i < 128; i++)
+  int32_t deltaSteeringEncoderLow = INT32_MAX;
+  int32_t deltaSteeringEncoderHigh = INT32_MIN;
+  int32_t totalSteeringEncoder = 0;
+  
+  for (uint8_t i = 1U; i <= ENCODER_CALIBRATION_NUM_STEPS; i++)
   {
-    // First time through discard the data
-    static bool bFirst = true;
-
-    // Get and measure the data
-    uint32_t startSteeringEncoderValue = pulseIn(STEERING_ENCODER_PIN, HIGH, PULSE_IN_TIMEOUT_US);
+    // Get and measure the data.  The position is already unwrapped, so
+    // there is no rollover case to handle.
+    ReadEncoders();
+    int32_t startSteeringEncoderPosition = m_SteeringEncoderPosition;
     uint32_t startTime = GetTimeStampMs();
     SetSteeringSpeedControllerValue(100);
     delay(100);
     SetSteeringSpeedControllerValue(OFF);
     uint32_t endTime = GetTimeStampMs();
-    uint32_t endSteeringEncoderValue = pulseIn(STEERING_ENCODER_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-    uint32_t deltaSteeringEncoderValue = 0U;
-    
-    if (bFirst)
-    {
-      Serial.println(F("First discarded."));
-      Serial.println();
-      bFirst = false;
-      delay(5000);
-    }
-    else
-    {
-      // Positive control causes the encoder to count down
-      // start > end is the normal case
-      if (startSteeringEncoderValue > endSteeringEncoderValue)
-      {
-        deltaSteeringEncoderValue = startSteeringEncoderValue - endSteeringEncoderValue;
-      }
-      // end > start, rollover case
-      else
-      {
-        deltaSteeringEncoderValue = (4096 - endSteeringEncoderValue) + startSteeringEncoderValue;
-      }
-  
-      static uint32_t deltaSteeringEncoderLow = deltaSteeringEncoderValue;
-      static uint32_t deltaSteeringEncoderHigh = deltaSteeringEncoderValue;
-      
-      // Save off high/low
-      if (deltaSteeringEncoderValue < deltaSteeringEncoderLow)
-      {
-        deltaSteeringEncoderLow = deltaSteeringEncoderValue;
-      }
-      if (deltaSteeringEncoderValue > deltaSteeringEncoderHigh)
-      {
-        deltaSteeringEncoderHigh = deltaSteeringEncoderValue;
-      }
-  
-      static uint64_t totalSteeringEncoder = 0ULL;
-      totalSteeringEncoder += deltaSteeringEncoderValue;
-      static uint32_t count = 0U;
-      count++;
-      
-      Serial.print(F("Encoder Start: "));
-      Serial.println(startSteeringEncoderValue);
-      Serial.print(F("Encoder End: "));
-      Serial.println(endSteeringEncoderValue);
-      Serial.print(F("Encoder Delta: "));
-      Serial.println(deltaSteeringEncoderValue);
-      Serial.print(F("Encoder Low: "));
-      Serial.println(deltaSteeringEncoderLow);
-      Serial.print(F("Encoder High: "));
-      Serial.println(deltaSteeringEncoderHigh);
-      Serial.print(F("Encoder Average: "));
-      Serial.println(static_cast<int>(totalSteeringEncoder / count));
-      
-      //Serial.print(F("Start Time: "));
-      //Serial.println(startTime);
-      //Serial.print(F("End Time: "));
-      //Serial.println(endTime);
-      Serial.print(F("Time Delta: "));
-      Serial.println(endTime - startTime);
-      
-      Serial.println();
-      Serial.println();
-      
-      delay(100);
-    }
-  }
-}
-
-
-////////////////////////////////////////////////////////////////////////////////
-/// Method: ReadEncoders
-///
-/// Details:  Reads and stores all encoder values.  This method also contains
-///           some logic to handle encoder overflow by monitoring encoder
-///           direction of change and using a multiplier since the encoder
-///           is relative with a range of 0 - 4096.
-///
-/// Note: http://www.ctr-electronics.com/downloads/pdf/Magnetic%20Encoder%20User's%20Guide.pdf
-////////////////////////////////////////////////////////////////////////////////
-void SoapBoxDerbyCar::ReadEncoders()
-{
-  // This method should not currently be called
-  ASSERT(false);
-  
-  static bool bFirstTime = true;
-  static int previousSteeringEncoderValue = -1;
-
-  // The first time through we need to get a previous value
-  // so that any subsequent calls have valid data to use.
-  if (bFirstTime)
-  {
-    previousSteeringEncoderValue = pulseIn(STEERING_ENCODER_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-    m_SteeringEncoderMultiplier = 0;
-    bFirstTime = false;
-  }
-  else
-  {
-    // Save previous value, no further action needed
-    previousSteeringEncoderValue = m_SteeringEncoderValue;
-  }
-
-  // Get a new sample reading for this call
-  m_SteeringEncoderValue = pulseIn(STEERING_ENCODER_PIN, HIGH, PULSE_IN_TIMEOUT_US);
-
-  // @todo: Have this use the multiplier!
-  // Save off minimum value seen
-  /*
-  if (steeringEncoderValue < minSteeringEncoderValue)
-  {
-    minSteeringEncoderValue = steeringEncoderValue;
-  }
+    ReadEncoders();
+    int32_t endSteeringEncoderPosition = m_SteeringEncoderPosition;
 
-  // Save off maximum value seen
-  if (steeringEncoderValue > maxSteeringEncoderValue)
-  {
-    maxSteeringEncoderValue = steeringEncoderValue;
-  }
-  */
-  
-  // This section of code checks for overflow/underflow of the encoder.
-  // The data read on the pulseIn has empirically shown to not be constant,
-  // even if the steering mechanism is not moving.  To ensure that we are
-  // seeing a 'new' reading instead of variations from the same physical
-  // position, make sure the difference of the two numbers exceeds the
-  // steering jitter.  This logic *might* handle the case where the
-  // absolute position is near zero by ensuring too large of a delta is
-  // also not seen.
-  const int STEERING_ENCODER_JITTER_MIN = 1000;
-  const int STEERING_ENCODER_JITTER_MAX = 4050;
-
-  int steeringEncoderDifference = abs(m_SteeringEncoderValue - previousSteeringEncoderValue);
-  if ((steeringEncoderDifference > STEERING_ENCODER_JITTER_MIN) && (steeringEncoderDifference < STEERING_ENCODER_JITTER_MAX))
-  {
-    // If the speed controller indicates we are moving left
-    if (m_SteeringDirection == LEFT)
+    if (!m_bSteeringEncoderValid)
     {
-      // If we are going left (counting down) and see a jump
-      // back up, we rolled under.
-      if (previousSteeringEncoderValue < m_SteeringEncoderValue)
-      {
-        m_SteeringEncoderMultiplier--;
-      }
+      Serial.println(F("No encoder signal."));
+      return;
     }
-    // If the speed controller indicates we are moving right
-    else if (m_SteeringDirection == RIGHT)
+
+    // Positive control causes the encoder to count down
+    int32_t deltaSteeringEncoderValue = startSteeringEncoderPosition - endSteeringEncoderPosition;
+    
+    // Save off high/low
+    if (deltaSteeringEncoderValue < deltaSteeringEncoderLow)
     {
-      // If we are going right (counting up) and see a jump
-      // back down, we rolled over.
-      if (previousSteeringEncoderValue > m_SteeringEncoderValue)
-      {
-        m_SteeringEncoderMultiplier++;
-      }
+      deltaSteeringEncoderLow = deltaSteeringEncoderValue;
     }
-    else
+    if (deltaSteeringEncoderValue > deltaSteeringEncoderHigh)
     {
+      deltaSteeringEncoderHigh = deltaSteeringEncoderValue;
     }
+    totalSteeringEncoder += deltaSteeringEncoderValue;
+    
+    Serial.print(F("Encoder Start: "));
+    Serial.println(startSteeringEncoderPosition);
+    Serial.print(F("Encoder End: "));
+    Serial.println(endSteeringEncoderPosition);
+    Serial.print(F("Encoder Delta: "));
+    Serial.println(deltaSteeringEncoderValue);
+    Serial.print(F("Encoder Low: "));
+    Serial.println(deltaSteeringEncoderLow);
+    Serial.print(F("Encoder High: "));
+    Serial.println(deltaSteeringEncoderHigh);
+    Serial.print(F("Encoder Average: "));
+    Serial.println(totalSteeringEncoder / i);
+    Serial.print(F("Time Delta: "));
+    Serial.println(endTime - startTime);
+    
+    Serial.println();
+    Serial.println();
+    
+    delay(100);
   }
-}
-
+}
@@ -0,0 +1,388 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     FlightRecorder.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains the flight recorder for a soap box derby car.
+///
+/// Note:     The data log only takes an entry every DATA_LOG_ENTRY_INTERVAL_MS,
+///           which is too coarse to show what led up to a limit switch trip,
+///           the brake dropping, an emergency stop, an assert or autonomous
+///           starting and ending.  The flight recorder keeps a short ring of
+///           samples taken at the steering control rate instead: the
+///           controller inputs, the pot, the Hall counts and the steering
+///           command.
+///
+///           An event in FLIGHT_RECORDER_TRIGGER_MASK keeps the ring going
+///           for FLIGHT_RECORDER_POST_TRIGGER_SAMPLES more samples and then
+///           freezes it, leaving up to FLIGHT_RECORDER_PRE_TRIGGER_SAMPLES
+///           from before the event in it.  The frozen samples are saved to
+///           the snapshot after the data log journal in EEPROM, a byte at a
+///           time like the journal, and the header goes last so a torn save
+///           leaves a bad CRC.  Sampling stops while the save runs, then the
+///           ring starts over and the next event can trigger it.  Events
+///           that come in while a snapshot is being captured or saved are
+///           not recorded.
+///
+///           An assert does not wait for the post-trigger samples, since
+///           nothing updates the values being sampled after it.  It freezes
+///           whatever the ring holds and saves it before stopping the car's
+///           loop for good (see ProcessAssert()).
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+IGNORE_FLAGS("-Wignored-qualifiers")  // Silence warnings in EEPROM.h header
+#include <EEPROM.h>                   // for writing the snapshot to EEPROM
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+SoapBoxDerbyCar::FlightRecorderSample         SoapBoxDerbyCar::m_FlightRecorderSamples[FLIGHT_RECORDER_NUM_SAMPLES]  = {};
+volatile uint8_t                              SoapBoxDerbyCar::m_FlightRecorderState                                = FLIGHT_RECORDER_ARMED;
+uint8_t                                       SoapBoxDerbyCar::m_FlightRecorderHead                                 = 0U;
+uint8_t                                       SoapBoxDerbyCar::m_FlightRecorderNumSamples                           = 0U;
+volatile uint8_t                              SoapBoxDerbyCar::m_FlightRecorderPostSamplesLeft                      = 0U;
+uint16_t                                      SoapBoxDerbyCar::m_FlightRecorderTick                                 = 0U;
+SoapBoxDerbyCar::FlightRecorderSnapshotHeader SoapBoxDerbyCar::m_FlightRecorderSnapshotHeader                       = {};
+uint16_t                                      SoapBoxDerbyCar::m_FlightRecorderSavePosition                         = 0U;
+
+// Order must match FlightRecorderEvent
+const char SoapBoxDerbyCar::FLIGHT_RECORDER_EVENT_NAMES[NUM_FLIGHT_RECORDER_EVENTS][16] PROGMEM =
+{
+  "Limit switch",
+  "Brake",
+  "Emergency stop",
+  "Assert",
+  "Auto launch",
+  "Auto exit"
+};
+
+// GLOBALS
+// (none)
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: TriggerFlightRecorder
+///
+/// Details:  Marks an event for the flight recorder.  If the event is in
+///           FLIGHT_RECORDER_TRIGGER_MASK and the recorder is armed, the
+///           post-trigger samples start.  Safe to call from an ISR.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::TriggerFlightRecorder(FlightRecorderEvent event)
+{
+  if ((FLIGHT_RECORDER_TRIGGER_MASK & (1U << event)) == 0U)
+  {
+    return;
+  }
+
+  uint8_t oldSreg = SREG;
+  cli();
+  if (m_FlightRecorderState == FLIGHT_RECORDER_ARMED)
+  {
+    m_FlightRecorderSnapshotHeader.m_TriggerTimeMs = GetTimeStampMs();
+    m_FlightRecorderSnapshotHeader.m_Incarnation = m_NonVolatileCarData.m_Incarnation;
+    m_FlightRecorderSnapshotHeader.m_Event = static_cast<uint8_t>(event);
+    m_FlightRecorderPostSamplesLeft = FLIGHT_RECORDER_POST_TRIGGER_SAMPLES;
+    m_FlightRecorderState = FLIGHT_RECORDER_CAPTURING;
+  }
+  SREG = oldSreg;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateFlightRecorder
+///
+/// Details:  Flight recorder task.  Takes a sample every
+///           FLIGHT_RECORDER_SAMPLE_PERIOD_MS, freezing the ring once the
+///           post-trigger samples are in, or moves the snapshot save along
+///           by a byte.  It runs at a fixed rate internally, so it is also
+///           called directly from the autonomous loops, where the scheduler
+///           is not running.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateFlightRecorder()
+{
+  if (m_FlightRecorderState == FLIGHT_RECORDER_SAVING)
+  {
+    SaveFlightRecorderSnapshot();
+
+    if (m_FlightRecorderState == FLIGHT_RECORDER_ARMED)
+    {
+      LogDebugMessage(DebugLogMessages::LOG_FLIGHT_RECORDER_SAVED,
+                      m_FlightRecorderSnapshotHeader.m_Event,
+                      m_FlightRecorderSnapshotHeader.m_TriggerIndex,
+                      m_FlightRecorderSnapshotHeader.m_NumSamples - m_FlightRecorderSnapshotHeader.m_TriggerIndex);
+    }
+    return;
+  }
+
+  uint16_t currentTick = GetSchedulerTick();
+  if (static_cast<uint16_t>(currentTick - m_FlightRecorderTick) < FLIGHT_RECORDER_SAMPLE_PERIOD_MS)
+  {
+    return;
+  }
+  m_FlightRecorderTick = currentTick;
+
+  RecordFlightRecorderSample();
+
+  noInterrupts();
+  if ((m_FlightRecorderState == FLIGHT_RECORDER_CAPTURING) && (--m_FlightRecorderPostSamplesLeft == 0U))
+  {
+    FreezeFlightRecorder();
+  }
+  interrupts();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RecordFlightRecorderSample
+///
+/// Details:  Adds a sample of the current inputs and steering command to the
+///           ring, over the oldest one once it is full.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::RecordFlightRecorderSample()
+{
+  noInterrupts();
+  uint16_t leftHallCount = m_LeftHallCount;
+  uint16_t rightHallCount = m_RightHallCount;
+  uint8_t limitSwitchMask = m_LimitSwitchRawMask;
+  interrupts();
+
+  uint8_t flags = 0U;
+  flags |= m_bBrakeSwitch ? FLIGHT_RECORDER_BRAKE_SWITCH_FLAG : 0U;
+  flags |= m_bMasterEnable ? FLIGHT_RECORDER_MASTER_ENABLE_FLAG : 0U;
+  flags |= m_bBrakeApplied ? FLIGHT_RECORDER_BRAKE_APPLIED_FLAG : 0U;
+  flags |= ((limitSwitchMask & LEFT_LIMIT_SWITCH_BIT) != 0U) ? FLIGHT_RECORDER_LEFT_LIMIT_FLAG : 0U;
+  flags |= ((limitSwitchMask & RIGHT_LIMIT_SWITCH_BIT) != 0U) ? FLIGHT_RECORDER_RIGHT_LIMIT_FLAG : 0U;
+  flags |= m_bIsAutonomousExecuting ? FLIGHT_RECORDER_AUTONOMOUS_FLAG : 0U;
+  flags |= (m_ControllerSignalLostMask != 0U) ? FLIGHT_RECORDER_CONTROLLER_LOST_FLAG : 0U;
+
+  FlightRecorderSample & rSample = m_FlightRecorderSamples[m_FlightRecorderHead];
+  rSample.m_TimeStampMs = static_cast<uint16_t>(GetTimeStampMs());
+  rSample.m_YawInputUs = static_cast<uint16_t>(m_ControllerChannelInputs[YAW_INPUT_CHANNEL]);
+  rSample.m_PotValue = static_cast<int16_t>(m_FrontAxlePotentiometerValue);
+  rSample.m_LeftHallCount = leftHallCount;
+  rSample.m_RightHallCount = rightHallCount;
+  rSample.m_SteeringValue = static_cast<int8_t>(m_CurrentSteeringValue);
+  rSample.m_Flags = flags;
+
+  m_FlightRecorderHead = ((m_FlightRecorderHead + 1U) < FLIGHT_RECORDER_NUM_SAMPLES) ? (m_FlightRecorderHead + 1U) : 0U;
+  if (m_FlightRecorderNumSamples < FLIGHT_RECORDER_NUM_SAMPLES)
+  {
+    m_FlightRecorderNumSamples++;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: FreezeFlightRecorder
+///
+/// Details:  Stops sampling and starts saving the ring to EEPROM.  The
+///           snapshot is all of the samples in the ring, and the ones taken
+///           since the trigger are at the end.  The CRC is finished as the
+///           samples are saved.  Interrupts must be off.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::FreezeFlightRecorder()
+{
+  FlightRecorderSnapshotHeader & rHeader = m_FlightRecorderSnapshotHeader;
+  uint8_t numPostTriggerSamples = FLIGHT_RECORDER_POST_TRIGGER_SAMPLES - m_FlightRecorderPostSamplesLeft;
+  if (numPostTriggerSamples > m_FlightRecorderNumSamples)
+  {
+    numPostTriggerSamples = m_FlightRecorderNumSamples;
+  }
+  rHeader.m_NumSamples = m_FlightRecorderNumSamples;
+  rHeader.m_TriggerIndex = m_FlightRecorderNumSamples - numPostTriggerSamples;
+  rHeader.m_Reserved = 0U;
+
+  const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rHeader);
+  uint16_t crc = DataLogCodec::CRC_SEED;
+  for (uint8_t i = 0U; i < offsetof(FlightRecorderSnapshotHeader, m_Crc); i++)
+  {
+    crc = DataLogCodec::UpdateCrc(crc, pHeader[i]);
+  }
+  rHeader.m_Crc = crc;
+
+  m_FlightRecorderPostSamplesLeft = 0U;
+  m_FlightRecorderSavePosition = 0U;
+  m_FlightRecorderState = FLIGHT_RECORDER_SAVING;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SaveFlightRecorderSnapshot
+///
+/// Details:  Advances the snapshot save by one byte, oldest sample first and
+///           the header last.  Returns right away while the EEPROM is busy.
+///           Bytes that already match are skipped without writing.  Once the
+///           header is written, the ring starts over and the recorder is
+///           armed again.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SaveFlightRecorderSnapshot()
+{
+  if (!eeprom_is_ready())
+  {
+    return;
+  }
+
+  FlightRecorderSnapshotHeader & rHeader = m_FlightRecorderSnapshotHeader;
+  uint16_t dataSize = rHeader.m_NumSamples * sizeof(FlightRecorderSample);
+  uint8_t oldestSample = (m_FlightRecorderHead + FLIGHT_RECORDER_NUM_SAMPLES - rHeader.m_NumSamples) % FLIGHT_RECORDER_NUM_SAMPLES;
+  unsigned dataOffset = FLIGHT_RECORDER_EEPROM_OFFSET + sizeof(FlightRecorderSnapshotHeader);
+  while (m_FlightRecorderSavePosition < dataSize)
+  {
+    uint16_t position = m_FlightRecorderSavePosition++;
+    uint8_t sample = (oldestSample + (position / sizeof(FlightRecorderSample))) % FLIGHT_RECORDER_NUM_SAMPLES;
+    uint8_t data = reinterpret_cast<const uint8_t *>(&m_FlightRecorderSamples[sample])[position % sizeof(FlightRecorderSample)];
+    rHeader.m_Crc = DataLogCodec::UpdateCrc(rHeader.m_Crc, data);
+    if (EEPROM.read(dataOffset + position) != data)
+    {
+      EEPROM.write(dataOffset + position, data);
+      return;
+    }
+  }
+
+  const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rHeader);
+  while (m_FlightRecorderSavePosition < (dataSize + sizeof(FlightRecorderSnapshotHeader)))
+  {
+    uint16_t position = m_FlightRecorderSavePosition++ - dataSize;
+    if (EEPROM.read(FLIGHT_RECORDER_EEPROM_OFFSET + position) != pHeader[position])
+    {
+      EEPROM.write(FLIGHT_RECORDER_EEPROM_OFFSET + position, pHeader[position]);
+      return;
+    }
+  }
+
+  m_FlightRecorderNumSamples = 0U;
+  m_FlightRecorderState = FLIGHT_RECORDER_ARMED;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SaveFlightRecorderOnAssert
+///
+/// Details:  Freezes the flight recorder without waiting for the rest of
+///           the post-trigger samples and saves the snapshot, waiting on the
+///           EEPROM.  If a snapshot from an earlier event is being captured
+///           or saved, that one is finished instead of the assert's.  It
+///           does not rely on interrupts, since an assert can come from an
+///           ISR.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SaveFlightRecorderOnAssert()
+{
+  uint8_t oldSreg = SREG;
+  cli();
+  if (m_FlightRecorderState == FLIGHT_RECORDER_CAPTURING)
+  {
+    FreezeFlightRecorder();
+  }
+
+  while (m_FlightRecorderState == FLIGHT_RECORDER_SAVING)
+  {
+    SaveFlightRecorderSnapshot();
+  }
+  SREG = oldSreg;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ReadFlightRecorderSnapshot
+///
+/// Details:  Reads the snapshot header from EEPROM and checks its CRC against
+///           the samples.  Returns whether there is a valid snapshot.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::ReadFlightRecorderSnapshot(FlightRecorderSnapshotHeader & rHeader)
+{
+  GenericReadFromEeprom(rHeader, FLIGHT_RECORDER_EEPROM_OFFSET);
+
+  if ((rHeader.m_NumSamples > FLIGHT_RECORDER_NUM_SAMPLES) ||
+      (rHeader.m_TriggerIndex > rHeader.m_NumSamples) ||
+      (rHeader.m_Event >= NUM_FLIGHT_RECORDER_EVENTS))
+  {
+    return false;
+  }
+
+  const uint8_t * pHeader = reinterpret_cast<const uint8_t *>(&rHeader);
+  uint16_t crc = DataLogCodec::CRC_SEED;
+  for (uint8_t i = 0U; i < offsetof(FlightRecorderSnapshotHeader, m_Crc); i++)
+  {
+    crc = DataLogCodec::UpdateCrc(crc, pHeader[i]);
+  }
+
+  unsigned dataOffset = FLIGHT_RECORDER_EEPROM_OFFSET + sizeof(FlightRecorderSnapshotHeader);
+  uint16_t dataSize = rHeader.m_NumSamples * sizeof(FlightRecorderSample);
+  for (uint16_t i = 0U; i < dataSize; i++)
+  {
+    crc = DataLogCodec::UpdateCrc(crc, EEPROM.read(dataOffset + i));
+  }
+
+  return (crc == rHeader.m_Crc);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DisplayFlightRecorder
+///
+/// Details:  Displays the recorder state and the snapshot saved in EEPROM on
+///           the console.  Sample times are relative to the trigger, and
+///           sample numbers count from the first one after it.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::DisplayFlightRecorder()
+{
+  Serial.print(F("Flight recorder: "));
+  if (m_FlightRecorderState == FLIGHT_RECORDER_ARMED)
+  {
+    Serial.println(F("armed"));
+  }
+  else if (m_FlightRecorderState == FLIGHT_RECORDER_CAPTURING)
+  {
+    Serial.println(F("capturing"));
+  }
+  else
+  {
+    Serial.println(F("saving"));
+  }
+
+  FlightRecorderSnapshotHeader header;
+  if (!ReadFlightRecorderSnapshot(header))
+  {
+    Serial.println(F("No flight recorder snapshot in EEPROM."));
+    return;
+  }
+
+  Serial.print(F("Event: "));
+  Serial.print(reinterpret_cast<const __FlashStringHelper *>(FLIGHT_RECORDER_EVENT_NAMES[header.m_Event]));
+  Serial.print(F(", incarnation: "));
+  Serial.print(header.m_Incarnation);
+  Serial.print(F(", time (ms): "));
+  Serial.print(header.m_TriggerTimeMs);
+  Serial.print(F(", samples before/after: "));
+  Serial.print(header.m_TriggerIndex);
+  Serial.print(F("/"));
+  Serial.println(header.m_NumSamples - header.m_TriggerIndex);
+
+  unsigned offset = FLIGHT_RECORDER_EEPROM_OFFSET + sizeof(FlightRecorderSnapshotHeader);
+  for (uint8_t i = 0U; i < header.m_NumSamples; i++)
+  {
+    FlightRecorderSample sample;
+    GenericReadFromEeprom(sample, offset);
+    offset += sizeof(sample);
+
+    Serial.print(F("Sample #"));
+    Serial.print(static_cast<int>(i) - static_cast<int>(header.m_TriggerIndex));
+    Serial.print(F(" - Time (ms): "));
+    Serial.print(static_cast<int16_t>(sample.m_TimeStampMs - static_cast<uint16_t>(header.m_TriggerTimeMs)));
+    Serial.print(F(", Steering input: "));
+    Serial.print(sample.m_YawInputUs);
+    Serial.print(F(", Pot: "));
+    Serial.print(sample.m_PotValue);
+    Serial.print(F(", Hall counts left/right: "));
+    Serial.print(sample.m_LeftHallCount);
+    Serial.print(F("/"));
+    Serial.print(sample.m_RightHallCount);
+    Serial.print(F(", Steering: "));
+    Serial.print(static_cast<int>(sample.m_SteeringValue));
+    Serial.print(F(", Flags: 0x"));
+    Serial.println(sample.m_Flags, HEX);
+  }
+
+  Serial.println();
+}
@@ -8,6 +8,13 @@
 ///           https://www.sunfounder.com/learn/sensor_kit_v1_for_Arduino/lesson-1-hall-sensor-sensor-kit-v1-for-arduino.html
 ///           for some guidance on the Hall sensor.
 ///
+///           Each wheel has 12 magnets, so a count is ~3.2 inches of travel.
+///           The ISRs also time stamp every edge, which gives each wheel's
+///           speed and acceleration as of its last magnet and lets the
+///           distance be interpolated between magnets.  The pose estimator
+///           uses the interpolated distances, so a difference between the
+///           wheels shows up as it happens instead of a whole magnet later.
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -15,7 +22,11 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+SoapBoxDerbyCar::WheelMotion SoapBoxDerbyCar::m_LeftWheelMotion                            = {};
+SoapBoxDerbyCar::WheelMotion SoapBoxDerbyCar::m_RightWheelMotion                           = {};
+unsigned long                SoapBoxDerbyCar::m_LeftHallEdgeTimesUs[HALL_EDGE_RING_SIZE]   = {};
+unsigned long                SoapBoxDerbyCar::m_RightHallEdgeTimesUs[HALL_EDGE_RING_SIZE]  = {};
+volatile uint16_t            SoapBoxDerbyCar::m_HallRejectedEdgeCount                      = 0U;
 
 // GLOBALS
 // (none)
@@ -45,21 +56,24 @@ void SoapBoxDerbyCar::LeftHallSensorInterruptHandler()
   // 'volatile' because this is an ISR and the Arduino
   // documentation recommends it.
   static volatile InterruptEdgeDirection leftSensorInterruptEdge;
+
+  // Time stamp first, so it is as close to the edge as possible
+  unsigned long edgeTimeUs = GetTimeStampUs();
   
   // Get the value of the pin so we can distinguish
   // if this is a rising or falling edge interrupt.
-  leftSensorInterruptEdge = static_cast<InterruptEdgeDirection>(!digitalRead(LEFT_HALL_SENSOR_PIN));
+  leftSensorInterruptEdge = static_cast<InterruptEdgeDirection>(!DigitalPin<LEFT_HALL_SENSOR_PIN>::Read());
   
   // Only increment the sensor value if we see a
   // rising edge (magnetic field appearing).
   if (leftSensorInterruptEdge == RISING_EDGE)
   {
     // Increase the counter
-    GetSingletonInstance()->IncrementLeftHallSensorCount();
+    GetSingletonInstance()->IncrementLeftHallSensorCount(edgeTimeUs);
   }
   
   // Update the visual LED
-  digitalWrite(LEFT_HALL_SENSOR_LED_PIN, static_cast<int>(leftSensorInterruptEdge));
+  DigitalPin<LEFT_HALL_SENSOR_LED_PIN>::Write(leftSensorInterruptEdge == RISING_EDGE);
 }
 
 
@@ -87,32 +101,187 @@ void SoapBoxDerbyCar::RightHallSensorInterruptHandler()
   // 'volatile' because this is an ISR and the Arduino
   // documentation recommends it.
   static volatile InterruptEdgeDirection rightSensorInterruptEdge;
+
+  // Time stamp first, so it is as close to the edge as possible
+  unsigned long edgeTimeUs = GetTimeStampUs();
   
   // Get the value of the pin so we can distinguish
   // if this is a rising or falling edge interrupt.
-  rightSensorInterruptEdge = static_cast<InterruptEdgeDirection>(!digitalRead(RIGHT_HALL_SENSOR_PIN));
+  rightSensorInterruptEdge = static_cast<InterruptEdgeDirection>(!DigitalPin<RIGHT_HALL_SENSOR_PIN>::Read());
   
   // Only increment the sensor value if we see a
   // rising edge (magnetic field appearing).
   if (rightSensorInterruptEdge == RISING_EDGE)
   {
     // Increase the counter
-    GetSingletonInstance()->IncrementRightHallSensorCount();
+    GetSingletonInstance()->IncrementRightHallSensorCount(edgeTimeUs);
   }
   
   // Update the visual LED
-  digitalWrite(RIGHT_HALL_SENSOR_LED_PIN, static_cast<int>(rightSensorInterruptEdge));
+  DigitalPin<RIGHT_HALL_SENSOR_LED_PIN>::Write(rightSensorInterruptEdge == RISING_EDGE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RecordHallEdge
+///
+/// Details:  Counts a magnet passing a Hall sensor and time stamps it in the
+///           wheel's edge ring.  An edge sooner than HALL_MIN_EDGE_INTERVAL_US
+///           after the last one is faster than the car can go, so it is noise
+///           (sensor bounce or pickup on the wiring).  It is dropped and
+///           counted instead.  Called from the Hall sensor ISRs.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::RecordHallEdge(volatile unsigned int & rHallCount, unsigned long * pEdgeTimesUs, unsigned long edgeTimeUs)
+{
+  const unsigned int RING_MASK = HALL_EDGE_RING_SIZE - 1U;
+
+  unsigned int hallCount = rHallCount;
+  if ((edgeTimeUs - pEdgeTimesUs[(hallCount - 1U) & RING_MASK]) < HALL_MIN_EDGE_INTERVAL_US)
+  {
+    if (m_HallRejectedEdgeCount < UINT16_MAX)
+    {
+      m_HallRejectedEdgeCount++;
+    }
+    return;
+  }
+
+  pEdgeTimesUs[hallCount & RING_MASK] = edgeTimeUs;
+  rHallCount = hallCount + 1U;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ResetHallSensorCounts
 ///
-/// Details:  Resets the values of the hall sensor counters to zero.
+/// Details:  Resets the values of the hall sensor counters to zero, along
+///           with the wheel motion derived from them.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ResetHallSensorCounts()
 {
+  const unsigned int RING_MASK = HALL_EDGE_RING_SIZE - 1U;
+
+  noInterrupts();
+
+  // The last edge moves to the slot before count zero, where the glitch
+  // filter looks for it
+  m_LeftHallEdgeTimesUs[RING_MASK] = m_LeftHallEdgeTimesUs[(m_LeftHallCount - 1U) & RING_MASK];
+  m_RightHallEdgeTimesUs[RING_MASK] = m_RightHallEdgeTimesUs[(m_RightHallCount - 1U) & RING_MASK];
   m_LeftHallCount = 0;
   m_RightHallCount = 0;
+
+  interrupts();
+
+  m_LeftWheelMotion = WheelMotion();
+  m_RightWheelMotion = WheelMotion();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateWheelMotion
+///
+/// Details:  Brings the motion of both rear wheels up to date with their Hall
+///           edges.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateWheelMotion()
+{
+  UpdateWheelMotion(m_LeftWheelMotion, m_LeftHallCount, m_LeftHallEdgeTimesUs);
+  UpdateWheelMotion(m_RightWheelMotion, m_RightHallCount, m_RightHallEdgeTimesUs);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateWheelMotion
+///
+/// Details:  Updates one wheel's motion.  New edges give the speed over the
+///           last magnet and the acceleration between the last two.  Between
+///           edges, the distance is interpolated at the last speed (stopping
+///           just short of the next magnet), and once the next edge is later
+///           than the last interval the speed can be no more than one magnet
+///           over the time since the last edge, so it decays as the wheel
+///           slows down.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateWheelMotion(WheelMotion & rWheel, const volatile unsigned int & rHallCount, const unsigned long * pEdgeTimesUs)
+{
+  const unsigned int RING_MASK = HALL_EDGE_RING_SIZE - 1U;
+  const int32_t US_PER_SECOND = 1000000L;
+
+  // The time is taken with the edges so it cannot be before the last one
+  noInterrupts();
+  uint16_t hallCount = rHallCount;
+  unsigned long lastEdgeTimeUs = pEdgeTimesUs[(hallCount - 1U) & RING_MASK];
+  unsigned long previousEdgeTimeUs = pEdgeTimesUs[(hallCount - 2U) & RING_MASK];
+  unsigned long oldestEdgeTimeUs = pEdgeTimesUs[(hallCount - 3U) & RING_MASK];
+  unsigned long currentTimeUs = GetTimeStampUs();
+  interrupts();
+
+  uint16_t numNewEdges = hallCount - rWheel.m_HallCount;
+  if (numNewEdges != 0U)
+  {
+    rWheel.m_HallCount = hallCount;
+    rWheel.m_NumEdges = (numNewEdges >= 3U) ? 3U : min(rWheel.m_NumEdges + numNewEdges, 3U);
+    rWheel.m_LastEdgeTimeUs = lastEdgeTimeUs;
+
+    if (rWheel.m_NumEdges >= 2U)
+    {
+      unsigned long intervalUs = lastEdgeTimeUs - previousEdgeTimeUs;
+      rWheel.m_LastEdgeIntervalUs = intervalUs;
+      rWheel.m_SpeedQ8 = static_cast<int32_t>(static_cast<unsigned long>(WHEEL_LENGTH_PER_MAGNET_Q8 * US_PER_SECOND) / intervalUs);
+    }
+
+    if (rWheel.m_NumEdges >= 3U)
+    {
+      // Each speed is the average over its interval, so they are half of
+      // each interval apart.  1s = 15625 * 64us keeps this in 32 bits.
+      unsigned long previousIntervalUs = previousEdgeTimeUs - oldestEdgeTimeUs;
+      int32_t previousSpeedQ8 = static_cast<int32_t>(static_cast<unsigned long>(WHEEL_LENGTH_PER_MAGNET_Q8 * US_PER_SECOND) / previousIntervalUs);
+      int32_t speedChangeQ8 = constrain(rWheel.m_SpeedQ8 - previousSpeedQ8, -(INT32_MAX / 15625L), (INT32_MAX / 15625L));
+      unsigned long speedChangeTimeUs = (rWheel.m_LastEdgeIntervalUs + previousIntervalUs) / 2U;
+      rWheel.m_AccelerationQ8 = (speedChangeQ8 * 15625L) / static_cast<int32_t>(speedChangeTimeUs / 64U);
+    }
+  }
+
+  int32_t distanceQ8 = static_cast<int32_t>(hallCount) * WHEEL_LENGTH_PER_MAGNET_Q8;
+  if (rWheel.m_NumEdges < 2U)
+  {
+    rWheel.m_DistanceQ8 = distanceQ8;
+    return;
+  }
+
+  unsigned long sinceEdgeUs = currentTimeUs - rWheel.m_LastEdgeTimeUs;
+  int32_t fractionQ8 = POSE_Q8_ONE - 1;
+  if (sinceEdgeUs >= HALL_WHEEL_STOPPED_TIMEOUT_US)
+  {
+    rWheel.m_SpeedQ8 = 0;
+    rWheel.m_AccelerationQ8 = 0;
+  }
+  else if (sinceEdgeUs > rWheel.m_LastEdgeIntervalUs)
+  {
+    int32_t maxSpeedQ8 = static_cast<int32_t>(static_cast<unsigned long>(WHEEL_LENGTH_PER_MAGNET_Q8 * US_PER_SECOND) / sinceEdgeUs);
+    rWheel.m_SpeedQ8 = min(rWheel.m_SpeedQ8, maxSpeedQ8);
+  }
+  else
+  {
+    fractionQ8 = min(static_cast<int32_t>((sinceEdgeUs * POSE_Q8_ONE) / rWheel.m_LastEdgeIntervalUs), POSE_Q8_ONE - 1);
+  }
+
+  rWheel.m_DistanceQ8 = distanceQ8 + ((WHEEL_LENGTH_PER_MAGNET_Q8 * fractionQ8) / POSE_Q8_ONE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetWheelSpeedRatioQ8
+///
+/// Details:  Returns the left wheel speed over the right, Q8.  Above one
+///           means the car is turning right.  It is one while either wheel
+///           has no speed yet.
+////////////////////////////////////////////////////////////////////////////////
+int32_t SoapBoxDerbyCar::GetWheelSpeedRatioQ8() const
+{
+  if ((m_LeftWheelMotion.m_SpeedQ8 == 0) || (m_RightWheelMotion.m_SpeedQ8 == 0))
+  {
+    return POSE_Q8_ONE;
+  }
+
+  return (m_LeftWheelMotion.m_SpeedQ8 * POSE_Q8_ONE) / m_RightWheelMotion.m_SpeedQ8;
 }
 
@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     Memory.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains the SRAM usage monitor for a soap box derby car.
+///
+/// Note:     The Mega's 8kB of SRAM holds the static data (.data/.bss) at
+///           the bottom, the heap right above it and the stack coming down
+///           from the top.  Nothing stops the two from running into each
+///           other, so this measures how close they get.
+///
+///           At boot, everything between the top of the heap and the stack
+///           pointer is painted with STACK_PAINT_VALUE.  The memory task
+///           then scans up from the top of the heap for the first byte that
+///           is no longer painted, which is as deep as the stack has ever
+///           been.  The scan is done a chunk at a time so the task stays
+///           short.  The heap only grows through malloc(), so its high-water
+///           mark is just the highest top of the heap seen.
+///
+///           With STATIC_ALLOCATION, the car and its speed controller are
+///           static data instead of coming off the heap, so the build's
+///           SRAM report (see Benchmark/Makefile) includes them.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+uint8_t * SoapBoxDerbyCar::m_pStackLowWater       = nullptr;
+uint8_t * SoapBoxDerbyCar::m_pStackScanPointer    = nullptr;
+uint8_t * SoapBoxDerbyCar::m_pHeapHighWater       = nullptr;
+
+// GLOBALS
+// The end of the static data (from the linker) and the top of the heap
+// (from avr-libc's malloc(), null until the first allocation)
+extern char __heap_start[];
+extern char * __brkval;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetHeapEnd
+///
+/// Details:  Returns the first byte above the heap.
+////////////////////////////////////////////////////////////////////////////////
+uint8_t * SoapBoxDerbyCar::GetHeapEnd()
+{
+  return reinterpret_cast<uint8_t *>((__brkval != nullptr) ? __brkval : __heap_start);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: PaintStack
+///
+/// Details:  Paints the free SRAM between the heap and the stack.  It runs
+///           before the car is created, so the heap in use is what the core
+///           allocated.  Interrupts are off so none of them can push onto
+///           the stack below the stack pointer while it is being painted.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::PaintStack()
+{
+  noInterrupts();
+
+  uint8_t * pHeapEnd = GetHeapEnd();
+  uint8_t * pStackPointer = reinterpret_cast<uint8_t *>(SP);
+  for (uint8_t * pData = pHeapEnd; pData <= pStackPointer; pData++)
+  {
+    *pData = STACK_PAINT_VALUE;
+  }
+
+  m_pStackLowWater = pStackPointer + 1;
+  m_pStackScanPointer = pHeapEnd;
+  m_pHeapHighWater = pHeapEnd;
+
+  interrupts();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateMemoryUsage
+///
+/// Details:  Memory task.  Records the top of the heap and scans the next
+///           chunk of painted SRAM for stack use.  A scan runs from the top
+///           of the heap to the lowest stack byte found so far, and starts
+///           over when it finds a byte the stack wrote or gets there.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateMemoryUsage()
+{
+  uint8_t * pHeapEnd = GetHeapEnd();
+  if (pHeapEnd > m_pHeapHighWater)
+  {
+    m_pHeapHighWater = pHeapEnd;
+  }
+
+  // The heap may have grown over the bytes the scan was on
+  if (m_pStackScanPointer < pHeapEnd)
+  {
+    m_pStackScanPointer = pHeapEnd;
+  }
+
+  uint8_t * pScanEnd = m_pStackScanPointer + MEMORY_SCAN_CHUNK_BYTES;
+  if (pScanEnd > m_pStackLowWater)
+  {
+    pScanEnd = m_pStackLowWater;
+  }
+
+  uint8_t * pData = m_pStackScanPointer;
+  while ((pData < pScanEnd) && (*pData == STACK_PAINT_VALUE))
+  {
+    pData++;
+  }
+
+  if ((pData < pScanEnd) || (pData == m_pStackLowWater))
+  {
+    m_pStackLowWater = pData;
+    m_pStackScanPointer = pHeapEnd;
+  }
+  else
+  {
+    m_pStackScanPointer = pData;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetMemoryUsage
+///
+/// Details:  Fills in the current and worst case SRAM usage, in bytes.
+///           The stack and minimum free values are as of the last complete
+///           scan.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::GetMemoryUsage(MemoryUsage & rUsage)
+{
+  uint8_t * pRamStart = reinterpret_cast<uint8_t *>(RAMSTART);
+  uint8_t * pRamEnd = reinterpret_cast<uint8_t *>(RAMEND);
+  uint8_t * pHeapStart = reinterpret_cast<uint8_t *>(__heap_start);
+  uint8_t * pHeapEnd = GetHeapEnd();
+  uint8_t * pStackPointer = reinterpret_cast<uint8_t *>(SP);
+
+  rUsage.m_StaticDataBytes = static_cast<uint16_t>(pHeapStart - pRamStart);
+  rUsage.m_HeapBytes = static_cast<uint16_t>(pHeapEnd - pHeapStart);
+  rUsage.m_HeapHighWaterBytes = static_cast<uint16_t>(m_pHeapHighWater - pHeapStart);
+  rUsage.m_MaxStackBytes = static_cast<uint16_t>(pRamEnd - m_pStackLowWater + 1);
+  rUsage.m_FreeBytes = static_cast<uint16_t>(pStackPointer - pHeapEnd + 1);
+  rUsage.m_MinFreeBytes = static_cast<uint16_t>(m_pStackLowWater - m_pHeapHighWater);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DisplayMemoryUsage
+///
+/// Details:  Displays the SRAM usage on the console.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::DisplayMemoryUsage()
+{
+  MemoryUsage usage;
+  GetMemoryUsage(usage);
+
+  Serial.print(F("Static data (bytes): "));
+  Serial.println(usage.m_StaticDataBytes);
+  Serial.print(F("Heap/high-water (bytes): "));
+  Serial.print(usage.m_HeapBytes);
+  Serial.print(F("/"));
+  Serial.println(usage.m_HeapHighWaterBytes);
+  Serial.print(F("Max stack (bytes): "));
+  Serial.println(usage.m_MaxStackBytes);
+  Serial.print(F("Free/min free (bytes): "));
+  Serial.print(usage.m_FreeBytes);
+  Serial.print(F("/"));
+  Serial.println(usage.m_MinFreeBytes);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SendMemoryUsageData
+///
+/// Details:  Sends the SRAM usage out the car data serial port as one binary
+///           frame (see TelemetryProtocol.hpp).  Like the car data frames,
+///           it is dropped and counted if the transmit buffer is full.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SendMemoryUsageData()
+{
+  MemoryUsage usage;
+  GetMemoryUsage(usage);
+
+  int32_t memoryData[TelemetryProtocol::NUM_MEMORY_USAGE_FIELDS] = {};
+  memoryData[TelemetryProtocol::STATIC_DATA_BYTES] = usage.m_StaticDataBytes;
+  memoryData[TelemetryProtocol::HEAP_BYTES] = usage.m_HeapBytes;
+  memoryData[TelemetryProtocol::HEAP_HIGH_WATER_BYTES] = usage.m_HeapHighWaterBytes;
+  memoryData[TelemetryProtocol::MAX_STACK_BYTES] = usage.m_MaxStackBytes;
+  memoryData[TelemetryProtocol::FREE_BYTES] = usage.m_FreeBytes;
+  memoryData[TelemetryProtocol::MIN_FREE_BYTES] = usage.m_MinFreeBytes;
+
+  uint8_t frame[TelemetryProtocol::MAX_FRAME_SIZE_BYTES];
+  uint8_t frameSize = TelemetryProtocol::EncodeFrame(TelemetryProtocol::MEMORY_USAGE_FRAME,
+                                                     m_CarDataSequence++,
+                                                     memoryData,
+                                                     TelemetryProtocol::NUM_MEMORY_USAGE_FIELDS,
+                                                     frame);
+
+  // Make sure the buffer wasn't overrun
+  ASSERT(frameSize <= sizeof(frame));
+
+  if (m_pDataTransmitSerialPort->availableForWrite() >= frameSize)
+  {
+    m_pDataTransmitSerialPort->write(frame, frameSize);
+  }
+  else
+  {
+    m_CarDataDroppedFrameCount++;
+  }
+}
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     Odometry.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains the pose estimator for a soap box derby car.  Distance
+///           travelled comes from the rear wheel Hall sensors.  Heading comes
+///           from the front axle angle (the bicycle model, smooth but off by
+///           any alignment error) pulled slowly toward the heading implied by
+///           the difference between the rear wheels (unbiased, but a Hall
+///           count is ~5.7 degrees of it).  The wheel distances are
+///           interpolated between Hall counts from the edge times, so the
+///           wheel heading moves smoothly instead of in whole counts.
+///
+///           The heading error that remains is integrated into an axle bias,
+///           which learns the steering alignment error so the heading does
+///           not settle off by it (a PI complementary filter).
+///
+///           Everything is fixed point, with the trig done from tables in
+///           flash that are generated at compile time.  The tables are
+///           indexed by pot clicks, the angle one pot click moves the axle,
+///           which is also the unit used for heading.  See the notes in
+///           ReadPotentiometers() for the geometry.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+#define POSE_TABLE_ROW(entry, i)  entry(i), entry((i) + 1), entry((i) + 2), entry((i) + 3), entry((i) + 4), entry((i) + 5), entry((i) + 6), entry((i) + 7)
+#define POSE_TABLE(entry)         POSE_TABLE_ROW(entry, 0), POSE_TABLE_ROW(entry, 8), POSE_TABLE_ROW(entry, 16), POSE_TABLE_ROW(entry, 24),  \
+                                  POSE_TABLE_ROW(entry, 32), POSE_TABLE_ROW(entry, 40), POSE_TABLE_ROW(entry, 48), POSE_TABLE_ROW(entry, 56), \
+                                  entry(64)
+#define POSE_TAN_ENTRY(i)         PoseTableEntry(PoseTan((i) * AXLE_RADIANS_PER_POT_CLICK))
+#define POSE_SIN_ENTRY(i)         PoseTableEntry(PoseSin((i) * AXLE_RADIANS_PER_POT_CLICK))
+#define POSE_VERSIN_ENTRY(i)      PoseTableEntry(PoseVersin((i) * AXLE_RADIANS_PER_POT_CLICK))
+
+// Q16 tan, sin and versine (1 - cos) for 0 - 64 clicks
+const uint16_t SoapBoxDerbyCar::POSE_TAN_TABLE[POSE_TABLE_SIZE] PROGMEM = { POSE_TABLE(POSE_TAN_ENTRY) };
+const uint16_t SoapBoxDerbyCar::POSE_SIN_TABLE[POSE_TABLE_SIZE] PROGMEM = { POSE_TABLE(POSE_SIN_ENTRY) };
+const uint16_t SoapBoxDerbyCar::POSE_VERSIN_TABLE[POSE_TABLE_SIZE] PROGMEM = { POSE_TABLE(POSE_VERSIN_ENTRY) };
+
+#undef POSE_TABLE_ROW
+#undef POSE_TABLE
+#undef POSE_TAN_ENTRY
+#undef POSE_SIN_ENTRY
+#undef POSE_VERSIN_ENTRY
+
+// GLOBALS
+// (none)
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ResetPose
+///
+/// Details:  Makes the current position the origin, facing straight down the
+///           hill.  Call right after ResetHallSensorCounts(), since the wheel
+///           heading is taken from the total wheel distances.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ResetPose()
+{
+  UpdateWheelMotion();
+  m_Pose.m_LastLeftDistanceQ8 = m_LeftWheelMotion.m_DistanceQ8;
+  m_Pose.m_LastRightDistanceQ8 = m_RightWheelMotion.m_DistanceQ8;
+
+  m_Pose.m_XQ8 = 0;
+  m_Pose.m_YQ8 = 0;
+  m_Pose.m_HeadingQ8 = 0;
+  m_Pose.m_AxleBiasQ16 = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdatePose
+///
+/// Details:  Advances the pose by the wheel distances travelled since the
+///           last update.  Uses the latest front axle potentiometer reading.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdatePose()
+{
+  UpdateWheelMotion();
+  int32_t leftDistanceQ8 = m_LeftWheelMotion.m_DistanceQ8;
+  int32_t rightDistanceQ8 = m_RightWheelMotion.m_DistanceQ8;
+
+  int32_t newDistanceQ8 = (leftDistanceQ8 - m_Pose.m_LastLeftDistanceQ8) + (rightDistanceQ8 - m_Pose.m_LastRightDistanceQ8);
+  m_Pose.m_LastLeftDistanceQ8 = leftDistanceQ8;
+  m_Pose.m_LastRightDistanceQ8 = rightDistanceQ8;
+
+  if (newDistanceQ8 == 0)
+  {
+    return;
+  }
+
+  // Rear axle center travel
+  int32_t travelQ8 = newDistanceQ8 / 2;
+
+  // Heading change from the front axle: ds * tan(axle angle) / wheel base
+  int32_t axleAngleQ8 = (static_cast<int32_t>(m_FrontAxlePotCenterValue - m_FrontAxlePotentiometerValue) * POSE_Q8_ONE) + (m_Pose.m_AxleBiasQ16 / POSE_Q8_ONE);
+  int32_t tanQ16 = LookupPoseTable(POSE_TAN_TABLE, axleAngleQ8);
+  if (axleAngleQ8 < 0)
+  {
+    tanQ16 = -tanQ16;
+  }
+  m_Pose.m_HeadingQ8 += (travelQ8 * tanQ16) / POSE_STEERING_HEADING_DIVISOR;
+
+  // Pull toward the heading from the wheels, in proportion to the distance
+  // travelled.  The left wheel ahead means the car has turned right.
+  // The gains are per Hall count of travel, and the travel is usually a
+  // fraction of a count, so the bias is kept to Q16 to not lose it.
+  int32_t wheelHeadingQ8 = ((leftDistanceQ8 - rightDistanceQ8) * POSE_HEADING_PER_HALL_COUNT_Q8) / WHEEL_LENGTH_PER_MAGNET_Q8;
+  int32_t headingErrorQ8 = wheelHeadingQ8 - m_Pose.m_HeadingQ8;
+  int32_t travelledErrorQ8 = (headingErrorQ8 * travelQ8) / WHEEL_LENGTH_PER_MAGNET_Q8;
+  m_Pose.m_HeadingQ8 += (travelledErrorQ8 * POSE_HEADING_CORRECTION_Q8) / POSE_Q8_ONE;
+  m_Pose.m_AxleBiasQ16 += travelledErrorQ8 * POSE_AXLE_BIAS_CORRECTION_Q8;
+
+  // Position
+  int32_t sinQ16 = LookupPoseTable(POSE_SIN_TABLE, m_Pose.m_HeadingQ8);
+  if (m_Pose.m_HeadingQ8 < 0)
+  {
+    sinQ16 = -sinQ16;
+  }
+  int32_t versinQ16 = LookupPoseTable(POSE_VERSIN_TABLE, m_Pose.m_HeadingQ8);
+
+  m_Pose.m_XQ8 += travelQ8 - ((travelQ8 * versinQ16) / POSE_Q16_ONE);
+  m_Pose.m_YQ8 += (travelQ8 * sinQ16) / POSE_Q16_ONE;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LookupPoseTable
+///
+/// Details:  Linearly interpolates one of the pose tables at the magnitude
+///           of a Q8 click angle.  Angles past the end of the table use the
+///           last entry.
+////////////////////////////////////////////////////////////////////////////////
+uint16_t SoapBoxDerbyCar::LookupPoseTable(const uint16_t * pTable, int32_t angleQ8)
+{
+  if (angleQ8 < 0)
+  {
+    angleQ8 = -angleQ8;
+  }
+
+  int32_t index = angleQ8 / POSE_Q8_ONE;
+  if (index >= (POSE_TABLE_SIZE - 1))
+  {
+    return pgm_read_word(&pTable[POSE_TABLE_SIZE - 1]);
+  }
+
+  uint16_t low = pgm_read_word(&pTable[index]);
+  uint16_t high = pgm_read_word(&pTable[index + 1]);
+  uint16_t fraction = static_cast<uint16_t>(angleQ8 % POSE_Q8_ONE);
+
+  return low + static_cast<uint16_t>((static_cast<uint32_t>(high - low) * fraction) / POSE_Q8_ONE);
+}
@@ -5,6 +5,14 @@
 /// Details:  Contains the main logic and workflow for potentiometers on a soap
 ///           box derby car.
 ///
+///           The front axle pot is sampled by the ADC in free running mode.
+///           The ADC interrupt accumulates POT_ADC_OVERSAMPLE_COUNT
+///           conversions and decimates them into one 12-bit sample, which is
+///           pushed into a small ring.  Readers filter the ring (moving
+///           average or median) without ever waiting on a conversion.  Do not
+///           call analogRead() while the ADC is free running; it would wait
+///           forever for a conversion to end.
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -12,126 +20,362 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+volatile uint16_t SoapBoxDerbyCar::m_PotAdcSamples[POT_FILTER_SIZE] = {};
+volatile uint16_t SoapBoxDerbyCar::m_PotAdcSampleSum                = 0U;
+volatile uint8_t  SoapBoxDerbyCar::m_PotAdcSampleIndex              = 0U;
+volatile uint8_t  SoapBoxDerbyCar::m_PotAdcSampleCount              = 0U;
+volatile uint16_t SoapBoxDerbyCar::m_PotAdcOversampleSum            = 0U;
+volatile uint8_t  SoapBoxDerbyCar::m_PotAdcOversampleCount          = 0U;
 
 // GLOBALS
 // (none)
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR
+///
+/// Details:  ADC conversion complete vector (front axle potentiometer).
+////////////////////////////////////////////////////////////////////////////////
+ISR(ADC_vect)
+{
+  SoapBoxDerbyCar::PotentiometerAdcInterruptHandler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ConfigurePotentiometerAdc
+///
+/// Details:  Starts the ADC free running on the front axle potentiometer and
+///           waits for the first decimated sample.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ConfigurePotentiometerAdc()
+{
+  static_assert((POT_FILTER_SIZE & (POT_FILTER_SIZE - 1U)) == 0U, "Pot filter size must be a power of 2!");
+  static_assert((POT_MEDIAN_SIZE <= POT_FILTER_SIZE) && ((POT_MEDIAN_SIZE % 2U) == 1U), "Pot median size must be odd and fit in the filter!");
+  static_assert((POT_ADC_OVERSAMPLE_COUNT * 1023UL) <= UINT16_MAX, "Pot oversample sum overflows!");
+  static_assert((POT_FILTER_SIZE * (1023UL << POT_ADC_DECIMATION_SHIFT)) <= UINT16_MAX, "Pot filter sum overflows!");
+
+  noInterrupts();
+
+  m_PotAdcSampleSum = 0U;
+  m_PotAdcSampleIndex = 0U;
+  m_PotAdcSampleCount = 0U;
+  m_PotAdcOversampleSum = 0U;
+  m_PotAdcOversampleCount = 0U;
+  for (uint8_t i = 0U; i < POT_FILTER_SIZE; i++)
+  {
+    m_PotAdcSamples[i] = 0U;
+  }
+
+  // AVcc reference (same as analogRead()), right adjusted, channel 0-7
+  ADMUX = _BV(REFS0) | (FRONT_AXLE_POTENTIOMETER_PIN & 0x07);
+
+  // Free running (auto trigger source 0), MUX5 clear for channels 0-7
+  ADCSRB = 0U;
+
+  // The pot pin is analog only, turn off its digital input buffer
+  DIDR0 |= _BV(FRONT_AXLE_POTENTIOMETER_PIN & 0x07);
+
+  // Enable, start, auto trigger, interrupt
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | POT_ADC_PRESCALER_BITS;
+
+  interrupts();
+
+  while (m_PotAdcSampleCount == 0U)
+  {
+    delay(1);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: PotentiometerAdcInterruptHandler
+///
+/// Details:  Accumulates one ADC conversion.  Every POT_ADC_OVERSAMPLE_COUNT
+///           conversions, the decimated sample goes into the ring and the
+///           running sum used by the moving average is updated.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::PotentiometerAdcInterruptHandler()
+{
+  m_PotAdcOversampleSum += ADC;
+  if (++m_PotAdcOversampleCount < POT_ADC_OVERSAMPLE_COUNT)
+  {
+    return;
+  }
+
+  uint16_t sample = m_PotAdcOversampleSum >> POT_ADC_DECIMATION_SHIFT;
+  m_PotAdcOversampleSum = 0U;
+  m_PotAdcOversampleCount = 0U;
+
+  uint8_t index = m_PotAdcSampleIndex;
+  m_PotAdcSampleSum = (m_PotAdcSampleSum - m_PotAdcSamples[index]) + sample;
+  m_PotAdcSamples[index] = sample;
+  m_PotAdcSampleIndex = (index + 1U) & (POT_FILTER_SIZE - 1U);
+
+  if (m_PotAdcSampleCount < POT_FILTER_SIZE)
+  {
+    m_PotAdcSampleCount++;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CalculateSteeringCalibrationChecksum
+///
+/// Details:  Computes the checksum over the saved pot calibration values.
+////////////////////////////////////////////////////////////////////////////////
+uint16_t SoapBoxDerbyCar::CalculateSteeringCalibrationChecksum(const SteeringCalibration & rCalibration)
+{
+  return CalculateNonVolatileChecksum(&rCalibration, offsetof(SteeringCalibration, m_Checksum), STEERING_CALIBRATION_CHECKSUM_SEED);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LoadSteeringCalibration
+///
+/// Details:  Takes the pot calibration stored in EEPROM if it is valid and
+///           makes sense.  Otherwise the RAM copy is left with a bad checksum
+///           so ValidateSteeringCalibration() knows there isn't one.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::LoadSteeringCalibration(const NonVolatileCarData & rEepromCarData)
+{
+  const SteeringCalibration & rSaved = rEepromCarData.m_SteeringCalibration;
+  SteeringCalibration & rCalibration = m_NonVolatileCarData.m_SteeringCalibration;
+
+  // Pot is wired up where left -> right is decreasing
+  if ((memcmp(&rEepromCarData.m_Header, NON_VOLATILE_CAR_DATA_HEADER, sizeof(rEepromCarData.m_Header)) == 0) &&
+      (CalculateSteeringCalibrationChecksum(rSaved) == rSaved.m_Checksum) &&
+      ((rSaved.m_PotMaxLeftValue - rSaved.m_PotMaxRightValue) >= AUTO_CENTERING_MIN_RANGE_CLICKS) &&
+      (rSaved.m_PotCenterValue < rSaved.m_PotMaxLeftValue) &&
+      (rSaved.m_PotCenterValue > rSaved.m_PotMaxRightValue))
+  {
+    rCalibration = rSaved;
+  }
+  else
+  {
+    memset(&rCalibration, 0, sizeof(rCalibration));
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SaveSteeringCalibration
+///
+/// Details:  Saves the current pot calibration to EEPROM right away, so it
+///           survives even if the data log is never written.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SaveSteeringCalibration()
+{
+  SteeringCalibration & rCalibration = m_NonVolatileCarData.m_SteeringCalibration;
+  rCalibration.m_PotMaxLeftValue = m_FrontAxlePotMaxLeftValue;
+  rCalibration.m_PotMaxRightValue = m_FrontAxlePotMaxRightValue;
+  rCalibration.m_PotCenterValue = m_FrontAxlePotCenterValue;
+  rCalibration.m_Checksum = CalculateSteeringCalibrationChecksum(rCalibration);
+
+  WriteEepromCarDataHeader();
+  GenericWriteToEeprom(rCalibration, offsetof(NonVolatileCarData, m_SteeringCalibration));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ValidateSteeringCalibration
+///
+/// Details:  Checks the saved pot calibration against the car instead of
+///           redoing it.  The steering is driven to whichever limit switch is
+///           closer, and the pot must read what was saved for that end.  The
+///           steering is then centered.  Returns false (having only moved the
+///           steering) if there is no saved calibration or it doesn't match,
+///           in which case the full calibration has to be run.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::ValidateSteeringCalibration()
+{
+  const SteeringCalibration & rCalibration = m_NonVolatileCarData.m_SteeringCalibration;
+  if (CalculateSteeringCalibrationChecksum(rCalibration) != rCalibration.m_Checksum)
+  {
+    LogDebugMessage(DebugLogMessages::LOG_POT_CALIBRATION_NOT_SAVED);
+    return false;
+  }
+
+  // Just in case it was on, turn the status light off during calibration
+  DigitalPin<STATUS_LED_PIN>::SetLow();
+  DigitalPin<STEERING_CALIBRATION_LED_PIN>::SetHigh();
+  m_bCalibrationComplete = false;
+
+  ReadLimitSwitches();
+  ReadPotentiometers();
+  SteeringDirection direction = (m_FrontAxlePotentiometerValue >= rCalibration.m_PotCenterValue) ? LEFT : RIGHT;
+  int expectedValue = (direction == LEFT) ? rCalibration.m_PotMaxLeftValue : rCalibration.m_PotMaxRightValue;
+  int limitValue = DriveSteeringToLimitSwitch(direction);
+
+  if (abs(limitValue - expectedValue) > AUTO_CENTERING_VALIDATION_TOLERANCE)
+  {
+    LogDebugMessage(DebugLogMessages::LOG_POT_CALIBRATION_REJECTED, expectedValue, limitValue);
+    DigitalPin<STEERING_CALIBRATION_LED_PIN>::SetLow();
+    return false;
+  }
+
+  m_FrontAxlePotMaxLeftValue = rCalibration.m_PotMaxLeftValue;
+  m_FrontAxlePotMaxRightValue = rCalibration.m_PotMaxRightValue;
+  m_FrontAxlePotCenterValue = rCalibration.m_PotCenterValue;
+
+  DriveSteeringToPotentiometerValue(m_FrontAxlePotCenterValue);
+
+  m_LastGoodPotValue = m_FrontAxlePotCenterValue;
+  m_bCalibrationComplete = true;
+  DigitalPin<STEERING_CALIBRATION_LED_PIN>::SetLow();
+
+  LogDebugMessage(DebugLogMessages::LOG_POT_CALIBRATION_VALIDATED,
+                  m_FrontAxlePotMaxLeftValue,
+                  m_FrontAxlePotMaxRightValue,
+                  m_FrontAxlePotCenterValue,
+                  m_FrontAxlePotentiometerValue);
+  return true;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: CalibrateSteeringPotentiometer
 ///
 /// Details:  Automatically turns the steering to max left, then to max right,
-///           and finally attempts to move back to true center.
+///           and finally attempts to move back to true center.  The result
+///           is saved to EEPROM.
 ///
 /// Note: Pot is wired up where left -> right is decreasing.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::CalibrateSteeringPotentiometer()
 {
   static int calibrationAttempt = 0;
-  Serial.println(F("\nCentering steering by pot..."));
-  Serial.print(F("Calibration attempt #"));
-  Serial.println(++calibrationAttempt);
+  LogDebugMessage(DebugLogMessages::LOG_POT_CALIBRATION_START, ++calibrationAttempt);
 
   // Just in case it was on, turn the status light off during calibration
-  digitalWrite(STATUS_LED_PIN, LOW);
+  DigitalPin<STATUS_LED_PIN>::SetLow();
   
   // Give a visual indication calibration is in progress
-  digitalWrite(STEERING_CALIBRATION_LED_PIN, HIGH);
+  DigitalPin<STEERING_CALIBRATION_LED_PIN>::SetHigh();
 
   // A recalibration can be triggered, so reset the status variable
   m_bCalibrationComplete = false;
 
   // @todo: Debug why this sometimes gets stuck.
   
-  // Calibrate max left
-  
-  // Move to the left limit switch
-  SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_LEFT_SPEED);
-  
-  while (m_LeftSteeringLimitSwitchValue != 1)
-  {
-    // Keep updating limit switches and potentiometer
-    ReadLimitSwitches();
-    ReadPotentiometers();
-  }
-  
-  // Hit left limit switch, motor off
-  SetSteeringSpeedControllerValue(OFF);
+  // Calibrate max left, then max right
+  m_FrontAxlePotMaxLeftValue = DriveSteeringToLimitSwitch(LEFT);
+  m_FrontAxlePotMaxRightValue = DriveSteeringToLimitSwitch(RIGHT);
   
-  // Pause to let things settle
-  delay(AUTO_CENTERING_CALIBRATION_DELAY_MS);
+  // Compute and save off the center value
+  m_FrontAxlePotCenterValue = m_FrontAxlePotMaxLeftValue + ((m_FrontAxlePotMaxRightValue - m_FrontAxlePotMaxLeftValue) / 2);
   
-  // Read the potentiometer again to get the last value
-  ReadPotentiometers();
+  // Return to center
+  DriveSteeringToPotentiometerValue(m_FrontAxlePotCenterValue);
   
-  // Save off the value
-  m_FrontAxlePotMaxLeftValue = m_FrontAxlePotentiometerValue;
+  m_LastGoodPotValue = m_FrontAxlePotCenterValue;
+  m_bCalibrationComplete = true;
+
+  // Give a visual indication calibration is complete
+  DigitalPin<STEERING_CALIBRATION_LED_PIN>::SetLow();
   
-  // Calibrate max right
+  LogDebugMessage(DebugLogMessages::LOG_POT_CALIBRATION_COMPLETE,
+                  m_FrontAxlePotMaxLeftValue,
+                  m_FrontAxlePotMaxRightValue,
+                  m_FrontAxlePotCenterValue,
+                  m_FrontAxlePotentiometerValue);
 
-  // Move to the right limit switch
-  SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_RIGHT_SPEED);
+  SaveSteeringCalibration();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DriveSteeringToLimitSwitch
+///
+/// Details:  Drives the steering left or right until that limit switch trips,
+///           then waits for the axle to come to rest.  Returns the pot value
+///           there.
+////////////////////////////////////////////////////////////////////////////////
+int SoapBoxDerbyCar::DriveSteeringToLimitSwitch(SteeringDirection direction)
+{
+  int & rLimitSwitchValue = (direction == LEFT) ? m_LeftSteeringLimitSwitchValue : m_RightSteeringLimitSwitchValue;
+  
+  SetSteeringSpeedControllerValue((direction == LEFT) ? AUTO_CENTERING_CALIBRATION_LEFT_SPEED : AUTO_CENTERING_CALIBRATION_RIGHT_SPEED);
   
-  while (m_RightSteeringLimitSwitchValue != 1)
+  do
   {
     // Keep updating limit switches and potentiometer
     ReadLimitSwitches();
-    ReadPotentiometers();   
+    ReadPotentiometers();
   }
-
-  // Hit right limit switch, motor off
-  SetSteeringSpeedControllerValue(OFF);
+  while (rLimitSwitchValue != 1);
   
-  // Pause to let things settle
-  delay(AUTO_CENTERING_CALIBRATION_DELAY_MS);
+  // Hit the limit switch, motor off
+  SetSteeringSpeedControllerValue(OFF);
   
-  // Read the potentiometer again to get the last value
+  WaitForPotentiometerToSettle();
+  return m_FrontAxlePotentiometerValue;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DriveSteeringToPotentiometerValue
+///
+/// Details:  Drives the steering toward a pot value until it gets there (or
+///           hits a limit switch), then waits for the axle to come to rest.
+///           Turning left increases the pot value.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::DriveSteeringToPotentiometerValue(int targetValue)
+{
   ReadPotentiometers();
+  bool bMovingLeft = (m_FrontAxlePotentiometerValue < targetValue);
   
-  // Save off the value
-  m_FrontAxlePotMaxRightValue = m_FrontAxlePotentiometerValue;
-  
-  // Compute and save off the center value
-  m_FrontAxlePotCenterValue = m_FrontAxlePotMaxLeftValue + ((m_FrontAxlePotMaxRightValue - m_FrontAxlePotMaxLeftValue) / 2);
+  SetSteeringSpeedControllerValue(bMovingLeft ? AUTO_CENTERING_CALIBRATION_LEFT_SPEED : AUTO_CENTERING_CALIBRATION_RIGHT_SPEED);
   
-  // Return to center
-  SetSteeringSpeedControllerValue(AUTO_CENTERING_CALIBRATION_CENTER_SPEED);
+  // Update limit switch status in case we overshoot somehow.  The switch
+  // at the end being left may still be tripped when this starts.
   do
   {
-    // Update limit switch status in case we overshoot somehow
     ReadLimitSwitches();
     ReadPotentiometers();
   }
-  while ((m_FrontAxlePotentiometerValue > m_FrontAxlePotCenterValue) && (m_LeftSteeringLimitSwitchValue != 1));
+  while ((bMovingLeft ? (m_FrontAxlePotentiometerValue < targetValue) : (m_FrontAxlePotentiometerValue > targetValue)) &&
+         ((bMovingLeft ? m_LeftSteeringLimitSwitchValue : m_RightSteeringLimitSwitchValue) != 1));
   
-  // Back to center, motor off
   SetSteeringSpeedControllerValue(OFF);
   
-  // Pause to let things settle
-  delay(AUTO_CENTERING_CALIBRATION_DELAY_MS);
-  
-  m_LastGoodPotValue = m_FrontAxlePotCenterValue;
-  m_bCalibrationComplete = true;
+  WaitForPotentiometerToSettle();
+}
 
-  // Give a visual indication calibration is complete
-  digitalWrite(STEERING_CALIBRATION_LED_PIN, LOW);
-  
-  Serial.print(F("Left calibration pot value: "));
-  Serial.println(m_FrontAxlePotMaxLeftValue);
-  Serial.print(F("Right calibration pot value: "));
-  Serial.println(m_FrontAxlePotMaxRightValue);
-  Serial.print(F("Center calibration pot value: "));
-  Serial.println(m_FrontAxlePotCenterValue);
-  Serial.print(F("Final calibration position: "));
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: WaitForPotentiometerToSettle
+///
+/// Details:  Waits for the axle to come to rest after the steering motor is
+///           turned off.  That is when the filtered pot value stops changing
+///           for a few samples in a row.  If it never does (noise or a stuck
+///           reading), it gives up after AUTO_CENTERING_SETTLE_TIMEOUT_MS,
+///           which is the fixed pause this used to be.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::WaitForPotentiometerToSettle()
+{
+  unsigned long startTimeMs = GetTimeStampMs();
   ReadPotentiometers();
-  Serial.println(m_FrontAxlePotentiometerValue);
-  Serial.print(F("Pot diff: "));
-  Serial.println(m_FrontAxlePotMaxRightValue - m_FrontAxlePotMaxLeftValue);
-  Serial.print(F("1/2 Pot diff: "));
-  Serial.println((m_FrontAxlePotMaxRightValue - m_FrontAxlePotMaxLeftValue) / 2);
-  Serial.println(F("Centering calibration complete..."));
-  Serial.println();
+  int lastValueQ2 = m_FrontAxlePotentiometerValueQ2;
+  uint8_t numSettledSamples = 0U;
+  
+  while ((numSettledSamples < AUTO_CENTERING_SETTLE_NUM_SAMPLES) && (CalcDeltaTimeMs(startTimeMs) < AUTO_CENTERING_SETTLE_TIMEOUT_MS))
+  {
+    delay(AUTO_CENTERING_SETTLE_INTERVAL_MS);
+    ReadPotentiometers();
+    
+    if (abs(m_FrontAxlePotentiometerValueQ2 - lastValueQ2) <= AUTO_CENTERING_SETTLE_MAX_CHANGE_Q2)
+    {
+      numSettledSamples++;
+    }
+    else
+    {
+      numSettledSamples = 0U;
+    }
+    lastValueQ2 = m_FrontAxlePotentiometerValueQ2;
+  }
+  
+  LogDebugMessage(DebugLogMessages::LOG_POT_SETTLED, m_FrontAxlePotentiometerValue, CalcDeltaTimeMs(startTimeMs));
 }
 
 
@@ -146,17 +390,17 @@ void SoapBoxDerbyCar::CenterSteeringByPotentiometer()
   // Get the latest potetiometer value
   ReadPotentiometers();
   
-  // If the pot value is less then center, the angle is to the left,
-  // so need to move back to the right.
+  // If the pot value is less then center, the angle is to the right,
+  // so need to move back to the left.
   if (m_FrontAxlePotentiometerValue <= (m_FrontAxlePotCenterValue - POTENTIOMETER_MAX_JITTER_VALUE))
   {
-    SetSteeringSpeedControllerValue(AUTO_TURN_RIGHT_SPEED);
+    SetSteeringSpeedControllerValue(AUTO_TURN_LEFT_SPEED);
   }
-  // If the pot value is greater then center, the angle is to the right,
-  // so need to move back to the left.
+  // If the pot value is greater then center, the angle is to the left,
+  // so need to move back to the right.
   else if (m_FrontAxlePotentiometerValue >= (m_FrontAxlePotCenterValue + POTENTIOMETER_MAX_JITTER_VALUE))
   {
-    SetSteeringSpeedControllerValue(AUTO_TURN_LEFT_SPEED);
+    SetSteeringSpeedControllerValue(AUTO_TURN_RIGHT_SPEED);
   }
   else
   {
@@ -206,14 +450,15 @@ void SoapBoxDerbyCar::CenterSteeringByPotentiometer()
 /// Empirical measurements show a range of ~60 clicks, therefore:
 /// Actual axis range of motion is ~14.6484735 degrees
 /// Potentiometer range of motion is ~34.1796785 degrees
+///
+/// The turning math above is done in fixed point by the pose estimator
+/// (see Odometry.ino).
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ReadPotentiometers()
 {
-  // Arduino reference says it takes about 100us to read an analog input.
-  m_FrontAxlePotentiometerValue = analogRead(FRONT_AXLE_POTENTIOMETER_PIN);
-  return;
-
-  // @todo: Turn logic below back on.
+  // Never blocks, the ADC is sampled in the background
+  m_FrontAxlePotentiometerValueQ2 = GetFilteredPotentiometerValue();
+  m_FrontAxlePotentiometerValue = (m_FrontAxlePotentiometerValueQ2 + 2) >> POT_ADC_DECIMATION_SHIFT;
 
   if (m_bCalibrationComplete)
   {
@@ -223,6 +468,7 @@ void SoapBoxDerbyCar::ReadPotentiometers()
          (m_FrontAxlePotentiometerValue < (m_FrontAxlePotMaxRightValue - POTENTIOMETER_MAX_JITTER_VALUE)) )
     {
       m_FrontAxlePotentiometerValue = m_LastGoodPotValue;
+      m_FrontAxlePotentiometerValueQ2 = m_LastGoodPotValue << POT_ADC_DECIMATION_SHIFT;
     }
     // Reading was good, save it off for potential future use
     else
@@ -230,81 +476,63 @@ void SoapBoxDerbyCar::ReadPotentiometers()
       m_LastGoodPotValue = m_FrontAxlePotentiometerValue;
     }
   }
-  
-  // Current implementation only reads the value from the sensor.
-  // The logic below may be useful in the future when more complex behavior is required.
-  return;
-  
-  // Find the potentiometer's diff from true center
-  int potDiff = 0;
-  SteeringDirection axleDirection = NONE;
-  if (m_FrontAxlePotentiometerValue > m_FrontAxlePotCenterValue)
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetFilteredPotentiometerValue
+///
+/// Details:  Returns the latest filtered front axle potentiometer reading as a
+///           12-bit (Q2) value.  Uses however many samples are in the ring
+///           until it fills.
+////////////////////////////////////////////////////////////////////////////////
+int SoapBoxDerbyCar::GetFilteredPotentiometerValue()
+{
+  if (POT_FILTER_TYPE == POT_FILTER_MOVING_AVERAGE)
   {
-    // Axle angled to the left
-    potDiff = m_FrontAxlePotentiometerValue - m_FrontAxlePotCenterValue;
-    axleDirection = LEFT;
+    noInterrupts();
+    uint16_t sampleSum = m_PotAdcSampleSum;
+    uint8_t sampleCount = m_PotAdcSampleCount;
+    interrupts();
+
+    if (sampleCount == 0U)
+    {
+      return m_FrontAxlePotentiometerValueQ2;
+    }
+
+    return static_cast<int>((sampleSum + (sampleCount / 2U)) / sampleCount);
   }
-  else if (m_FrontAxlePotentiometerValue < m_FrontAxlePotCenterValue)
+
+  // Median of the most recent samples
+  uint16_t samples[POT_MEDIAN_SIZE];
+  noInterrupts();
+  uint8_t sampleCount = min(m_PotAdcSampleCount, POT_MEDIAN_SIZE);
+  uint8_t index = m_PotAdcSampleIndex;
+  for (uint8_t i = 0U; i < sampleCount; i++)
   {
-    // Axle angled to the right
-    potDiff = m_FrontAxlePotCenterValue - m_FrontAxlePotentiometerValue;
-    axleDirection = RIGHT;
+    index = (index - 1U) & (POT_FILTER_SIZE - 1U);
+    samples[i] = m_PotAdcSamples[index];
   }
-  else
+  interrupts();
+
+  if (sampleCount == 0U)
   {
-    potDiff = 0;
-    axleDirection = NONE;
+    return m_FrontAxlePotentiometerValueQ2;
   }
-  
-  // The potentiometer has a 250 degree range of motion, and 1024 input value
-  // GEAR_RATIO comes from the teeth ratio on the gears
-  const double POT_INPUT_RATIO      = 250.0 / 1024.0;
-  const double GEAR_RATIO           = 3.0/7.0;
-  
-  // Convert the pot diff into the pot's angle of movement
-  // After, convert that to axle angle of movement based on the gear ratio
-  double potAngleDiff = potDiff * POT_INPUT_RATIO;
-  double axleAngleDiff = potAngleDiff * GEAR_RATIO;
-  
-  // From comments above:
-  // r = w / tan(theta) (front wheel radius)
-  // R = w / sin(theta) (back wheel radius)
-  // Outer wheel radius is also the inner radius + axle length
-  double innerWheelRadius = abs(WHEEL_BASE_LENGTH_INCHES / tan(axleAngleDiff * DEGREES_TO_RADIANS));
-  double outerWheelRadius = innerWheelRadius + WHEEL_AXLE_LEGNTH_INCHES;
-  
-  // Arclength equation is S = r * theta
-  double innerArcLength = innerWheelRadius * axleAngleDiff;
-  double outerArcLength = outerWheelRadius * axleAngleDiff;
 
-  double arcLengthRatio = outerArcLength / innerArcLength;
-  
-  // Silence warnings (for now)
-  (void)axleDirection;
-  (void)arcLengthRatio;
-
-  /*
-  Serial.print(F("Raw pot value: "));
-  Serial.println(frontAxlePotentiometerValue);
-  Serial.print(F("Pot diff from center: "));
-  Serial.println(potDiff);
-  Serial.print(F("Pot angle diff: "));
-  Serial.println(potAngleDiff);
-  Serial.print(F("Axle angle diff: "));
-  Serial.println(axleAngleDiff);
-  Serial.print(F("Inner wheel radius: "));
-  Serial.println(innerWheelRadius);
-  Serial.print(F("Outer wheel radius: "));
-  Serial.println(outerWheelRadius);
-  Serial.print(F("Inner arc length: "));
-  Serial.println(innerArcLength);
-  Serial.print(F("Outer arc length: "));
-  Serial.println(outerArcLength);
-  Serial.print(F("Arc length ratio: "));
-  Serial.println(arcLengthRatio);
-  Serial.println();
-  Serial.println();
-  delay(2000);
-  */
-}
-
+  // Insertion sort, there are only a handful
+  for (uint8_t i = 1U; i < sampleCount; i++)
+  {
+    uint16_t sample = samples[i];
+    uint8_t j = i;
+    while ((j > 0U) && (samples[j - 1U] > sample))
+    {
+      samples[j] = samples[j - 1U];
+      j--;
+    }
+    samples[j] = sample;
+  }
+
+  return static_cast<int>(samples[sampleCount / 2U]);
+}
@@ -2,10 +2,23 @@
 /// File:     PwmSpeedController.hpp
 /// Author:   David Stalter
 ///
-/// Details:  Simple class to control a PWM speed controller.  Based on
-///           https://github.com/FRC4014/SRTester/blob/master/SRTester.ino
-///           The Servo library is leveraged to interact with the controller,
-///           since both are PWM based and there is no other native library.
+/// Details:  Simple class to control a PWM speed controller, such as a Talon
+///           SR or SparkFun motor controller, from -100 to 100 percent.  The
+///           pulse comes straight from Timer 4's output compare C (pin 8)
+///           instead of the Servo library's shared interrupt.  Timer 4 runs
+///           in fast PWM mode with ICR4 as TOP, so the frame rate can be set
+///           to whatever the speed controller takes, and a new speed goes out
+///           with the next frame without any jitter from other interrupts.
+///
+///           Speed changes can also be ramped.  With a rate limit, the output
+///           moves toward the new speed a little each frame (a trapezoidal
+///           profile).  Adding an acceleration limit also ramps the rate up
+///           and down, which gives an S-curve.  The ramp runs in the Timer 4
+///           overflow interrupt, once per frame.  Stop() skips the ramp, for
+///           limit switches and emergency stops.
+///
+///           Timer 4 can only drive one of these, and its input capture can't
+///           be used for anything else while it does.
 ///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
@@ -14,22 +27,68 @@
 #define PWMSPEEDCONTROLLER_HPP
 
 // INCLUDES
-#include <Servo.h>                    // for built in Arduino Servo functionality
+#include <Arduino.h>                  // for the Timer 4 registers
+#include "DigitalPin.hpp"             // for checking the output pin
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Class:  PwmSpeedController
 ///
-/// Details:  A class for interacting with a PWM based speed controller such as
-///           a Talon SR or SparkFun motor controller.
+/// Details:  A PWM speed controller driven by Timer 4 output compare C.
 ////////////////////////////////////////////////////////////////////////////////
 class PwmSpeedController
 {
 public:
-  // Constructor
-  PwmSpeedController(int pin) : m_OutputPin(pin)
+  // The only pin Timer 4 output compare C drives
+  static const unsigned int OUTPUT_PIN = 8;
+
+  // Constructor.  A rate limit of zero turns the ramp off, an acceleration
+  // limit of zero leaves just the rate limit.
+  PwmSpeedController(unsigned int frameRateHz, unsigned int rampRatePercentPerSec, unsigned long rampAccelerationPercentPerSec2) :
+    m_RampTarget(0),
+    m_RampOutput(0),
+    m_RampRate(0),
+    m_MaxRampRate(0),
+    m_MaxRampAcceleration(0)
   {
-    m_PwmControl.attach(pin);
+    m_pInstance = this;
+
+    frameRateHz = constrain(frameRateHz, MIN_FRAME_RATE_HZ, MAX_FRAME_RATE_HZ);
+
+    // Both are per frame, in fractions of a timer tick
+    uint32_t maxRampRate = (static_cast<uint32_t>(rampRatePercentPerSec) * TICKS_PER_PERCENT * RAMP_UNITS_PER_TICK) / frameRateHz;
+    uint32_t maxRampAcceleration = ((static_cast<uint32_t>(rampAccelerationPercentPerSec2) * TICKS_PER_PERCENT * RAMP_UNITS_PER_TICK) / frameRateHz) / frameRateHz;
+    if (rampRatePercentPerSec != 0U)
+    {
+      m_MaxRampRate = static_cast<int16_t>(constrain(maxRampRate, 1UL, static_cast<uint32_t>(MAX_RAMP_OUTPUT)));
+    }
+    if (rampAccelerationPercentPerSec2 != 0UL)
+    {
+      // The rate only ever changes by the acceleration, so the rate limit is
+      // kept a multiple of it.  That keeps the stopping distance exact.
+      m_MaxRampAcceleration = static_cast<int16_t>(constrain(maxRampAcceleration, 1UL, static_cast<uint32_t>(m_MaxRampRate)));
+      m_MaxRampRate -= m_MaxRampRate % m_MaxRampAcceleration;
+    }
+
+    pinMode(OUTPUT_PIN, OUTPUT);
+
+    // The 16 bit registers share one temporary register, so nothing else
+    // can touch the timer in the middle of a write
+    uint8_t oldSreg = SREG;
+    cli();
+
+    // Stopped while it is set up.  Fast PWM with ICR4 as TOP (mode 14) and
+    // OC4C set at BOTTOM and cleared on compare match.
+    TCCR4B = 0U;
+    TCNT4 = 0U;
+    ICR4 = static_cast<uint16_t>(((F_CPU / TIMER_PRESCALER) / frameRateHz) - 1UL);
+    OCR4C = NEUTRAL_TICKS - 1U;
+    TCCR4A = _BV(COM4C1) | _BV(WGM41);
+    TIFR4 = _BV(TOV4);
+    TIMSK4 = (m_MaxRampRate != 0) ? _BV(TOIE4) : 0U;
+    TCCR4B = _BV(WGM43) | _BV(WGM42) | TIMER_PRESCALER_BITS;
+
+    SREG = oldSreg;
   }
 
   // Update output speed
@@ -49,21 +108,139 @@ public:
     {
     }
 
-    // 1000us = full reverse
-    // 1500us = neutral
-    // 2000us = full forward
-    const int PWM_SCALE_FACTOR = 5;
-    const int PWM_BASE_VALUE = 1500;
-    
-    // Scale up to 1000-2000
-    value = (value * PWM_SCALE_FACTOR) + PWM_BASE_VALUE;
-    m_PwmControl.writeMicroseconds(value);
+    int16_t target = static_cast<int16_t>(value * TICKS_PER_PERCENT * RAMP_UNITS_PER_TICK);
+
+    uint8_t oldSreg = SREG;
+    cli();
+    m_RampTarget = target;
+    if (m_MaxRampRate == 0)
+    {
+      m_RampOutput = target;
+      WriteOutput(target);
+    }
+    SREG = oldSreg;
+  }
+
+  // Neutral right away, skipping the ramp.  Safe to call from an ISR.
+  inline void Stop()
+  {
+    uint8_t oldSreg = SREG;
+    cli();
+    m_RampTarget = 0;
+    m_RampOutput = 0;
+    m_RampRate = 0;
+    WriteOutput(0);
+    SREG = oldSreg;
+  }
+
+  // Timer 4 overflow (once per frame).  The vector is in SpeedControllers.ino.
+  static inline void FrameInterruptHandler()
+  {
+    if (m_pInstance != nullptr)
+    {
+      m_pInstance->UpdateRamp();
+    }
   }
-    
+
 private:
-  Servo m_PwmControl;
-  int m_OutputPin;
+  //////////////////////////////////////////////////////////////////////////////
+  /// Method: UpdateRamp
+  ///
+  /// Details:  Moves the output one frame toward the target.  With an
+  ///           acceleration limit, each frame takes the fastest of speeding
+  ///           up, holding or slowing down that can still stop at the target,
+  ///           so the output eases in instead of overshooting.  The next
+  ///           frame picks up the new compare value.
+  //////////////////////////////////////////////////////////////////////////////
+  inline void UpdateRamp()
+  {
+    int16_t target = m_RampTarget;
+    int16_t output = m_RampOutput;
+    int16_t rate = m_RampRate;
+    int16_t error = target - output;
+    if ((error == 0) && (rate == 0))
+    {
+      return;
+    }
+
+    if (m_MaxRampAcceleration == 0)
+    {
+      output += constrain(error, -m_MaxRampRate, m_MaxRampRate);
+    }
+    else if ((abs(error) <= m_MaxRampAcceleration) && (abs(rate) <= m_MaxRampAcceleration))
+    {
+      // Close enough to stop here this frame
+      output = target;
+      rate = 0;
+    }
+    else
+    {
+      bool bTowardTarget = ((rate > 0) && (error > 0)) || ((rate < 0) && (error < 0));
+      if (!bTowardTarget)
+      {
+        rate += (error > 0) ? m_MaxRampAcceleration : -m_MaxRampAcceleration;
+      }
+      else
+      {
+        // Moving the speed this frame and then slowing by the acceleration
+        // each frame after stops speed * (speed - acceleration) /
+        // (2 * acceleration) further on, which has to fit in what's left.
+        // Both sides are times 2 * acceleration.
+        // Speeds stay signed: on the AVR a uint16_t sum is an unsigned int,
+        // and min() would compare it against the signed rate limit.
+        uint32_t remainingDistance = (static_cast<uint32_t>(abs(error)) * m_MaxRampAcceleration) * 2U;
+        int16_t speed = abs(rate);
+        int16_t newSpeed = min(speed + m_MaxRampAcceleration, m_MaxRampRate);
+        if ((static_cast<uint32_t>(newSpeed) * (newSpeed + m_MaxRampAcceleration)) > remainingDistance)
+        {
+          newSpeed = speed;
+          if ((static_cast<uint32_t>(newSpeed) * (newSpeed + m_MaxRampAcceleration)) > remainingDistance)
+          {
+            newSpeed = speed - m_MaxRampAcceleration;
+          }
+        }
+        rate = (error > 0) ? newSpeed : -newSpeed;
+      }
+      output += rate;
+    }
+
+    m_RampOutput = output;
+    m_RampRate = rate;
+    WriteOutput(output);
+  }
+
+  // Output in ramp units to the compare register.  OC4C is high for
+  // OCR4C + 1 ticks.  Interrupts must be off.
+  static inline void WriteOutput(int16_t output)
+  {
+    OCR4C = static_cast<uint16_t>((NEUTRAL_TICKS - 1) + (output / RAMP_UNITS_PER_TICK));
+  }
+
+  // Where the ISR finds the controller
+  static PwmSpeedController * m_pInstance;
+
+  // Shared with the ISR
+  volatile int16_t m_RampTarget;
+  volatile int16_t m_RampOutput;
+  volatile int16_t m_RampRate;
+
+  // Limits per frame, zero when off
+  int16_t m_MaxRampRate;
+  int16_t m_MaxRampAcceleration;
+
+  // 1000us = full reverse
+  // 1500us = neutral
+  // 2000us = full forward
+  static const unsigned long  TIMER_PRESCALER         = 8;
+  static const uint8_t        TIMER_PRESCALER_BITS    = _BV(CS41);  // 16 MHz / 8, 0.5us ticks
+  static const int            NEUTRAL_TICKS           = 3000;
+  static const int            TICKS_PER_PERCENT       = 10;         // 5us
+  static const int            RAMP_UNITS_PER_TICK     = 16;         // Ramp math is in sixteenths of a tick
+  static const int16_t        MAX_RAMP_OUTPUT         = 100 * TICKS_PER_PERCENT * RAMP_UNITS_PER_TICK;
+  static const unsigned int   MIN_FRAME_RATE_HZ       = 50;         // Longest frame TOP can count
+  static const unsigned int   MAX_FRAME_RATE_HZ       = 400;        // Room for a 2ms pulse and a gap
+
+  static_assert(MegaPinMap::IsPortBit(OUTPUT_PIN, MegaPinMap::PORT_H, 5), "Timer 4 output compare C is PH5!");
 };
 
-#endif // PWMSPEEDCONTROLLER_HPP
-
+#endif // PWMSPEEDCONTROLLER_HPP
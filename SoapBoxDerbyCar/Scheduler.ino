@@ -0,0 +1,292 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     Scheduler.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains a small fixed rate, cooperative scheduler for the manual
+///           control loop of a soap box derby car.
+///
+/// Note:     Timer 2 generates a 1ms tick.  Each task has a period in ticks
+///           and a priority.  A task is released when its period expires,
+///           and each pass of the scheduler runs the most urgent released
+///           task to completion.  Tasks are never preempted, so a long task
+///           delays everything behind it.  That is what the timing statistics
+///           are for: each task records its execution time and how often it
+///           missed a whole period (an overrun), and the steering control
+///           task records the period it actually achieved.
+///
+///           Releases are kept on the original schedule (the next release is
+///           a multiple of the period from the first one), so a late task
+///           does not drift the rest of its schedule.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+volatile uint16_t SoapBoxDerbyCar::m_SchedulerTickCount = 0U;
+
+// Order must match SchedulerTaskId
+SoapBoxDerbyCar::SchedulerTask SoapBoxDerbyCar::m_SchedulerTasks[NUM_SCHEDULER_TASKS] =
+{
+  { &SoapBoxDerbyCar::ReadControllerInput,          CONTROLLER_TASK_PERIOD_MS,                          0, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::ReadSensors,                  SENSORS_TASK_PERIOD_MS,                             1, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::UpdateManualControl,          STEERING_CONTROL_TASK_PERIOD_MS,                    2, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::LogCurrentData,               DATA_LOG_ENTRY_INTERVAL_MS,                         3, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::TransmitCarDataIfRequested,   CAR_DATA_TRANSMIT_TASK_PERIOD_MS,                   4, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::ReadSerialInput,              DEBUG_COMMANDS ? SERIAL_COMMAND_TASK_PERIOD_MS : 0, 5, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::LogDebugValues,               DEBUG_PRINTS ? DEBUG_PRINT_INTERVAL_MS : 0,         6, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::ToggleStatusLight,            STATUS_LED_BLINK_DELAY_MS,                          7, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::UpdateDataLogJournal,         DATA_LOG_JOURNAL_TASK_PERIOD_MS,                    8, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::DrainDebugLog,                DEBUG_LOG_TASK_PERIOD_MS,                           9, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::UpdateMemoryUsage,            MEMORY_TASK_PERIOD_MS,                              10, 0, 0, 0, 0, 0, 0 },
+  { &SoapBoxDerbyCar::UpdateFlightRecorder,         FLIGHT_RECORDER_TASK_PERIOD_MS,                     11, 0, 0, 0, 0, 0, 0 }
+};
+
+SoapBoxDerbyCar::LoopTimingStats SoapBoxDerbyCar::m_SteeringLoopTimingStats = {};
+
+const char SoapBoxDerbyCar::SCHEDULER_TASK_NAMES[NUM_SCHEDULER_TASKS][12] PROGMEM =
+{
+  "Controller",
+  "Sensors",
+  "Steering",
+  "Data log",
+  "Car data",
+  "Commands",
+  "Debug",
+  "Status LED",
+  "EEPROM log",
+  "Debug log",
+  "Memory",
+  "Recorder"
+};
+
+// GLOBALS
+// (none)
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR(TIMER2_COMPA_vect)
+///
+/// Details:  Timer 2 compare match vector (scheduler tick).
+////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER2_COMPA_vect)
+{
+  SoapBoxDerbyCar::SchedulerTickInterruptHandler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SchedulerTickInterruptHandler
+///
+/// Details:  Advances the scheduler tick count.  The tick also paces the
+///           sonar pings.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SchedulerTickInterruptHandler()
+{
+  m_SchedulerTickCount++;
+  UpdateSonarRanging();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ConfigureScheduler
+///
+/// Details:  Starts the Timer 2 scheduler tick.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ConfigureScheduler()
+{
+  noInterrupts();
+
+  // CTC mode, /64 prescaler, compare match A interrupt
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  TCNT2 = 0U;
+  OCR2A = SCHEDULER_TIMER_COMPARE_VALUE;
+  OCR2B = SONAR_TRIGGER_END_TIMER_COUNT;
+  TIFR2 = _BV(OCF2A);
+  TIMSK2 = _BV(OCIE2A);
+
+  interrupts();
+
+  StartScheduler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: StartScheduler
+///
+/// Details:  Releases every task immediately and restarts the steering loop
+///           period measurement.  Called at start up and whenever the
+///           scheduler has not been running (i.e. after autonomous), so the
+///           time spent elsewhere is not counted against the tasks.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::StartScheduler()
+{
+  uint16_t currentTick = GetSchedulerTick();
+  for (int i = 0; i < NUM_SCHEDULER_TASKS; i++)
+  {
+    m_SchedulerTasks[i].m_NextReleaseTick = currentTick;
+  }
+
+  m_SteeringLoopTimingStats.m_LastStartTimeUs = 0UL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetSchedulerTick
+///
+/// Details:  Returns an atomic copy of the scheduler tick count.
+////////////////////////////////////////////////////////////////////////////////
+uint16_t SoapBoxDerbyCar::GetSchedulerTick()
+{
+  noInterrupts();
+  uint16_t currentTick = m_SchedulerTickCount;
+  interrupts();
+
+  return currentTick;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ResetSchedulerStatistics
+///
+/// Details:  Clears the task and steering loop timing statistics.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ResetSchedulerStatistics()
+{
+  for (int i = 0; i < NUM_SCHEDULER_TASKS; i++)
+  {
+    m_SchedulerTasks[i].m_RunCount = 0UL;
+    m_SchedulerTasks[i].m_OverrunCount = 0UL;
+    m_SchedulerTasks[i].m_MinExecTimeUs = ~0UL;
+    m_SchedulerTasks[i].m_MaxExecTimeUs = 0UL;
+    m_SchedulerTasks[i].m_TotalExecTimeUs = 0UL;
+  }
+
+  m_SteeringLoopTimingStats.m_MinPeriodUs = ~0UL;
+  m_SteeringLoopTimingStats.m_MaxPeriodUs = 0UL;
+  m_SteeringLoopTimingStats.m_TotalPeriodUs = 0UL;
+  m_SteeringLoopTimingStats.m_NumPeriods = 0UL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RunScheduler
+///
+/// Details:  Runs the most urgent released task, if there is one.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::RunScheduler()
+{
+  uint16_t currentTick = GetSchedulerTick();
+
+  // Find the released task with the most urgent priority.  The tick
+  // difference is signed so the comparison survives the counter wrapping.
+  SchedulerTask * pReadyTask = nullptr;
+  for (int i = 0; i < NUM_SCHEDULER_TASKS; i++)
+  {
+    SchedulerTask * pTask = &m_SchedulerTasks[i];
+    if ((pTask->m_PeriodTicks == 0U) || (static_cast<int16_t>(currentTick - pTask->m_NextReleaseTick) < 0))
+    {
+      continue;
+    }
+
+    if ((pReadyTask == nullptr) || (pTask->m_Priority < pReadyTask->m_Priority))
+    {
+      pReadyTask = pTask;
+    }
+  }
+
+  if (pReadyTask == nullptr)
+  {
+    return;
+  }
+
+  // Schedule the next release.  If one or more whole periods were
+  // missed, skip them and count the overrun.
+  uint16_t ticksLate = currentTick - pReadyTask->m_NextReleaseTick;
+  if (ticksLate >= pReadyTask->m_PeriodTicks)
+  {
+    pReadyTask->m_OverrunCount++;
+  }
+  pReadyTask->m_NextReleaseTick += ((ticksLate / pReadyTask->m_PeriodTicks) + 1U) * pReadyTask->m_PeriodTicks;
+
+  unsigned long startTimeUs = GetTimeStampUs();
+
+  // Track the period the steering loop is really closing at
+  if (pReadyTask == &m_SchedulerTasks[STEERING_CONTROL_TASK])
+  {
+    if (m_SteeringLoopTimingStats.m_LastStartTimeUs != 0UL)
+    {
+      unsigned long periodUs = startTimeUs - m_SteeringLoopTimingStats.m_LastStartTimeUs;
+      m_SteeringLoopTimingStats.m_MinPeriodUs = min(m_SteeringLoopTimingStats.m_MinPeriodUs, periodUs);
+      m_SteeringLoopTimingStats.m_MaxPeriodUs = max(m_SteeringLoopTimingStats.m_MaxPeriodUs, periodUs);
+      m_SteeringLoopTimingStats.m_TotalPeriodUs += periodUs;
+      m_SteeringLoopTimingStats.m_NumPeriods++;
+    }
+    m_SteeringLoopTimingStats.m_LastStartTimeUs = startTimeUs;
+  }
+
+  (this->*(pReadyTask->m_pTaskFunction))();
+
+  unsigned long execTimeUs = CalcDeltaTimeUs(startTimeUs);
+  pReadyTask->m_RunCount++;
+  pReadyTask->m_MinExecTimeUs = min(pReadyTask->m_MinExecTimeUs, execTimeUs);
+  pReadyTask->m_MaxExecTimeUs = max(pReadyTask->m_MaxExecTimeUs, execTimeUs);
+  pReadyTask->m_TotalExecTimeUs += execTimeUs;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DisplaySchedulerStatistics
+///
+/// Details:  Displays the scheduler timing statistics collected since the last
+///           time they were displayed, then resets them.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::DisplaySchedulerStatistics()
+{
+  Serial.println(F("Task, period (ms), runs, overruns, exec min/avg/max (us)"));
+  for (int i = 0; i < NUM_SCHEDULER_TASKS; i++)
+  {
+    const SchedulerTask & rTask = m_SchedulerTasks[i];
+    Serial.print(reinterpret_cast<const __FlashStringHelper *>(SCHEDULER_TASK_NAMES[i]));
+    Serial.print(F(", "));
+    Serial.print(rTask.m_PeriodTicks);
+    Serial.print(F(", "));
+    Serial.print(rTask.m_RunCount);
+    Serial.print(F(", "));
+    Serial.print(rTask.m_OverrunCount);
+    Serial.print(F(", "));
+    if (rTask.m_RunCount != 0UL)
+    {
+      Serial.print(rTask.m_MinExecTimeUs);
+      Serial.print(F("/"));
+      Serial.print(rTask.m_TotalExecTimeUs / rTask.m_RunCount);
+      Serial.print(F("/"));
+      Serial.println(rTask.m_MaxExecTimeUs);
+    }
+    else
+    {
+      Serial.println(F("-"));
+    }
+  }
+
+  Serial.print(F("Steering loop period min/avg/max (us): "));
+  if (m_SteeringLoopTimingStats.m_NumPeriods != 0UL)
+  {
+    Serial.print(m_SteeringLoopTimingStats.m_MinPeriodUs);
+    Serial.print(F("/"));
+    Serial.print(m_SteeringLoopTimingStats.m_TotalPeriodUs / m_SteeringLoopTimingStats.m_NumPeriods);
+    Serial.print(F("/"));
+    Serial.println(m_SteeringLoopTimingStats.m_MaxPeriodUs);
+  }
+  else
+  {
+    Serial.println(F("-"));
+  }
+
+  Serial.println();
+
+  ResetSchedulerStatistics();
+}
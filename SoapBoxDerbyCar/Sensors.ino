@@ -5,6 +5,24 @@
 /// Details:  Contains the main logic and workflow for sensors on a soap box
 ///           derby car.
 ///
+///           The steering limit switches are pin change interrupts.  A switch
+///           closing cuts the steering motor in the ISR if the steering is
+///           heading into it, so the rack stops even while the main loop is
+///           busy.  The switch states the rest of the code sees are debounced
+///           by time: a switch has to stay closed (or open) for
+///           LIMIT_SWITCH_DEBOUNCE_US to count.  A switch that opens again
+///           before then was a glitch.  Glitches are counted, and the steering
+///           command they interrupted is put back.
+///
+///           The sonar sensors range without the main loop waiting on them.
+///           The scheduler tick starts a ping and Timer 2 compare match B
+///           ends the trigger pulse, then the echo's edges are time stamped
+///           by the port B pin change interrupt (shared with the limit
+///           switches).  Sensors take turns, one ping per
+///           SONAR_PING_PERIOD_TICKS, so a sensor never hears another's
+///           ping.  ReadSonarSensors() only has to filter the finished
+///           echoes.
+///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -12,12 +30,52 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+volatile uint8_t        SoapBoxDerbyCar::m_LimitSwitchRawMask             = 0U;
+volatile uint8_t        SoapBoxDerbyCar::m_LimitSwitchDebouncedMask       = 0U;
+volatile uint8_t        SoapBoxDerbyCar::m_LimitSwitchTrippedMask         = 0U;
+volatile unsigned long  SoapBoxDerbyCar::m_LimitSwitchChangeTimesUs[2]    = {};
+volatile uint16_t       SoapBoxDerbyCar::m_LimitSwitchGlitchCount         = 0U;
+
+volatile uint8_t        SoapBoxDerbyCar::m_SonarState                                                  = SONAR_IDLE;
+volatile uint8_t        SoapBoxDerbyCar::m_SonarActiveSensor                                           = 0U;
+volatile uint8_t        SoapBoxDerbyCar::m_SonarPingTicks                                              = 0U;
+volatile unsigned long  SoapBoxDerbyCar::m_SonarEchoStartUs                                            = 0UL;
+volatile uint16_t       SoapBoxDerbyCar::m_SonarEchoWidthsUs[NUM_SONAR_SENSORS]                        = {};
+volatile uint8_t        SoapBoxDerbyCar::m_SonarNewEchoMask                                            = 0U;
+uint8_t                 SoapBoxDerbyCar::m_SonarReadingsInches[NUM_SONAR_SENSORS * SONAR_MEDIAN_SIZE]  = {};
+uint8_t                 SoapBoxDerbyCar::m_SonarReadingIndexes[NUM_SONAR_SENSORS]                      = {};
+uint8_t                 SoapBoxDerbyCar::m_SonarDistancesInches[NUM_SONAR_SENSORS]                     = {};
+uint8_t                 SoapBoxDerbyCar::m_SonarValidMask                                              = 0U;
+uint16_t                SoapBoxDerbyCar::m_SonarNoEchoCount                                            = 0U;
 
 // GLOBALS
 // (none)
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR(PCINT0_vect)
+///
+/// Details:  Pin change interrupt vector for port B (limit switches and
+///           sonar echoes).
+////////////////////////////////////////////////////////////////////////////////
+ISR(PCINT0_vect)
+{
+  SoapBoxDerbyCar::SteeringLimitSwitchInterruptHandler();
+  SoapBoxDerbyCar::SonarEchoInterruptHandler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR(TIMER2_COMPB_vect)
+///
+/// Details:  Timer 2 compare match B vector (end of a sonar trigger pulse).
+////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER2_COMPB_vect)
+{
+  SoapBoxDerbyCar::SonarTriggerEndInterruptHandler();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ConfigureSensors
 ///
@@ -28,13 +86,16 @@ void SoapBoxDerbyCar::ConfigureSensors()
   // Configure the sensor pin modes
   pinMode(BRAKE_MAGNET_RELAY_PIN, OUTPUT);
 
-  // @todo: There are phantom interrupts being triggered by the limit
-  // switches.  Stick to polling mode until the issue can be investigated.
-  // Note: Using a limit switch as an interrupt may require still configuring
-  // the pin as INPUT_PULLUP or a physical resistor to be connected.
+  // The limit switch pin change interrupts are turned on with the other
+  // ISRs, until then the switches are only polled.  Start out debounced to
+  // whatever the switches are now.  The old shared interrupt line is still
+  // wired, so it stays an input.
   pinMode(STEERING_LEFT_LIMIT_SWITCH_PIN, INPUT_PULLUP);
   pinMode(STEERING_RIGHT_LIMIT_SWITCH_PIN, INPUT_PULLUP);
-  pinMode(STEERING_LIMIT_SWITCHES_INTERRUPT_PIN, INPUT_PULLUP);
+  pinMode(PIN_20_INTERRUPT_RESERVED, INPUT_PULLUP);
+  m_LimitSwitchRawMask = ReadLimitSwitchPins();
+  m_LimitSwitchDebouncedMask = m_LimitSwitchRawMask;
+  ReadLimitSwitches();
   
   // Even though the Hall sensor pins will be used for interrupts, still
   // configure them as inputs with pull-up resistors.  The pins will be read in
@@ -48,15 +109,31 @@ void SoapBoxDerbyCar::ConfigureSensors()
   pinMode(SWITCH_4_RESERVED, INPUT_PULLUP);
   
   pinMode(STEERING_ENCODER_PIN, INPUT);
+
+  // The pings start with the scheduler tick.  Until a sensor has heard
+  // enough echoes its distance is not valid.
   pinMode(SONAR_TRIGGER_PIN, OUTPUT);
   pinMode(SONAR_ECHO_PIN, INPUT);
+  for (uint8_t i = 0U; i < (NUM_SONAR_SENSORS * SONAR_MEDIAN_SIZE); i++)
+  {
+    m_SonarReadingsInches[i] = SONAR_NO_ECHO_INCHES;
+  }
+  for (uint8_t sensor = 0U; sensor < NUM_SONAR_SENSORS; sensor++)
+  {
+    m_SonarDistancesInches[sensor] = SONAR_NO_ECHO_INCHES;
+  }
+  
+  ConfigurePotentiometerAdc();
+  ConfigureSteeringEncoderCapture();
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: SteeringLimitSwitchInterruptHandler
 ///
-/// Details:  Interrupt handler for when a steering limit switch triggers.
+/// Details:  Interrupt handler for any change on a steering limit switch.
+///           Cuts the steering motor if a switch closes in the direction it
+///           is turning.
 ///           See https://playground.arduino.cc/Code/Interrupts and the AVR
 ///           ATmega328P datasheet.
 ////////////////////////////////////////////////////////////////////////////////
@@ -74,37 +151,287 @@ void SoapBoxDerbyCar::SteeringLimitSwitchInterruptHandler()
   // touch interrupt enabling/disabling ourselves via
   // interrupts()/noInterrupts().
   
-  volatile InterruptEdgeDirection interruptEdge = static_cast<InterruptEdgeDirection>(digitalRead(STEERING_LIMIT_SWITCHES_INTERRUPT_PIN));
-  
-  // Debug visual assist (reversed logic since this is falling edge)
-  int ledState = (interruptEdge == RISING_EDGE) ? LOW : HIGH;
-  digitalWrite(STEER_LIMIT_SWITCHES_LED_PIN, ledState);
+  unsigned long changeTimeUs = GetTimeStampUs();
+  uint8_t rawMask = ReadLimitSwitchPins();
+  uint8_t closedMask = RecordLimitSwitchChanges(rawMask, changeTimeUs);
+
+  // Debug visual assist
+  DigitalPin<STEER_LIMIT_SWITCHES_LED_PIN>::Write(rawMask != 0U);
 
-  if (interruptEdge == FALLING_EDGE)
+  // A steering limit switch is tripped, turn the motor off
+  if ((closedMask & GetSingletonInstance()->GetSteeringLimitSwitchBit()) != 0U)
   {
-    // A steering limit switch is tripped, turn the motor off
     GetSingletonInstance()->DisableSteeringSpeedController();
   }
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: RecordLimitSwitchChanges
+///
+/// Details:  Time stamps the limit switches that changed since the last
+///           sample, counting a switch that went back to its debounced state
+///           too soon as a glitch.  Returns the switches that just closed,
+///           which are also latched as tripped.  Called from the ISR, and
+///           with interrupts off when polling (the ISR is not attached while
+///           the constructor calibrates the steering).
+////////////////////////////////////////////////////////////////////////////////
+uint8_t SoapBoxDerbyCar::RecordLimitSwitchChanges(uint8_t rawMask, unsigned long changeTimeUs)
+{
+  uint8_t changedMask = rawMask ^ m_LimitSwitchRawMask;
+  m_LimitSwitchRawMask = rawMask;
+
+  for (uint8_t side = 0U; side < 2U; side++)
+  {
+    uint8_t sideBit = static_cast<uint8_t>(1U << side);
+    if ((changedMask & sideBit) == 0U)
+    {
+      continue;
+    }
+
+    if ((((rawMask ^ m_LimitSwitchDebouncedMask) & sideBit) == 0U) &&
+        ((changeTimeUs - m_LimitSwitchChangeTimesUs[side]) < LIMIT_SWITCH_DEBOUNCE_US) &&
+        (m_LimitSwitchGlitchCount < UINT16_MAX))
+    {
+      m_LimitSwitchGlitchCount++;
+    }
+    m_LimitSwitchChangeTimesUs[side] = changeTimeUs;
+  }
+
+  uint8_t closedMask = changedMask & rawMask & static_cast<uint8_t>(~m_LimitSwitchDebouncedMask);
+  m_LimitSwitchTrippedMask |= closedMask;
+  return closedMask;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ReadLimitSwitches
 ///
-/// Details:  Reads and stores all limit switch values.
+/// Details:  Samples the limit switches and brings their debounced values up
+///           to date.  A switch confirmed closed ends a steering command into
+///           it.  One that opened again without being confirmed gets back the
+///           command that was cut.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ReadLimitSwitches()
 {
-  m_LeftSteeringLimitSwitchValue = digitalRead(STEERING_LEFT_LIMIT_SWITCH_PIN);
-  m_RightSteeringLimitSwitchValue = digitalRead(STEERING_RIGHT_LIMIT_SWITCH_PIN);
+  noInterrupts();
+  unsigned long currentTimeUs = GetTimeStampUs();
+  uint8_t closedMask = RecordLimitSwitchChanges(ReadLimitSwitchPins(), currentTimeUs);
+  uint8_t rawMask = m_LimitSwitchRawMask;
+  unsigned long changeTimesUs[2] = { m_LimitSwitchChangeTimesUs[0], m_LimitSwitchChangeTimesUs[1] };
+  interrupts();
+
+  uint8_t steeringBit = GetSteeringLimitSwitchBit();
+  if ((closedMask & steeringBit) != 0U)
+  {
+    DisableSteeringSpeedController();
+  }
+
+  uint8_t previousDebouncedMask = m_LimitSwitchDebouncedMask;
+  uint8_t debouncedMask = previousDebouncedMask;
+  for (uint8_t side = 0U; side < 2U; side++)
+  {
+    uint8_t sideBit = static_cast<uint8_t>(1U << side);
+    if ((((rawMask ^ debouncedMask) & sideBit) != 0U) && ((currentTimeUs - changeTimesUs[side]) >= LIMIT_SWITCH_DEBOUNCE_US))
+    {
+      debouncedMask ^= sideBit;
+    }
+  }
+
+  // The latch only holds switches that are closed but not confirmed yet
+  noInterrupts();
+  m_LimitSwitchDebouncedMask = debouncedMask;
+  uint8_t trippedMask = m_LimitSwitchTrippedMask & static_cast<uint8_t>(~debouncedMask);
+  uint8_t glitchMask = trippedMask & static_cast<uint8_t>(~m_LimitSwitchRawMask);
+  m_LimitSwitchTrippedMask = trippedMask & static_cast<uint8_t>(~glitchMask);
+  interrupts();
+
+  // A confirmed trip of either switch is a flight recorder event
+  if ((debouncedMask & static_cast<uint8_t>(~previousDebouncedMask)) != 0U)
+  {
+    TriggerFlightRecorder(FLIGHT_RECORDER_LIMIT_SWITCH);
+  }
+
+  if (((debouncedMask & static_cast<uint8_t>(~previousDebouncedMask)) & steeringBit) != 0U)
+  {
+    DisableSteeringSpeedController();
+    SetSteeringDirection(OFF);
+    m_CurrentSteeringValue = OFF;
+  }
+  else if ((glitchMask & steeringBit) != 0U)
+  {
+    m_pSteeringSpeedController->SetSpeed(m_CurrentSteeringValue);
+  }
+  else
+  {
+  }
+
+  m_LeftSteeringLimitSwitchValue = ((debouncedMask & LEFT_LIMIT_SWITCH_BIT) != 0U) ? 1 : 0;
+  m_RightSteeringLimitSwitchValue = ((debouncedMask & RIGHT_LIMIT_SWITCH_BIT) != 0U) ? 1 : 0;
   
   if ((m_LeftSteeringLimitSwitchValue == 1) || (m_RightSteeringLimitSwitchValue == 1))
   {
-    digitalWrite(STEER_LIMIT_SWITCHES_LED_PIN, HIGH);
+    DigitalPin<STEER_LIMIT_SWITCHES_LED_PIN>::SetHigh();
   }
   else
   {
-    digitalWrite(STEER_LIMIT_SWITCHES_LED_PIN, LOW);
+    DigitalPin<STEER_LIMIT_SWITCHES_LED_PIN>::SetLow();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ReadSensors
+///
+/// Details:  Reads the sensors polled by the manual control loop.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ReadSensors()
+{
+  // Hall sensors are interrupt driven
+  ReadLimitSwitches();
+  ReadPotentiometers();
+  ReadSonarSensors();
+  ReadEncoders();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateSonarRanging
+///
+/// Details:  Paces the sonar pings, called from the scheduler tick ISR.  A
+///           ping gets SONAR_PING_PERIOD_TICKS to itself.  It starts with the
+///           trigger going high, and compare match B takes it low again
+///           SONAR_TRIGGER_END_TIMER_COUNT timer counts into the tick.  If
+///           other interrupts hold this one off past that, the pulse just
+///           lasts the whole tick, which the sensors don't mind.  An echo
+///           that has not ended by the end of the period is no echo.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateSonarRanging()
+{
+  if (++m_SonarPingTicks < SONAR_PING_PERIOD_TICKS)
+  {
+    return;
+  }
+  m_SonarPingTicks = 0U;
+
+  uint8_t sensor = m_SonarActiveSensor;
+  uint8_t state = m_SonarState;
+  if (state == SONAR_TRIGGERING)
+  {
+    SetSonarTrigger(sensor, false);
+  }
+  if ((state == SONAR_TRIGGERING) || (state == SONAR_WAITING_FOR_ECHO) || (state == SONAR_TIMING_ECHO))
+  {
+    m_SonarEchoWidthsUs[sensor] = 0U;
+    m_SonarNewEchoMask |= static_cast<uint8_t>(1U << sensor);
+  }
+
+  // Next sensor's turn
+  sensor++;
+  if (sensor == NUM_SONAR_SENSORS)
+  {
+    sensor = 0U;
+  }
+  m_SonarActiveSensor = sensor;
+  m_SonarState = SONAR_TRIGGERING;
+  SetSonarTrigger(sensor, true);
+
+  // The compare B flag sets every tick whether or not its interrupt is on
+  TIFR2 = _BV(OCF2B);
+  TIMSK2 |= _BV(OCIE2B);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SonarTriggerEndInterruptHandler
+///
+/// Details:  Interrupt handler for Timer 2 compare match B.  Ends the trigger
+///           pulse of the sensor being pinged and starts listening for its
+///           echo.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SonarTriggerEndInterruptHandler()
+{
+  TIMSK2 &= static_cast<uint8_t>(~_BV(OCIE2B));
+  SetSonarTrigger(m_SonarActiveSensor, false);
+  m_SonarState = SONAR_WAITING_FOR_ECHO;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SonarEchoInterruptHandler
+///
+/// Details:  Interrupt handler for a change on port B, after the limit
+///           switches have had theirs.  Times the echo of the sensor being
+///           pinged from its rising to its falling edge.  Only that sensor's
+///           echo pin is looked at, so the other port B changes are ignored.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SonarEchoInterruptHandler()
+{
+  uint8_t state = m_SonarState;
+  if ((state != SONAR_WAITING_FOR_ECHO) && (state != SONAR_TIMING_ECHO))
+  {
+    return;
+  }
+
+  unsigned long edgeTimeUs = GetTimeStampUs();
+  uint8_t sensor = m_SonarActiveSensor;
+  bool bEchoHigh = ReadSonarEcho(sensor);
+  if (bEchoHigh && (state == SONAR_WAITING_FOR_ECHO))
+  {
+    m_SonarEchoStartUs = edgeTimeUs;
+    m_SonarState = SONAR_TIMING_ECHO;
+  }
+  else if (!bEchoHigh && (state == SONAR_TIMING_ECHO))
+  {
+    // Too long is the sensor giving up, which is no echo
+    unsigned long echoWidthUs = edgeTimeUs - m_SonarEchoStartUs;
+    m_SonarEchoWidthsUs[sensor] = (echoWidthUs < SONAR_MAX_ECHO_US) ? static_cast<uint16_t>(echoWidthUs) : 0U;
+    m_SonarNewEchoMask |= static_cast<uint8_t>(1U << sensor);
+    m_SonarState = SONAR_PING_DONE;
+  }
+  else
+  {
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SetSonarTrigger
+///
+/// Details:  Drives a sonar sensor's trigger pin.  DigitalPin needs the pin
+///           at compile time, so each sensor is a case here and in
+///           ReadSonarEcho().
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SetSonarTrigger(uint8_t sensor, bool bHigh)
+{
+  static_assert(NUM_SONAR_SENSORS == 1U, "Add the new sonar sensor's pins to SetSonarTrigger() and ReadSonarEcho()!");
+
+  switch (sensor)
+  {
+    case 0:
+    default:
+    {
+      DigitalPin<SONAR_TRIGGER_PIN>::Write(bHigh);
+      break;
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ReadSonarEcho
+///
+/// Details:  Reads a sonar sensor's echo pin.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::ReadSonarEcho(uint8_t sensor)
+{
+  switch (sensor)
+  {
+    case 0:
+    default:
+    {
+      return DigitalPin<SONAR_ECHO_PIN>::Read();
+    }
   }
 }
 
@@ -112,25 +439,100 @@ void SoapBoxDerbyCar::ReadLimitSwitches()
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: ReadSonarSensors
 ///
-/// Details:  Reads and stores all sonar values.
+/// Details:  Turns the echoes timed since the last call into distances.  A
+///           sensor's distance is the median of its last SONAR_MEDIAN_SIZE
+///           pings, counting no echo as out of range, so a single missed or
+///           stray echo does not move it.  The distance is valid while most
+///           of those pings heard an echo.
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::ReadSonarSensors()
 {
-  const int SONAR_TRIGGER_INIT_DELAY_US   = 2;
-  const int SONAR_TRIGGER_PULSE_DELAY_US  = 5;
-  const int SONAR_CONVERT_PULSE_TO_INCHES = 74 / 2;
-  
-  // Prepare output pin with a clean low signal
-  digitalWrite(SONAR_TRIGGER_PIN, LOW);
-  delayMicroseconds(SONAR_TRIGGER_INIT_DELAY_US);
-  
-  // Trigger the pin to start the output sonar signal
-  digitalWrite(SONAR_TRIGGER_PIN, HIGH);
-  delayMicroseconds(SONAR_TRIGGER_PULSE_DELAY_US);
-  digitalWrite(SONAR_TRIGGER_PIN, LOW);
-
-  // Listen for a response
-  // Division constants from the sample 'Ping' program
-  m_SonarDistanceInches = pulseIn(SONAR_ECHO_PIN, HIGH, PULSE_IN_TIMEOUT_US) / SONAR_CONVERT_PULSE_TO_INCHES;
+  static_assert((SONAR_MEDIAN_SIZE % 2U) == 1U, "Sonar median size must be odd!");
+  static_assert((SONAR_MAX_ECHO_US / SONAR_ECHO_US_PER_INCH) < SONAR_NO_ECHO_INCHES, "Sonar range does not fit in a byte!");
+  static_assert(NUM_SONAR_SENSORS <= 8U, "Sonar sensors do not fit in the masks!");
+
+  noInterrupts();
+  uint8_t newEchoMask = m_SonarNewEchoMask;
+  m_SonarNewEchoMask = 0U;
+  uint16_t echoWidthsUs[NUM_SONAR_SENSORS];
+  for (uint8_t sensor = 0U; sensor < NUM_SONAR_SENSORS; sensor++)
+  {
+    echoWidthsUs[sensor] = m_SonarEchoWidthsUs[sensor];
+  }
+  interrupts();
+
+  for (uint8_t sensor = 0U; sensor < NUM_SONAR_SENSORS; sensor++)
+  {
+    uint8_t sensorBit = static_cast<uint8_t>(1U << sensor);
+    if ((newEchoMask & sensorBit) == 0U)
+    {
+      continue;
+    }
+
+    uint8_t readingInches = SONAR_NO_ECHO_INCHES;
+    if (echoWidthsUs[sensor] != 0U)
+    {
+      readingInches = static_cast<uint8_t>(echoWidthsUs[sensor] / SONAR_ECHO_US_PER_INCH);
+    }
+    else if (m_SonarNoEchoCount < UINT16_MAX)
+    {
+      m_SonarNoEchoCount++;
+    }
+    else
+    {
+    }
+
+    uint8_t * pReadings = &m_SonarReadingsInches[sensor * SONAR_MEDIAN_SIZE];
+    pReadings[m_SonarReadingIndexes[sensor]] = readingInches;
+    if (++m_SonarReadingIndexes[sensor] == SONAR_MEDIAN_SIZE)
+    {
+      m_SonarReadingIndexes[sensor] = 0U;
+    }
+
+    // Insertion sort, there are only a handful
+    uint8_t readings[SONAR_MEDIAN_SIZE];
+    for (uint8_t i = 0U; i < SONAR_MEDIAN_SIZE; i++)
+    {
+      uint8_t reading = pReadings[i];
+      uint8_t j = i;
+      while ((j > 0U) && (readings[j - 1U] > reading))
+      {
+        readings[j] = readings[j - 1U];
+        j--;
+      }
+      readings[j] = reading;
+    }
+
+    m_SonarDistancesInches[sensor] = readings[SONAR_MEDIAN_SIZE / 2U];
+    if (m_SonarDistancesInches[sensor] != SONAR_NO_ECHO_INCHES)
+    {
+      m_SonarValidMask |= sensorBit;
+    }
+    else
+    {
+      m_SonarValidMask &= static_cast<uint8_t>(~sensorBit);
+    }
+  }
 }
-
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: GetWallDistanceInches
+///
+/// Details:  Gets the distance to the nearest thing any sonar sensor sees.
+///           Returns false if none of them has a valid distance.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::GetWallDistanceInches(int & rDistanceInches) const
+{
+  bool bValid = false;
+  rDistanceInches = 0;
+  for (uint8_t sensor = 0U; sensor < NUM_SONAR_SENSORS; sensor++)
+  {
+    if (((m_SonarValidMask & (1U << sensor)) != 0U) && (!bValid || (m_SonarDistancesInches[sensor] < rDistanceInches)))
+    {
+      rDistanceInches = m_SonarDistancesInches[sensor];
+      bValid = true;
+    }
+  }
+  return bValid;
+}
@@ -0,0 +1,211 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     SerialCommandParser.hpp
+/// Author:   David Stalter
+///
+/// Details:  Incremental parser for text commands arriving on a serial port.
+///           Bytes are fed in one at a time as they are received, so nothing
+///           ever waits on the port, and the line is kept in a fixed buffer
+///           inside the parser (no String, no heap).
+///
+///           A command is a name followed by up to MAX_ARGUMENTS integer
+///           arguments separated by spaces or commas, ended by a new line,
+///           carriage return or ';'.  The first argument may follow the name
+///           directly ("ps50" is "ps 50").  A line that stops arriving
+///           without an ending is taken as complete after IDLE_TIMEOUT_MS,
+///           for senders that do not end their lines (the Arduino serial
+///           monitor with no line ending, or the original Pi requests).
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SERIALCOMMANDPARSER_HPP
+#define SERIALCOMMANDPARSER_HPP
+
+// INCLUDES
+#include <stdint.h>                   // for fixed width integer types
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  SerialCommandParser
+///
+/// Details:  Splits a serial byte stream into commands.  After ProcessByte()
+///           or CheckIdle() return true, the command is available from the
+///           getters until the next byte is fed in.
+////////////////////////////////////////////////////////////////////////////////
+class SerialCommandParser
+{
+public:
+  static const uint8_t        MAX_LINE_LENGTH   = 24;
+  static const uint8_t        MAX_NAME_LENGTH   = 3;
+  static const uint8_t        MAX_ARGUMENTS     = 2;
+  static const unsigned long  IDLE_TIMEOUT_MS   = 50;
+
+  // How a completed line parsed
+  enum Status
+  {
+    COMMAND_OK,
+    COMMAND_TOO_LONG,
+    COMMAND_BAD_ARGUMENTS
+  };
+
+  // Constructor
+  SerialCommandParser() :
+    m_Line(),
+    m_LineLength(0U),
+    m_bLineOverflowed(false),
+    m_LastByteTimeStampMs(0UL),
+    m_Name(),
+    m_Arguments(),
+    m_NumArguments(0U),
+    m_Status(COMMAND_OK)
+  {
+  }
+
+  // Adds one received byte.  Returns true if it completed a command.
+  inline bool ProcessByte(char data, unsigned long timeStampMs)
+  {
+    m_LastByteTimeStampMs = timeStampMs;
+
+    if ((data == '\n') || (data == '\r') || (data == ';'))
+    {
+      return EndLine();
+    }
+
+    if (m_LineLength < MAX_LINE_LENGTH)
+    {
+      m_Line[m_LineLength++] = data;
+    }
+    else
+    {
+      m_bLineOverflowed = true;
+    }
+
+    return false;
+  }
+
+  // Completes a partial line nothing has been added to for IDLE_TIMEOUT_MS.
+  // Returns true if that made a command.
+  inline bool CheckIdle(unsigned long timeStampMs)
+  {
+    if ((m_LineLength == 0U) ||((timeStampMs - m_LastByteTimeStampMs) < IDLE_TIMEOUT_MS))
+    {
+      return false;
+    }
+
+    return EndLine();
+  }
+
+  inline Status GetStatus() const { return m_Status; }
+  inline const char * GetName() const { return m_Name; }
+  inline uint8_t GetNumArguments() const { return m_NumArguments; }
+  inline long GetArgument(uint8_t index) const { return (index < m_NumArguments) ? m_Arguments[index] : 0L; }
+
+private:
+  // Parses the buffered line.  Blank lines are not commands.
+  inline bool EndLine()
+  {
+    uint8_t length = m_LineLength;
+    bool bOverflowed = m_bLineOverflowed;
+    m_LineLength = 0U;
+    m_bLineOverflowed = false;
+
+    m_Name[0] = '\0';
+    m_NumArguments = 0U;
+    m_Status = COMMAND_OK;
+
+    if (bOverflowed)
+    {
+      m_Status = COMMAND_TOO_LONG;
+      return true;
+    }
+
+    uint8_t i = SkipSeparators(0U, length);
+    if (i == length)
+    {
+      return false;
+    }
+
+    // The name is the letters up to a separator, digit or sign
+    uint8_t nameLength = 0U;
+    while ((i < length) && IsNameCharacter(m_Line[i]))
+    {
+      if (nameLength == MAX_NAME_LENGTH)
+      {
+        m_Status = COMMAND_TOO_LONG;
+        return true;
+      }
+      m_Name[nameLength++] = m_Line[i++];
+    }
+    m_Name[nameLength] = '\0';
+
+    while ((i = SkipSeparators(i, length)) < length)
+    {
+      if ((m_NumArguments == MAX_ARGUMENTS) || !ParseArgument(i, length, m_Arguments[m_NumArguments]))
+      {
+        m_Status = COMMAND_BAD_ARGUMENTS;
+        return true;
+      }
+      m_NumArguments++;
+    }
+
+    return true;
+  }
+
+  inline uint8_t SkipSeparators(uint8_t i, uint8_t length) const
+  {
+    while ((i < length) && ((m_Line[i] == ' ') || (m_Line[i] == ',') || (m_Line[i] == '\t')))
+    {
+      i++;
+    }
+    return i;
+  }
+
+  static inline bool IsNameCharacter(char data)
+  {
+    return ((data >= 'a') && (data <= 'z')) || ((data >= 'A') && (data <= 'Z')) || (data == '?');
+  }
+
+  // Reads an optionally signed decimal number starting at rIndex and moves
+  // past it.  Returns false if there is not one there.
+  inline bool ParseArgument(uint8_t & rIndex, uint8_t length, long & rValue) const
+  {
+    bool bNegative = false;
+    if ((m_Line[rIndex] == '-') || (m_Line[rIndex] == '+'))
+    {
+      bNegative = (m_Line[rIndex] == '-');
+      rIndex++;
+    }
+
+    uint8_t numDigits = 0U;
+    rValue = 0L;
+    while ((rIndex < length) && (m_Line[rIndex] >= '0') && (m_Line[rIndex] <= '9'))
+    {
+      rValue = (rValue * 10L) + (m_Line[rIndex++] - '0');
+      numDigits++;
+    }
+
+    // Anything but a separator or the end of the line is not a number
+    const uint8_t MAX_DIGITS = 9;
+    if ((numDigits == 0U) || (numDigits > MAX_DIGITS) || ((rIndex < length) && (SkipSeparators(rIndex, length) == rIndex)))
+    {
+      return false;
+    }
+
+    if (bNegative)
+    {
+      rValue = -rValue;
+    }
+    return true;
+  }
+
+  char m_Line[MAX_LINE_LENGTH];
+  uint8_t m_LineLength;
+  bool m_bLineOverflowed;
+  unsigned long m_LastByteTimeStampMs;
+  char m_Name[MAX_NAME_LENGTH + 1];
+  long m_Arguments[MAX_ARGUMENTS];
+  uint8_t m_NumArguments;
+  Status m_Status;
+};
+
+#endif // SERIALCOMMANDPARSER_HPP
@@ -4,7 +4,11 @@
 ///
 /// Details:  Contains functionality for serial port operations speicific to the
 ///           soap box derby car.  At least one of the non-default ports is used
-///           to transmit data to another microcontroller.
+///           to transmit data to another microcontroller.  Car data goes out
+///           as binary frames (see TelemetryProtocol.hpp), either one per
+///           request or streamed at a requested rate.  Commands from the
+///           console and the car data port go through the same incremental
+///           parser (see SerialCommandParser.hpp) and command table.
 ///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
@@ -13,7 +17,34 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+uint8_t       SoapBoxDerbyCar::m_CarDataSequence            = 0U;
+uint16_t      SoapBoxDerbyCar::m_CarDataStreamPeriodMs      = 0U;
+uint16_t      SoapBoxDerbyCar::m_CarDataStreamTick          = 0U;
+unsigned long SoapBoxDerbyCar::m_CarDataDroppedFrameCount   = 0UL;
+SerialCommandParser SoapBoxDerbyCar::m_ConsoleCommandParser;
+SerialCommandParser SoapBoxDerbyCar::m_CarDataCommandParser;
+
+// Order must match SerialCommandId
+const SoapBoxDerbyCar::SerialCommand SoapBoxDerbyCar::SERIAL_COMMANDS[NUM_SERIAL_COMMANDS] PROGMEM =
+{
+  // Name   Min/max arguments   Console only
+  { "h",    0, 0,               true  },    // List the commands
+  { "p",    0, 0,               true  },    // Display debug prints
+  { "l",    0, 1,               true  },    // Display the data log [from entry]
+  { "c",    0, 0,               true  },    // Clear the RAM data log
+  { "s",    0, 0,               true  },    // Send one car data frame
+  { "d",    0, 0,               true  },    // Display EEPROM
+  { "e",    0, 0,               true  },    // Erase EEPROM
+  { "r",    0, 0,               true  },    // Restore the data log from EEPROM
+  { "w",    0, 0,               true  },    // Write to EEPROM
+  { "t",    0, 0,               true  },    // Display scheduler statistics
+  { "g",    0, 2,               true  },    // Display steering gains [or set gain value]
+  { "m",    0, 0,               true  },    // Display memory usage
+  { "f",    0, 0,               true  },    // Display the flight recorder snapshot
+  { "pi",   0, 0,               false },    // Send one car data frame
+  { "ps",   1, 1,               false },    // Stream car data at rate (Hz)
+  { "pm",   0, 0,               false }     // Send one memory usage frame
+};
 
 // GLOBALS
 // (none)
@@ -33,7 +64,6 @@ void SoapBoxDerbyCar::ConfigureSerialPorts()
 
   // Enable the serial port for transmitting car data
   m_pDataTransmitSerialPort->begin(SERIAL_PORT_BAUD_RATE);
-  m_pDataTransmitSerialPort->setTimeout(SERIAL_PORT_TIMEOUT_MS);
 }
 
 
@@ -44,102 +74,312 @@ void SoapBoxDerbyCar::ConfigureSerialPorts()
 ////////////////////////////////////////////////////////////////////////////////
 bool SoapBoxDerbyCar::IsSerialTransmitSwitchSet()
 {
-  return (digitalRead(SERIAL_TRANSMIT_SWITCH_PIN) == 1);
+  return DigitalPin<SERIAL_TRANSMIT_SWITCH_PIN>::Read();
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Method: IsCarDataRequested
+/// Method: ProcessSerialCommands
 ///
-/// Details:  Checks if there is a request to send serial data.
+/// Details:  Feeds the bytes a serial port has already received to its
+///           command parser and executes each command they complete.  Never
+///           waits for more input.  Only console commands print errors, the
+///           car data port is left for binary frames.
 ////////////////////////////////////////////////////////////////////////////////
-bool SoapBoxDerbyCar::IsCarDataRequested()
+void SoapBoxDerbyCar::ProcessSerialCommands(HardwareSerial & rPort, SerialCommandParser & rParser, bool bConsole)
 {
-  bool bResult = false;
-  
-  if (m_pDataTransmitSerialPort->available())
+  int numBytes = rPort.available();
+  while (numBytes-- > 0)
   {
-    if (m_pDataTransmitSerialPort->readString() == SERIAL_PORT_DATA_REQUEST_STRING)
+    if (rParser.ProcessByte(static_cast<char>(rPort.read()), GetTimeStampMs()))
     {
-      bResult = true;
+      ExecuteSerialCommand(rParser, bConsole);
     }
   }
 
-  return bResult;
+  // Senders that do not end their lines
+  if (rParser.CheckIdle(GetTimeStampMs()))
+  {
+    ExecuteSerialCommand(rParser, bConsole);
+  }
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Method: SendCarSerialData
+/// Method: ExecuteSerialCommand
 ///
-/// Details:  Sends basic information about the state of the car and its sensors
-///           out via a serial port.
+/// Details:  Looks up a parsed command, checks its arguments and runs it.
 ////////////////////////////////////////////////////////////////////////////////
-void SoapBoxDerbyCar::SendCarSerialData()
+void SoapBoxDerbyCar::ExecuteSerialCommand(const SerialCommandParser & rParser, bool bConsole)
 {
-  static int transmitCount = 0;
-  static unsigned long lastTimeStamp = 0;
-  
-  const int NUM_FIELDS_TO_TRANSMIT = 10;
-  int32_t serialData[NUM_FIELDS_TO_TRANSMIT] = {};
-  static_assert(sizeof(serialData) == NUM_FIELDS_TO_TRANSMIT * 4, "Serial data size is not using 32 bit integers!");
+  SerialCommand command;
+  uint8_t commandId = 0U;
+  for (commandId = 0U; commandId < NUM_SERIAL_COMMANDS; commandId++)
+  {
+    memcpy_P(&command, &SERIAL_COMMANDS[commandId], sizeof(command));
+    if (strcmp(command.m_Name, rParser.GetName()) == 0)
+    {
+      break;
+    }
+  }
 
-  // If enough time hasn't elapsed, don't transmit
-  if (CalcDeltaTimeMs(lastTimeStamp) < SERIAL_DATA_TRANSMIT_INTERVAL_MS)
+  const __FlashStringHelper * pError = nullptr;
+  if (rParser.GetStatus() == SerialCommandParser::COMMAND_TOO_LONG)
   {
+    pError = F("Input command too long.");
+  }
+  else if ((commandId == NUM_SERIAL_COMMANDS) || (command.m_bConsoleOnly && !bConsole))
+  {
+    pError = F("Unrecognized input command.");
+  }
+  else if ((rParser.GetStatus() != SerialCommandParser::COMMAND_OK) ||
+           (rParser.GetNumArguments() < command.m_MinArguments) ||
+           (rParser.GetNumArguments() > command.m_MaxArguments))
+  {
+    pError = F("Invalid input command arguments.");
+  }
+  else
+  {
+  }
+
+  if (pError != nullptr)
+  {
+    if (bConsole)
+    {
+      Serial.println(pError);
+    }
     return;
   }
-  
-  // Package together all of the data
-  int transmitDataIndex = 0;
-  serialData[transmitDataIndex++] = m_CurrentSteeringValue;
-  serialData[transmitDataIndex++] = m_bBrakeApplied;
-  serialData[transmitDataIndex++] = m_LeftHallCount;
-  serialData[transmitDataIndex++] = m_RightHallCount;
-  serialData[transmitDataIndex++] = m_LeftSteeringLimitSwitchValue;
-  serialData[transmitDataIndex++] = m_RightSteeringLimitSwitchValue;
-  serialData[transmitDataIndex++] = m_FrontAxlePotentiometerValue;
-  serialData[transmitDataIndex++] = m_bIsAutonomousExecuting;
 
-  // Make sure the buffer wasn't overrun
-  ASSERT(transmitDataIndex == NUM_FIELDS_TO_TRANSMIT);
+  switch (static_cast<SerialCommandId>(commandId))
+  {
+    case COMMAND_HELP:
+    {
+      Serial.print(F("Commands:"));
+      for (uint8_t i = 0U; i < NUM_SERIAL_COMMANDS; i++)
+      {
+        memcpy_P(&command, &SERIAL_COMMANDS[i], sizeof(command));
+        Serial.print(F(" "));
+        Serial.print(command.m_Name);
+      }
+      Serial.println();
+      break;
+    }
+    case COMMAND_DISPLAY_DEBUG_PRINTS:
+    {
+      DisplayValues();
+      break;
+    }
+    case COMMAND_DISPLAY_DATA_LOG:
+    {
+      DisplayDataLog(rParser.GetArgument(0));
+      break;
+    }
+    case COMMAND_CLEAR_DATA_LOG:
+    {
+      ClearDataLog(RAM_LOG);
+      break;
+    }
+    case COMMAND_SEND_SERIAL_DATA:
+    case COMMAND_REQUEST_CAR_DATA:
+    {
+      SendCarSerialData();
+      break;
+    }
+    case COMMAND_DISPLAY_EEPROM:
+    {
+      DisplayEeprom();
+      break;
+    }
+    case COMMAND_ERASE_EEPROM:
+    {
+      EraseEeprom();
+      break;
+    }
+    case COMMAND_RESTORE_FROM_EEPROM:
+    {
+      RestoreLogFromEeprom();
+      break;
+    }
+    case COMMAND_WRITE_TO_EEPROM:
+    {
+      WriteLogToEeprom();
+      break;
+    }
+    case COMMAND_DISPLAY_SCHEDULER_STATS:
+    {
+      DisplaySchedulerStatistics();
+      break;
+    }
+    case COMMAND_STEERING_GAINS:
+    {
+      // Set with "g <gain> <value>", saved by the next EEPROM write
+      if ((rParser.GetNumArguments() == 1U) ||
+          ((rParser.GetNumArguments() == 2U) && !SetSteeringGain(rParser.GetArgument(0), rParser.GetArgument(1))))
+      {
+        Serial.println(F("Invalid input command arguments."));
+        break;
+      }
+      DisplaySteeringGains();
+      break;
+    }
+    case COMMAND_DISPLAY_MEMORY_USAGE:
+    {
+      DisplayMemoryUsage();
+      break;
+    }
+    case COMMAND_DISPLAY_FLIGHT_RECORDER:
+    {
+      DisplayFlightRecorder();
+      break;
+    }
+    case COMMAND_STREAM_CAR_DATA:
+    {
+      SetCarDataStreamRate(rParser.GetArgument(0));
+      break;
+    }
+    case COMMAND_REQUEST_MEMORY_USAGE:
+    {
+      SendMemoryUsageData();
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+}
 
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SetCarDataStreamRate
+///
+/// Details:  Sets how many car data frames per second are sent without being
+///           requested.  Zero stops the stream.  The rate is limited to
+///           CAR_DATA_MAX_STREAM_RATE_HZ, and the period is rounded up to a
+///           multiple of the transmit task period.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SetCarDataStreamRate(long rateHz)
+{
+  rateHz = constrain(rateHz, 0L, static_cast<long>(CAR_DATA_MAX_STREAM_RATE_HZ));
+  m_CarDataStreamPeriodMs = 0U;
+  
+  if (rateHz != 0L)
+  {
+    // The transmit task only checks the stream every task period, so a
+    // shorter remainder would be stretched to the next check anyway
+    const long TASK_PERIOD_MS = static_cast<long>(CAR_DATA_TRANSMIT_TASK_PERIOD_MS);
+    long periodMs = 1000L / rateHz;
+    periodMs = ((periodMs + TASK_PERIOD_MS - 1L) / TASK_PERIOD_MS) * TASK_PERIOD_MS;
+    m_CarDataStreamPeriodMs = static_cast<uint16_t>(periodMs);
+  }
+  
+  m_CarDataStreamTick = GetSchedulerTick();
+  
   if (DEBUG_PRINTS)
   {
-    Serial.print(F("Serial data transmission #"));
-    Serial.println(++transmitCount);
+    LogDebugMessage(DebugLogMessages::LOG_CAR_DATA_STREAM_PERIOD, m_CarDataStreamPeriodMs);
   }
+}
 
-  // The preferred way to transmit is by writing out via a byte pointer.
-  // However, the listener on the other end could be something like
-  // javascript, which does not provide easy direct support of manipulating
-  // byte streams.  If the receiver has better support of byte manipulation
-  // and conversion, the stream can be written directly instead.  Configure
-  // this via the SERIAL_PORT_USE_RAW_DATA variable.
 
-  // Send the header
-  m_pDataTransmitSerialPort->println("SBDC");
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SendCarSerialData
+///
+/// Details:  Sends basic information about the state of the car and its sensors
+///           out via a serial port, as one binary frame (see
+///           TelemetryProtocol.hpp).  This never blocks: if the transmit
+///           buffer does not have room for the whole frame, the frame is
+///           dropped and counted.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::SendCarSerialData()
+{
+  int32_t carData[TelemetryProtocol::NUM_CAR_STATE_FIELDS] = {};
 
-  if (SERIAL_PORT_USE_RAW_DATA)
+  uint8_t statusFlags = 0U;
+  if (m_bBrakeApplied)
   {
-    byte * pData = reinterpret_cast<byte *>(&serialData);
-    for (size_t i = 0; i < sizeof(serialData); i++)
-    {
-      m_pDataTransmitSerialPort->write(*pData++);
-    }
+    statusFlags |= TelemetryProtocol::BRAKE_APPLIED_FLAG;
+  }
+  if (m_bIsAutonomousExecuting)
+  {
+    statusFlags |= TelemetryProtocol::AUTONOMOUS_EXECUTING_FLAG;
+  }
+  if (m_LeftSteeringLimitSwitchValue != 0)
+  {
+    statusFlags |= TelemetryProtocol::LEFT_LIMIT_SWITCH_FLAG;
+  }
+  if (m_RightSteeringLimitSwitchValue != 0)
+  {
+    statusFlags |= TelemetryProtocol::RIGHT_LIMIT_SWITCH_FLAG;
+  }
+
+  int wallDistanceInches = 0;
+  if (GetWallDistanceInches(wallDistanceInches))
+  {
+    statusFlags |= TelemetryProtocol::WALL_DISTANCE_VALID_FLAG;
+  }
 
-    // Send a newline footer to indicate the end of the data
-    m_pDataTransmitSerialPort->println();
+  noInterrupts();
+  uint16_t leftHallCount = m_LeftHallCount;
+  uint16_t rightHallCount = m_RightHallCount;
+  interrupts();
+
+  // Package together all of the data
+  carData[TelemetryProtocol::TIME_STAMP_MS] = static_cast<int32_t>(GetTimeStampMs());
+  carData[TelemetryProtocol::STATUS_FLAGS] = statusFlags;
+  carData[TelemetryProtocol::STEERING_VALUE] = m_CurrentSteeringValue;
+  carData[TelemetryProtocol::LEFT_HALL_COUNT] = leftHallCount;
+  carData[TelemetryProtocol::RIGHT_HALL_COUNT] = rightHallCount;
+  carData[TelemetryProtocol::FRONT_AXLE_POTENTIOMETER] = m_FrontAxlePotentiometerValue;
+  carData[TelemetryProtocol::POSE_X_Q8] = m_Pose.m_XQ8;
+  carData[TelemetryProtocol::POSE_Y_Q8] = m_Pose.m_YQ8;
+  carData[TelemetryProtocol::POSE_HEADING_Q8] = m_Pose.m_HeadingQ8;
+  carData[TelemetryProtocol::STEERING_TARGET_CLICKS] = m_SteeringTargetClicks;
+  carData[TelemetryProtocol::WALL_DISTANCE_INCHES] = wallDistanceInches;
+
+  uint8_t frame[TelemetryProtocol::MAX_FRAME_SIZE_BYTES];
+  uint8_t frameSize = TelemetryProtocol::EncodeFrame(TelemetryProtocol::CAR_STATE_FRAME,
+                                                     m_CarDataSequence++,
+                                                     carData,
+                                                     TelemetryProtocol::NUM_CAR_STATE_FIELDS,
+                                                     frame);
+
+  // Make sure the buffer wasn't overrun
+  ASSERT(frameSize <= sizeof(frame));
+
+  if (m_pDataTransmitSerialPort->availableForWrite() >= frameSize)
+  {
+    m_pDataTransmitSerialPort->write(frame, frameSize);
   }
   else
   {
-    // Send the data
-    for (size_t i = 0; i < NUM_FIELDS_TO_TRANSMIT; i++)
-    {
-      m_pDataTransmitSerialPort->println(serialData[i]);
-    }
+    m_CarDataDroppedFrameCount++;
   }
 
-  lastTimeStamp = GetTimeStampMs();
+  if (DEBUG_PRINTS)
+  {
+    LogDebugMessage(DebugLogMessages::LOG_CAR_DATA_FRAME_SENT, m_CarDataSequence, m_CarDataDroppedFrameCount);
+  }
 }
-
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: TransmitCarDataIfRequested
+///
+/// Details:  Handles requests from the car data serial port (which send
+///           requested frames right away), then sends a frame if streaming
+///           is on and the next one is due.  The scheduler is stopped during
+///           autonomous, so the autonomous loop calls this directly.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::TransmitCarDataIfRequested()
+{
+  ProcessSerialCommands(*m_pDataTransmitSerialPort, m_CarDataCommandParser, false);
+  
+  uint16_t currentTick = GetSchedulerTick();
+  if ((m_CarDataStreamPeriodMs != 0U) && (static_cast<uint16_t>(currentTick - m_CarDataStreamTick) >= m_CarDataStreamPeriodMs))
+  {
+    m_CarDataStreamTick = currentTick;
+    SendCarSerialData();
+  }
+}
@@ -32,22 +32,22 @@
 #define SOAPBOXDERBYCAR_HPP
 
 // INCLUDES
+#include <new.h>                      // for placement new (AVR core 1.8.3 or later)
 #include "PwmSpeedController.hpp"     // for speed controller declarations
+#include "DataLogCodec.hpp"           // for the data log record format
+#include "TelemetryProtocol.hpp"      // for the car data frame format
+#include "SerialCommandParser.hpp"    // for serial command parsing
+#include "DebugLogMessages.hpp"       // for deferred debug log message IDs
+#include "DigitalPin.hpp"             // for direct port pin access
 
 // MACROS
-#define ASSERT(condition)           \
-  do                                \
-  {                                 \
-    if (!(condition))               \
-    {                               \
-      Serial.println();             \
-      Serial.println(F("ASSERT!")); \
-      Serial.print(F("File: "));    \
-      Serial.println(__FILE__);     \
-      Serial.print(F("Line: "));    \
-      Serial.println(__LINE__);     \
-      ProcessAssert();              \
-    }                               \
+#define ASSERT(condition)                     \
+  do                                          \
+  {                                           \
+    if (!(condition))                         \
+    {                                         \
+      ProcessAssert(F(__FILE__), __LINE__);   \
+    }                                         \
   } while (false)
 
 #define UNUSED __attribute__((unused))
@@ -75,11 +75,23 @@ public:
   //////////////////////////////////////////////////////////////////////////////
   /// Method: CreateSingletonInstance
   ///
-  /// Details:  Creates the singleton SoapBoxDerbyCar instance.
+  /// Details:  Creates the singleton SoapBoxDerbyCar instance.  The free SRAM
+  ///           is painted first, so stack use can be measured (see
+  ///           Memory.ino).
   //////////////////////////////////////////////////////////////////////////////
   inline static void CreateSingletonInstance()
   {
-    m_pSoapBoxDerbyCar = new SoapBoxDerbyCar();
+    PaintStack();
+
+    if (STATIC_ALLOCATION)
+    {
+      alignas(SoapBoxDerbyCar) static uint8_t soapBoxDerbyCarStorage[sizeof(SoapBoxDerbyCar)];
+      m_pSoapBoxDerbyCar = new (soapBoxDerbyCarStorage) SoapBoxDerbyCar();
+    }
+    else
+    {
+      m_pSoapBoxDerbyCar = new SoapBoxDerbyCar();
+    }
   }
   
   //////////////////////////////////////////////////////////////////////////////
@@ -112,9 +124,29 @@ public:
     // Attach the ISRs
     attachInterrupt(digitalPinToInterrupt(LEFT_HALL_SENSOR_PIN), LeftHallSensorInterruptHandler, CHANGE);
     attachInterrupt(digitalPinToInterrupt(RIGHT_HALL_SENSOR_PIN), RightHallSensorInterruptHandler, CHANGE);
-    //attachInterrupt(digitalPinToInterrupt(STEERING_LIMIT_SWITCHES_INTERRUPT_PIN), SteeringLimitSwitchInterruptHandler, CHANGE);
+
+    // The limit switch handler can cut the steering motor, so it also waits
+    // for the singleton.  The sonar echoes share the port B vector.
+    PCMSK0 |= LIMIT_SWITCH_PCMSK0_MASK | SONAR_ECHO_PCMSK0_MASK;
+    PCIFR = _BV(PCIF0);
+    PCICR |= _BV(PCIE0);
   }
 
+  // Raw vector interrupt handlers.  The ISR() macro has to be used at file
+  // scope, so the class handlers it forwards to must be publicly reachable.
+  static void ControllerInputInterruptHandler();
+  static void SchedulerTickInterruptHandler();
+  static void SonarTriggerEndInterruptHandler();
+  static void PotentiometerAdcInterruptHandler();
+  static void SteeringEncoderCaptureInterruptHandler();
+  static void SteeringLimitSwitchInterruptHandler();
+  static void SonarEchoInterruptHandler();
+
+  // The cycle count benchmarks measure private methods (see Benchmark/),
+  // the host tests check them (see Host/HostTests.cpp)
+  friend class SoapBoxDerbyCarBenchmark;
+  friend class SoapBoxDerbyCarHostTests;
+
 private:
   
   //////////////////////////////////////////////////////////////////////////////
@@ -138,35 +170,279 @@ private:
     RISING_EDGE   = HIGH
   };
 
+  // Scheduler tasks, in the same order as m_SchedulerTasks
+  enum SchedulerTaskId
+  {
+    CONTROLLER_TASK,
+    SENSORS_TASK,
+    STEERING_CONTROL_TASK,
+    DATA_LOG_TASK,
+    CAR_DATA_TRANSMIT_TASK,
+    SERIAL_COMMAND_TASK,
+    DEBUG_PRINT_TASK,
+    STATUS_LIGHT_TASK,
+    DATA_LOG_JOURNAL_TASK,
+    DEBUG_LOG_TASK,
+    MEMORY_TASK,
+    FLIGHT_RECORDER_TASK,
+    NUM_SCHEDULER_TASKS
+  };
+
+  // Filters that can be applied to the potentiometer samples
+  enum PotentiometerFilterType
+  {
+    POT_FILTER_MOVING_AVERAGE,
+    POT_FILTER_MEDIAN
+  };
+
   // Locations for where the data log can be kept
   enum LogLocation
   {
     RAM_LOG,
     EEPROM_LOG
   };
+
+  // Serial commands, in the same order as SERIAL_COMMANDS
+  enum SerialCommandId
+  {
+    COMMAND_HELP,
+    COMMAND_DISPLAY_DEBUG_PRINTS,
+    COMMAND_DISPLAY_DATA_LOG,
+    COMMAND_CLEAR_DATA_LOG,
+    COMMAND_SEND_SERIAL_DATA,
+    COMMAND_DISPLAY_EEPROM,
+    COMMAND_ERASE_EEPROM,
+    COMMAND_RESTORE_FROM_EEPROM,
+    COMMAND_WRITE_TO_EEPROM,
+    COMMAND_DISPLAY_SCHEDULER_STATS,
+    COMMAND_STEERING_GAINS,
+    COMMAND_DISPLAY_MEMORY_USAGE,
+    COMMAND_DISPLAY_FLIGHT_RECORDER,
+    COMMAND_REQUEST_CAR_DATA,
+    COMMAND_STREAM_CAR_DATA,
+    COMMAND_REQUEST_MEMORY_USAGE,
+    NUM_SERIAL_COMMANDS
+  };
+
+  // Steering gains that can be set by command, in SteeringGains order
+  enum SteeringGainId
+  {
+    HEADING_KP_GAIN,
+    LATERAL_KP_GAIN,
+    LATERAL_KI_GAIN,
+    INNER_KP_GAIN,
+    INNER_KI_GAIN,
+    INNER_KD_GAIN,
+    NUM_STEERING_GAINS
+  };
+
+  // Where the sonar ranging is in the current ping
+  enum SonarState
+  {
+    SONAR_IDLE,
+    SONAR_TRIGGERING,
+    SONAR_WAITING_FOR_ECHO,
+    SONAR_TIMING_ECHO,
+    SONAR_PING_DONE
+  };
+
+  // What the EEPROM journal writer is doing
+  enum DataLogJournalState
+  {
+    JOURNAL_IDLE,
+    JOURNAL_WRITING_DATA,
+    JOURNAL_WRITING_HEADER
+  };
+
+  // Events that can trigger a flight recorder snapshot, in the same order
+  // as FLIGHT_RECORDER_EVENT_NAMES
+  enum FlightRecorderEvent
+  {
+    FLIGHT_RECORDER_LIMIT_SWITCH,
+    FLIGHT_RECORDER_BRAKE,
+    FLIGHT_RECORDER_EMERGENCY_STOP,
+    FLIGHT_RECORDER_ASSERT,
+    FLIGHT_RECORDER_AUTONOMOUS_LAUNCH,
+    FLIGHT_RECORDER_AUTONOMOUS_EXIT,
+    NUM_FLIGHT_RECORDER_EVENTS
+  };
+
+  // What the flight recorder is doing
+  enum FlightRecorderState
+  {
+    FLIGHT_RECORDER_ARMED,
+    FLIGHT_RECORDER_CAPTURING,
+    FLIGHT_RECORDER_SAVING
+  };
   
   
   //////////////////////////////////////////////////////////////////////////////
   /// STRUCTS
   //////////////////////////////////////////////////////////////////////////////
   
-  // Data log entry structure
-  struct DataLogEntry
+  // Scheduler task configuration and timing statistics.  A lower priority
+  // value is more urgent.  A period of zero disables the task.
+  struct SchedulerTask
+  {
+    void (SoapBoxDerbyCar::*m_pTaskFunction)();
+    uint16_t      m_PeriodTicks;
+    uint8_t       m_Priority;
+    uint16_t      m_NextReleaseTick;
+    unsigned long m_RunCount;
+    unsigned long m_OverrunCount;
+    unsigned long m_MinExecTimeUs;
+    unsigned long m_MaxExecTimeUs;
+    unsigned long m_TotalExecTimeUs;
+  };
+
+  // A serial command's name and the arguments it takes.  Commands that are
+  // not console only are also accepted from the car data serial port.
+  struct SerialCommand
+  {
+    char    m_Name[SerialCommandParser::MAX_NAME_LENGTH + 1];
+    uint8_t m_MinArguments;
+    uint8_t m_MaxArguments;
+    bool    m_bConsoleOnly;
+  };
+
+  // Period measured between consecutive starts of the steering control task
+  struct LoopTimingStats
+  {
+    unsigned long m_LastStartTimeUs;
+    unsigned long m_MinPeriodUs;
+    unsigned long m_MaxPeriodUs;
+    unsigned long m_TotalPeriodUs;
+    unsigned long m_NumPeriods;
+  };
+
+  // SRAM usage in bytes (see Memory.ino)
+  struct MemoryUsage
+  {
+    uint16_t m_StaticDataBytes;
+    uint16_t m_HeapBytes;
+    uint16_t m_HeapHighWaterBytes;
+    uint16_t m_MaxStackBytes;
+    uint16_t m_FreeBytes;
+    uint16_t m_MinFreeBytes;
+  };
+
+  // One flight recorder sample.  The time stamp is the low 16 bits of the
+  // ms time stamp, the inputs are raw pulse widths and pot clicks, and the
+  // flags are the FLIGHT_RECORDER_*_FLAG bits.
+  struct FlightRecorderSample
+  {
+    uint16_t m_TimeStampMs;
+    uint16_t m_YawInputUs;
+    int16_t  m_PotValue;
+    uint16_t m_LeftHallCount;
+    uint16_t m_RightHallCount;
+    int8_t   m_SteeringValue;
+    uint8_t  m_Flags;
+  };
+
+  // Header of the flight recorder snapshot in EEPROM.  The samples follow
+  // it, oldest first, and the ones from the trigger on start at
+  // m_TriggerIndex.  The CRC covers the fields before it and the samples.
+  // The reserved byte keeps the layout the same in the host build.
+  struct FlightRecorderSnapshotHeader
+  {
+    uint32_t m_TriggerTimeMs;
+    int16_t  m_Incarnation;
+    uint8_t  m_Event;
+    uint8_t  m_NumSamples;
+    uint8_t  m_TriggerIndex;
+    uint8_t  m_Reserved;
+    uint16_t m_Crc;
+  };
+
+  // Car position relative to where autonomous started, from the rear axle
+  // center.  X is down the hill, Y and heading are positive to the right.
+  // Positions are Q8 inches.  Heading is Q8 pot clicks, i.e. the angle one
+  // pot click moves the front axle, so it shares the axle angle tables.
+  // The axle bias is the learned alignment error, also Q8 pot clicks.
+  struct Pose
+  {
+    int32_t  m_XQ8;
+    int32_t  m_YQ8;
+    int32_t  m_HeadingQ8;
+    int32_t  m_AxleBiasQ16;
+    int32_t  m_LastLeftDistanceQ8;
+    int32_t  m_LastRightDistanceQ8;
+  };
+
+  // One rear wheel's motion, from the time stamps of its Hall edges.  The
+  // distance is interpolated between magnets at the last edge interval.
+  // Distance is Q8 inches, speed Q8 inches per second and acceleration Q8
+  // inches per second squared.
+  struct WheelMotion
+  {
+    uint16_t      m_HallCount;        // Count as of the last update
+    uint8_t       m_NumEdges;         // Edges seen since reset, up to 3
+    unsigned long m_LastEdgeTimeUs;
+    unsigned long m_LastEdgeIntervalUs;
+    int32_t       m_DistanceQ8;
+    int32_t       m_SpeedQ8;
+    int32_t       m_AccelerationQ8;
+  };
+
+  // Steering controller gains, Q8 fixed point (value / 256)
+  struct SteeringGains
+  {
+    int16_t  m_HeadingKp;         // Target clicks per click of heading
+    int16_t  m_LateralKp;         // Target clicks per inch of lateral offset
+    int16_t  m_LateralKi;         // Target clicks per inch of offset per sample
+    int16_t  m_InnerKp;           // Output % per click of error
+    int16_t  m_InnerKi;           // Output % per click of error per sample
+    int16_t  m_InnerKd;           // Output % per click of movement per sample
+    uint16_t m_Checksum;
+  };
+
+  // Front axle pot calibration (pot clicks), saved so a boot only has to
+  // check it instead of redoing it
+  struct SteeringCalibration
   {
-    uint32_t m_TimeStampMs;
-    int32_t  m_LeftWheelDistanceInches;
-    int32_t  m_RightWheelDistanceInches;
-    int32_t  m_FrontAxlePotentiometer;
+    int16_t  m_PotMaxLeftValue;
+    int16_t  m_PotMaxRightValue;
+    int16_t  m_PotCenterValue;
+    uint16_t m_Checksum;
   };
 
-  // Non-volatile data structure
+  // Non-volatile data structure.  Fixed width types keep the EEPROM layout
+  // the same in the host build, so its EEPROM dumps decode the same way.
+  // The data log itself is saved in the journal that follows it in EEPROM.
+  // The data log sequence number is that of the block being logged; it is
+  // recovered from the journal at boot.  The layout version is that of the
+  // journal and flight recorder snapshot after it (see
+  // CheckEepromLayoutVersion()).
   struct NonVolatileCarData
   {
-    uint32_t m_Header;
-    int      m_Incarnation;
-    bool     m_bSavedByAuto;
-    bool     m_bDataLogOverflowed;
-    int      m_DataLogIndex;
+    uint32_t      m_Header;
+    int16_t       m_Incarnation;
+    bool          m_bSavedByAuto;
+    bool          m_bDataLogOverflowed;
+    int16_t       m_DataLogIndex;
+    SteeringGains m_SteeringGains;
+    uint16_t      m_DataLogSequence;
+    SteeringCalibration m_SteeringCalibration;
+    uint16_t      m_EepromLayoutVersion;
+  };
+
+  // Progress copying data log blocks into the EEPROM journal.  The committed
+  // sequence and length are what the journal holds for the newest block.
+  // A commit writes the new data bytes of one block into its slot, then the
+  // slot header.
+  struct DataLogJournal
+  {
+    DataLogJournalState             m_State;
+    uint16_t                        m_BlockOffset;        // RAM block being logged
+    uint16_t                        m_BlockLength;        // Bytes logged in it
+    uint16_t                        m_CommittedSequence;
+    uint16_t                        m_CommittedLength;
+    DataLogCodec::JournalSlotHeader m_SlotHeader;         // Being committed
+    uint16_t                        m_CommitRamOffset;
+    uint16_t                        m_CommitPosition;     // Next byte to write
+    unsigned long                   m_LastCommitTimeMs;
+    bool                            m_bFlushRequested;
   };
   
   
@@ -195,11 +471,24 @@ private:
   bool IsControllerOn();
   bool IsRecalibrationRequested();
   void ReadControllerInput();
+  unsigned long GetControllerChannelAgeUs(int channel);
+  inline bool IsControllerChannelLost(int channel) { return ((m_ControllerSignalLostMask & (1U << channel)) != 0U); }
   
   // MOTOR CONTROL
+  static PwmSpeedController * CreateSteeringSpeedController();
   void SetSteeringDirection(int value);
   void SetSteeringSpeedControllerValue(int value);
   void UpdateSpeedControllers();
+  void UpdateManualControl();
+
+  // STEERING CONTROL
+  static uint16_t CalculateSteeringGainsChecksum(const SteeringGains & rGains);
+  void LoadSteeringGains(const NonVolatileCarData & rEepromCarData);
+  void DisplaySteeringGains();
+  bool SetSteeringGain(long gainId, long value);
+  void ResetSteeringController();
+  void UpdateSteeringController();
+  int CalculateSteeringOutput(int targetPositionClicks);
 
   // BRAKE CONTROL
   void ApplyBrake();
@@ -208,29 +497,65 @@ private:
   
   // SENSORS
   void ConfigureSensors();
+  void ReadSensors();
 
   // ENCODERS
+  void ConfigureSteeringEncoderCapture();
   void CalibrateSteeringEncoder();
   void ReadEncoders();
 
   // HALL EFFECT
   static void LeftHallSensorInterruptHandler();
   static void RightHallSensorInterruptHandler();
-  inline void IncrementLeftHallSensorCount() { m_LeftWheelDistanceInches = ++m_LeftHallCount * WHEEL_LENGTH_PER_MAGNET_INCHES; }
-  inline void IncrementRightHallSensorCount() { m_RightWheelDistanceInches = ++m_RightHallCount * WHEEL_LENGTH_PER_MAGNET_INCHES; }
+  inline void IncrementLeftHallSensorCount(unsigned long edgeTimeUs) { RecordHallEdge(m_LeftHallCount, m_LeftHallEdgeTimesUs, edgeTimeUs); }
+  inline void IncrementRightHallSensorCount(unsigned long edgeTimeUs) { RecordHallEdge(m_RightHallCount, m_RightHallEdgeTimesUs, edgeTimeUs); }
+  static void RecordHallEdge(volatile unsigned int & rHallCount, unsigned long * pEdgeTimesUs, unsigned long edgeTimeUs);
+  void UpdateWheelMotion();
+  static void UpdateWheelMotion(WheelMotion & rWheel, const volatile unsigned int & rHallCount, const unsigned long * pEdgeTimesUs);
+  int32_t GetWheelSpeedRatioQ8() const;
+  inline static int32_t HallCountToInches(unsigned int count) { return (static_cast<int32_t>(count) * WHEEL_LENGTH_PER_MAGNET_Q8) / POSE_Q8_ONE; }
   void ResetHallSensorCounts();
 
+  // ODOMETRY
+  void ResetPose();
+  void UpdatePose();
+  static uint16_t LookupPoseTable(const uint16_t * pTable, int32_t angleQ8);
+  inline static int16_t PoseHeadingToCentidegrees(int32_t headingQ8) { return static_cast<int16_t>((headingQ8 * POSE_CENTIDEGREES_PER_CLICK_Q15) / 32768L); }
+
+  // Compile time generation of the pose tables.  Taylor series are plenty
+  // accurate over the table range (well under 0.5 rad).
+  static constexpr double PoseSin(double x) { return x * (1.0 - ((x * x) / 6.0) * (1.0 - ((x * x) / 20.0) * (1.0 - ((x * x) / 42.0) * (1.0 - ((x * x) / 72.0))))); }
+  static constexpr double PoseVersin(double x) { return ((x * x) / 2.0) * (1.0 - ((x * x) / 12.0) * (1.0 - ((x * x) / 30.0) * (1.0 - ((x * x) / 56.0)))); }
+  static constexpr double PoseTan(double x) { return PoseSin(x) / (1.0 - PoseVersin(x)); }
+  static constexpr uint16_t PoseTableEntry(double value) { return static_cast<uint16_t>((value * 65536.0) + 0.5); }
+
   // LIMIT SWITCHES
-  static void SteeringLimitSwitchInterruptHandler();
-  inline void DisableSteeringSpeedController() { m_pSteeringSpeedController->SetSpeed(OFF); }
+  inline void DisableSteeringSpeedController() { m_pSteeringSpeedController->Stop(); }
   void ReadLimitSwitches();
+  static uint8_t RecordLimitSwitchChanges(uint8_t rawMask, unsigned long changeTimeUs);
+  inline static uint8_t ReadLimitSwitchPins() { return (DigitalPin<STEERING_LEFT_LIMIT_SWITCH_PIN>::Read() ? LEFT_LIMIT_SWITCH_BIT : 0U) | (DigitalPin<STEERING_RIGHT_LIMIT_SWITCH_PIN>::Read() ? RIGHT_LIMIT_SWITCH_BIT : 0U); }
+  inline uint8_t GetSteeringLimitSwitchBit() const { return (m_SteeringDirection == LEFT) ? LEFT_LIMIT_SWITCH_BIT : ((m_SteeringDirection == RIGHT) ? RIGHT_LIMIT_SWITCH_BIT : 0U); }
+  inline static bool IsSteeringLimitReached(int value) { return (((value < 0) ? LEFT_LIMIT_SWITCH_BIT : ((value > 0) ? RIGHT_LIMIT_SWITCH_BIT : 0U)) & (m_LimitSwitchDebouncedMask | m_LimitSwitchTrippedMask)) != 0U; }
 
   // POTENTIOMETERS
+  void ConfigurePotentiometerAdc();
+  static uint16_t CalculateSteeringCalibrationChecksum(const SteeringCalibration & rCalibration);
+  void LoadSteeringCalibration(const NonVolatileCarData & rEepromCarData);
+  void SaveSteeringCalibration();
+  bool ValidateSteeringCalibration();
   void CalibrateSteeringPotentiometer();
+  int DriveSteeringToLimitSwitch(SteeringDirection direction);
+  void DriveSteeringToPotentiometerValue(int targetValue);
+  void WaitForPotentiometerToSettle();
   void ReadPotentiometers();
+  int GetFilteredPotentiometerValue();
 
   // SONAR
+  static void UpdateSonarRanging();
+  static void SetSonarTrigger(uint8_t sensor, bool bHigh);
+  static bool ReadSonarEcho(uint8_t sensor);
   void ReadSonarSensors();
+  bool GetWallDistanceInches(int & rDistanceInches) const;
 
   // TIMER
   static inline unsigned long GetTimeStampMs() { return millis(); }
@@ -238,6 +563,14 @@ private:
   static inline unsigned long CalcDeltaTimeMs(unsigned long startTimeMs) { return (millis() - startTimeMs); }
   static inline unsigned long CalcDeltaTimeUs(unsigned long startTimeUs) { return (micros() - startTimeUs); }
 
+  // SCHEDULER
+  static void ConfigureScheduler();
+  static void StartScheduler();
+  static uint16_t GetSchedulerTick();
+  static void ResetSchedulerStatistics();
+  void RunScheduler();
+  void DisplaySchedulerStatistics();
+
   // DATA LOGGING
   template <typename TypeToRead>
   void GenericReadFromEeprom(TypeToRead & rDataToRead, unsigned offset);
@@ -245,28 +578,71 @@ private:
   void GenericWriteToEeprom(const TypeToWrite & rDataToWrite, unsigned offset);
   template <typename TypeToErase>
   void GenericEraseEeprom(const TypeToErase & rDataToErase, unsigned offset);
+  static uint16_t CalculateNonVolatileChecksum(const void * pData, size_t length, uint16_t seed);
+  void WriteEepromCarDataHeader();
   
   void LogData(unsigned long entryTimeStampMs = GetTimeStampMs());
+  inline void LogCurrentData() { LogData(GetTimeStampMs()); }
   void ClearDataLog(LogLocation logLocation);
-  void DisplayDataLog();
+  void DisplayDataLog(long firstEntry = 0L);
   void DisplayEeprom();
+  void CheckEepromLayoutVersion(const NonVolatileCarData & rEepromCarData);
+  void InitializeDataLogJournal();
+  bool ReadDataLogJournalSlot(uint16_t slot, DataLogCodec::JournalSlotHeader & rHeader, uint8_t * pData = nullptr);
+  bool FindNewestDataLogJournalSlot(uint16_t & rSequence);
+  void UpdateDataLogJournal();
+  bool StartDataLogJournalCommit();
   void RestoreLogFromEeprom();
   void WriteLogToEeprom(bool bFromAuto = false);
+  inline unsigned GetDataLogJournalSlotOffset(uint16_t sequence) { return DATA_LOG_JOURNAL_EEPROM_OFFSET + ((sequence % DATA_LOG_JOURNAL_NUM_SLOTS) * DataLogCodec::JOURNAL_SLOT_SIZE_BYTES); }
   void EraseEeprom();
   void GetEepromCarData(NonVolatileCarData & rCarData);
 
   // SERIAL PORT
   void ConfigureSerialPorts();
   bool IsSerialTransmitSwitchSet();
-  bool IsCarDataRequested();
+  void ProcessSerialCommands(HardwareSerial & rPort, SerialCommandParser & rParser, bool bConsole);
+  void ExecuteSerialCommand(const SerialCommandParser & rParser, bool bConsole);
+  void SetCarDataStreamRate(long rateHz);
   void SendCarSerialData();
+  void TransmitCarDataIfRequested();
   
   // DEBUG ASSIST
   void ConfigureDebugPins();
   void BlinkStatusLight();
-  void DisplayValues(bool bShowImmediately = false);
+  void ToggleStatusLight();
+  void DisplayValues();
+  void LogDebugValues();
   void ReadSerialInput();
-  static void ProcessAssert();
+  static void ProcessAssert(const __FlashStringHelper * pFile, int line);
+
+  // DEBUG LOG
+  static void LogDebugMessage(DebugLogMessages::Id id, const int32_t * pArguments, uint8_t numArguments);
+  static inline void LogDebugMessage(DebugLogMessages::Id id) { LogDebugMessage(id, nullptr, 0U); }
+  static inline void LogDebugMessage(DebugLogMessages::Id id, int32_t arg0) { LogDebugMessage(id, &arg0, 1U); }
+  static inline void LogDebugMessage(DebugLogMessages::Id id, int32_t arg0, int32_t arg1) { const int32_t args[] = {arg0, arg1}; LogDebugMessage(id, args, 2U); }
+  static inline void LogDebugMessage(DebugLogMessages::Id id, int32_t arg0, int32_t arg1, int32_t arg2) { const int32_t args[] = {arg0, arg1, arg2}; LogDebugMessage(id, args, 3U); }
+  static inline void LogDebugMessage(DebugLogMessages::Id id, int32_t arg0, int32_t arg1, int32_t arg2, int32_t arg3) { const int32_t args[] = {arg0, arg1, arg2, arg3}; LogDebugMessage(id, args, 4U); }
+  static void WriteDebugLog(bool bWait);
+  inline void DrainDebugLog() { WriteDebugLog(false); }
+
+  // MEMORY
+  static uint8_t * GetHeapEnd();
+  static void PaintStack();
+  void UpdateMemoryUsage();
+  static void GetMemoryUsage(MemoryUsage & rUsage);
+  void DisplayMemoryUsage();
+  void SendMemoryUsageData();
+
+  // FLIGHT RECORDER
+  static void TriggerFlightRecorder(FlightRecorderEvent event);
+  void UpdateFlightRecorder();
+  void RecordFlightRecorderSample();
+  static void FreezeFlightRecorder();
+  static void SaveFlightRecorderSnapshot();
+  static void SaveFlightRecorderOnAssert();
+  bool ReadFlightRecorderSnapshot(FlightRecorderSnapshotHeader & rHeader);
+  void DisplayFlightRecorder();
   
   
   //////////////////////////////////////////////////////////////////////////////
@@ -280,72 +656,210 @@ private:
   // Channels start at '1', not '0'.  Increase array size by one for easy indexing.
   static const int NUM_CONTROLLER_INPUT_CHANNELS = 6;
   int m_ControllerChannelInputs[NUM_CONTROLLER_INPUT_CHANNELS + 1];
+  uint8_t m_ControllerSignalLostMask;
   bool m_bBrakeSwitch;
   bool m_bMasterEnable;
   
+  // Receiver pulse capture state, written by the pin change ISR.  These are
+  // static so the ISR never has to go through the singleton.
+  static volatile uint16_t      m_ControllerPulseWidthUs[NUM_CONTROLLER_INPUT_CHANNELS + 1];
+  static volatile unsigned long m_ControllerPulseTimeStampUs[NUM_CONTROLLER_INPUT_CHANNELS + 1];
+  static unsigned long          m_ControllerPulseStartUs[NUM_CONTROLLER_INPUT_CHANNELS + 1];
+  
   // SPEED CONTROLLERS
   PwmSpeedController * m_pSteeringSpeedController;
   SteeringDirection m_SteeringDirection;
   int m_CurrentSteeringValue;
 
+  // STEERING CONTROL
+  // Positions are in pot clicks from center, positive to the right.
+  int32_t m_SteeringLateralIntegral;
+  int32_t m_SteeringInnerIntegral;
+  int m_SteeringTargetClicks;
+  int m_SteeringLastPositionClicks;
+  int m_SteeringOutput;
+  uint16_t m_SteeringControlTick;
+  
   // BRAKE CONTROL
   bool m_bBrakeApplied;
   
   // ENCODERS
-  int m_SteeringEncoderValue;
-  int m_SteeringEncoderMultiplier;
+  // The encoder PWM is measured by the Timer 5 input capture interrupt,
+  // see Encoder.ino.  Positions are in encoder units (ENCODER_MAX_VALUE a
+  // turn), unwrapped across turns by the interrupt.
+  int32_t m_SteeringEncoderPosition;
+  bool m_bSteeringEncoderValid;
+  uint16_t m_SteeringEncoderLastSampleCount;
+  unsigned long m_SteeringEncoderSampleTimeStampMs;
+  static volatile int32_t m_SteeringEncoderIsrPosition;
+  static volatile uint16_t m_SteeringEncoderSampleCount;
+  static uint16_t m_SteeringEncoderRiseTicks;
+  static uint16_t m_SteeringEncoderHighTicks;
+  static uint16_t m_SteeringEncoderLastValue;
   
   // HALL EFFECT
-  // Some are volatile because they are used in an interrupt handler.
+  // Some are volatile because they are used in an interrupt handler.  Edge
+  // 'n' of a wheel is time stamped in its ring at n % HALL_EDGE_RING_SIZE.
   volatile unsigned int m_LeftHallCount;
   volatile unsigned int m_RightHallCount;
-  double m_LeftWheelDistanceInches;
-  double m_RightWheelDistanceInches;
+  static WheelMotion m_LeftWheelMotion;
+  static WheelMotion m_RightWheelMotion;
+  static unsigned long m_LeftHallEdgeTimesUs[];
+  static unsigned long m_RightHallEdgeTimesUs[];
+  static volatile uint16_t m_HallRejectedEdgeCount;
+
+  // ODOMETRY
+  Pose m_Pose;
+  static const uint16_t POSE_TAN_TABLE[];
+  static const uint16_t POSE_SIN_TABLE[];
+  static const uint16_t POSE_VERSIN_TABLE[];
   
   // LIMIT SWITCHES
+  // The values are the debounced switch states.  The static state is shared
+  // with the pin change ISR, with a bit per side (LEFT/RIGHT_LIMIT_SWITCH_BIT,
+  // and the side's index in the change times is its bit number).  The ISR
+  // latches a switch that closes in m_LimitSwitchTrippedMask until it is
+  // either confirmed by the debounce or opens again as a glitch.
   int m_LeftSteeringLimitSwitchValue;
   int m_RightSteeringLimitSwitchValue;
+  static volatile uint8_t m_LimitSwitchRawMask;
+  static volatile uint8_t m_LimitSwitchDebouncedMask;
+  static volatile uint8_t m_LimitSwitchTrippedMask;
+  static volatile unsigned long m_LimitSwitchChangeTimesUs[];
+  static volatile uint16_t m_LimitSwitchGlitchCount;
   
   // POTENTIOMETERS
+  // The pot is sampled by the ADC interrupt, see Potentiometer.ino.  The Q2
+  // value is the filtered reading with the two extra bits from oversampling.
   int m_FrontAxlePotentiometerValue;
+  int m_FrontAxlePotentiometerValueQ2;
   int m_FrontAxlePotMaxLeftValue;
   int m_FrontAxlePotMaxRightValue;
   int m_FrontAxlePotCenterValue;
   int m_LastGoodPotValue;
+  static volatile uint16_t m_PotAdcSamples[];
+  static volatile uint16_t m_PotAdcSampleSum;
+  static volatile uint8_t m_PotAdcSampleIndex;
+  static volatile uint8_t m_PotAdcSampleCount;
+  static volatile uint16_t m_PotAdcOversampleSum;
+  static volatile uint8_t m_PotAdcOversampleCount;
   
   // SONAR
-  int m_SonarDistanceInches;
+  // The pings run off the scheduler tick and the echo pin change
+  // interrupt, see Sensors.ino.  The ISRs hand over an echo width per
+  // sensor and ReadSonarSensors() filters it into inches.
+  static volatile uint8_t m_SonarState;
+  static volatile uint8_t m_SonarActiveSensor;
+  static volatile uint8_t m_SonarPingTicks;
+  static volatile unsigned long m_SonarEchoStartUs;
+  static volatile uint16_t m_SonarEchoWidthsUs[];
+  static volatile uint8_t m_SonarNewEchoMask;
+  static uint8_t m_SonarReadingsInches[];
+  static uint8_t m_SonarReadingIndexes[];
+  static uint8_t m_SonarDistancesInches[];
+  static uint8_t m_SonarValidMask;
+  static uint16_t m_SonarNoEchoCount;
+
+  // SCHEDULER
+  // The tick count is only ever read through GetSchedulerTick().
+  static volatile uint16_t m_SchedulerTickCount;
+  static SchedulerTask m_SchedulerTasks[NUM_SCHEDULER_TASKS];
+  static LoopTimingStats m_SteeringLoopTimingStats;
+  static const char SCHEDULER_TASK_NAMES[NUM_SCHEDULER_TASKS][12];
+
+  // FLIGHT RECORDER
+  // A ring of the last FLIGHT_RECORDER_NUM_SAMPLES samples, taken at the
+  // steering control rate (see FlightRecorder.ino).  An event in
+  // FLIGHT_RECORDER_TRIGGER_MASK keeps the ring going for the post-trigger
+  // samples and then freezes it, so it holds the samples from before and
+  // after the event.  The frozen ring is saved to the EEPROM after the data
+  // log journal a byte at a time, then the recorder is armed again.
+  static const uint8_t        FLIGHT_RECORDER_PRE_TRIGGER_SAMPLES   = 24;     // 120ms
+  static const uint8_t        FLIGHT_RECORDER_POST_TRIGGER_SAMPLES  = 8;      // 40ms
+  static const uint8_t        FLIGHT_RECORDER_NUM_SAMPLES           = FLIGHT_RECORDER_PRE_TRIGGER_SAMPLES + FLIGHT_RECORDER_POST_TRIGGER_SAMPLES;
+  static const int            FLIGHT_RECORDER_SNAPSHOT_SIZE_BYTES   = sizeof(FlightRecorderSnapshotHeader) + (FLIGHT_RECORDER_NUM_SAMPLES * sizeof(FlightRecorderSample));
+  static const uint8_t        FLIGHT_RECORDER_TRIGGER_MASK          = (1U << FLIGHT_RECORDER_LIMIT_SWITCH) | (1U << FLIGHT_RECORDER_BRAKE) |
+                                                                      (1U << FLIGHT_RECORDER_EMERGENCY_STOP) | (1U << FLIGHT_RECORDER_ASSERT) |
+                                                                      (1U << FLIGHT_RECORDER_AUTONOMOUS_LAUNCH) | (1U << FLIGHT_RECORDER_AUTONOMOUS_EXIT);
+
+  static FlightRecorderSample m_FlightRecorderSamples[];
+  static volatile uint8_t m_FlightRecorderState;
+  static uint8_t m_FlightRecorderHead;                      // Next sample written
+  static uint8_t m_FlightRecorderNumSamples;
+  static volatile uint8_t m_FlightRecorderPostSamplesLeft;
+  static uint16_t m_FlightRecorderTick;
+  static FlightRecorderSnapshotHeader m_FlightRecorderSnapshotHeader;
+  static uint16_t m_FlightRecorderSavePosition;             // Next byte to write
+  static const char FLIGHT_RECORDER_EVENT_NAMES[NUM_FLIGHT_RECORDER_EVENTS][16];
 
   // DATA LOGGING
-  // 2 entries/sec for two minutes max
+  // 20 entries/sec, compressed (see DataLogCodec.hpp)
   // This is limited by the amount of SRAM the Arduino has (8kB).
   // It is also static so that it doesn't come off the heap and can be
   // used in the global variables post build computation by the IDE.
-  // The size of DataLogEntry is currently sixteen bytes, which gives an
-  // array size of 16 * 240 = 3840 bytes (47% of SRAM).  This size
-  // also needs to fit in EEPROM (4kB), which it currently does, leaving
-  // 256B maximum for any other non-volatile data.  The EEPROM layout is
-  // the non-volatile data in the first 256B, followed by the data log.
+  // Entries average three to four bytes while driving, so the 3kB log
+  // holds the last 40+ seconds (m_DataLogIndex is the byte offset of the
+  // next record).  The EEPROM layout is the non-volatile data in the first
+  // 256B, followed by a journal the log blocks are copied into as they are
+  // written, a byte at a time in the background.  The journal slots are
+  // used in turn, so every cell gets the same wear, and it holds a few more
+  // blocks than the RAM log.  The flight recorder snapshot is at the end of
+  // the EEPROM, after the journal.  Part of a block is committed at most
+  // every DATA_LOG_JOURNAL_COMMIT_INTERVAL_MS, which bounds the data lost in
+  // a power cut and the writes to each slot header.  Block sequence numbers
+  // wrap at DATA_LOG_SEQUENCE_MODULUS, the largest multiple of the slot
+  // count that fits in 16 bits, so the slots stay in turn across the wrap.
   
   static const int            EEPROM_SIZE_BYTES                     = 4 * 1024;
   static const int            MAX_NON_VOLATILE_CAR_DATA_SIZE_BYTES  = 256;
-  static const int            MAX_DATA_LOG_ENTRIES                  = 2 * 60 * 2;
-  static const int            DATA_LOG_EEPROM_OFFSET                = MAX_NON_VOLATILE_CAR_DATA_SIZE_BYTES;
-  static const unsigned long  DATA_LOG_ENTRY_INTERVAL_MS            = 500;
+  static const int            DATA_LOG_NUM_BLOCKS                   = 24;
+  static const int            DATA_LOG_SIZE_BYTES                   = DATA_LOG_NUM_BLOCKS * DataLogCodec::BLOCK_SIZE_BYTES;
+  static const int            DATA_LOG_JOURNAL_EEPROM_OFFSET        = MAX_NON_VOLATILE_CAR_DATA_SIZE_BYTES;
+  static const int            DATA_LOG_JOURNAL_NUM_SLOTS            = (EEPROM_SIZE_BYTES - DATA_LOG_JOURNAL_EEPROM_OFFSET - FLIGHT_RECORDER_SNAPSHOT_SIZE_BYTES) / DataLogCodec::JOURNAL_SLOT_SIZE_BYTES;
+  static const int            FLIGHT_RECORDER_EEPROM_OFFSET         = DATA_LOG_JOURNAL_EEPROM_OFFSET + (DATA_LOG_JOURNAL_NUM_SLOTS * DataLogCodec::JOURNAL_SLOT_SIZE_BYTES);
+  static const uint16_t       DATA_LOG_SEQUENCE_MODULUS             = DATA_LOG_JOURNAL_NUM_SLOTS * (0xFFFFU / DATA_LOG_JOURNAL_NUM_SLOTS);
+  static const unsigned long  DATA_LOG_ENTRY_INTERVAL_MS            = 50;
+  static const unsigned long  DATA_LOG_JOURNAL_COMMIT_INTERVAL_MS   = 500;
+  static const uint16_t       EEPROM_LAYOUT_VERSION                 = 1;      // Bump when the journal or snapshot layout changes
   static const bool           DATA_LOG_OVERFLOW_ALLOWED             = true;
-  static const String         NON_VOLATILE_CAR_DATA_HEADER;
+  static const char           NON_VOLATILE_CAR_DATA_HEADER[];
   
   static NonVolatileCarData m_NonVolatileCarData;
-  static DataLogEntry m_DataLog[MAX_DATA_LOG_ENTRIES];
+  static uint8_t m_DataLog[DATA_LOG_SIZE_BYTES];
+  static DataLogCodec::State m_DataLogEncoderState;
+  static DataLogJournal m_DataLogJournal;
   
   static_assert(sizeof(m_NonVolatileCarData) < MAX_NON_VOLATILE_CAR_DATA_SIZE_BYTES, "Non-volatile car data too large!");
-  static_assert((sizeof(m_DataLog) + sizeof(m_NonVolatileCarData)) < EEPROM_SIZE_BYTES, "Data will not fit in EEPROM!");
+  static_assert(offsetof(NonVolatileCarData, m_EepromLayoutVersion) == 34, "EEPROM layout version moved, update the host log decoder!");
+  static_assert(DATA_LOG_JOURNAL_NUM_SLOTS >= DATA_LOG_NUM_BLOCKS, "Data log will not fit in the EEPROM journal!");
+  static_assert((FLIGHT_RECORDER_EEPROM_OFFSET + FLIGHT_RECORDER_SNAPSHOT_SIZE_BYTES) <= EEPROM_SIZE_BYTES, "Flight recorder snapshot will not fit in EEPROM!");
 
   // SERIAL PORTS
-  static const int SERIAL_PORT_TIMEOUT_MS = 1;
-  static const bool SERIAL_PORT_USE_RAW_DATA = false;
-  static const String SERIAL_PORT_DATA_REQUEST_STRING;
+  static const SerialCommand SERIAL_COMMANDS[NUM_SERIAL_COMMANDS];
+  static SerialCommandParser m_ConsoleCommandParser;
+  static SerialCommandParser m_CarDataCommandParser;
+  static uint8_t m_CarDataSequence;
+  static uint16_t m_CarDataStreamPeriodMs;
+  static uint16_t m_CarDataStreamTick;
+  static unsigned long m_CarDataDroppedFrameCount;
   HardwareSerial * m_pDataTransmitSerialPort;
+
+  // DEBUG LOG
+  // Messages waiting to go out the console, each a length byte and the
+  // frame payload.  Only the main context adds to it, and only
+  // WriteDebugLog() removes from it.  The byte indexes wrap with the ring.
+  static uint8_t m_DebugLogRing[];
+  static volatile uint8_t m_DebugLogHead;
+  static volatile uint8_t m_DebugLogTail;
+  static uint16_t m_DebugLogDroppedCount;
+  static uint8_t m_DebugLogSequence;
+
+  // MEMORY
+  // The lowest stack byte found written over, where the scan for a lower
+  // one is up to and the highest top of the heap seen
+  static uint8_t * m_pStackLowWater;
+  static uint8_t * m_pStackScanPointer;
+  static uint8_t * m_pHeapHighWater;
   
   // MISC
   bool m_bCalibrationComplete;
@@ -365,12 +879,16 @@ private:
   // AUTONOMOUS
   static const int            AUTO_CENTERING_CALIBRATION_LEFT_SPEED   = -50;
   static const int            AUTO_CENTERING_CALIBRATION_RIGHT_SPEED  =  50;
-  static const int            AUTO_CENTERING_CALIBRATION_CENTER_SPEED = -50;
-  static const int            AUTO_CENTERING_CALIBRATION_DELAY_MS     =  2000;
+  static const unsigned long  AUTO_CENTERING_SETTLE_TIMEOUT_MS        =  2000;
+  static const unsigned long  AUTO_CENTERING_SETTLE_INTERVAL_MS       =  20;
+  static const uint8_t        AUTO_CENTERING_SETTLE_NUM_SAMPLES       =  3;
+  static const int            AUTO_CENTERING_SETTLE_MAX_CHANGE_Q2     =  2;       // Half a click
+  static const int            AUTO_CENTERING_VALIDATION_TOLERANCE     =  4;       // Clicks
+  static const int            AUTO_CENTERING_MIN_RANGE_CLICKS         =  20;
+  static const uint16_t       STEERING_CALIBRATION_CHECKSUM_SEED      =  0xC3A5;
   static const int            AUTO_TURN_LEFT_SPEED                    = -80;
   static const int            AUTO_TURN_RIGHT_SPEED                   =  80;
   static const int            AUTO_HALL_SENSOR_LAUNCH_COUNT           =  3;
-  static const int            AUTO_HALL_SENSOR_COUNT_MAX_DIFF         =  2;
   static const unsigned long  AUTO_MAX_LENGTH_MS                      =  300000;  // Five minutes
   
   // On the Mega, digital pins 2, 3, and 18-21 are interrupts.
@@ -379,12 +897,12 @@ private:
   // DIGITAL PINS
   static const unsigned int   SERIAL_RX_RESERVED                      = 0;
   static const unsigned int   SERIAL_TX_RESERVED                      = 1;
-  static const unsigned int   CH1_INPUT_PIN                           = 2;    // Derby car yaw control
-  static const unsigned int   CH2_INPUT_PIN                           = 3;
-  static const unsigned int   CH3_INPUT_PIN                           = 4;
-  static const unsigned int   CH4_INPUT_PIN                           = 5;    // Recalibrate derby car
-  static const unsigned int   CH5_INPUT_PIN                           = 6;    // Derby car brake control
-  static const unsigned int   CH6_INPUT_PIN                           = 7;    // Master enable (disable all input control)
+  static const unsigned int   PIN_2_INTERRUPT_RESERVED                = 2;    // Old CH1 wiring
+  static const unsigned int   PIN_3_INTERRUPT_RESERVED                = 3;    // Old CH2 wiring
+  static const unsigned int   PIN_4_RESERVED                          = 4;    // Old CH3 wiring
+  static const unsigned int   PIN_5_RESERVED                          = 5;    // Old CH4 wiring
+  static const unsigned int   PIN_6_RESERVED                          = 6;    // Old CH5 wiring
+  static const unsigned int   PIN_7_RESERVED                          = 7;    // Old CH6 wiring
   static const unsigned int   STEERING_SPEED_CONTROLLER_PIN           = 8;
   static const unsigned int   BRAKE_MAGNET_RELAY_PIN                  = 9;
   static const unsigned int   STEERING_LEFT_LIMIT_SWITCH_PIN          = 10;
@@ -397,7 +915,7 @@ private:
   static const unsigned int   SERIAL_2_RX_RESERVED                    = 17;
   static const unsigned int   LEFT_HALL_SENSOR_PIN                    = 18;   // Must be a board interrupt pin
   static const unsigned int   RIGHT_HALL_SENSOR_PIN                   = 19;   // Must be a board interrupt pin
-  static const unsigned int   STEERING_LIMIT_SWITCHES_INTERRUPT_PIN   = 20;   // Must be a board interrupt pin
+  static const unsigned int   PIN_20_INTERRUPT_RESERVED               = 20;   // Old limit switch wiring, left an input
   static const unsigned int   PIN_21_INTERRUPT_RESERVED               = 21;   // Must be a board interrupt pin
   static const unsigned int   PIN_22_RESERVED                         = 22;
   static const unsigned int   PIN_23_RESERVED                         = 23;
@@ -426,12 +944,35 @@ private:
   static const unsigned int   SERIAL_TRANSMIT_SWITCH_PIN              = 45;
   static const unsigned int   SWITCH_3_RESERVED                       = 46;
   static const unsigned int   SWITCH_4_RESERVED                       = 47;
-  static const unsigned int   PIN_48_RESERVED                         = 48;
-  static const unsigned int   PIN_49_RESERVED                         = 49;
+  static const unsigned int   STEERING_ENCODER_PIN                    = 48;   // Must be ICP5 (Timer 5 input capture)
+  static const unsigned int   PIN_49_RESERVED                         = 49;   // Old encoder wiring (ICP4, Timer 4 drives pin 8 now)
   static const unsigned int   PIN_50_RESERVED                         = 50;
-  static const unsigned int   STEERING_ENCODER_PIN                    = 51;
+  static const unsigned int   PIN_51_RESERVED                         = 51;
   static const unsigned int   SONAR_TRIGGER_PIN                       = 52;
   static const unsigned int   SONAR_ECHO_PIN                          = 53;
+  
+  // The receiver channels are on port K (A8-A13) because it is the only
+  // port with six consecutive pin change interrupts broken out on the Mega.
+  // Bit 'n' of PINK is channel 'n + 1'.
+  static const unsigned int   CH1_INPUT_PIN                           = 62;   // A8/PCINT16, derby car yaw control
+  static const unsigned int   CH2_INPUT_PIN                           = 63;   // A9/PCINT17
+  static const unsigned int   CH3_INPUT_PIN                           = 64;   // A10/PCINT18
+  static const unsigned int   CH4_INPUT_PIN                           = 65;   // A11/PCINT19, recalibrate derby car
+  static const unsigned int   CH5_INPUT_PIN                           = 66;   // A12/PCINT20, derby car brake control
+  static const unsigned int   CH6_INPUT_PIN                           = 67;   // A13/PCINT21, master enable (disable all input control)
+
+  // Wiring that depends on what the pin is on the chip
+  static_assert(digitalPinToInterrupt(LEFT_HALL_SENSOR_PIN) != NOT_AN_INTERRUPT, "Left Hall sensor must be on an interrupt pin!");
+  static_assert(digitalPinToInterrupt(RIGHT_HALL_SENSOR_PIN) != NOT_AN_INTERRUPT, "Right Hall sensor must be on an interrupt pin!");
+  static_assert((MegaPinMap::GetPort(STEERING_LEFT_LIMIT_SWITCH_PIN) == MegaPinMap::PORT_B) && (MegaPinMap::GetPort(STEERING_RIGHT_LIMIT_SWITCH_PIN) == MegaPinMap::PORT_B),
+                "Limit switches must be on port B (PCINT0-7)!");
+  static_assert(MegaPinMap::GetPort(SONAR_ECHO_PIN) == MegaPinMap::PORT_B, "Sonar echoes must be on port B (PCINT0-7)!");
+  static_assert(MegaPinMap::IsPortBit(STEERING_ENCODER_PIN, MegaPinMap::PORT_L, 1), "Steering encoder must be on ICP5 (PL1)!");
+  static_assert(STEERING_SPEED_CONTROLLER_PIN == PwmSpeedController::OUTPUT_PIN, "Steering speed controller must be on OC4C (pin 8)!");
+  static_assert(MegaPinMap::IsPortBit(CH1_INPUT_PIN, MegaPinMap::PORT_K, 0) && MegaPinMap::IsPortBit(CH2_INPUT_PIN, MegaPinMap::PORT_K, 1) &&
+                MegaPinMap::IsPortBit(CH3_INPUT_PIN, MegaPinMap::PORT_K, 2) && MegaPinMap::IsPortBit(CH4_INPUT_PIN, MegaPinMap::PORT_K, 3) &&
+                MegaPinMap::IsPortBit(CH5_INPUT_PIN, MegaPinMap::PORT_K, 4) && MegaPinMap::IsPortBit(CH6_INPUT_PIN, MegaPinMap::PORT_K, 5),
+                "Controller channel 'n' must be on PK(n - 1)!");
 
   static const unsigned int   DEBUG_OUTPUT_LEDS_START_PIN             = LEFT_HALL_SENSOR_LED_PIN;
   static const unsigned int   DEBUG_OUTPUT_LEDS_END_PIN               = AUTONOMOUS_EXECUTING_LED_PIN;
@@ -444,16 +985,54 @@ private:
   static const int            MIN_OUTPUT_PERCENTAGE                   =  10;
   static const int            RELEASE_BRAKE_PERCENTAGE                =  25;
   static const int            APPLY_BRAKE_PERCENTAGE                  = -40;
+  static const unsigned int   STEERING_SPEED_CONTROLLER_FRAME_RATE_HZ = 200;    // Talon SR takes up to ~333Hz, one frame per steering control tick
+
+  // The ramp rate matches the autonomous output's own slew limit (10% per
+  // 5ms tick).  Any slower and the ramp lags the inner steering loop enough
+  // to upset its tuning.
+  static const unsigned int   STEERING_RAMP_RATE_PERCENT_PER_SEC      = 2000;   // 0 -> 100% in 50ms, zero for no ramp
+  static const unsigned long  STEERING_RAMP_ACCEL_PERCENT_PER_SEC2    = 200000; // Full rate in 10ms, zero for a trapezoidal ramp
   
   // I/O
   static const int            YAW_INPUT_CHANNEL                       = 1;
   static const int            RECALIBRATE_INPUT_CHANNEL               = 4;
   static const int            BRAKE_INPUT_CHANNEL                     = 5;
   static const int            MASTER_ENABLE_INPUT_CHANNEL             = 6;
+  static const uint8_t        CONTROLLER_INPUT_PORT_MASK              = 0x3F;   // PCINT16-21
+  static const uint8_t        CONTROLLER_REQUIRED_CHANNELS_MASK       = (1U << YAW_INPUT_CHANNEL) | (1U << RECALIBRATE_INPUT_CHANNEL) | (1U << BRAKE_INPUT_CHANNEL) | (1U << MASTER_ENABLE_INPUT_CHANNEL);
+  static const unsigned int   CONTROLLER_MIN_VALID_PULSE_US           = 800;
+  static const unsigned int   CONTROLLER_MAX_VALID_PULSE_US           = 2200;
+  static const unsigned long  CONTROLLER_SIGNAL_LOST_TIMEOUT_US       = 100000;
   static const int            NUM_MAGNETS_PER_WHEEL                   = 12;
+  static const uint8_t        HALL_EDGE_RING_SIZE                     = 4;      // Power of 2
+  static const unsigned long  HALL_MIN_EDGE_INTERVAL_US               = 2000;   // ~130 ft/s, anything closer is a glitch
+  static const unsigned long  HALL_WHEEL_STOPPED_TIMEOUT_US           = 1000000;
+  static const uint8_t        LEFT_LIMIT_SWITCH_BIT                   = 0x01;
+  static const uint8_t        RIGHT_LIMIT_SWITCH_BIT                  = 0x02;
+  static const uint8_t        LIMIT_SWITCH_PCMSK0_MASK                = _BV(MegaPinMap::GetBit(STEERING_LEFT_LIMIT_SWITCH_PIN)) | _BV(MegaPinMap::GetBit(STEERING_RIGHT_LIMIT_SWITCH_PIN));
+  static const unsigned long  LIMIT_SWITCH_DEBOUNCE_US                = 5000;   // Closed or open this long to count
+  static const uint8_t        NUM_SONAR_SENSORS                       = 1;      // Fired in turn, see SetSonarTrigger()
+  static const uint8_t        SONAR_ECHO_PCMSK0_MASK                  = _BV(MegaPinMap::GetBit(SONAR_ECHO_PIN));
+  static const uint8_t        SONAR_TRIGGER_END_TIMER_COUNT           = 4;      // OCR2B, ends the pulse 20us into the tick
+  static const uint8_t        SONAR_PING_PERIOD_TICKS                 = 50;     // Per sensor, long enough for the last echo to die out
+  static const uint16_t       SONAR_MAX_ECHO_US                       = 30000;  // Longer is no echo (the HC-SR04 gives 38ms)
+  static const uint16_t       SONAR_ECHO_US_PER_INCH                  = 148;    // Out and back at 74us/inch
+  static const uint8_t        SONAR_NO_ECHO_INCHES                    = 255;
+  static const uint8_t        SONAR_MEDIAN_SIZE                       = 3;      // Most recent pings per sensor, odd
   static const int            POTENTIOMETER_MAX_JITTER_VALUE          = 5;
   static const int            POTENTIOMETER_MAX_VALUE                 = 1024;
+  static const uint8_t        POT_ADC_PRESCALER_BITS                  = _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);  // 16 MHz / 128, ~9.6 kHz sampling
+  static const uint8_t        POT_ADC_OVERSAMPLE_COUNT                = 16;     // 4^2 samples for 2 extra bits
+  static const uint8_t        POT_ADC_DECIMATION_SHIFT                = 2;
+  static const uint8_t        POT_FILTER_SIZE                         = 8;      // Decimated samples, power of 2
+  static const uint8_t        POT_MEDIAN_SIZE                         = 5;      // Most recent samples, odd
+  static const PotentiometerFilterType POT_FILTER_TYPE                = POT_FILTER_MOVING_AVERAGE;
   static const int            ENCODER_MAX_VALUE                       = 4096;
+  static const uint8_t        ENCODER_TIMER_PRESCALER_BITS            = _BV(CS51);  // 16 MHz / 8, 0.5us ticks
+  static const uint16_t       ENCODER_MIN_PERIOD_TICKS                = 6400;       // PWM is ~4.1ms (244Hz)
+  static const uint16_t       ENCODER_MAX_PERIOD_TICKS                = 12000;
+  static const unsigned long  ENCODER_SIGNAL_LOST_TIMEOUT_MS          = 25;
+  static const uint8_t        ENCODER_CALIBRATION_NUM_STEPS           = 128;
 
   // PHYSICAL CAR CONSTANTS
   static constexpr double     WHEEL_AXLE_LEGNTH_INCHES                = 32.0;
@@ -467,29 +1046,85 @@ private:
   static const int            ON                                      = 100;
   static const unsigned int   TENTH_OF_A_SECOND_DELAY_MS              = 100;
   static const unsigned long  STATUS_LED_BLINK_DELAY_MS               = 500;
-  static const unsigned long  SERIAL_DATA_TRANSMIT_INTERVAL_MS        = 1000;
-  static const unsigned long  PULSE_IN_TIMEOUT_US                     = 50000;
   static constexpr double     INCHES_PER_FOOT                         = 12.0;
   static constexpr double     DEGREES_TO_RADIANS                      = 2.0 * M_PI / 360.0;
+
+  // ODOMETRY
+  // One pot click of axle angle (250 degree, 10-bit pot; see ReadPotentiometers())
+  static constexpr double     AXLE_DEGREES_PER_POT_CLICK              = 250.0 / 1024.0;
+  static constexpr double     AXLE_RADIANS_PER_POT_CLICK              = AXLE_DEGREES_PER_POT_CLICK * DEGREES_TO_RADIANS;
+  static const int32_t        POSE_Q8_ONE                             = 256;
+  static const int32_t        POSE_Q16_ONE                            = 65536L;
+  static const int            POSE_TABLE_SIZE                         = 65;       // 0 - 64 clicks (15.6 degrees)
+  static const int32_t        WHEEL_LENGTH_PER_MAGNET_Q8              = static_cast<int32_t>((WHEEL_LENGTH_PER_MAGNET_INCHES * POSE_Q8_ONE) + 0.5);
+  static const int32_t        POSE_HEADING_PER_HALL_COUNT_Q8          = static_cast<int32_t>(((WHEEL_LENGTH_PER_MAGNET_INCHES / (WHEEL_AXLE_LEGNTH_INCHES * AXLE_RADIANS_PER_POT_CLICK)) * POSE_Q8_ONE) + 0.5);
+  static const int32_t        POSE_STEERING_HEADING_DIVISOR           = static_cast<int32_t>((WHEEL_BASE_LENGTH_INCHES * AXLE_RADIANS_PER_POT_CLICK * POSE_Q16_ONE) + 0.5);
+  static const int32_t        POSE_CENTIDEGREES_PER_CLICK_Q15         = static_cast<int32_t>(((AXLE_DEGREES_PER_POT_CLICK * 100.0 / POSE_Q8_ONE) * 32768.0) + 0.5);
+  static const int32_t        POSE_HEADING_CORRECTION_Q8              = 4;        // Per Hall count travelled
+  static const int32_t        POSE_AXLE_BIAS_CORRECTION_Q8            = 78;       // Per Hall count travelled
   
+  // STEERING CONTROL
+  static const int16_t        DEFAULT_STEERING_HEADING_KP             =  512;     // 2.0
+  static const int16_t        DEFAULT_STEERING_LATERAL_KP             =  84;      // 0.33
+  static const int16_t        DEFAULT_STEERING_LATERAL_KI             =  1;       // 0.004
+  static const int16_t        DEFAULT_STEERING_INNER_KP               =  2560;    // 10.0
+  static const int16_t        DEFAULT_STEERING_INNER_KI               =  13;      // 0.05
+  static const int16_t        DEFAULT_STEERING_INNER_KD               =  256;     // 1.0
+  static const int            STEERING_Q8_ONE                         =  256;
+  static const int            STEERING_TARGET_MARGIN_CLICKS           =  3;
+  static const int            STEERING_POSITION_TOLERANCE_CLICKS      =  1;
+  static const int            STEERING_MAX_OUTPUT_CHANGE_PERCENT      =  10;
+  static const uint16_t       STEERING_GAINS_VERSION                  =  1;       // Bump when the defaults or the ramp are retuned
+  static const uint16_t       STEERING_GAINS_CHECKSUM_SEED            =  0x5A5A ^ STEERING_GAINS_VERSION;
+
+  // SCHEDULER
+  // Timer 2 in CTC mode with a /64 prescaler gives a 250kHz count, so a
+  // compare value of 249 ticks the scheduler once per millisecond.
+  static const uint8_t        SCHEDULER_TIMER_COMPARE_VALUE           = 249;
+  static const uint16_t       CONTROLLER_TASK_PERIOD_MS               = 10;
+  static const uint16_t       SENSORS_TASK_PERIOD_MS                  = 5;
+  static const uint16_t       STEERING_CONTROL_TASK_PERIOD_MS         = 5;
+  static const uint16_t       CAR_DATA_TRANSMIT_TASK_PERIOD_MS        = 10;
+  static const uint16_t       SERIAL_COMMAND_TASK_PERIOD_MS           = 20;
+  static const uint16_t       DATA_LOG_JOURNAL_TASK_PERIOD_MS         = 1;
+  static const uint16_t       DEBUG_LOG_TASK_PERIOD_MS                = 1;
+  static const uint16_t       MEMORY_TASK_PERIOD_MS                   = 10;
+  static const uint16_t       FLIGHT_RECORDER_TASK_PERIOD_MS          = 1;
+
+  // SERIAL PORTS
+  static const int            CAR_DATA_MAX_STREAM_RATE_HZ             = 100;
+
   // DEBUG ASSIST
-  static const char           COMMAND_DISPLAY_DEBUG_PRINTS            = 'p';
-  static const char           COMMAND_DISPLAY_DATA_LOG                = 'l';
-  static const char           COMMAND_CLEAR_DATA_LOG                  = 'c';
-  static const char           COMMAND_SEND_SERIAL_DATA                = 's';
-  static const char           COMMAND_DISPLAY_EEPROM                  = 'd';
-  static const char           COMMAND_ERASE_EEPROM                    = 'e';
-  static const char           COMMAND_RESTORE_FROM_EEPROM             = 'r';
-  static const char           COMMAND_WRITE_TO_EEPROM                 = 'w';
-  static const char           COMMAND_NEW_LINE                        = '\n';
-  static const char           COMMAND_CARRIAGE_RETURN                 = '\r';
   static const bool           DEBUG_PRINTS                            = false;
   static const bool           DEBUG_COMMANDS                          = true;
   static const unsigned long  DEBUG_PRINT_INTERVAL_MS                 = 3000;
+  static const int            DEBUG_LOG_RING_SIZE_BYTES               = 256;
+
+  // MEMORY
+  // With STATIC_ALLOCATION the car and its speed controller are static data
+  // instead of coming off the heap, so the build accounts for them.
+  static const bool           STATIC_ALLOCATION                       = true;
+  static const uint8_t        STACK_PAINT_VALUE                       = 0xC5;
+  static const uint8_t        MEMORY_SCAN_CHUNK_BYTES                 = 64;
+
+  // FLIGHT RECORDER
+  static const uint16_t       FLIGHT_RECORDER_SAMPLE_PERIOD_MS        = STEERING_CONTROL_TASK_PERIOD_MS;
+  static const uint8_t        FLIGHT_RECORDER_BRAKE_SWITCH_FLAG       = 0x01;
+  static const uint8_t        FLIGHT_RECORDER_MASTER_ENABLE_FLAG      = 0x02;
+  static const uint8_t        FLIGHT_RECORDER_BRAKE_APPLIED_FLAG      = 0x04;
+  static const uint8_t        FLIGHT_RECORDER_LEFT_LIMIT_FLAG         = 0x08;
+  static const uint8_t        FLIGHT_RECORDER_RIGHT_LIMIT_FLAG        = 0x10;
+  static const uint8_t        FLIGHT_RECORDER_AUTONOMOUS_FLAG         = 0x20;
+  static const uint8_t        FLIGHT_RECORDER_CONTROLLER_LOST_FLAG    = 0x40;
+
+  static_assert(DEBUG_LOG_RING_SIZE_BYTES == 256, "Debug log ring size must match its byte indexes!");
+  static_assert(sizeof(FlightRecorderSnapshotHeader) == 12, "Flight recorder snapshot header must be the same on the car and the host!");
+  static_assert(((HALL_EDGE_RING_SIZE & (HALL_EDGE_RING_SIZE - 1)) == 0) && (HALL_EDGE_RING_SIZE >= 3), "Hall edge ring must be a power of 2 holding 3 edges!");
 };
 
-// The car object comes off the heap (not included in memory usage analysis).
-// Make sure the size is reasonable to prevent strange runtime issues.
+// The car object comes off the heap unless STATIC_ALLOCATION is set (then it
+// is static data and in the build's memory usage).  Make sure the size is
+// reasonable to prevent strange runtime issues.
 static_assert(sizeof(SoapBoxDerbyCar) < 256, "Instance size greater than 256B, review memory use!");
 
 #endif // SOAPBOXDERBYCAR_HPP
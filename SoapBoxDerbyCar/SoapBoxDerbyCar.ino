@@ -12,11 +12,12 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-SoapBoxDerbyCar *                   SoapBoxDerbyCar::m_pSoapBoxDerbyCar               = nullptr;
-SoapBoxDerbyCar::NonVolatileCarData SoapBoxDerbyCar::m_NonVolatileCarData             = {0, 0, false, false, 0};
-SoapBoxDerbyCar::DataLogEntry       SoapBoxDerbyCar::m_DataLog[MAX_DATA_LOG_ENTRIES]  = {};
-const String                        SoapBoxDerbyCar::SERIAL_PORT_DATA_REQUEST_STRING  = "pi";
-const String                        SoapBoxDerbyCar::NON_VOLATILE_CAR_DATA_HEADER     = "SBDC";
+SoapBoxDerbyCar *                   SoapBoxDerbyCar::m_pSoapBoxDerbyCar              = nullptr;
+SoapBoxDerbyCar::NonVolatileCarData SoapBoxDerbyCar::m_NonVolatileCarData            = {0, 0, false, false, 0, {}, 0, {}, 0};
+uint8_t                             SoapBoxDerbyCar::m_DataLog[DATA_LOG_SIZE_BYTES]  = {};
+DataLogCodec::State                 SoapBoxDerbyCar::m_DataLogEncoderState           = {};
+SoapBoxDerbyCar::DataLogJournal     SoapBoxDerbyCar::m_DataLogJournal                = {};
+const char                          SoapBoxDerbyCar::NON_VOLATILE_CAR_DATA_HEADER[]  = "SBDC";
 
 // GLOBALS
 // (none)
@@ -65,46 +66,61 @@ void loop()
 SoapBoxDerbyCar::SoapBoxDerbyCar() :
   m_bIsAutonomousExecuting(false),
   m_ControllerChannelInputs(),
+  m_ControllerSignalLostMask(0xFFU),
   m_bBrakeSwitch(false),
   m_bMasterEnable(false),
-  m_pSteeringSpeedController(new PwmSpeedController(STEERING_SPEED_CONTROLLER_PIN)),
+  m_pSteeringSpeedController(CreateSteeringSpeedController()),
   m_SteeringDirection(NONE),
   m_CurrentSteeringValue(0),
+  m_SteeringLateralIntegral(0),
+  m_SteeringInnerIntegral(0),
+  m_SteeringTargetClicks(0),
+  m_SteeringLastPositionClicks(0),
+  m_SteeringOutput(OFF),
+  m_SteeringControlTick(0U),
   m_bBrakeApplied(false),
-  m_SteeringEncoderValue(0),
-  m_SteeringEncoderMultiplier(0),
+  m_SteeringEncoderPosition(0),
+  m_bSteeringEncoderValid(false),
+  m_SteeringEncoderLastSampleCount(0U),
+  m_SteeringEncoderSampleTimeStampMs(0UL),
   m_LeftHallCount(0),
   m_RightHallCount(0),
-  m_LeftWheelDistanceInches(0.0),
-  m_RightWheelDistanceInches(0.0),
+  m_Pose(),
   m_LeftSteeringLimitSwitchValue(0),
   m_RightSteeringLimitSwitchValue(0),
   m_FrontAxlePotentiometerValue(0),
+  m_FrontAxlePotentiometerValueQ2(0),
   m_FrontAxlePotMaxLeftValue(0),
   m_FrontAxlePotMaxRightValue(0),
   m_FrontAxlePotCenterValue(0),
   m_LastGoodPotValue(0),
-  m_SonarDistanceInches(0),
   m_pDataTransmitSerialPort(&Serial3),
   m_bCalibrationComplete(false),
   m_bStatusLedState(false),
   m_StatusLedTimeStampMs(0UL)
 {
   // Give a visual indication that initialization is in progress
-  digitalWrite(INITIALIZING_LED_PIN, HIGH);
+  DigitalPin<INITIALIZING_LED_PIN>::SetHigh();
   
   // Initialize the RAM copy of the non-volatile car data
   NonVolatileCarData eepromCarData;
   GetEepromCarData(eepromCarData);
 
-  memcpy(&m_NonVolatileCarData.m_Header, &NON_VOLATILE_CAR_DATA_HEADER, sizeof(m_NonVolatileCarData.m_Header));
+  memcpy(&m_NonVolatileCarData.m_Header, NON_VOLATILE_CAR_DATA_HEADER, sizeof(m_NonVolatileCarData.m_Header));
   m_NonVolatileCarData.m_Incarnation = eepromCarData.m_Incarnation + 1;
   
-  // Clear out the data log
+  // Clear out the data log and pick up the journal where it left off, unless
+  // it was written with a different layout
   ClearDataLog(RAM_LOG);
+  CheckEepromLayoutVersion(eepromCarData);
+  InitializeDataLogJournal();
   
   // Configure serial ports (including default print console)
   ConfigureSerialPorts();
+
+  // Steering gains and calibration live in the non-volatile car data
+  LoadSteeringGains(eepromCarData);
+  LoadSteeringCalibration(eepromCarData);
   
   // Configure pin modes
   ConfigureController();
@@ -114,11 +130,19 @@ SoapBoxDerbyCar::SoapBoxDerbyCar() :
   // Arm the brake
   ArmBrake();
 
-  // Center the steering
-  CalibrateSteeringPotentiometer();
-  
+  // Center the steering.  A saved calibration only has to be checked
+  // against a limit switch, the full one runs if that fails.
+  if (!ValidateSteeringCalibration())
+  {
+    CalibrateSteeringPotentiometer();
+  }
+
+  // Start the manual control loop tick
+  ResetSchedulerStatistics();
+  ConfigureScheduler();
+
   // Give a visual indication that initialization is complete
-  digitalWrite(INITIALIZING_LED_PIN, LOW);
+  DigitalPin<INITIALIZING_LED_PIN>::SetLow();
 }
 
 
@@ -133,7 +157,7 @@ void SoapBoxDerbyCar::Run()
   if (IsAutonomousSwitchSet())
   {
     // In case the manual control LED was on
-    digitalWrite(MANUAL_CONTROL_LED_PIN, LOW);
+    DigitalPin<MANUAL_CONTROL_LED_PIN>::SetLow();
       
     Serial.println(F("Auto waiting..."));
 
@@ -178,69 +202,43 @@ void SoapBoxDerbyCar::Run()
     {
       Serial.println(F("Auto cancelled..."));
     }
+
+    // The manual control tasks were not running while in autonomous,
+    // so restart their schedule from now.
+    StartScheduler();
   }
   else
   {
-    // Update the status light
-    BlinkStatusLight();
-    
-    // Get the latest input values
-    ReadControllerInput();
-    
-    // Read the Hall sensors
-    // Note: Currently interrupt driven
-    //ReadHallSensors();
-  
-    // Read the limit switches
-    ReadLimitSwitches();
+    // Manual control runs as a set of fixed rate tasks (see Scheduler.ino)
+    RunScheduler();
+  }
+}
 
-    // Read the potentiometers
-    ReadPotentiometers();
-  
-    // Read the sonar sensors
-    //ReadSonarSensors();
-  
-    // Read the encoders
-    //ReadEncoders();
-  
-    // Make sure the controller is sending data and check the enable switch
-    if (IsControllerOn() && m_bMasterEnable)
-    {
-      // Visual indication of state
-      digitalWrite(MANUAL_CONTROL_LED_PIN, HIGH);
-      
-      // Update with the user control for steering
-      UpdateSpeedControllers();
 
-      // Update the state of the brake based on user input
-      UpdateBrakeControl();
-    }
-    else
-    {
-      // Visual indication of state
-      digitalWrite(MANUAL_CONTROL_LED_PIN, LOW);
-    }
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateManualControl
+///
+/// Details:  Steering control task for manual mode.  Applies the user input to
+///           the steering and brake while the controller is on and enabled.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateManualControl()
+{
+  // Make sure the controller is sending data and check the enable switch
+  if (IsControllerOn() && m_bMasterEnable)
+  {
+    // Visual indication of state
+    DigitalPin<MANUAL_CONTROL_LED_PIN>::SetHigh();
 
-    // Log a data entry
-    LogData();
-  
-    // Check if serial data should be sent and transmit it if appropriate
-    if (IsCarDataRequested())// || IsSerialTransmitSwitchSet())
-    {
-      SendCarSerialData();
-    }
-  
-    // Display values to the serial console, if enabled
-    if (DEBUG_PRINTS)
-    {
-      DisplayValues();
-    }
+    // Update with the user control for steering
+    UpdateSpeedControllers();
 
-    // Get debug commands from the serial console, if enabled
-    if (DEBUG_COMMANDS)
-    {
-      ReadSerialInput();
-    }
+    // Update the state of the brake based on user input
+    UpdateBrakeControl();
+  }
+  else
+  {
+    // Visual indication of state
+    DigitalPin<MANUAL_CONTROL_LED_PIN>::SetLow();
   }
 }
 
@@ -254,9 +252,12 @@ void SoapBoxDerbyCar::Run()
 ////////////////////////////////////////////////////////////////////////////////
 void SoapBoxDerbyCar::EmergencyStop(SoapBoxDerbyCar * pInstance)
 {
+  // Ahead of the brake, so the snapshot is for the emergency stop
+  TriggerFlightRecorder(FLIGHT_RECORDER_EMERGENCY_STOP);
+
   // Emergency stop will ignore steering and unconditionally apply the brake
   pInstance->m_SteeringDirection = NONE;
-  pInstance->m_pSteeringSpeedController->SetSpeed(OFF);
+  pInstance->m_pSteeringSpeedController->Stop();
   
   pInstance->ApplyBrake();
 }
@@ -3,7 +3,10 @@
 /// Author:   David Stalter
 ///
 /// Details:  Contains the main logic for updating speed controllers present
-///           on a soap box derby car.
+///           on a soap box derby car.  The steering speed controller is
+///           driven by Timer 4 and ramps to each new speed in the timer's
+///           overflow interrupt (see PwmSpeedController.hpp).  Reaching
+///           a limit switch still stops it right away.
 ///
 /// Copyright (c) 2019 David Stalter
 ////////////////////////////////////////////////////////////////////////////////
@@ -12,12 +15,43 @@
 #include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
 
 // STATIC DATA
-// (none)
+PwmSpeedController * PwmSpeedController::m_pInstance = nullptr;
 
 // GLOBALS
 // (none)
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ISR(TIMER4_OVF_vect)
+///
+/// Details:  Timer 4 overflow vector (steering speed controller frame).
+////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER4_OVF_vect)
+{
+  PwmSpeedController::FrameInterruptHandler();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CreateSteeringSpeedController
+///
+/// Details:  Creates the steering speed controller, in static storage with
+///           STATIC_ALLOCATION or off the heap without it.  Static storage
+///           is constructed in place, since a static object would need a
+///           destructor registered for an exit that never comes.
+////////////////////////////////////////////////////////////////////////////////
+PwmSpeedController * SoapBoxDerbyCar::CreateSteeringSpeedController()
+{
+  if (STATIC_ALLOCATION)
+  {
+    alignas(PwmSpeedController) static uint8_t steeringSpeedControllerStorage[sizeof(PwmSpeedController)];
+    return new (steeringSpeedControllerStorage) PwmSpeedController(STEERING_SPEED_CONTROLLER_FRAME_RATE_HZ, STEERING_RAMP_RATE_PERCENT_PER_SEC, STEERING_RAMP_ACCEL_PERCENT_PER_SEC2);
+  }
+
+  return new PwmSpeedController(STEERING_SPEED_CONTROLLER_FRAME_RATE_HZ, STEERING_RAMP_RATE_PERCENT_PER_SEC, STEERING_RAMP_ACCEL_PERCENT_PER_SEC2);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Method: SetSteeringDirection
 ///
@@ -51,24 +85,20 @@ void SoapBoxDerbyCar::SetSteeringSpeedControllerValue(int value)
   // Just in case it wasn't called elsewhere
   ReadLimitSwitches();
     
-  // If the value is negative, steering is going
-  // left.  Make sure the limit switch isn't tripped.
-  if ((value < 0) && (m_LeftSteeringLimitSwitchValue == 1))
-  {
-    value = OFF;
-  }
-  // If the value is positive, steering is going
-  // right.  Make sure the limit switch isn't tripped.
-  else if ((value > 0) && (m_RightSteeringLimitSwitchValue == 1))
+  // Negative values steer left, positive right.  Make sure the limit switch
+  // that way isn't tripped (or just closed and not debounced yet).  If it
+  // is, stop without ramping down.
+  if (IsSteeringLimitReached(value))
   {
     value = OFF;
+    m_pSteeringSpeedController->Stop();
   }
   else
   {
+    m_pSteeringSpeedController->SetSpeed(value);
   }
 
-  // Update the speed controller and direction
-  m_pSteeringSpeedController->SetSpeed(value);
+  // Update the direction
   SetSteeringDirection(value);
   m_CurrentSteeringValue = value;
 }
@@ -82,7 +112,7 @@ void SoapBoxDerbyCar::SetSteeringSpeedControllerValue(int value)
 void SoapBoxDerbyCar::UpdateSpeedControllers()
 {
   // Make sure there's actually data to process
-  if (m_ControllerChannelInputs[YAW_INPUT_CHANNEL] == 0)
+  if (IsControllerChannelLost(YAW_INPUT_CHANNEL))
   {
     return;
   }
@@ -128,20 +158,17 @@ void SoapBoxDerbyCar::UpdateSpeedControllers()
     // Just in case it wasn't called elsewhere
     ReadLimitSwitches();
     
-    // Check the left limit switch
-    if ((steerOutputValue < 0) && (m_LeftSteeringLimitSwitchValue == 1))
+    // Check the limit switch in the direction of travel, and update talon
+    if (IsSteeringLimitReached(steerOutputValue))
     {
       steerOutputValue = OFF;
+      m_pSteeringSpeedController->Stop();
     }
-
-    // Check the right limit switch
-    if ((steerOutputValue > 0) && (m_RightSteeringLimitSwitchValue == 1))
+    else
     {
-      steerOutputValue = OFF;
+      m_pSteeringSpeedController->SetSpeed(steerOutputValue);
     }
     
-    // Update talon
-    m_pSteeringSpeedController->SetSpeed(steerOutputValue);
     SetSteeringDirection(steerOutputValue);
     m_CurrentSteeringValue = steerOutputValue;
   }
@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     SteeringControl.ino
+/// Author:   David Stalter
+///
+/// Details:  Contains the closed loop steering control used by autonomous.
+///           There are two cascaded loops.  The outer loop turns the pose
+///           estimate (heading and lateral offset) into a target front axle
+///           position, and the inner loop drives the
+///           steering speed controller to hold the axle at that position
+///           using the front axle potentiometer.
+///
+///           Everything is fixed point.  Gains are Q8 (value / 256) and
+///           positions are in pot clicks from the calibrated center, positive
+///           to the right to match the steering speed controller value.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+// INCLUDES
+#include "SoapBoxDerbyCar.hpp"        // for constants and function declarations
+
+// STATIC DATA
+// (none)
+
+// GLOBALS
+// (none)
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CalculateSteeringGainsChecksum
+///
+/// Details:  Computes the checksum over the gain values.
+////////////////////////////////////////////////////////////////////////////////
+uint16_t SoapBoxDerbyCar::CalculateSteeringGainsChecksum(const SteeringGains & rGains)
+{
+  return CalculateNonVolatileChecksum(&rGains, offsetof(SteeringGains, m_Checksum), STEERING_GAINS_CHECKSUM_SEED);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: LoadSteeringGains
+///
+/// Details:  Uses the steering gains stored in EEPROM if they are valid,
+///           otherwise falls back to the compiled in defaults.  Either way
+///           the RAM copy ends up with a valid checksum, so the next write
+///           of the non-volatile car data persists it.  The gains version
+///           is part of the checksum seed, so gains saved before a retune
+///           (tuned against the old defaults and ramp) are not valid and
+///           the new defaults are used instead.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::LoadSteeringGains(const NonVolatileCarData & rEepromCarData)
+{
+  SteeringGains & rGains = m_NonVolatileCarData.m_SteeringGains;
+
+  if ((memcmp(&rEepromCarData.m_Header, NON_VOLATILE_CAR_DATA_HEADER, sizeof(rEepromCarData.m_Header)) == 0) &&
+      (CalculateSteeringGainsChecksum(rEepromCarData.m_SteeringGains) == rEepromCarData.m_SteeringGains.m_Checksum))
+  {
+    rGains = rEepromCarData.m_SteeringGains;
+    Serial.println(F("Steering gains loaded from EEPROM."));
+  }
+  else
+  {
+    rGains.m_HeadingKp = DEFAULT_STEERING_HEADING_KP;
+    rGains.m_LateralKp = DEFAULT_STEERING_LATERAL_KP;
+    rGains.m_LateralKi = DEFAULT_STEERING_LATERAL_KI;
+    rGains.m_InnerKp = DEFAULT_STEERING_INNER_KP;
+    rGains.m_InnerKi = DEFAULT_STEERING_INNER_KI;
+    rGains.m_InnerKd = DEFAULT_STEERING_INNER_KD;
+    rGains.m_Checksum = CalculateSteeringGainsChecksum(rGains);
+    Serial.println(F("Steering gains set to defaults."));
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: DisplaySteeringGains
+///
+/// Details:  Prints the steering gains (raw Q8 values) to the console, each
+///           with the SteeringGainId that sets it.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::DisplaySteeringGains()
+{
+  const SteeringGains & rGains = m_NonVolatileCarData.m_SteeringGains;
+
+  Serial.println(F("Steering gains (Q8):"));
+  Serial.print(F("0 Heading Kp: "));
+  Serial.println(rGains.m_HeadingKp);
+  Serial.print(F("1 Lateral Kp: "));
+  Serial.println(rGains.m_LateralKp);
+  Serial.print(F("2 Lateral Ki: "));
+  Serial.println(rGains.m_LateralKi);
+  Serial.print(F("3 Inner Kp: "));
+  Serial.println(rGains.m_InnerKp);
+  Serial.print(F("4 Inner Ki: "));
+  Serial.println(rGains.m_InnerKi);
+  Serial.print(F("5 Inner Kd: "));
+  Serial.println(rGains.m_InnerKd);
+  Serial.println();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: SetSteeringGain
+///
+/// Details:  Changes one gain in the RAM copy of the steering gains and
+///           updates the checksum.  Returns false if the gain or value is out
+///           of range.  The next write of the non-volatile car data saves it.
+////////////////////////////////////////////////////////////////////////////////
+bool SoapBoxDerbyCar::SetSteeringGain(long gainId, long value)
+{
+  if ((gainId < 0L) || (gainId >= NUM_STEERING_GAINS) || (value < INT16_MIN) || (value > INT16_MAX))
+  {
+    return false;
+  }
+
+  SteeringGains & rGains = m_NonVolatileCarData.m_SteeringGains;
+  int16_t * const pGains[NUM_STEERING_GAINS] =
+  {
+    &rGains.m_HeadingKp, &rGains.m_LateralKp, &rGains.m_LateralKi,
+    &rGains.m_InnerKp, &rGains.m_InnerKi, &rGains.m_InnerKd
+  };
+
+  *pGains[gainId] = static_cast<int16_t>(value);
+  rGains.m_Checksum = CalculateSteeringGainsChecksum(rGains);
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: ResetSteeringController
+///
+/// Details:  Clears the controller state and the pose.  Called at the start
+///           of each autonomous run, after the Hall sensor counts are reset.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::ResetSteeringController()
+{
+  ResetPose();
+
+  m_SteeringLateralIntegral = 0;
+  m_SteeringInnerIntegral = 0;
+  m_SteeringTargetClicks = 0;
+  m_SteeringLastPositionClicks = m_FrontAxlePotCenterValue - m_FrontAxlePotentiometerValue;
+  m_SteeringOutput = OFF;
+  m_SteeringControlTick = GetSchedulerTick();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: UpdateSteeringController
+///
+/// Details:  Runs both steering loops at a fixed rate off the scheduler tick.
+///           It is safe to call as often as desired; it returns immediately
+///           if the next sample is not due yet.
+////////////////////////////////////////////////////////////////////////////////
+void SoapBoxDerbyCar::UpdateSteeringController()
+{
+  uint16_t currentTick = GetSchedulerTick();
+  if (static_cast<uint16_t>(currentTick - m_SteeringControlTick) < STEERING_CONTROL_TASK_PERIOD_MS)
+  {
+    return;
+  }
+  m_SteeringControlTick = currentTick;
+
+  const SteeringGains & rGains = m_NonVolatileCarData.m_SteeringGains;
+
+  // Keep the target away from the limit switches
+  int targetLimitClicks = ((m_FrontAxlePotMaxLeftValue - m_FrontAxlePotMaxRightValue) / 2) - STEERING_TARGET_MARGIN_CLICKS;
+  if (targetLimitClicks < 0)
+  {
+    targetLimitClicks = 0;
+  }
+  int32_t targetLimitQ16 = static_cast<int32_t>(targetLimitClicks) * POSE_Q16_ONE;
+
+  UpdatePose();
+
+  // Outer loop.  A heading or offset to the right needs a turn back to the
+  // left (a negative target).  Gains are Q8 and the pose is Q8, so the
+  // target is Q16 clicks.
+  m_SteeringLateralIntegral += static_cast<int32_t>(rGains.m_LateralKi) * m_Pose.m_YQ8;
+  m_SteeringLateralIntegral = constrain(m_SteeringLateralIntegral, -targetLimitQ16, targetLimitQ16);
+
+  int32_t targetQ16 = -(static_cast<int32_t>(rGains.m_HeadingKp) * m_Pose.m_HeadingQ8)
+                      - (static_cast<int32_t>(rGains.m_LateralKp) * m_Pose.m_YQ8)
+                      - m_SteeringLateralIntegral;
+  targetQ16 = constrain(targetQ16, -targetLimitQ16, targetLimitQ16);
+  m_SteeringTargetClicks = static_cast<int>(targetQ16 / POSE_Q16_ONE);
+
+  // Inner loop
+  SetSteeringSpeedControllerValue(CalculateSteeringOutput(m_SteeringTargetClicks));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Method: CalculateSteeringOutput
+///
+/// Details:  One sample of the front axle position PID.  The derivative is
+///           taken on the measurement so target steps do not kick the motor.
+///           The integrator only accumulates while the output is not
+///           saturated in the direction of the error (anti-windup).  Non-zero
+///           outputs are shifted past MIN_OUTPUT_PERCENTAGE, below which the
+///           motor does not move, and the change per sample is slew limited.
+////////////////////////////////////////////////////////////////////////////////
+int SoapBoxDerbyCar::CalculateSteeringOutput(int targetPositionClicks)
+{
+  const SteeringGains & rGains = m_NonVolatileCarData.m_SteeringGains;
+  const int32_t MAX_OUTPUT_Q8 = static_cast<int32_t>(ON) * STEERING_Q8_ONE;
+
+  int positionClicks = m_FrontAxlePotCenterValue - m_FrontAxlePotentiometerValue;
+  int error = targetPositionClicks - positionClicks;
+  int positionChange = positionClicks - m_SteeringLastPositionClicks;
+  m_SteeringLastPositionClicks = positionClicks;
+
+  int output = OFF;
+  if (abs(error) > STEERING_POSITION_TOLERANCE_CLICKS)
+  {
+    int32_t proportionalQ8 = static_cast<int32_t>(rGains.m_InnerKp) * error;
+    int32_t derivativeQ8 = -(static_cast<int32_t>(rGains.m_InnerKd) * positionChange);
+    int32_t outputQ8 = proportionalQ8 + m_SteeringInnerIntegral + derivativeQ8;
+
+    bool bSaturatedHigh = (outputQ8 >= MAX_OUTPUT_Q8) && (error > 0);
+    bool bSaturatedLow = (outputQ8 <= -MAX_OUTPUT_Q8) && (error < 0);
+    if (!bSaturatedHigh && !bSaturatedLow)
+    {
+      m_SteeringInnerIntegral += static_cast<int32_t>(rGains.m_InnerKi) * error;
+      m_SteeringInnerIntegral = constrain(m_SteeringInnerIntegral, -MAX_OUTPUT_Q8, MAX_OUTPUT_Q8);
+    }
+
+    outputQ8 = constrain(outputQ8, -MAX_OUTPUT_Q8, MAX_OUTPUT_Q8);
+    output = static_cast<int>(outputQ8 / STEERING_Q8_ONE);
+
+    // Deadband compensation: map (0, MAX] onto (MIN_OUTPUT_PERCENTAGE, MAX]
+    if (output != OFF)
+    {
+      int magnitude = MIN_OUTPUT_PERCENTAGE + ((abs(output) * (ON - MIN_OUTPUT_PERCENTAGE)) / ON);
+      output = (output > 0) ? magnitude : -magnitude;
+    }
+  }
+
+  // Slew limit the output
+  output = constrain(output, m_SteeringOutput - STEERING_MAX_OUTPUT_CHANGE_PERCENT, m_SteeringOutput + STEERING_MAX_OUTPUT_CHANGE_PERCENT);
+  m_SteeringOutput = output;
+
+  return output;
+}
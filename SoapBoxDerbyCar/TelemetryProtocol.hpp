@@ -0,0 +1,321 @@
+////////////////////////////////////////////////////////////////////////////////
+/// File:     TelemetryProtocol.hpp
+/// Author:   David Stalter
+///
+/// Details:  Binary frame format for the car's telemetry link (Serial3, to
+///           the Raspberry Pi) and its deferred debug log (on the console).
+///           Shared by the sketch (encoding) and the host tools (decoding),
+///           so it only depends on the standard integer types and the data
+///           log codec's helpers.
+///
+///           A frame is:
+///             SYNC_BYTE_1 SYNC_BYTE_2       start of frame
+///             length                        payload size in bytes
+///             type                          FrameType
+///             sequence                      increments on every frame
+///             payload                       the fields, as zig-zag varints
+///             crc (low byte first)          CRC-16 over length to payload
+///
+///           Every frame built gets the next sequence number, including ones
+///           the car drops because its transmit buffer is full, so gaps seen
+///           by the receiver count lost frames from either end.  The sync
+///           bytes can appear in the data; the receiver relies on the length
+///           and CRC to find real frames and resynchronizes after a bad one.
+///
+/// Copyright (c) 2019 David Stalter
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TELEMETRYPROTOCOL_HPP
+#define TELEMETRYPROTOCOL_HPP
+
+// INCLUDES
+#include <string.h>                   // for memcpy
+#include "DataLogCodec.hpp"           // for the CRC and varint helpers
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  TelemetryProtocol
+///
+/// Details:  Frame layout constants and the frame encoder.
+////////////////////////////////////////////////////////////////////////////////
+class TelemetryProtocol
+{
+public:
+  enum FrameType
+  {
+    CAR_STATE_FRAME     = 1,
+    DEBUG_LOG_FRAME     = 2,
+    MEMORY_USAGE_FRAME  = 3
+  };
+
+  // The fields of a CAR_STATE_FRAME, in payload order
+  enum CarStateField
+  {
+    TIME_STAMP_MS,
+    STATUS_FLAGS,
+    STEERING_VALUE,
+    LEFT_HALL_COUNT,
+    RIGHT_HALL_COUNT,
+    FRONT_AXLE_POTENTIOMETER,
+    POSE_X_Q8,
+    POSE_Y_Q8,
+    POSE_HEADING_Q8,
+    STEERING_TARGET_CLICKS,
+    WALL_DISTANCE_INCHES,
+    NUM_CAR_STATE_FIELDS
+  };
+
+  // The fields of a MEMORY_USAGE_FRAME (SRAM bytes), in payload order
+  enum MemoryUsageField
+  {
+    STATIC_DATA_BYTES,
+    HEAP_BYTES,
+    HEAP_HIGH_WATER_BYTES,
+    MAX_STACK_BYTES,
+    FREE_BYTES,
+    MIN_FREE_BYTES,
+    NUM_MEMORY_USAGE_FIELDS
+  };
+
+  // Bits of the STATUS_FLAGS field
+  enum StatusFlag
+  {
+    BRAKE_APPLIED_FLAG        = 0x01,
+    AUTONOMOUS_EXECUTING_FLAG = 0x02,
+    LEFT_LIMIT_SWITCH_FLAG    = 0x04,
+    RIGHT_LIMIT_SWITCH_FLAG   = 0x08,
+    WALL_DISTANCE_VALID_FLAG  = 0x10
+  };
+
+  static const uint8_t  SYNC_BYTE_1               = 0xA5;
+  static const uint8_t  SYNC_BYTE_2               = 0x5A;
+  static const uint8_t  HEADER_SIZE_BYTES         = 5;
+  static const uint8_t  CRC_SIZE_BYTES            = 2;
+  static const uint8_t  MAX_PAYLOAD_SIZE_BYTES    = NUM_CAR_STATE_FIELDS * DataLogCodec::MAX_VARINT_SIZE_BYTES;
+  static const uint8_t  MAX_FRAME_SIZE_BYTES      = HEADER_SIZE_BYTES + MAX_PAYLOAD_SIZE_BYTES + CRC_SIZE_BYTES;
+
+  static_assert((NUM_MEMORY_USAGE_FIELDS * DataLogCodec::MAX_VARINT_SIZE_BYTES) <= MAX_PAYLOAD_SIZE_BYTES, "Memory usage frame will not fit in a frame!");
+
+  // Builds a frame into pFrame (at least MAX_FRAME_SIZE_BYTES) and returns
+  // its size.  numFields must be at most NUM_CAR_STATE_FIELDS.
+  static uint8_t EncodeFrame(uint8_t type, uint8_t sequence, const int32_t * pFields, uint8_t numFields, uint8_t * pFrame)
+  {
+    return FinishFrame(type, sequence, EncodeFields(pFields, numFields, &pFrame[HEADER_SIZE_BYTES]), pFrame);
+  }
+
+  // Writes fields as a payload and returns its size
+  static uint8_t EncodeFields(const int32_t * pFields, uint8_t numFields, uint8_t * pPayload)
+  {
+    uint8_t * pNext = pPayload;
+    for (uint8_t i = 0U; i < numFields; i++)
+    {
+      pNext = DataLogCodec::WriteVarint(DataLogCodec::ZigZagEncode(pFields[i]), pNext);
+    }
+    return static_cast<uint8_t>(pNext - pPayload);
+  }
+
+  // Fills in the header and CRC around a payload already at
+  // &pFrame[HEADER_SIZE_BYTES] and returns the frame size
+  static uint8_t FinishFrame(uint8_t type, uint8_t sequence, uint8_t payloadSize, uint8_t * pFrame)
+  {
+    uint8_t * pNext = &pFrame[HEADER_SIZE_BYTES + payloadSize];
+
+    pFrame[0] = SYNC_BYTE_1;
+    pFrame[1] = SYNC_BYTE_2;
+    pFrame[2] = payloadSize;
+    pFrame[3] = type;
+    pFrame[4] = sequence;
+
+    uint16_t crc = DataLogCodec::CRC_SEED;
+    for (uint8_t * pData = &pFrame[2]; pData < pNext; pData++)
+    {
+      crc = DataLogCodec::UpdateCrc(crc, *pData);
+    }
+    *pNext++ = static_cast<uint8_t>(crc);
+    *pNext++ = static_cast<uint8_t>(crc >> 8);
+
+    return static_cast<uint8_t>(pNext - pFrame);
+  }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// Class:  TelemetryDecoder
+///
+/// Details:  Pulls frames out of a received byte stream, one byte at a time.
+///           Keeps counts of good frames, CRC failures, bytes skipped while
+///           looking for a frame and frames missing from the sequence.
+////////////////////////////////////////////////////////////////////////////////
+class TelemetryDecoder
+{
+public:
+  TelemetryDecoder() :
+    m_State(WAIT_SYNC_1),
+    m_Frame(),
+    m_FrameSize(0U),
+    m_bHaveSequence(false),
+    m_LastSequence(0U),
+    m_NumFrames(0UL),
+    m_NumCrcErrors(0UL),
+    m_NumSkippedBytes(0UL),
+    m_NumMissedFrames(0UL)
+  {
+  }
+
+  // Returns true when data completes a valid frame, which stays available
+  // until the next call.
+  bool ProcessByte(uint8_t data)
+  {
+    switch (m_State)
+    {
+      case WAIT_SYNC_1:
+      {
+        if (data == TelemetryProtocol::SYNC_BYTE_1)
+        {
+          m_State = WAIT_SYNC_2;
+        }
+        else
+        {
+          m_NumSkippedBytes++;
+        }
+        break;
+      }
+      case WAIT_SYNC_2:
+      {
+        if (data == TelemetryProtocol::SYNC_BYTE_2)
+        {
+          m_Frame[0] = TelemetryProtocol::SYNC_BYTE_1;
+          m_Frame[1] = TelemetryProtocol::SYNC_BYTE_2;
+          m_FrameSize = 2U;
+          m_State = READ_FRAME;
+        }
+        else
+        {
+          m_NumSkippedBytes++;
+          m_State = (data == TelemetryProtocol::SYNC_BYTE_1) ? WAIT_SYNC_2 : WAIT_SYNC_1;
+        }
+        break;
+      }
+      case READ_FRAME:
+      {
+        m_Frame[m_FrameSize++] = data;
+        if ((m_FrameSize == 3U) && (data > TelemetryProtocol::MAX_PAYLOAD_SIZE_BYTES))
+        {
+          Resynchronize();
+        }
+        else if ((m_FrameSize > 3U) && (m_FrameSize == GetFrameSize()))
+        {
+          m_State = WAIT_SYNC_1;
+          if (IsCrcValid())
+          {
+            CountFrame();
+            return true;
+          }
+          m_NumCrcErrors++;
+          Resynchronize();
+        }
+        break;
+      }
+      default:
+      {
+        break;
+      }
+    }
+
+    return false;
+  }
+
+  uint8_t GetType() const { return m_Frame[3]; }
+  uint8_t GetSequence() const { return m_Frame[4]; }
+
+  uint8_t GetFrameSize() const
+  {
+    return TelemetryProtocol::HEADER_SIZE_BYTES + m_Frame[2] + TelemetryProtocol::CRC_SIZE_BYTES;
+  }
+
+  // Decodes up to maxFields payload fields from the last frame.  Returns
+  // how many there were, or zero if the payload is malformed.
+  uint8_t GetFields(int32_t * pFields, uint8_t maxFields) const
+  {
+    const uint8_t * pPayload = &m_Frame[TelemetryProtocol::HEADER_SIZE_BYTES];
+    uint8_t payloadSize = m_Frame[2];
+    uint8_t offset = 0U;
+    uint8_t numFields = 0U;
+    while ((offset < payloadSize) && (numFields < maxFields))
+    {
+      uint32_t value = 0U;
+      uint8_t size = DataLogCodec::ReadVarint(&pPayload[offset], payloadSize - offset, value);
+      if (size == 0U)
+      {
+        return 0U;
+      }
+      pFields[numFields++] = DataLogCodec::ZigZagDecode(value);
+      offset += size;
+    }
+    return numFields;
+  }
+
+  unsigned long GetNumFrames() const { return m_NumFrames; }
+  unsigned long GetNumCrcErrors() const { return m_NumCrcErrors; }
+  unsigned long GetNumSkippedBytes() const { return m_NumSkippedBytes; }
+  unsigned long GetNumMissedFrames() const { return m_NumMissedFrames; }
+
+private:
+  enum DecoderState
+  {
+    WAIT_SYNC_1,
+    WAIT_SYNC_2,
+    READ_FRAME
+  };
+
+  bool IsCrcValid() const
+  {
+    uint8_t crcOffset = GetFrameSize() - TelemetryProtocol::CRC_SIZE_BYTES;
+    uint16_t crc = DataLogCodec::CRC_SEED;
+    for (uint8_t i = 2U; i < crcOffset; i++)
+    {
+      crc = DataLogCodec::UpdateCrc(crc, m_Frame[i]);
+    }
+    return (crc == static_cast<uint16_t>(m_Frame[crcOffset] | (m_Frame[crcOffset + 1U] << 8)));
+  }
+
+  void CountFrame()
+  {
+    if (m_bHaveSequence)
+    {
+      m_NumMissedFrames += static_cast<uint8_t>(GetSequence() - m_LastSequence - 1U);
+    }
+    m_LastSequence = GetSequence();
+    m_bHaveSequence = true;
+    m_NumFrames++;
+  }
+
+  // The bytes after a bad frame's sync word may hold the start of a real
+  // frame, so they are fed through again.  A whole frame found this way is
+  // counted but not returned.
+  void Resynchronize()
+  {
+    uint8_t replay[TelemetryProtocol::MAX_FRAME_SIZE_BYTES];
+    uint8_t numBytes = m_FrameSize - 1U;
+    memcpy(replay, &m_Frame[1], numBytes);
+
+    m_State = WAIT_SYNC_1;
+    m_NumSkippedBytes++;
+    for (uint8_t i = 0U; i < numBytes; i++)
+    {
+      (void)ProcessByte(replay[i]);
+    }
+  }
+
+  DecoderState m_State;
+  uint8_t m_Frame[TelemetryProtocol::MAX_FRAME_SIZE_BYTES];
+  uint8_t m_FrameSize;
+  bool m_bHaveSequence;
+  uint8_t m_LastSequence;
+  unsigned long m_NumFrames;
+  unsigned long m_NumCrcErrors;
+  unsigned long m_NumSkippedBytes;
+  unsigned long m_NumMissedFrames;
+};
+
+#endif // TELEMETRYPROTOCOL_HPP